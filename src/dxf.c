@@ -21,13 +21,44 @@ section ends with group code 0, ENDSEC
 #include <string.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include "dxf.h"
 #include "dxf_types.h"
+#include "dxf_trace.h"
+#include "dxf_validate.h"
+#include "dxf_model.h"
+#include "dxf_block.h"
+#include "dxf_batch.h"
+#include "dxf_query.h"
+#include "dxf_ocs.h"
+#include "dxf_topo.h"
+#include "dxf_text.h"
+#include "dxf_string.h"
+#include "dxf_xdata.h"
+#include "dxf_dict.h"
+#include "dxf_compact.h"
+#include "dxf_spill.h"
+#include "dxf_share.h"
+#include "dxf_group.h"
 #include "util.h"
 
 /* Max line length according to DXF manual, not including NL */
 #define DXF_MAX_LINE_LENGTH 2049
 
+/* Size of the read block; lines longer than this cannot be parsed */
+#define DXF_READ_BLOCK_SIZE 65536
+
+/* Size of the dxf_probe() buffer, enough for any pair of lines */
+#define DXF_PROBE_BUFFER_SIZE (2 * (DXF_MAX_LINE_LENGTH + 2))
+
+/* Parsed pages of a mapped file are released every this many bytes */
+#define DXF_MMAP_RELEASE_SIZE (64 << 20)
+
+/* Phase times are sampled on one record in (DXF_STATS_SAMPLE_MASK + 1) */
+#define DXF_STATS_SAMPLE_MASK 63
+
 /* Local prototypes */
 static dxf_error_t _dxf_load_fd(const dxf_handle_t dxf, int fd);
 
@@ -43,9 +74,33 @@ typedef struct _var_t {
     } value;
 } var_t;
 
+/*
+Lines of the file being loaded, through the group reader so that loading
+and reading back accept the same lines.  Either a block refilled with
+read(), or the whole file mapped at once.
+*/
+typedef struct _dxf_reader_t {
+    dxf_group_reader_t group; /* Lines of the block or the mapping */
+    int fd; /* File descriptor */
+    int mapped; /* Non-zero if group holds a mapping of the whole file */
+    size_t released; /* Mapped bytes before this were released */
+} dxf_reader_t;
+
+/* File offset of the next line */
+#define DXF_READER_OFFSET(rd) DXF_GROUP_OFFSET(&(rd)->group)
+
+/*
+Every record is exactly two lines, so line numbers are never counted while
+parsing; they follow from the number of records already parsed.
+*/
+#define DXF_RECORD_LINE(dxf, n) \
+    ((dxf_off_t)(2 * (dxf)->stats.record_cnt + (n)))
+
 typedef struct _section_t {
-    int start;
-    int end;
+    dxf_off_t start; /* Line of the section name */
+    dxf_off_t end; /* Line of ENDSEC */
+    dxf_off_t offset; /* File offset of the SECTION record */
+    dxf_off_t length; /* Bytes up to and including ENDSEC */
     char *name;
 } section_t;
 
@@ -56,34 +111,100 @@ typedef struct _section_t {
 */
 typedef struct _dxf_t {
     dxf_error_detail_t error; /**< Last error */
-    int line; /**< Current DXF line number being processed */
-    int column; /**< Current DXF column number being processed */
+    dxf_off_t line; /**< DXF line number of the last error */
+    int column; /**< DXF column number of the last error */
     char filename[FILENAME_MAX]; /**< Filename, if available */
     section_t *section; /**< Sections */
-    int section_cnt;
+    size_t section_cnt;
     var_t *variable;
-    int variable_cnt;
+    size_t variable_cnt;
+    dxf_load_options_t options; /**< Options the drawing was loaded with */
+    dxf_stats_t stats; /**< Load statistics */
+    int sample; /**< Non-zero if the current record is timed */
+    double mark; /**< Time of the last phase boundary of a timed record */
+    double sampled[dxfPhaseCnt]; /**< Sampled time per phase */
+    double section_time; /**< Time the current section started */
+    dxf_model_t model; /**< Records outside HEADER and the handle index */
+    dxf_query_index_t query_index; /**< Entity bitmaps */
 } dxf_t;
 
+static dxf_error_t _dxf_load_records(dxf_t *dxf, dxf_reader_t *rd);
+
+/* Reallocates, counting the request against the load statistics */
+static void *_dxf_realloc(dxf_t *dxf, void *ptr, size_t size) {
+    dxf->stats.bytes_allocated += size;
+    return realloc(ptr, size);
+}
+
+/* Duplicates a string, counting it against the load statistics */
+static char *_dxf_strdup(dxf_t *dxf, const char *s) {
+    dxf->stats.bytes_allocated += strlen(s) + 1;
+    return util_strdup(s);
+}
+
 static void _dxf_add_variable(dxf_t *dxf, const char *name, int type, 
     const char *value) {
     assert(dxf != NULL);
     assert((name != NULL) && (*name != '\0'));
     /*assert((value != NULL) && (*value != '\0'));*/
 
-    dxf->variable = (var_t*)realloc(dxf->variable, (sizeof(var_t) * 
+    dxf->variable = (var_t*)_dxf_realloc(dxf, dxf->variable, (sizeof(var_t) *
         (dxf->variable_cnt + 1)));
-    dxf->variable[dxf->variable_cnt].name = strdup(name);
+    dxf->variable[dxf->variable_cnt].name = _dxf_strdup(dxf, name);
     dxf->variable[dxf->variable_cnt].type = type;
     /* do the right thing based on type, this is char* example */
     if((value != NULL) && (*value != '\0')) {
-        dxf->variable[dxf->variable_cnt].value.c = strdup(value);
+        dxf->variable[dxf->variable_cnt].value.c = _dxf_strdup(dxf, value);
     } else {
-        dxf->variable[dxf->variable_cnt].value.c = strdup("NA");
+        dxf->variable[dxf->variable_cnt].value.c = _dxf_strdup(dxf, "NA");
     }
     dxf->variable_cnt++;
 }
 
+/* Closes the current phase of a timed record */
+static void _dxf_phase_mark(dxf_t *dxf, dxf_phase_t phase) {
+    if(dxf->sample != 0) {
+        double now = util_now();
+        dxf->sampled[phase] += now - dxf->mark;
+        dxf->mark = now;
+    }
+}
+
+/* Looks up (or adds) a named counter */
+static dxf_stats_named_t *_dxf_stats_named(dxf_stats_named_t *named,
+    int *cnt, int max, const char *name) {
+    int i;
+
+    for(i = 0; i < (*cnt); i++) {
+        if(strcmp(named[i].name, name) == 0) {
+            return &named[i];
+        }
+    }
+    if((*cnt) == max) {
+        return (dxf_stats_named_t*)NULL;
+    }
+    (void)snprintf(named[i].name, sizeof(named[i].name), "%s", name);
+    (*cnt)++;
+    return &named[i];
+}
+
+/* Spreads the non-I/O scan time over phases by their sampled share */
+static void _dxf_stats_finish(dxf_t *dxf, double scan_seconds) {
+    double sampled = dxf->sampled[dxfPhaseTokenize] +
+        dxf->sampled[dxfPhaseDecode];
+    int p;
+
+    scan_seconds -= dxf->stats.phase_seconds[dxfPhaseIO] +
+        dxf->stats.phase_seconds[dxfPhaseIndex];
+    if((sampled <= 0.0) || (scan_seconds <= 0.0)) {
+        return;
+    }
+    for(p = dxfPhaseTokenize; p <= dxfPhaseDecode; p++) {
+        dxf->stats.phase_seconds[p] = scan_seconds * dxf->sampled[p] /
+            sampled;
+    }
+}
+
 #define MAX_OPEN_DXF 1024
 
 /* This should be optimized */
@@ -91,20 +212,27 @@ static void _dxf_add_variable(dxf_t *dxf, const char *name, int type,
 */
 static dxf_t **g_handle_to_dxf = (dxf_t**)NULL; 
 static short g_init = 0;
+/* Guards g_handle_to_dxf, so drawings can be loaded from several threads */
+static pthread_mutex_t g_handle_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void _dxf_init() {
+    (void)pthread_mutex_lock(&g_handle_lock);
     if(g_init != 1) {
         g_handle_to_dxf = (dxf_t**)calloc(MAX_OPEN_DXF, sizeof(dxf_t*));
         assert(g_handle_to_dxf != NULL);
         g_init = 1;
     }
+    (void)pthread_mutex_unlock(&g_handle_lock);
+    dxf_trace_init();
 }
 
 static void _dxf_cleanup() {
+    (void)pthread_mutex_lock(&g_handle_lock);
     if(g_init == 1) {
         dxf_handle_t handle;
         for(handle = 0; handle < MAX_OPEN_DXF; handle++) {
             if(g_handle_to_dxf[handle] != NULL) {
+                (void)pthread_mutex_unlock(&g_handle_lock);
                 return;
             }
         }
@@ -112,13 +240,13 @@ static void _dxf_cleanup() {
         g_handle_to_dxf = (dxf_t**)NULL;
         g_init = 0;
     }
+    (void)pthread_mutex_unlock(&g_handle_lock);
 }
 
-extern int dxf_group_type_map[];
-
 static dxf_error_t dxf_get_registered(const dxf_handle_t handle,
     dxf_t **dxf) {
-    if(g_handle_to_dxf[handle] != NULL) {
+    if((g_handle_to_dxf != NULL) && (handle < MAX_OPEN_DXF) &&
+        (g_handle_to_dxf[handle] != NULL)) {
         *dxf = g_handle_to_dxf[handle];
         return dxfErrorOk;
     }
@@ -128,7 +256,7 @@ static dxf_error_t dxf_get_registered(const dxf_handle_t handle,
 static dxf_error_t dxf_unregister_handle(const dxf_handle_t handle) {
     dxf_error_t err;
     dxf_t *dxf;
-    int i;
+    size_t i;
 
     if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
         return err;
@@ -151,21 +279,34 @@ static dxf_error_t dxf_unregister_handle(const dxf_handle_t handle) {
         free(dxf->variable);
     }
 
+    dxf_query_index_free(&dxf->query_index);
+    dxf_model_free(&dxf->model);
     free(dxf);
+    (void)pthread_mutex_lock(&g_handle_lock);
     g_handle_to_dxf[handle] = (dxf_t*)NULL;
+    (void)pthread_mutex_unlock(&g_handle_lock);
     return dxfErrorOk;
 }
 
 static dxf_error_t dxf_register_handle(dxf_handle_t *handle, dxf_t **dxf) {
     assert(dxf != NULL);
+    (void)pthread_mutex_lock(&g_handle_lock);
+    /* Another thread may have unloaded the last drawing since _dxf_init() */
+    if(g_init != 1) {
+        g_handle_to_dxf = (dxf_t**)calloc(MAX_OPEN_DXF, sizeof(dxf_t*));
+        assert(g_handle_to_dxf != NULL);
+        g_init = 1;
+    }
     for((*handle) = 0; (*handle) < MAX_OPEN_DXF; ((*handle)++)) {
         if(g_handle_to_dxf[(*handle)] == NULL) {
             (*dxf) = (dxf_t*)calloc(1, sizeof(dxf_t));
             assert((*dxf) != NULL);
             g_handle_to_dxf[(*handle)] = (*dxf);
+            (void)pthread_mutex_unlock(&g_handle_lock);
             return dxfErrorOk;
         }
     }
+    (void)pthread_mutex_unlock(&g_handle_lock);
 
     return dxfErrorTooManyOpen;
 }
@@ -182,7 +323,7 @@ static char *DXF_ERROR_S[] = {
     "Bad file descriptor",
     "Invalid Format",
     "End of file",
-    "Read error (fgets)",
+    "Read error",
     "Line exceeds max length",
     "Non-ASCII character",
     "Digit expected",
@@ -191,7 +332,17 @@ static char *DXF_ERROR_S[] = {
     "Close failed",
     "Snprintf failed",
     "Too many open DXF files",
-    "Invalid DXF handle"
+    "Invalid DXF handle",
+    "Invalid variable",
+    "Invalid record",
+    "Not found",
+    "Out of memory",
+    "Invalid query",
+    "Write failed",
+    "Invalid catalog",
+    "Invalid precision",
+    "Invalid shared drawing",
+    "Over resident budget"
 };
 
 dxf_error_t dxf_print_error(const dxf_error_t code, FILE *fp) {
@@ -199,220 +350,133 @@ dxf_error_t dxf_print_error(const dxf_error_t code, FILE *fp) {
     return dxfErrorOk;
 }
 
-typedef struct _range_to_type_t {
-    int start;
-    int end;
-    char type_name[32];
-} range_to_type_t;
-
-/*
-If you modify this map, generate and use udpated source code by:
-    - calling dxf_print_type_map()
-    - paste output over value in dxf_types.c
-*/
-static range_to_type_t g_range_to_types [] = {
-    { 0, 9, "dxfString2049" },
-    { 10, 39, "dxfDouble" },
-    { 40, 59, "dxfDouble" },
-    { 60, 79, "dxfInt16" },
-    { 90, 99, "dxfInt32" },
-    { 100, 100, "dxfString255" },
-    { 102, 102, "dxfString255" },
-    { 105, 105, "dxfString255" },
-    { 110, 119, "dxfDouble" },
-    { 120, 129, "dxfDouble" },
-    { 130, 139, "dxfDouble" },
-    { 140, 149, "dxfDouble" },
-    { 160, 169, "dxfInt64" },
-    { 170, 179, "dxfInt16" },
-    { 210, 239, "dxfDouble" },
-    { 270, 279, "dxfInt16" },
-    { 280, 289, "dxfInt16" },
-    { 290, 299, "dxfBoolean" },
-    { 300, 309, "dxfString2049" },
-    { 310, 319, "dxfString2049" },
-    { 320, 329, "dxfString255" },
-    { 330, 369, "dxfString255" },
-    { 370, 379, "dxfInt16" },
-    { 380, 389, "dxfInt16" },
-    { 390, 399, "dxfString255" },
-    { 400, 409, "dxfInt16" },
-    { 410, 419, "dxfInt16" },
-    { 420, 429, "dxfInt32" },
-    { 430, 439, "dxfString2049" },
-    { 440, 449, "dxfInt32" },
-    { 450, 459, "dxfLong" },
-    { 460, 469, "dxfDouble" },
-    { 470, 479, "dxfString2049" },
-    { 480, 481, "dxfString255" },
-    { 999, 999, "dxfString2049" },
-    { 1000, 1009, "dxfString2049" },
-    { 1010, 1059, "dxfDouble" },
-    { 1060, 1070, "dxfInt16" },
-    { 1071, 1071, "dxfInt32" }
-};
+/**
+Reads the next line from a DXF stream, without copying it.
 
-const char *dxf_type_enum_to_name(const int type) {
-    if(type == 0) {
-        return "dxfString2049";
-    } else if(type == 1) {
-        return "dxfDouble";
-    } else if(type == 2) {
-        return "dxfInt16";
-    } else if(type == 3) {
-        return "dxfInt32";
-    } else if(type == 4) {
-        return "dxfString255";
-    } else if(type == 5) {
-        return "dxfInt64";
-    } else if(type == 6) {
-        return "dxfBoolean";
-    } else if(type == 7) {
-        return "dxfLong";
-    } else {
-        fprintf(stderr, "Invalid group type: %i\n", type);
-        exit(EXIT_FAILURE);
-    }
-}
+@param  dxf DXF state structure.
+@param  rd  Reader.
+@param  line    On success, points at the first byte of the line inside the
+    reader block.  Valid until the next call.
+@param  len On success, line length, not including the NL.
+@returns 1 on success, 0 on error.
+*/
+static int _dxf_read_line(dxf_t *dxf, dxf_reader_t *rd, const char **line,
+    size_t *len) {
+    dxf_group_reader_t *g = &rd->group; /* Lines */
+    const char *nl; /* End of line */
+    double io; /* Refill time before the line */
+    dxf_error_t err;
 
-static int dxf_type_name_to_enum(const char *name) {
-    /*dxfString2049, dxfDouble, dxfInt16, dxfInt32,
-        dxfString255, dxfInt64, dxfBoolean, dxfLong */
-    if(strcmp(name, "dxfString2049") == 0) {
-        return 0;
-    } else if(strcmp(name, "dxfDouble") == 0) {
-        return 1;
-    } else if(strcmp(name, "dxfInt16") == 0) {
-        return 2;
-    } else if(strcmp(name, "dxfInt32") == 0) {
-        return 3;
-    } else if(strcmp(name, "dxfString255") == 0) {
-        return 4;
-    } else if(strcmp(name, "dxfInt64") == 0) {
-        return 5;
-    } else if(strcmp(name, "dxfBoolean") == 0) {
-        return 6;
-    } else if(strcmp(name, "dxfLong") == 0) {
-        return 7;
+    /* Lines inside the block are cut here; dxf_group_line() refills it */
+    if((nl = (const char*)memchr(g->buf + g->pos, '\n', g->size - g->pos)) !=
+        NULL) {
+        *line = g->buf + g->pos;
+        *len = (size_t)(nl - *line);
+        g->pos += *len + 1;
     } else {
-        fprintf(stderr, "Invalid group type name: %s\n", name);
-        exit(EXIT_FAILURE);
-    }
-}
-
-void dxf_print_type_map() {
-    int cnt = (int)(sizeof(g_range_to_types)/sizeof(range_to_type_t));
-    int i;
-    int min = INT_MAX;
-    int max = INT_MIN;
-    int total = 0;
-    int *array;
-    int array_len;
-
-    /* get min/max array bounds */
-    for(i = 0; i < cnt; i++) {
-        range_to_type_t t = g_range_to_types[i];
-        if(t.start < min) {
-            min = t.start;
-        }
-        if(t.end > max) {
-            max = t.end;
+        io = g->io_seconds;
+        err = dxf_group_line(g, line, len);
+
+        /* I/O is timed exactly, keep it out of the sampled record phases */
+        if(g->io_seconds != io) {
+            io = g->io_seconds - io;
+            dxf->stats.phase_seconds[dxfPhaseIO] += io;
+            dxf->mark += io;
         }
-    }
-
-    /* Allocate array big enough for entire range of group codes  */
-    array_len = max + 1;
-    array = (int*)malloc(array_len * sizeof(int));
-    assert(array != NULL);
-    memset(array, -1, array_len * sizeof(int));
-
-    /* Populate the (sparse) array */
-    for(i = 0; i < cnt; i++) {
-        int j;
-        range_to_type_t t = g_range_to_types[i];
-        for(j = t.start; j <= t.end; j++) {
-            array[j] = dxf_type_name_to_enum(t.type_name);
+        if(err != dxfErrorOk) {
+            if(err == dxfErrorFgets) {
+                SET_ERRNO_ERROR(dxf, err);
+            } else {
+                SET_ERROR(dxf, err);
+            }
+            return 0;
         }
     }
 
-    /* Print the array initialization */
-    printf("/* Array of integers where index is group code\n");
-    printf("and value is enumeration indicating data type associated\n");
-    printf("with that group code. */\n");
-    printf("int dxf_group_type_map [] = {\n");
-    for(i = 0; i < array_len; i++) {
-        printf("    %i", array[i]);
-        if((total + 1) < (max + 1)) {
-            printf(",");
+    /* Drop parsed pages so resident memory does not grow with file size */
+    if(rd->mapped != 0) {
+        size_t start = (size_t)(*line - g->buf); /* Keep the current line */
+        if(start - rd->released >= DXF_MMAP_RELEASE_SIZE) {
+            start -= start % DXF_MMAP_RELEASE_SIZE;
+            (void)madvise((void*)(g->buf + rd->released),
+                start - rd->released, MADV_DONTNEED);
+            rd->released = start;
         }
-        printf("\n");
-        total++;
     }
-    printf("};\n");
-    free(array);
+    return 1;
 }
 
 /**
-Parses a single data item from a DXF stream.
+Parses a group code line, see dxf_group_code(), and classifies the code by
+value type.
 
 @param  dxf DXF state structure.
-@param  fp  Open stream.
-@param  value   Character buffer at least (DXF_MAX_LINE_LENGTH+1) bytes.
-    On success, contains the parsed value.
-@param  id  If 1, item expected to be an id, therefore all digits.
-    If 0, expected to be regular value, therefore any ASCII.
+@param  p   Line, as returned by _dxf_read_line().
+@param  len Line length.
+@param  group_code  On success, contains the group code.
+@param  type    On success, contains the dxf_type_t of the group code or
+    DXF_TYPE_NONE.
 @returns 1 on success, 0 on error.
 */
-static int dxf_parse_item(dxf_t *dxf, FILE *fp, char *value, int id) {
-    char line[DXF_MAX_LINE_LENGTH * 2]; /* Line read buffer */
-    int i; /* Iterator */
-    int len; /* Temp length */
-    int line_len = 0; /* Line length */
+static int _dxf_parse_group_code(dxf_t *dxf, const char *p, size_t len,
+    int *group_code, unsigned int *type) {
+    size_t column; /* Offending character */
+    dxf_error_t err;
 
-    /* Read a line from the stream */
-    if(fgets(line, (int)sizeof(line), fp) == NULL) {
-        /* Error */
-        if(feof(fp) != 0) {
-            SET_ERROR(dxf, dxfErrorEOF);
-        } else {
-            SET_ERRNO_ERROR(dxf, dxfErrorFgets);
-        }
+    if((err = dxf_group_code(p, len, group_code, &column)) != dxfErrorOk) {
+        dxf->column = (int)column;
+        SET_ERROR(dxf, err);
         return 0;
     }
+    *type = DXF_GROUP_TYPE(*group_code);
+    return 1;
+}
 
-    /* Keep track of current line number */
-    dxf->line++;
+/**
+Parses a value line.
+Leading and trailing whitespace is trimmed and every character checked.
+
+@param  dxf DXF state structure.
+@param  line    Line, as returned by _dxf_read_line().
+@param  len Line length.
+@param  value   Character buffer at least (DXF_MAX_LINE_LENGTH+1) bytes.
+    On success, contains the parsed value.
+@returns 1 on success, 0 on error.
+*/
+static int _dxf_parse_value(dxf_t *dxf, const char *line, size_t len,
+    char *value) {
+    int i = 0; /* Iterator */
 
     /* Trim leading/trailing whitespace */
-    util_trim(line);
+    dxf_group_trim(&line, &len);
 
-    /* Loop over each character */
-    len = (int)strlen(line);
-    for(i = 0; i < len; i++) {
-        /* Keep track of the current column */
-        dxf->column = i;
+    /* Fast loads only make sure the value fits */
+    if(dxf->options.validate != dxfValidateStrict) {
+        if(len > DXF_MAX_LINE_LENGTH) {
+            dxf->column = DXF_MAX_LINE_LENGTH;
+            SET_ERROR(dxf, dxfErrorLineTooLong);
+            return 0;
+        }
+        i = (int)len;
+    }
 
+    /* Loop over each character, the column is only needed on error */
+    for(; i < (int)len; i++) {
         /* No value length may exceed max and all chars must be ASCII */
         if(i == DXF_MAX_LINE_LENGTH) {
+            dxf->column = i;
             SET_ERROR(dxf, dxfErrorLineTooLong);
             return 0;
         } else if(isascii((int)line[i]) == 0) {
+            dxf->column = i;
             SET_ERROR(dxf, dxfErrorNonASCII);
             return 0;
         }
-
-        /* If id, must be all digits */
-        if((id == 1) && (isdigit(line[i]) == 0)) {
-            SET_ERROR(dxf, dxfErrorDigitExpected);
-            return 0;
-        } 
-
-        /* Save the character and continue */
-        value[line_len++] = line[i];
     }
 
-    /* Terminate the value */
-    value[line_len] = '\0';
+    /* Save and terminate the value */
+    memcpy(value, line, len);
+    value[len] = '\0';
     return 1;
 }
 
@@ -420,34 +484,55 @@ static int dxf_parse_item(dxf_t *dxf, FILE *fp, char *value, int id) {
 Parses a single record from a DXF stream.
 
 @param  dxf DXF state structure.
-@param  fp  Open stream.
+@param  rd  Reader.
 @param  group_code  On success, contains the parsed group_code.
 @param  value  On success, contains the parsed value.
 @returns 1 on success, 0 on error.
 */
-static int dxf_parse_record(dxf_t *dxf, FILE *fp, int *group_code,
+static int dxf_parse_record(dxf_t *dxf, dxf_reader_t *rd, int *group_code,
     char *value) {
-    char buf[DXF_MAX_LINE_LENGTH + 1]; /* Temp buffer */
+    const char *line; /* Current line */
+    size_t len; /* Current line length */
+    unsigned int type; /* Value type of group code */
 
     /* Parse the group_code */
-    buf[0] = '\0';
-    if(dxf_parse_item(dxf, fp, buf, 1) != 1) {
+    if(_dxf_read_line(dxf, rd, &line, &len) != 1) {
+        /* Error */
+        dxf->line = DXF_RECORD_LINE(dxf, 0);
+        return 0;
+    }
+    if(_dxf_parse_group_code(dxf, line, len, group_code, &type) != 1) {
         /* Error */
+        dxf->line = DXF_RECORD_LINE(dxf, 1);
         return 0;
     }
-    *group_code = atoi(buf);
+    _dxf_phase_mark(dxf, dxfPhaseTokenize);
+    if(type == DXF_TYPE_NONE) {
+        dxf->stats.unknown_type_cnt++;
+    } else {
+        dxf->stats.type_cnt[type]++;
+    }
+    _dxf_phase_mark(dxf, dxfPhaseDecode);
 
     /* Parse the value */
-    if(dxf_parse_item(dxf, fp, value, 0) != 1) {
+    if(_dxf_read_line(dxf, rd, &line, &len) != 1) {
+        /* Error, the group code line was read */
+        dxf->line = DXF_RECORD_LINE(dxf, 1);
+        return 0;
+    }
+    if(_dxf_parse_value(dxf, line, len, value) != 1) {
         /* Error */
+        dxf->line = DXF_RECORD_LINE(dxf, 2);
         return 0;
     }
+    _dxf_phase_mark(dxf, dxfPhaseTokenize);
 
     return 1;
 }
 
 /**
 Attempts to load a DXF file by filename.
+Equivalent to dxf_load_ex() with default options.
 
 @param  handle  DXF handle.
 @param  filename    Filename.
@@ -456,10 +541,88 @@ calls and dxfErrorOk is returned.  On failure, handle is undefined and a
 relevant error code is returned.
 */
 dxf_error_t dxf_load(dxf_handle_t *handle, const char *filename) {
+    dxf_load_options_t options; /* Default options */
+
+    dxf_load_options_init(&options);
+    return dxf_load_ex(handle, filename, &options);
+}
+
+/**
+Sets load options to their defaults: strict validation, one worker thread
+per online CPU, regular files mapped, the whole file read.
+
+@param  options Load options.
+*/
+void dxf_load_options_init(dxf_load_options_t *options) {
+    assert(options != NULL);
+    memset(options, 0, sizeof(*options));
+    options->validate = dxfValidateStrict;
+    options->threads = 0;
+    options->io = dxfIoAuto;
+    options->last_section = (const char*)NULL;
+    options->compact_step = 0.0;
+    options->max_resident_bytes = 0;
+}
+
+/**
+Finds the value of a HEADER variable.
+
+@param  dxf DXF state structure.
+@param  name    Variable name, e.g. "$ACADVER".
+@returns The value, NULL if the variable was not read.
+*/
+static const char *_dxf_var_value(const dxf_t *dxf, const char *name) {
+    size_t i;
+
+    for(i = 0; i < dxf->variable_cnt; i++) {
+        if(strcmp(dxf->variable[i].name, name) == 0) {
+            return dxf->variable[i].value.c;
+        }
+    }
+    return (const char*)NULL;
+}
+
+/**
+Brings the vertex buffer and its world coordinates back into memory for
+good, for calls that return them in place: decodes a compact drawing,
+reads back every block of a spilled one if both buffers fit its budget.
+
+@param  dxf DXF state structure.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+static dxf_error_t _dxf_vertices_resident(dxf_t *dxf) {
+    dxf_error_t err;
+
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    if(dxf_compact_expand(&dxf->model) == 0) {
+        return dxfErrorNoMemory;
+    }
+    return dxf_spill_expand(&dxf->model);
+}
+
+/**
+Attempts to load a DXF file by filename, with options.
+Unless compact_step or max_resident_bytes is set, the geometry of entities
+is left in the file and read back the first time a call needs it, so the
+file must not change while the drawing is loaded.
+
+@param  handle  DXF handle.
+@param  filename    Filename.
+@param  options Load options, see dxf_load_options_init().
+@returns On success, handle will contain a valid handle for use in future API
+calls and dxfErrorOk is returned.  On failure, handle is undefined and a
+relevant error code is returned.
+*/
+dxf_error_t dxf_load_ex(dxf_handle_t *handle, const char *filename,
+    const dxf_load_options_t *options) {
     struct stat statbuf; /* Struct for stat() call */
     int fd; /* File descriptor */
     dxf_t *dxf;
     dxf_error_t err;
+    double start; /* Load start time */
 
     _dxf_init();
 
@@ -468,6 +631,7 @@ dxf_error_t dxf_load(dxf_handle_t *handle, const char *filename) {
 
     /* Is filename non-NULL? */
     assert(filename != NULL);
+    assert(options != NULL);
 
     /* Does file exist? */
     if(stat(filename, &statbuf) == -1) {
@@ -485,205 +649,1659 @@ dxf_error_t dxf_load(dxf_handle_t *handle, const char *filename) {
         return err;
     }
 
-    /* Save filename */
+    /* Save filename and options */
     snprintf(dxf->filename, sizeof(dxf->filename), "%s", filename);
+    memcpy(&dxf->options, options, sizeof(dxf->options));
+    dxf->stats.bytes_allocated += sizeof(dxf_t);
+    dxf_model_init(&dxf->model, &dxf->stats.bytes_allocated);
+
+    /* Geometry is read back on first use, from a file that can be */
+    dxf->model.defer_geometry = (options->compact_step <= 0.0) &&
+        (options->max_resident_bytes == 0) && S_ISREG(statbuf.st_mode);
 
     /* Load the DXF file */
+    start = util_now();
+    dxf_trace_begin("load", "load", filename);
     if((err = _dxf_load_fd((*handle), fd)) != dxfErrorOk) {
+        dxf_trace_end("load", "load");
+        dxf_trace_flush();
         (void)close(fd);
         dxf_unload((*handle));
         return err;
     }
+    dxf_trace_end("load", "load");
+    dxf_trace_flush();
+    dxf->model.codepage = dxf_string_codepage(_dxf_var_value(dxf, "$ACADVER"),
+        _dxf_var_value(dxf, "$DWGCODEPAGE"));
+    dxf->stats.total_seconds = util_now() - start;
+    _dxf_stats_finish(dxf, dxf->stats.total_seconds);
+    /* A group code line may have been read before end of file */
+    dxf->stats.line_cnt = 2 * dxf->stats.record_cnt;
+    if(dxf->line > (dxf_off_t)dxf->stats.line_cnt) {
+        dxf->stats.line_cnt = (unsigned long long)dxf->line;
+    }
 
     /* Close the file */
     (void)close(fd);
     return dxfErrorOk;
 }
 
+/* Appends bytes to the state dxf_share() keeps beside the store */
+static void _dxf_extra_put(char *extra, size_t *len, const void *p,
+    size_t size) {
+    if(extra != NULL) {
+        memcpy(extra + *len, p, size);
+    }
+    *len += size;
+}
+
 /**
-Attempts to load a DXF from an open file descriptor.
+Lays out the state of a drawing kept outside its store: statistics,
+filename, sections and HEADER variables.
 
 @param  dxf DXF state structure.
-@param  fd  File descriptor open and set to beginning of DXF stream.
-@returns dxfErrorOk on success, 0 on error.
+@param  extra   Receives the state, NULL to measure it only.
+@returns Bytes of the state.
 */
-static dxf_error_t _dxf_load_fd(const dxf_handle_t handle, int fd) {
-    FILE *fp;   /* file pointer for stream functions */
-    char cur_section[DXF_MAX_LINE_LENGTH + 1];
-    dxf_t *dxf;
-    dxf_error_t err;
-    enum { S_PRE_SECTION, S_START_SECTION, S_SECTION, S_HEADER_VALUE }
-        state = S_PRE_SECTION;
-    int section_start, section_end;
-    char buf0[DXF_MAX_LINE_LENGTH + 1];
-
-    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
-        return err;
+static size_t _dxf_extra_write(const dxf_t *dxf, char *extra) {
+    uint64_t cnt;
+    size_t len = 0, i;
+
+    _dxf_extra_put(extra, &len, &dxf->stats, sizeof(dxf->stats));
+    _dxf_extra_put(extra, &len, dxf->filename, strlen(dxf->filename) + 1);
+    cnt = dxf->section_cnt;
+    _dxf_extra_put(extra, &len, &cnt, sizeof(cnt));
+    for(i = 0; i < dxf->section_cnt; i++) {
+        const section_t *sec = &dxf->section[i];
+        _dxf_extra_put(extra, &len, &sec->start, sizeof(sec->start));
+        _dxf_extra_put(extra, &len, &sec->end, sizeof(sec->end));
+        _dxf_extra_put(extra, &len, &sec->offset, sizeof(sec->offset));
+        _dxf_extra_put(extra, &len, &sec->length, sizeof(sec->length));
+        _dxf_extra_put(extra, &len, sec->name, strlen(sec->name) + 1);
+    }
+    cnt = dxf->variable_cnt;
+    _dxf_extra_put(extra, &len, &cnt, sizeof(cnt));
+    for(i = 0; i < dxf->variable_cnt; i++) {
+        const var_t *var = &dxf->variable[i];
+        const char *value = (var->value.c != NULL) ? var->value.c : "";
+        _dxf_extra_put(extra, &len, &var->type, sizeof(var->type));
+        _dxf_extra_put(extra, &len, var->name, strlen(var->name) + 1);
+        _dxf_extra_put(extra, &len, value, strlen(value) + 1);
     }
+    return len;
+}
 
-    /* valid file descriptor? */
-    if(fcntl(fd, F_GETFL) == -1) {
-        SET_ERRNO_ERROR(dxf, dxfErrorBadFd);
-        return dxf->error.code;
+/* Reads bytes of the state back; 0 past its end */
+static int _dxf_extra_get(const char **p, const char *end, void *out,
+    size_t size) {
+    if((size_t)(end - *p) < size) {
+        return 0;
     }
+    memcpy(out, *p, size);
+    *p += size;
+    return 1;
+}
 
-    /* Get a stream pointer from fd */
-    if((fp = fdopen(fd, "r")) == NULL) {
-        SET_ERRNO_ERROR(dxf, dxfErrorBadFd);
-        return dxf->error.code;
+/* Reads a string of the state back; NULL past its end */
+static const char *_dxf_extra_string(const char **p, const char *end) {
+    const char *s = *p, *nul;
+
+    if((nul = (const char*)memchr(s, '\0', (size_t)(end - s))) == NULL) {
+        return (const char*)NULL;
     }
+    *p = nul + 1;
+    return s;
+}
 
-    /* Loop through and parse every DXF record */
-    while(feof(fp) != 1) {
-        int group_code = -1; /* Group code */
-        char value[DXF_MAX_LINE_LENGTH + 1]; /* Value */
+/**
+Restores the state laid out by _dxf_extra_write().
 
-        /* Parse a record */
-        value[0] = '\0';
-        if(dxf_parse_record(dxf, fp, &group_code, value) == 0) {
-            if(dxf->error.code == dxfErrorEOF) {
-                return dxfErrorOk;
-            }
-            /* Error */
-            return dxf->error.code;
-        }
-        /*
-        printf("cur_section=%s\n", cur_section);
-        if(group_code == 9) {
-            printf("%s\n", cur_section);
-        }
-        printf("%i: type=%i\n", group_code, dxf_group_type_map[group_code]);
-        if(group_code == 0) {
-            printf("%i: %s\n", group_code, value);
+@param  dxf DXF state structure, with no sections or variables.
+@param  p   State.
+@param  size    Bytes of the state.
+@returns dxfErrorOk on success, dxfErrorInvalidShare if the state is cut
+short.
+*/
+static dxf_error_t _dxf_extra_read(dxf_t *dxf, const char *p, size_t size) {
+    const char *end = p + size, *name, *value;
+    unsigned long long allocated = dxf->stats.bytes_allocated;
+    uint64_t cnt, i;
+    int type;
+
+    /* Statistics are the loading process's, except for this heap */
+    if(!_dxf_extra_get(&p, end, &dxf->stats, sizeof(dxf->stats)) ||
+        ((name = _dxf_extra_string(&p, end)) == NULL) ||
+        !_dxf_extra_get(&p, end, &cnt, sizeof(cnt))) {
+        return dxfErrorInvalidShare;
+    }
+    dxf->stats.bytes_allocated = allocated;
+    (void)snprintf(dxf->filename, sizeof(dxf->filename), "%s", name);
+    for(i = 0; i < cnt; i++) {
+        section_t sec;
+        if(!_dxf_extra_get(&p, end, &sec.start, sizeof(sec.start)) ||
+            !_dxf_extra_get(&p, end, &sec.end, sizeof(sec.end)) ||
+            !_dxf_extra_get(&p, end, &sec.offset, sizeof(sec.offset)) ||
+            !_dxf_extra_get(&p, end, &sec.length, sizeof(sec.length)) ||
+            ((name = _dxf_extra_string(&p, end)) == NULL)) {
+            return dxfErrorInvalidShare;
         }
-        */
-        switch(state) {
-            case S_PRE_SECTION:
-                if(group_code != 0) {
-                    fprintf(stderr, "KAG: Expected group code 0 at %i\n",
-                        dxf->line);
-                    return dxfErrorInvalidFormat;
-                }
-                if(strcmp(value, "SECTION") == 0) {
-                    state = S_START_SECTION;
-                } else if(strcmp(value, "EOF") == 0) {
-                    return dxfErrorOk;
-                } else {
-                    fprintf(stderr, "KAG: Expected SECTION or EOF at %i\n",
-                        dxf->line);
-                    return dxfErrorInvalidFormat;
-                }
-                break;
-            case S_START_SECTION:
-                if(group_code != 2) {
-                    fprintf(stderr, "KAG: Expected group code 2 at %i\n",
-                        dxf->line);
-                    return dxfErrorInvalidFormat;
-                }
-                if(snprintf(cur_section, sizeof(cur_section), "%s", value) !=
-                    (int)strlen(value)) {
-                    SET_ERROR(dxf, dxfErrorSnprintfFailed);
-                    return dxf->error.code;
-                }
-                section_start = dxf->line;
-                state = S_SECTION;
-                break;
-            case S_SECTION:
-                if((group_code == 0) && (strcmp(value, "ENDSEC") == 0)) {
-                    state = S_PRE_SECTION;
-                    section_end = dxf->line;
-                    dxf->section = (section_t*)realloc(dxf->section,
-                        (sizeof(section_t) * (dxf->section_cnt + 1)));
-                    dxf->section[dxf->section_cnt].start = section_start;
-                    dxf->section[dxf->section_cnt].end = section_end;
-                    dxf->section[dxf->section_cnt].name = strdup(cur_section);
-                    dxf->section_cnt++;
-                    break;
-                }
-                /* Mid-section */
-                if(strcmp(cur_section, "HEADER") == 0) {
-                    if(group_code == 9) {
-                        /* create a data element to add */
-                        /* value contains a header variable */
-                        /*printf("HEADER VAR = %s\n", value);*/
-                        strcpy(buf0, value);
-                        state = S_HEADER_VALUE;
-                    }
-                }
-                break;
-            case S_HEADER_VALUE:
-                _dxf_add_variable(dxf,  buf0, group_code, value);
-                state = S_SECTION;
-                break;
+        dxf->section = (section_t*)_dxf_realloc(dxf, dxf->section,
+            (sizeof(section_t) * (dxf->section_cnt + 1)));
+        sec.name = _dxf_strdup(dxf, name);
+        dxf->section[dxf->section_cnt++] = sec;
+    }
+    if(!_dxf_extra_get(&p, end, &cnt, sizeof(cnt))) {
+        return dxfErrorInvalidShare;
+    }
+    for(i = 0; i < cnt; i++) {
+        if(!_dxf_extra_get(&p, end, &type, sizeof(type)) ||
+            ((name = _dxf_extra_string(&p, end)) == NULL) ||
+            ((value = _dxf_extra_string(&p, end)) == NULL) ||
+            (*name == '\0')) {
+            return dxfErrorInvalidShare;
         }
+        _dxf_add_variable(dxf, name, type, value);
     }
     return dxfErrorOk;
 }
 
 /**
-Get the last error.
-Copies last error detail into provided structure.
+Copies a loaded drawing into a shared memory segment for dxf_attach(),
+typically called once before forking workers, which inherit the
+descriptor, or before passing it over a UNIX socket.  The segment holds
+the parsed drawing laid out for use in place, so attaching neither parses
+nor copies it, and is sealed once written where the system allows.  A
+compact drawing is decoded into the segment and stays compact, a spilled
+one is read back into it block by block and stays within its budget.
 
-@param  dxf DXF state structure.
-@param  error DXF error structure.
-@returns 1 on success, 0 on error.
+@param  handle  DXF handle.
+@param  fd  On success, contains the segment's file descriptor; close it
+    once every process that needs it has attached.
+@returns dxfErrorOk on success, error code otherwise.
 */
-dxf_error_t dxf_get_last_error(const dxf_handle_t handle, dxf_error_detail_t
-    *error) {
+dxf_error_t dxf_share(const dxf_handle_t handle, int *fd) {
     dxf_t *dxf;
     dxf_error_t err;
+    char *extra;
+    size_t size;
 
     if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
         return err;
     }
-
-    /* Is the error structure valid? */
-    assert(error != NULL);
-
-    /* Copy the current error into target structure */
-    error->code = dxf->error.code;
-    memcpy(error->msg, dxf->error.msg, sizeof(error->msg));
-
-    return dxfErrorOk;
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert(fd != NULL);
+    size = _dxf_extra_write(dxf, (char*)NULL);
+    if((extra = (char*)malloc(size)) == NULL) {
+        return dxfErrorNoMemory;
+    }
+    (void)_dxf_extra_write(dxf, extra);
+    err = dxf_share_create(&dxf->model, extra, size, fd);
+    free(extra);
+    return err;
 }
 
 /**
-Print last error details to stderr.
-Convenience function that prints details of the last error to stderr.
+Attaches a drawing shared by dxf_share(), usually from another process.
+The segment is mapped read-only and used in place by every process
+attached to it; only the name tables, block definitions and query index
+are built per process, as is anything built on first use (flattened
+geometry, the text and dictionary indexes).  Extended data and
+dictionaries are still read from the drawing's file, under the name it
+was loaded with.
+
+@param  handle  On success, contains a handle for use like any other;
+    dxf_unload() detaches.
+@param  fd  Segment file descriptor; may be closed once attached.
+@returns dxfErrorOk on success, dxfErrorInvalidShare if fd is not a
+segment written by this build, error code otherwise.
+*/
+dxf_error_t dxf_attach(dxf_handle_t *handle, int fd) {
+    const void *extra;
+    size_t size;
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    _dxf_init();
+    assert(handle != NULL);
+    if((err = dxf_register_handle(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    dxf_load_options_init(&dxf->options);
+    dxf_model_init(&dxf->model, &dxf->stats.bytes_allocated);
+    if(((err = dxf_share_attach(&dxf->model, fd, &extra, &size)) ==
+        dxfErrorOk) && ((err = _dxf_extra_read(dxf, (const char*)extra,
+        size)) == dxfErrorOk) && (dxf_query_index_build(&dxf->query_index,
+        &dxf->model) == 0)) {
+        err = dxfErrorNoMemory;
+    }
+    if(err != dxfErrorOk) {
+        (void)dxf_unload((*handle));
+        return err;
+    }
+    dxf->model.codepage = dxf_string_codepage(_dxf_var_value(dxf, "$ACADVER"),
+        _dxf_var_value(dxf, "$DWGCODEPAGE"));
+    return dxfErrorOk;
+}
+
+/* Copies a value into a fixed dxf_info_t string, truncating it */
+static void _dxf_probe_copy(char *dst, const char *value, size_t len) {
+    if(len >= DXF_INFO_VALUE_MAX) {
+        len = DXF_INFO_VALUE_MAX - 1;
+    }
+    memcpy(dst, value, len);
+    dst[len] = '\0';
+}
+
+/* HEADER variables dxf_probe() keeps */
+typedef enum {
+    dxfProbeNone,
+    dxfProbeVersion,
+    dxfProbeCodepage,
+    dxfProbeUnits,
+    dxfProbeExtmin,
+    dxfProbeExtmax
+} dxf_probe_var_t;
+
+/* Every dxf_probe_var_t bit but dxfProbeNone */
+#define DXF_PROBE_ALL (((1u << (dxfProbeExtmax + 1)) - 1) & ~1u)
+
+/**
+Reads the metadata of a drawing without loading it.  Only the HEADER
+section is read, through a small fixed buffer, and reading stops at its
+ENDSEC, or as soon as every variable of dxf_info_t was read; nothing is
+allocated, so the cost does not depend on the size of the file.
+
+@param  filename    Filename.
+@param  info    On success, contains the metadata.  Variables the HEADER
+    does not set keep their defaults, see dxf_info_t.
+@returns dxfErrorOk on success, error code otherwise; dxfErrorEOF if the
+file ends before the first ENDSEC.
+*/
+dxf_error_t dxf_probe(const char *filename, dxf_info_t *info) {
+    char buf[DXF_PROBE_BUFFER_SIZE]; /* Block */
+    dxf_group_reader_t rd; /* Reader */
+    dxf_probe_var_t var = dxfProbeNone; /* Variable being read */
+    unsigned int seen = 0; /* Bit (1 << var) set once var was read */
+    const char *line;
+    size_t len;
+    int group_code, fd;
+    dxf_error_t err;
+
+    assert(filename != NULL);
+    assert(info != NULL);
+
+    memset(info, 0, sizeof(*info));
+    info->units = -1;
+    if((fd = open(filename, O_RDONLY)) == -1) {
+        return (errno == ENOENT) ? dxfErrorInvalidFile : dxfErrorOpenFailed;
+    }
+    dxf_group_reader_open(&rd, fd, buf, sizeof(buf));
+
+    for(;;) {
+        if((err = dxf_group_read(&rd, &group_code, &line, &len)) !=
+            dxfErrorOk) {
+            break;
+        }
+        if(group_code == 0) {
+            if(((len == 6) && (memcmp(line, "ENDSEC", 6) == 0)) ||
+                ((len == 3) && (memcmp(line, "EOF", 3) == 0))) {
+                break;
+            }
+            var = dxfProbeNone;
+        } else if(group_code == 9) {
+            /* Every variable kept was read, the rest of HEADER is not
+               needed */
+            if(seen == DXF_PROBE_ALL) {
+                break;
+            }
+            var = dxfProbeNone;
+            if((len == 8) && (memcmp(line, "$ACADVER", 8) == 0)) {
+                var = dxfProbeVersion;
+            } else if((len == 12) && (memcmp(line, "$DWGCODEPAGE", 12) == 0)) {
+                var = dxfProbeCodepage;
+            } else if((len == 9) && (memcmp(line, "$INSUNITS", 9) == 0)) {
+                var = dxfProbeUnits;
+            } else if((len == 7) && (memcmp(line, "$EXTMIN", 7) == 0)) {
+                var = dxfProbeExtmin;
+            } else if((len == 7) && (memcmp(line, "$EXTMAX", 7) == 0)) {
+                var = dxfProbeExtmax;
+            }
+            if(var != dxfProbeNone) {
+                seen |= 1u << var;
+            }
+        } else if(var != dxfProbeNone) {
+            char value[DXF_INFO_VALUE_MAX]; /* Numeric value */
+            _dxf_probe_copy(value, line, len);
+            switch(var) {
+                case dxfProbeVersion:
+                    _dxf_probe_copy(info->version, line, len);
+                    break;
+                case dxfProbeCodepage:
+                    _dxf_probe_copy(info->codepage, line, len);
+                    break;
+                case dxfProbeUnits:
+                    info->units = (int)strtol(value, (char**)NULL, 10);
+                    break;
+                case dxfProbeExtmin:
+                case dxfProbeExtmax:
+                    /* Group codes 10, 20 and 30 */
+                    if((group_code % 10 == 0) && (group_code >= 10) &&
+                        (group_code <= 30)) {
+                        double *p = (var == dxfProbeExtmin) ? info->extmin :
+                            info->extmax;
+                        p[group_code / 10 - 1] = strtod(value, (char**)NULL);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    info->has_extents = ((seen & (1u << dxfProbeExtmin)) != 0) &&
+        ((seen & (1u << dxfProbeExtmax)) != 0);
+    info->bytes_read = rd.base + (dxf_off_t)rd.size;
+    (void)close(fd);
+    return err;
+}
+
+/**
+Maps the whole file for the reader, as the load options allow.
+Memory stays file-backed and is only touched once, sequentially, so resident
+memory does not grow with file size.
+
+@param  dxf DXF state structure.
+@param  rd  Reader, buf is set to the mapping on success.
+@returns dxfErrorOk if mapped or left for read(), error code otherwise.
+*/
+static dxf_error_t _dxf_reader_map(dxf_t *dxf, dxf_reader_t *rd) {
+    struct stat st; /* File size and type */
+    void *map; /* Mapping */
+    double t0 = util_now(); /* I/O start */
+
+    if(dxf->options.io == dxfIoRead) {
+        return dxfErrorOk;
+    }
+    if((fstat(rd->fd, &st) == -1) || (S_ISREG(st.st_mode) == 0) ||
+        (st.st_size <= 0) || ((uint64_t)st.st_size > (uint64_t)SIZE_MAX)) {
+        if(dxf->options.io == dxfIoMmap) {
+            SET_ERROR(dxf, dxfErrorBadFd);
+            return dxf->error.code;
+        }
+        return dxfErrorOk;
+    }
+    if((map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, rd->fd,
+        0)) == MAP_FAILED) {
+        if(dxf->options.io == dxfIoMmap) {
+            SET_ERRNO_ERROR(dxf, dxfErrorBadFd);
+            return dxf->error.code;
+        }
+        return dxfErrorOk;
+    }
+    (void)madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    dxf_group_reader_init(&rd->group, (const char*)map, (size_t)st.st_size);
+    rd->mapped = 1;
+    dxf->stats.bytes_read = (unsigned long long)st.st_size;
+    dxf->stats.phase_seconds[dxfPhaseIO] += util_now() - t0;
+    return dxfErrorOk;
+}
+
+/**
+Attempts to load a DXF from an open file descriptor.
+
+@param  dxf DXF state structure.
+@param  fd  File descriptor open and set to beginning of DXF stream.
+@returns dxfErrorOk on success, 0 on error.
+*/
+static dxf_error_t _dxf_load_fd(const dxf_handle_t handle, int fd) {
+    dxf_reader_t rd; /* Block reader */
+    char *block = (char*)NULL; /* Read block, unless mapped */
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+
+    /* valid file descriptor? */
+    if(fcntl(fd, F_GETFL) == -1) {
+        SET_ERRNO_ERROR(dxf, dxfErrorBadFd);
+        return dxf->error.code;
+    }
+
+    /* Set up the reader, mapping the file if possible */
+    memset(&rd, 0, sizeof(rd));
+    rd.fd = fd;
+    if((err = _dxf_reader_map(dxf, &rd)) != dxfErrorOk) {
+        return err;
+    }
+    if(rd.mapped == 0) {
+        block = (char*)_dxf_realloc(dxf, NULL, DXF_READ_BLOCK_SIZE);
+        assert(block != NULL);
+        dxf_group_reader_stream(&rd.group, fd, block, DXF_READ_BLOCK_SIZE);
+    }
+
+    /* With a budget, vertices are read back later; keep one entity's */
+    dxf->model.vertex_window = (dxf->options.max_resident_bytes > 0);
+    err = _dxf_load_records(dxf, &rd);
+    if(err == dxfErrorOk) {
+        double t0 = util_now(); /* Index start */
+
+        /* Handle to record index, and every pointer resolved through it */
+        dxf_trace_begin("load", "index", (const char*)NULL);
+        if((dxf_model_build_index(&dxf->model) == 0) ||
+            (dxf_query_index_build(&dxf->query_index, &dxf->model) == 0) ||
+            ((dxf->model.vertex_window != 0) &&
+            (dxf_spill_init(&dxf->model, dxf->filename,
+            dxf->options.max_resident_bytes) == 0)) ||
+            ((dxf->model.defer_geometry == 0) &&
+            (dxf_ocs_to_wcs(&dxf->model) == 0))) {
+            SET_ERROR(dxf, dxfErrorNoMemory);
+            err = dxf->error.code;
+        } else if((dxf->options.compact_step > 0.0) &&
+            (dxf->model.spill == NULL) &&
+            ((err = dxf_compact_encode(&dxf->model,
+            dxf->options.compact_step)) != dxfErrorOk)) {
+            SET_ERROR(dxf, err);
+        }
+        dxf_trace_end("load", "index");
+        dxf->stats.phase_seconds[dxfPhaseIndex] += util_now() - t0;
+    }
+    if(rd.mapped != 0) {
+        (void)munmap((void*)rd.group.buf, rd.group.size);
+    } else {
+        dxf->stats.bytes_read = (unsigned long long)(rd.group.base +
+            (dxf_off_t)rd.group.size);
+        free(block);
+    }
+
+    /* Deferred checks over everything the parse consumed */
+    if(dxf->options.validate == dxfValidateAfter) {
+        dxf_validate_result_t result; /* First invalid line */
+        dxf_error_t verr;
+
+        if((verr = dxf_validate_fd(fd, (off_t)DXF_READER_OFFSET(&rd),
+            DXF_MAX_LINE_LENGTH, dxf->options.threads, &result)) !=
+            dxfErrorOk) {
+            SET_ERROR(dxf, verr);
+            return verr;
+        }
+        if((result.code != dxfErrorOk) && ((err == dxfErrorOk) ||
+            (result.line <= dxf->line))) {
+            SET_ERROR(dxf, result.code);
+            dxf->line = result.line;
+            dxf->column = result.column;
+            return result.code;
+        }
+    }
+    return err;
+}
+
+/**
+Parses every record from a DXF stream into the DXF state structure.
+
+@param  dxf DXF state structure.
+@param  rd  Reader set to the beginning of the DXF stream.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+static dxf_error_t _dxf_load_records(dxf_t *dxf, dxf_reader_t *rd) {
+    char cur_section[DXF_MAX_LINE_LENGTH + 1];
+    enum { S_PRE_SECTION, S_START_SECTION, S_SECTION, S_HEADER_VALUE }
+        state = S_PRE_SECTION;
+    dxf_off_t section_start = 0, section_end;
+    dxf_off_t section_offset = 0; /* File offset of the SECTION record */
+    dxf_off_t record_offset; /* File offset of the current record */
+    char buf0[DXF_MAX_LINE_LENGTH + 1];
+    dxf_stats_named_t *named; /* Section or record type counter */
+    int is_header = 0; /* Current section is HEADER */
+    dxf_error_t err = dxfErrorOk;
+
+    /* Loop through and parse every DXF record */
+    for(;;) {
+        int group_code = -1; /* Group code */
+        char value[DXF_MAX_LINE_LENGTH + 1]; /* Value */
+
+        /* Time one record in every DXF_STATS_SAMPLE_MASK + 1 */
+        dxf->sample = ((dxf->stats.record_cnt & DXF_STATS_SAMPLE_MASK) == 0);
+        if(dxf->sample != 0) {
+            dxf->mark = util_now();
+        }
+
+        /* Parse a record */
+        value[0] = '\0';
+        record_offset = DXF_READER_OFFSET(rd);
+        if(dxf_parse_record(dxf, rd, &group_code, value) == 0) {
+            if(dxf->error.code != dxfErrorEOF) {
+                err = dxf->error.code;
+            }
+            goto done;
+        }
+        /*
+        printf("cur_section=%s\n", cur_section);
+        if(group_code == 9) {
+            printf("%s\n", cur_section);
+        }
+        printf("%i: type=%i\n", group_code, DXF_GROUP_TYPE(group_code));
+        if(group_code == 0) {
+            printf("%i: %s\n", group_code, value);
+        }
+        */
+        dxf->stats.record_cnt++;
+        switch(state) {
+            case S_PRE_SECTION:
+                if(group_code != 0) {
+                    fprintf(stderr, "KAG: Expected group code 0 at %lld\n",
+                        (long long)DXF_RECORD_LINE(dxf, 0));
+                    err = dxfErrorInvalidFormat;
+                    goto done;
+                }
+                if(strcmp(value, "SECTION") == 0) {
+                    section_offset = record_offset;
+                    state = S_START_SECTION;
+                } else if(strcmp(value, "EOF") == 0) {
+                    goto done;
+                } else {
+                    fprintf(stderr,
+                        "KAG: Expected SECTION or EOF at %lld\n",
+                        (long long)DXF_RECORD_LINE(dxf, 0));
+                    err = dxfErrorInvalidFormat;
+                    goto done;
+                }
+                break;
+            case S_START_SECTION:
+                if(group_code != 2) {
+                    fprintf(stderr, "KAG: Expected group code 2 at %lld\n",
+                        (long long)DXF_RECORD_LINE(dxf, 0));
+                    err = dxfErrorInvalidFormat;
+                    goto done;
+                }
+                if(snprintf(cur_section, sizeof(cur_section), "%s", value) !=
+                    (int)strlen(value)) {
+                    SET_ERROR(dxf, dxfErrorSnprintfFailed);
+                    err = dxf->error.code;
+                    goto done;
+                }
+                section_start = DXF_RECORD_LINE(dxf, 0);
+                is_header = (strcmp(cur_section, "HEADER") == 0);
+                dxf_model_begin_section(&dxf->model, cur_section,
+                    (uint32_t)dxf->section_cnt);
+                dxf->section_time = util_now();
+                dxf_trace_begin("section", cur_section, (const char*)NULL);
+                state = S_SECTION;
+                break;
+            case S_SECTION:
+                if((group_code == 0) && (strcmp(value, "ENDSEC") == 0)) {
+                    state = S_PRE_SECTION;
+                    dxf_model_end_record(&dxf->model);
+                    section_end = DXF_RECORD_LINE(dxf, 0);
+                    dxf->section = (section_t*)_dxf_realloc(dxf,
+                        dxf->section,
+                        (sizeof(section_t) * (dxf->section_cnt + 1)));
+                    dxf->section[dxf->section_cnt].start = section_start;
+                    dxf->section[dxf->section_cnt].end = section_end;
+                    dxf->section[dxf->section_cnt].offset = section_offset;
+                    dxf->section[dxf->section_cnt].length =
+                        DXF_READER_OFFSET(rd) - section_offset;
+                    dxf->section[dxf->section_cnt].name = _dxf_strdup(dxf,
+                        cur_section);
+                    dxf->section_cnt++;
+                    dxf_trace_end("section", cur_section);
+                    if((named = _dxf_stats_named(dxf->stats.section,
+                        &dxf->stats.section_cnt, DXF_STATS_MAX_SECTIONS,
+                        cur_section)) != NULL) {
+                        named->count++;
+                        named->seconds += util_now() - dxf->section_time;
+                    }
+                    if((dxf->options.last_section != NULL) &&
+                        (strcmp(cur_section, dxf->options.last_section) ==
+                        0)) {
+                        goto done;
+                    }
+                    break;
+                }
+                if(group_code == 0) {
+                    /* Entity, object or table entry */
+                    if((named = _dxf_stats_named(dxf->stats.record_type,
+                        &dxf->stats.record_type_cnt,
+                        DXF_STATS_MAX_RECORD_TYPES, value)) != NULL) {
+                        named->count++;
+                    } else {
+                        dxf->stats.record_type_overflow++;
+                    }
+                    if((is_header == 0) && (dxf_model_begin_record(
+                        &dxf->model, value, record_offset,
+                        DXF_RECORD_LINE(dxf, -1)) == 0)) {
+                        SET_ERROR(dxf, dxfErrorNoMemory);
+                        err = dxf->error.code;
+                        goto done;
+                    }
+                } else if(DXF_MODEL_KEEPS(&dxf->model, group_code) &&
+                    (dxf_model_add_group(&dxf->model, group_code, value) ==
+                    0)) {
+                    SET_ERROR(dxf, dxfErrorNoMemory);
+                    err = dxf->error.code;
+                    goto done;
+                }
+                if(DXF_MODEL_IS_XDATA(group_code) && (is_header == 0) &&
+                    (dxf_model_add_xdata(&dxf->model, record_offset,
+                    DXF_READER_OFFSET(rd)) == 0)) {
+                    SET_ERROR(dxf, dxfErrorNoMemory);
+                    err = dxf->error.code;
+                    goto done;
+                }
+                /* Mid-section */
+                if(is_header != 0) {
+                    if(group_code == 9) {
+                        /* create a data element to add */
+                        /* value contains a header variable */
+                        /*printf("HEADER VAR = %s\n", value);*/
+                        strcpy(buf0, value);
+                        state = S_HEADER_VALUE;
+                    }
+                }
+                break;
+            case S_HEADER_VALUE:
+                _dxf_add_variable(dxf,  buf0, group_code, value);
+                state = S_SECTION;
+                break;
+        }
+        _dxf_phase_mark(dxf, dxfPhaseDecode);
+    }
+
+done:
+    /* Close the trace of a section left by an error or by EOF */
+    if((state == S_SECTION) || (state == S_HEADER_VALUE)) {
+        dxf_trace_end("section", cur_section);
+    }
+    return err;
+}
+
+/**
+Get the last error.
+Copies last error detail into provided structure.
+
+@param  dxf DXF state structure.
+@param  error DXF error structure.
+@returns 1 on success, 0 on error.
+*/
+dxf_error_t dxf_get_last_error(const dxf_handle_t handle, dxf_error_detail_t
+    *error) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+
+    /* Is the error structure valid? */
+    assert(error != NULL);
+
+    /* Copy the current error into target structure */
+    error->code = dxf->error.code;
+    memcpy(error->msg, dxf->error.msg, sizeof(error->msg));
+
+    return dxfErrorOk;
+}
+
+/**
+Print last error details to stderr.
+Convenience function that prints details of the last error to stderr.
+
+@param  dxf DXF state structure.
+*/
+dxf_error_t dxf_print_last_error(const dxf_handle_t handle) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+
+    /* Print the error to stderr */
+    fprintf(stderr, "DXF Error:\n" \
+        "\tcode:\t%i\n" \
+        "\tmsg:\t%s\n" \
+        "\tline:\t%lld\n" \
+        "\tcolumn:\t%i\n",
+        dxf->error.code, dxf->error.msg, (long long)dxf->line, dxf->column);
+
+    return dxfErrorOk;
+}
+
+dxf_error_t dxf_has_var(const dxf_handle_t handle, const char *name) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+
+    /* Is the key valid? */
+    assert((name != NULL) && (*name != '\0'));
+
+    return dxfErrorInvalidVariable;
+}
+
+/**
+Gets the number of HEADER variables read.
+
+@param  handle  DXF handle.
+@param  cnt On success, contains the number of variables.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_get_var_cnt(const dxf_handle_t handle, size_t *cnt) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(cnt != NULL);
+    *cnt = dxf->variable_cnt;
+    return dxfErrorOk;
+}
+
+/**
+Gets a HEADER variable by position, in file order.  The value is the
+first group after the name, as written; "NA" if it is empty.
+
+@param  handle  DXF handle.
+@param  i   Position, less than dxf_get_var_cnt().
+@param  name    On success, points to the name, e.g. "$INSUNITS".
+@param  value   On success, points to the value; may be NULL.
+@returns dxfErrorOk on success, dxfErrorInvalidVariable if i is out of
+range, error code otherwise.
+*/
+dxf_error_t dxf_get_var(const dxf_handle_t handle, size_t i,
+    const char **name, const char **value) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(name != NULL);
+    if(i >= dxf->variable_cnt) {
+        return dxfErrorInvalidVariable;
+    }
+    *name = dxf->variable[i].name;
+    if(value != NULL) {
+        *value = dxf->variable[i].value.c;
+    }
+    return dxfErrorOk;
+}
+
+/**
+Gets the number of entries of the LAYER table.
+
+@param  handle  DXF handle.
+@param  cnt On success, contains the number of distinct layer names.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_get_layer_cnt(const dxf_handle_t handle, size_t *cnt) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(cnt != NULL);
+    *cnt = dxf->model.table_layers.cnt;
+    return dxfErrorOk;
+}
+
+/**
+Gets the name of a LAYER table entry, in file order.
+
+@param  handle  DXF handle.
+@param  i   Position, less than dxf_get_layer_cnt().
+@param  name    On success, points to the layer name.
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if i is out of
+range, error code otherwise.
+*/
+dxf_error_t dxf_get_layer(const dxf_handle_t handle, size_t i,
+    const char **name) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(name != NULL);
+    if(i >= dxf->model.table_layers.cnt) {
+        return dxfErrorInvalidRecord;
+    }
+    *name = dxf->model.table_layers.name[i];
+    return dxfErrorOk;
+}
+
+/**
+Parses an object handle as written in a drawing (hexadecimal).
+
+@param  s   Handle string, e.g. "1F".
+@param  object  On success, contains the handle.
+@returns dxfErrorOk on success, dxfErrorInvalidFormat otherwise.
+*/
+dxf_error_t dxf_parse_handle(const char *s, uint64_t *object) {
+    assert(s != NULL);
+    assert(object != NULL);
+    return (dxf_model_parse_handle(s, object) == 1) ? dxfErrorOk :
+        dxfErrorInvalidFormat;
+}
+
+/**
+Get the number of records.
+Record ids run from 0 to cnt - 1.
+
+@param  handle  DXF handle.
+@param  cnt On success, contains the number of records.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_get_record_cnt(const dxf_handle_t handle, size_t *cnt) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(cnt != NULL);
+    *cnt = dxf->model.record_cnt;
+    return dxfErrorOk;
+}
+
+/**
+Get record details.
+
+@param  handle  DXF handle.
+@param  id  Record id.
+@param  info    On success, contains the record details.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_get_record(const dxf_handle_t handle, dxf_record_id_t id,
+    dxf_record_info_t *info) {
+    const dxf_record_t *r;
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(info != NULL);
+    if(id >= dxf->model.record_cnt) {
+        return dxfErrorInvalidRecord;
+    }
+    r = &dxf->model.record[id];
+    info->type = dxf->model.types.name[r->type];
+    info->section = (r->section < dxf->section_cnt) ?
+        dxf->section[r->section].name : (const char*)NULL;
+    info->handle = r->handle;
+    info->owner = (r->owner == DXF_INDEX_NONE) ? DXF_RECORD_NONE :
+        dxf->model.pointer[r->pointer + r->owner].target;
+    info->offset = r->offset;
+    info->line = r->line;
+    info->pointer_cnt = r->pointer_cnt;
+    return dxfErrorOk;
+}
+
+/**
+Looks up the record with an object handle.
+Constant time, through the index built while loading.
+
+@param  handle  DXF handle.
+@param  object  Object handle (group 5).
+@param  id  On success, contains the record id.
+@returns dxfErrorOk on success, dxfErrorNotFound if no record has the
+object handle, error code otherwise.
+*/
+dxf_error_t dxf_lookup_handle(const dxf_handle_t handle, uint64_t object,
+    dxf_record_id_t *id) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(id != NULL);
+    if((*id = dxf_handle_index_find(&dxf->model.handles, object)) ==
+        DXF_RECORD_NONE) {
+        return dxfErrorNotFound;
+    }
+    return dxfErrorOk;
+}
+
+/**
+Get the pointers of a record, already resolved to record ids.
+
+@param  handle  DXF handle.
+@param  id  Record id.
+@param  pointers    On success, points at the record's pointers in file
+    order, valid until dxf_unload().
+@param  cnt On success, contains the number of pointers.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_get_pointers(const dxf_handle_t handle, dxf_record_id_t id,
+    const dxf_pointer_t **pointers, size_t *cnt) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(pointers != NULL);
+    assert(cnt != NULL);
+    if(id >= dxf->model.record_cnt) {
+        return dxfErrorInvalidRecord;
+    }
+    *pointers = dxf->model.pointer + dxf->model.record[id].pointer;
+    *cnt = dxf->model.record[id].pointer_cnt;
+    return dxfErrorOk;
+}
+
+/**
+Resolves the owner of a record.
+
+@param  handle  DXF handle.
+@param  id  Record id.
+@param  owner   On success, contains the owner's record id.
+@returns dxfErrorOk on success, dxfErrorNotFound if the record has no owner
+pointer or the owner is not in the drawing, error code otherwise.
+*/
+dxf_error_t dxf_resolve_owner(const dxf_handle_t handle, dxf_record_id_t id,
+    dxf_record_id_t *owner) {
+    dxf_record_info_t info;
+    dxf_error_t err;
+
+    assert(owner != NULL);
+    if((err = dxf_get_record(handle, id, &info)) != dxfErrorOk) {
+        return err;
+    }
+    if((*owner = info.owner) == DXF_RECORD_NONE) {
+        return dxfErrorNotFound;
+    }
+    return dxfErrorOk;
+}
+
+/**
+Gets the vertex buffer of the drawing: the vertices of every LWPOLYLINE
+and POLYLINE and the control points of every SPLINE, packed into one
+array aligned to DXF_VERTEX_ALIGN.  Each vertex is x, y, z, w, as written
+in the entity's coordinates; w is the bulge of a polyline vertex (z of an
+LWPOLYLINE is 0, its elevation is group 38) or the weight of a control
+point.  See dxf_get_entity_vertices() for the range of one entity.
+A drawing loaded compact is decoded back to doubles for good by the first
+call.  One loaded with max_resident_bytes is read back whole only if the
+buffer and its world coordinates fit the budget together, and fails with
+dxfErrorOverBudget otherwise; dxf_copy_vertices() decodes or reads only
+what it is asked for.
+
+@param  handle  DXF handle.
+@param  vertex  On success, points to the buffer; valid until
+    dxf_unload().
+@param  cnt On success, contains the number of vertices.
+@returns dxfErrorOk on success, dxfErrorOverBudget if the drawing is
+spilled and does not fit its budget, error code otherwise.
+*/
+dxf_error_t dxf_get_vertices(const dxf_handle_t handle,
+    const double **vertex, size_t *cnt) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(vertex != NULL);
+    assert(cnt != NULL);
+    if((err = _dxf_vertices_resident(dxf)) != dxfErrorOk) {
+        return err;
+    }
+    *vertex = dxf->model.vertex;
+    *cnt = dxf->model.vertex_cnt;
+    return dxfErrorOk;
+}
+
+/**
+Gets the range of an entity's vertices in the vertex buffer.
+
+@param  handle  DXF handle.
+@param  id  Record id of an entity.
+@param  first   On success, contains the index of the first vertex.
+@param  cnt On success, contains the number of vertices, 0 for entities
+    without any.
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if the record is not
+an entity, error code otherwise.
+*/
+dxf_error_t dxf_get_entity_vertices(const dxf_handle_t handle,
+    dxf_record_id_t id, size_t *first, size_t *cnt) {
+    uint32_t entity;
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert(first != NULL);
+    assert(cnt != NULL);
+    if((id >= dxf->model.record_cnt) ||
+        ((entity = dxf->model.record_entity[id]) == DXF_INDEX_NONE)) {
+        return dxfErrorInvalidRecord;
+    }
+    *first = dxf->model.entity[entity].vertex;
+    *cnt = dxf->model.entity[entity].vertex_cnt;
+    return dxfErrorOk;
+}
+
+/**
+Copies a range of the vertex buffer, or of its world coordinates, as laid
+out by dxf_get_vertices(); see dxf_get_entity_vertices() for the range of
+one entity.  A drawing loaded compact stays compact: only the range is
+decoded, within compact_step / 2 of the coordinates as read.  A drawing
+loaded with max_resident_bytes reads back the blocks holding the range
+from the file, which must not have changed since.  Safe to call from
+several threads.
+
+@param  handle  DXF handle.
+@param  world   Non-zero for world coordinates.
+@param  first   First vertex.
+@param  cnt Number of vertices.
+@param  vertex  Receives cnt vertices of x, y, z, w.
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if the range is
+past the end of the buffer, dxfErrorInvalidFormat if the file no longer
+holds the vertices, error code otherwise.
+*/
+dxf_error_t dxf_copy_vertices(const dxf_handle_t handle, int world,
+    size_t first, size_t cnt, double *vertex) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert((vertex != NULL) || (cnt == 0));
+    if((first > dxf->model.vertex_cnt) ||
+        (cnt > dxf->model.vertex_cnt - first)) {
+        return dxfErrorInvalidRecord;
+    }
+    return dxf_model_copy_vertices(&dxf->model, world, first, cnt, vertex);
+}
+
+/**
+Gets the world coordinates of the vertex buffer: dxf_get_vertices() with
+every vertex converted from its entity's OCS to the WCS, in the same
+layout and order.  Vertices of 2D polylines get the entity's elevation as
+z.  Brings a compact or spilled drawing back into memory for good, as
+dxf_get_vertices() does, under the same budget.
+
+@param  handle  DXF handle.
+@param  vertex  On success, points to the buffer, NULL if there are no
+    vertices; valid until dxf_unload().
+@param  cnt On success, contains the number of vertices.
+@returns dxfErrorOk on success, dxfErrorOverBudget if the drawing is
+spilled and does not fit its budget, error code otherwise.
+*/
+dxf_error_t dxf_get_world_vertices(const dxf_handle_t handle,
+    const double **vertex, size_t *cnt) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(vertex != NULL);
+    assert(cnt != NULL);
+    if((err = _dxf_vertices_resident(dxf)) != dxfErrorOk) {
+        return err;
+    }
+    *vertex = dxf->model.world;
+    *cnt = dxf->model.vertex_cnt;
+    return dxfErrorOk;
+}
 
-@param  dxf DXF state structure.
+/**
+Gets the first two points of an entity (groups 10 and 11), as written or
+converted to world coordinates.  Points of CIRCLE, ARC, TEXT, ATTRIB,
+ATTDEF, INSERT and 2D polylines are written in the entity's OCS, all
+others in the WCS.
+
+@param  handle  DXF handle.
+@param  id  Record id of an entity.
+@param  world   Non-zero for world coordinates.
+@param  p   On success, contains the group 10 point, 0 if absent.
+@param  q   On success, contains the group 11 point, 0 if absent; may be
+    NULL.
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if the record is not
+an entity, error code otherwise.
 */
-dxf_error_t dxf_print_last_error(const dxf_handle_t handle) {
+dxf_error_t dxf_get_entity_points(const dxf_handle_t handle,
+    dxf_record_id_t id, int world, double p[3], double q[3]) {
+    const dxf_entity_t *e;
+    uint32_t entity;
     dxf_t *dxf;
     dxf_error_t err;
 
     if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
         return err;
     }
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert(p != NULL);
+    if((id >= dxf->model.record_cnt) ||
+        ((entity = dxf->model.record_entity[id]) == DXF_INDEX_NONE)) {
+        return dxfErrorInvalidRecord;
+    }
+    e = &dxf->model.entity[entity];
+    memcpy(p, (world != 0) ? e->wp : e->p, 3 * sizeof(double));
+    if(q != NULL) {
+        memcpy(q, (world != 0) ? e->wq : e->q, 3 * sizeof(double));
+    }
+    return dxfErrorOk;
+}
 
-    /* Print the error to stderr */
-    fprintf(stderr, "DXF Error:\n" \
-        "\tcode:\t%i\n" \
-        "\tmsg:\t%s\n" \
-        "\tline:\t%i\n" \
-        "\tcolumn:\t%i\n",
-        dxf->error.code, dxf->error.msg, dxf->line, dxf->column);
+/**
+Flattens an entity into world space paths.
+Curves become chords within the tolerance; INSERTs, nested ones and
+MINSERT arrays included, are expanded from a cached flattened definition
+of their block plus a transform, so every insert of a block shares one
+definition.  Safe to call from several threads.
+
+@param  handle  DXF handle.
+@param  id  Record id of an entity in ENTITIES or in a block definition.
+@param  tolerance   Max distance between a curve and its chords, > 0.
+@param  geometry    Geometry the paths are appended to.
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if the record is not
+an entity, error code otherwise.
+*/
+dxf_error_t dxf_flatten(const dxf_handle_t handle, dxf_record_id_t id,
+    double tolerance, dxf_geometry_t *geometry) {
+    const dxf_batch_t *batch;
+    dxf_vertex_scratch_t scratch;
+    dxf_mat_t identity;
+    uint32_t entity;
+    dxf_t *dxf;
+    dxf_error_t err;
+    int ok;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert(tolerance > 0.0);
+    assert(geometry != NULL);
+    if((id >= dxf->model.record_cnt) ||
+        ((entity = dxf->model.record_entity[id]) == DXF_INDEX_NONE)) {
+        return dxfErrorInvalidRecord;
+    }
+    dxf_mat_identity(identity);
+    dxf_vertex_scratch_init(&scratch);
+
+    /* Copied from the flattened drawing when there is one */
+    if((dxf->model.entity[entity].block == DXF_INDEX_NONE) &&
+        ((batch = dxf_batch_find(&dxf->model, tolerance)) != NULL)) {
+        ok = dxf_geometry_append_paths(geometry, &batch->geometry,
+            batch->entity_path[entity], batch->entity_path[entity + 1] -
+            batch->entity_path[entity], identity, DXF_RECORD_NONE);
+    } else {
+        ok = dxf_block_flatten(&dxf->model, &dxf->model.entity[entity],
+            tolerance, identity, id, geometry, 0, &scratch);
+    }
+    err = (ok != 0) ? dxfErrorOk : (scratch.err != dxfErrorOk) ?
+        scratch.err : dxfErrorNoMemory;
+    dxf_vertex_scratch_free(&scratch);
+    return err;
+}
+
+/**
+Flattens every entity of the ENTITIES section into one packed buffer.
+Entities are flattened in parallel, by as many threads as the load
+options allow.  The result is cached in the drawing for the tolerance
+rounded down to a power of two: later calls with a tolerance that rounds
+the same, and dxf_flatten() of those entities, reuse it.  Safe to call
+from several threads.
+
+@param  handle  DXF handle.
+@param  tolerance   Max distance between a curve and its chords, > 0.
+@param  geometry    On success, points to the paths, in file order and
+    attributed to their entities; valid until dxf_unload().
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_tessellate(const dxf_handle_t handle, double tolerance,
+    const dxf_geometry_t **geometry) {
+    const dxf_batch_t *batch;
+    dxf_t *dxf;
+    dxf_error_t err;
 
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert(tolerance > 0.0);
+    assert(geometry != NULL);
+    if((batch = dxf_batch_get(&dxf->model, tolerance, dxf->options.threads,
+        &err)) == NULL) {
+        return err;
+    }
+    *geometry = &batch->geometry;
     return dxfErrorOk;
 }
 
-dxf_error_t dxf_has_var(const dxf_handle_t handle, const char *name) {
+/**
+Gets the flattened definition of a block, in block coordinates.
+Together with dxf_get_insert_transforms() this draws every insert of the
+block from one definition.
+
+@param  handle  DXF handle.
+@param  name    Block name (group 2).
+@param  tolerance   Max distance between a curve and its chords, > 0.
+@param  geometry    Geometry the paths are appended to, attributed to the
+    entities of the definition.
+@returns dxfErrorOk on success, dxfErrorNotFound if the block is not
+defined, error code otherwise.
+*/
+dxf_error_t dxf_flatten_block(const dxf_handle_t handle, const char *name,
+    double tolerance, dxf_geometry_t *geometry) {
+    const dxf_geometry_t *def;
+    dxf_vertex_scratch_t scratch;
+    dxf_mat_t identity;
+    uint32_t block;
     dxf_t *dxf;
     dxf_error_t err;
 
     if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
         return err;
     }
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert(name != NULL);
+    assert(tolerance > 0.0);
+    assert(geometry != NULL);
+    if(((block = dxf_names_find(&dxf->model.block_names, name)) ==
+        DXF_INDEX_NONE) ||
+        (dxf->model.block[block].record == DXF_RECORD_NONE)) {
+        return dxfErrorNotFound;
+    }
+    dxf_mat_identity(identity);
+    dxf_vertex_scratch_init(&scratch);
+    def = dxf_block_definition(&dxf->model, block, tolerance, 0, &scratch);
+    err = (scratch.err != dxfErrorOk) ? scratch.err : dxfErrorNoMemory;
+    dxf_vertex_scratch_free(&scratch);
+    if(def == NULL) {
+        return err;
+    }
+    if(dxf_geometry_append(geometry, def, identity, DXF_RECORD_NONE) == 0) {
+        return dxfErrorNoMemory;
+    }
+    return dxfErrorOk;
+}
 
-    /* Is the key valid? */
-    assert((name != NULL) && (*name != '\0'));
+/**
+Gets the block to world transforms of an INSERT, one per MINSERT cell.
+Each is three rows of x, y, z and translation: world = T * (x, y, z, 1).
 
-    return dxfErrorInvalidVariable;
+@param  handle  DXF handle.
+@param  id  Record id of an INSERT.
+@param  transform   Array of max transforms, or NULL to only count.
+@param  max Size of transform.
+@param  cnt On success, contains the number of cells, which may exceed
+    max.
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if the record is not
+an INSERT, dxfErrorNotFound if its block is not defined, error code
+otherwise.
+*/
+dxf_error_t dxf_get_insert_transforms(const dxf_handle_t handle,
+    dxf_record_id_t id, double (*transform)[12], size_t max, size_t *cnt) {
+    const dxf_entity_t *e;
+    dxf_mat_t identity;
+    uint32_t entity;
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert(cnt != NULL);
+    if((id >= dxf->model.record_cnt) ||
+        ((entity = dxf->model.record_entity[id]) == DXF_INDEX_NONE) ||
+        (dxf->model.entity[entity].kind != dxfKindInsert)) {
+        return dxfErrorInvalidRecord;
+    }
+    e = &dxf->model.entity[entity];
+    if((e->name == DXF_INDEX_NONE) ||
+        (dxf->model.block[e->name].record == DXF_RECORD_NONE)) {
+        return dxfErrorNotFound;
+    }
+    dxf_mat_identity(identity);
+    *cnt = dxf_block_insert_transforms(&dxf->model, e, identity, transform,
+        max);
+    return dxfErrorOk;
+}
+
+/**
+Builds the endpoint topology of the drawing, see dxf_topology_t.  Ends of
+LINE, ARC and polyline entities closer than the tolerance snap to one
+node.  Endpoints are hashed into a grid of tolerance-sized cells, so only
+neighbouring cells are compared, and the cells are searched by as many
+threads as the load options allow.  Chains are maximal runs of edges
+through nodes joining exactly two edge ends; closed polylines and loops
+are closed chains.
+
+@param  handle  DXF handle.
+@param  tolerance   Snap distance in world coordinates, > 0.
+@param  topology    Initialized topology; its previous contents are freed.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_build_topology(const dxf_handle_t handle, double tolerance,
+    dxf_topology_t *topology) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    if((err = dxf_spill_geometry(&dxf->model, dxf->filename)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    assert(tolerance > 0.0);
+    assert(topology != NULL);
+    return dxf_topo_build(&dxf->model, tolerance, dxf->options.threads,
+        topology);
+}
+
+/**
+Finds the TEXT, MTEXT, ATTRIB and ATTDEF entities whose text contains a
+string, ignoring ASCII case.  Text is matched after decoding its
+formatting codes, as returned by dxf_get_text(); MTEXT matches across its
+group 3 chunks.  The first search builds a trigram index of the drawing's
+text, later ones only check the entities holding the pattern's rarest
+trigram.  Safe to call from several threads.
+
+@param  handle  DXF handle.
+@param  pattern Substring to look for, as UTF-8; "" matches every text
+    entity.
+@param  ids Array of max record ids, or NULL to only count.
+@param  max Size of ids.
+@param  cnt On success, contains the number of entities found, in file
+    order, which may exceed max.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_text_search(const dxf_handle_t handle, const char *pattern,
+    dxf_record_id_t *ids, size_t max, size_t *cnt) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(pattern != NULL);
+    assert(cnt != NULL);
+    if(dxf_text_search_model(&dxf->model, pattern, ids, max, cnt) == 0) {
+        return dxfErrorNoMemory;
+    }
+    return dxfErrorOk;
+}
+
+/**
+Gets the text of a TEXT, MTEXT, ATTRIB or ATTDEF entity as UTF-8, with
+its formatting codes decoded: %%d, %%p and %%c become the degree,
+plus-minus and diameter signs, \U+XXXX escapes their character, and the
+MTEXT font, height, color and similar codes are dropped.  MTEXT paragraph
+breaks become newlines.  The code page is applied as by
+dxf_decode_string().
+
+@param  handle  DXF handle.
+@param  id  Record id of the entity.
+@param  text    Receives the NULL-terminated text, truncated to size - 1
+    bytes; may be NULL if size is 0.
+@param  size    Size of text.
+@param  len On success, contains the length of the whole text; may be
+    NULL.
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if the record has
+no text, error code otherwise.
+*/
+dxf_error_t dxf_get_text(const dxf_handle_t handle, dxf_record_id_t id,
+    char *text, size_t size, size_t *len) {
+    const dxf_text_span_t *span;
+    dxf_t *dxf;
+    dxf_error_t err;
+    char *decoded;
+    size_t n;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert((text != NULL) || (size == 0));
+    if((span = dxf_text_span(&dxf->model, id)) == NULL) {
+        return dxfErrorInvalidRecord;
+    }
+    if((decoded = (char*)malloc(DXF_STRING_EXPANSION * span->len + 1)) ==
+        NULL) {
+        return dxfErrorNoMemory;
+    }
+    n = dxf_text_span_decode(&dxf->model, span, decoded);
+    if(size > 0) {
+        memcpy(text, decoded, (n < size) ? n : size - 1);
+        text[(n < size) ? n : size - 1] = '\0';
+    }
+    if(len != NULL) {
+        *len = n;
+    }
+    free(decoded);
+    return dxfErrorOk;
+}
+
+/**
+Decodes a string value of the drawing, as returned by dxf_get_var(),
+dxf_get_layer() and the like, to UTF-8: ^ control character escapes,
+\\U+XXXX escapes and the $DWGCODEPAGE code page.  Values are kept as
+written and only decoded here; most need none of it and are copied as
+they are.  The double byte code pages ANSI_932, ANSI_936, ANSI_949 and
+ANSI_950 are not decoded: their high bytes are copied as written.
+
+@param  handle  DXF handle.
+@param  raw NULL-terminated value, as written.
+@param  text    Receives the NULL-terminated text, truncated to size - 1
+    bytes; may be NULL if size is 0.
+@param  size    Size of text.
+@param  len On success, contains the length of the whole text; may be
+    NULL.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_decode_string(const dxf_handle_t handle, const char *raw,
+    char *text, size_t size, size_t *len) {
+    dxf_t *dxf;
+    dxf_error_t err;
+    char *decoded = (char*)NULL;
+    size_t n;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(raw != NULL);
+    assert((text != NULL) || (size == 0));
+    n = strlen(raw);
+    if(!dxf_string_plain(raw, n, 1)) {
+        if((decoded = (char*)malloc(DXF_STRING_EXPANSION * n + 1)) == NULL) {
+            return dxfErrorNoMemory;
+        }
+        n = dxf_string_decode(raw, n, dxf->model.codepage, 1, decoded);
+        raw = decoded;
+    }
+    if(size > 0) {
+        memcpy(text, raw, (n < size) ? n : size - 1);
+        text[(n < size) ? n : size - 1] = '\0';
+    }
+    if(len != NULL) {
+        *len = n;
+    }
+    free(decoded);
+    return dxfErrorOk;
+}
+
+/**
+Gets the named object dictionary, the root of the dictionary tree of the
+OBJECTS section.  Its entries (ACAD_GROUP, ACAD_LAYOUT, ...) lead to the
+other dictionaries, see dxf_get_dict_entries().
+
+@param  handle  DXF handle.
+@param  id  On success, contains the record id of the dictionary.
+@returns dxfErrorOk on success, dxfErrorNotFound if the drawing has no
+OBJECTS section, error code otherwise.
+*/
+dxf_error_t dxf_get_named_object_dict(const dxf_handle_t handle,
+    dxf_record_id_t *id) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(id != NULL);
+    if(dxf->model.objects_first == DXF_INDEX_NONE) {
+        return dxfErrorNotFound;
+    }
+    *id = dxf->model.objects_first;
+    return dxfErrorOk;
+}
+
+/**
+Gets the entries of a dictionary.  Loading only indexes the OBJECTS
+section; the first call reads every dictionary back from the file the
+drawing was loaded from, which must not have changed since.  Safe to call
+from several threads.
+
+@param  handle  DXF handle.
+@param  id  Record id of a DICTIONARY or ACDBDICTIONARYWDFLT.
+@param  entries On success, points at the entries in file order, valid
+    until dxf_unload().
+@param  cnt On success, contains the number of entries.
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if the record is
+not a dictionary, error code otherwise.
+*/
+dxf_error_t dxf_get_dict_entries(const dxf_handle_t handle,
+    dxf_record_id_t id, const dxf_dict_entry_t **entries, size_t *cnt) {
+    const dxf_dict_index_t *index;
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(entries != NULL);
+    assert(cnt != NULL);
+    if((err = dxf_dict_index(&dxf->model, dxf->filename, &index)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    if(dxf_dict_entries(index, id, entries, cnt) == 0) {
+        return dxfErrorInvalidRecord;
+    }
+    return dxfErrorOk;
+}
+
+/**
+Looks up an entry of a dictionary by name, ignoring case as AutoCAD does.
+
+@param  handle  DXF handle.
+@param  id  Record id of the dictionary.
+@param  name    Entry name, e.g. "ACAD_LAYOUT".
+@param  entry   On success, contains the record id of the object.
+@returns dxfErrorOk on success, dxfErrorNotFound if the dictionary has no
+such entry or its object is not in the drawing, error code otherwise.
+*/
+dxf_error_t dxf_find_dict_entry(const dxf_handle_t handle, dxf_record_id_t id,
+    const char *name, dxf_record_id_t *entry) {
+    const dxf_dict_entry_t *entries;
+    size_t cnt, i, k;
+    dxf_error_t err;
+
+    assert(name != NULL);
+    assert(entry != NULL);
+    if((err = dxf_get_dict_entries(handle, id, &entries, &cnt)) !=
+        dxfErrorOk) {
+        return err;
+    }
+    for(i = 0; i < cnt; i++) {
+        for(k = 0; (name[k] != '\0') && (tolower((unsigned char)name[k]) ==
+            tolower((unsigned char)entries[i].name[k])); k++) {
+        }
+        if((name[k] == '\0') && (entries[i].name[k] == '\0') &&
+            (entries[i].record != DXF_RECORD_NONE)) {
+            *entry = entries[i].record;
+            return dxfErrorOk;
+        }
+    }
+    return dxfErrorNotFound;
+}
+
+/**
+Starts reading the extended data of a record, see dxf_xdata_t.  The data
+is read back from the file the drawing was loaded from, which must not
+have changed since.
+
+@param  handle  DXF handle.
+@param  id  Record id.
+@param  xdata   On success, the iterator, empty if the record has no
+    extended data; free it with dxf_xdata_end().
+@returns dxfErrorOk on success, dxfErrorInvalidRecord if id is out of
+range, error code otherwise.
+*/
+dxf_error_t dxf_xdata_begin(const dxf_handle_t handle, dxf_record_id_t id,
+    dxf_xdata_t **xdata) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(xdata != NULL);
+    if(id >= dxf->model.record_cnt) {
+        return dxfErrorInvalidRecord;
+    }
+    return dxf_xdata_open(&dxf->model, dxf->filename, id, xdata);
+}
+
+/**
+Starts an entity query, see dxf_query_t.
+
+@param  handle  DXF handle.
+@param  query   On success, the query; free it with dxf_query_end().
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_query_begin(const dxf_handle_t handle, dxf_query_t **query) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+    assert(query != NULL);
+    if((*query = dxf_query_new(&dxf->query_index, &dxf->model)) == NULL) {
+        return dxfErrorNoMemory;
+    }
+    return dxfErrorOk;
 }
 
 /**
@@ -709,23 +2327,24 @@ dxf_error_t dxf_unload(const dxf_handle_t handle) {
 dxf_error_t dxf_print(dxf_handle_t handle, FILE *fp) {
     dxf_t *dxf;
     dxf_error_t err;
-    int i;
+    size_t i;
 
     if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
         return err;
     }
 
     fprintf(fp, "%s\n", dxf->filename);
-    fprintf(fp, "\tlines: %i\n", dxf->line);
+    fprintf(fp, "\tlines: %llu\n", dxf->stats.line_cnt);
     for(i = 0; i < dxf->section_cnt; i++) {
-        fprintf(fp, "\t%s (%i - %i)\n", 
+        fprintf(fp, "\t%s (%lld - %lld)\n", 
             dxf->section[i].name,
-            dxf->section[i].start,
-            dxf->section[i].end);
+            (long long)dxf->section[i].start,
+            (long long)dxf->section[i].end);
     }
     for(i = 0; i < dxf->variable_cnt; i++) {
-        fprintf(fp, "\t%s\t", dxf_type_enum_to_name(
-            dxf_group_type_map[dxf->variable[i].type]));
+        unsigned int type = DXF_GROUP_TYPE(dxf->variable[i].type);
+        fprintf(fp, "\t%s\t", (type == DXF_TYPE_NONE) ? "unknown" :
+            dxf_type_names[type]);
         fprintf(fp, "%s = ",
             dxf->variable[i].name);
         if(dxf->variable[i].value.c != NULL) {
@@ -737,3 +2356,74 @@ dxf_error_t dxf_print(dxf_handle_t handle, FILE *fp) {
     return dxfErrorOk;
 }
 
+
+/**
+Get load statistics.
+Copies the statistics gathered while loading into provided structure.
+
+@param  handle  DXF handle.
+@param  stats   Statistics structure.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_get_stats(const dxf_handle_t handle, dxf_stats_t *stats) {
+    dxf_t *dxf;
+    dxf_error_t err;
+
+    if((err = dxf_get_registered(handle, &dxf)) != dxfErrorOk) {
+        return err;
+    }
+
+    /* Is the stats structure valid? */
+    assert(stats != NULL);
+
+    memcpy(stats, &dxf->stats, sizeof(*stats));
+    return dxfErrorOk;
+}
+
+/**
+Print load statistics.
+
+@param  handle  DXF handle.
+@param  fp  Output stream.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_print_stats(const dxf_handle_t handle, FILE *fp) {
+    static const char *PHASE_S[] = { "io", "tokenize", "decode", "index" };
+    dxf_stats_t stats;
+    dxf_error_t err;
+    int i;
+
+    if((err = dxf_get_stats(handle, &stats)) != dxfErrorOk) {
+        return err;
+    }
+
+    fprintf(fp, "\tbytes read: %llu\n", stats.bytes_read);
+    fprintf(fp, "\tlines: %llu\n", stats.line_cnt);
+    fprintf(fp, "\trecords: %llu\n", stats.record_cnt);
+    fprintf(fp, "\tbytes allocated: %llu\n", stats.bytes_allocated);
+    fprintf(fp, "\ttotal: %.6fs\n", stats.total_seconds);
+    for(i = 0; i < dxfPhaseCnt; i++) {
+        fprintf(fp, "\tphase %s: %.6fs\n", PHASE_S[i],
+            stats.phase_seconds[i]);
+    }
+    for(i = 0; i < DXF_TYPE_CNT; i++) {
+        if(stats.type_cnt[i] > 0) {
+            fprintf(fp, "\ttype %s: %llu\n", dxf_type_names[i],
+                stats.type_cnt[i]);
+        }
+    }
+    fprintf(fp, "\ttype unknown: %llu\n", stats.unknown_type_cnt);
+    for(i = 0; i < stats.section_cnt; i++) {
+        fprintf(fp, "\tsection %s: %llu, %.6fs\n", stats.section[i].name,
+            stats.section[i].count, stats.section[i].seconds);
+    }
+    for(i = 0; i < stats.record_type_cnt; i++) {
+        fprintf(fp, "\trecord %s: %llu\n", stats.record_type[i].name,
+            stats.record_type[i].count);
+    }
+    if(stats.record_type_overflow > 0) {
+        fprintf(fp, "\trecord (other): %llu\n", stats.record_type_overflow);
+    }
+
+    return dxfErrorOk;
+}
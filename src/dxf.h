@@ -13,6 +13,37 @@
  *
  * make
  *
+ * \section bench_sec Benchmarking
+ *
+ * make bench
+ *
+ * Generates a deterministic synthetic corpus (dxfgen) with one file per
+ * record mix and reports MB/s, records/s, peak RSS and allocation counts
+ * for every parse mode (dxfbench).  Results are appended to
+ * bench/results.tsv, labelled with the current release, so throughput can
+ * be compared between releases.  BENCH_SIZE, BENCH_MIXES and BENCH_ITER
+ * control the corpus size, mixes and iteration count.
+ *
+ * make bench-perf
+ *
+ * Reads cycles, instructions, branch misses and cache misses per MB parsed
+ * for every parse mode through perf_event_open(), appending them to
+ * bench/counters.tsv.  When bench/baseline.tsv exists, any counter more than
+ * BENCH_THRESHOLD percent above its baseline fails the target.  Counters
+ * the host does not expose are reported as n/a.
+ *
+ * make bench-large
+ *
+ * Generates a file larger than 4 GB (BENCH_LARGE_SIZE) and loads it through
+ * both the read() and the mmap() paths.  Peak RSS should not grow with the
+ * file size.
+ *
+ * \section trace_sec Tracing
+ *
+ * Setting DXF_TRACE=path, or calling dxf_set_trace_sink(), writes begin/end
+ * events for every load and section in Chrome trace JSON format, one
+ * timeline per thread.  Open the file in chrome://tracing or Perfetto.
+ *
  * \section example Example Usage
  *
  * \code
@@ -39,13 +70,21 @@ int main(int argc, char **argv) {
 #ifndef _DXF_H_
 #define _DXF_H_
 
+#include <stdio.h>
 #include "util.h"
+#include "dxf_types.h"
 
 /**
 Handle required by API calls.
 */
 typedef unsigned int dxf_handle_t;
 
+/**
+Byte offsets and line numbers.  64-bit on every platform, so drawings past
+2 GB load the same as small ones.
+*/
+typedef int64_t dxf_off_t;
+
 /** 
  * All possible error values.
  * The various errors generated by dxf API calls.
@@ -55,7 +94,7 @@ typedef enum {
     dxfErrorBadFd, /**< Bad file descriptor. */
     dxfErrorInvalidFormat, /**< Invalid DXF format. */
     dxfErrorEOF, /**< End-of-file encountered. */
-    dxfErrorFgets, /**< Error reading with fgets(). */
+    dxfErrorFgets, /**< Error reading the file. */
     dxfErrorLineTooLong, /**< Line length exceeds max allowed. */
     dxfErrorNonASCII, /**< Non-ASCII character encountered. */
     dxfErrorDigitExpected, /**< Non-digit encountered. */
@@ -65,7 +104,17 @@ typedef enum {
     dxfErrorSnprintfFailed,/**< Failed to copy data. */
     dxfErrorTooManyOpen, /**< Too many dxf files open. */
     dxfErrorInvalidHandle, /**< Invalid handle. */
-    dxfErrorInvalidVariable /**< Invalid variable. */
+    dxfErrorInvalidVariable, /**< Invalid variable. */
+    dxfErrorInvalidRecord, /**< Record id out of range. */
+    dxfErrorNotFound, /**< No record with the object handle. */
+    dxfErrorNoMemory, /**< Out of memory. */
+    dxfErrorInvalidQuery, /**< Query operator without its operands. */
+    dxfErrorWriteFailed, /**< Failed to write a file. */
+    dxfErrorInvalidCatalog, /**< Not a catalog, or one from another build. */
+    dxfErrorInvalidPrecision, /**< Coordinates do not fit the compact step. */
+    dxfErrorInvalidShare, /**< Not a shared drawing, or one from another
+        build. */
+    dxfErrorOverBudget /**< Vertices do not fit max_resident_bytes. */
 } dxf_error_t;
 
 /**
@@ -77,12 +126,397 @@ typedef struct _dxf_error_t {
     char msg[FILENAME_MAX * 2]; /**< Error message */
 } dxf_error_detail_t;
 
+/**
+ * Validation levels.
+ * How much of the input dxf_load_ex() checks.
+ */
+typedef enum {
+    dxfValidateStrict, /**< Check every character while parsing. */
+    dxfValidateFast, /**< Check only what is needed to parse. */
+    dxfValidateAfter /**< Parse as fast, then check every character in a
+        separate parallel pass; errors are reported as strict would. */
+} dxf_validate_t;
+
+/**
+ * Input methods.
+ * How dxf_load_ex() reads the file.
+ */
+typedef enum {
+    dxfIoAuto, /**< Map regular files, read anything else. */
+    dxfIoRead, /**< Stream through a fixed size block with read(). */
+    dxfIoMmap /**< Map the whole file; fail if it cannot be mapped. */
+} dxf_io_t;
+
+/**
+ * Load options.
+ * Initialize with dxf_load_options_init() before changing fields.
+ */
+typedef struct _dxf_load_options_t {
+    dxf_validate_t validate; /**< Validation level, default strict */
+    int threads; /**< Worker threads, 0 for one per online CPU */
+    dxf_io_t io; /**< Input method, default auto */
+    const char *last_section; /**< Stop reading after the ENDSEC of the
+        first section with this name, e.g. "TABLES"; NULL, the default,
+        reads the whole file */
+    double compact_step; /**< Non-zero keeps the vertex buffer and its
+        world coordinates quantized to this step, decoded on access by
+        dxf_copy_vertices() and entity by entity by flattening and
+        topology; 0, the default, keeps doubles */
+    size_t max_resident_bytes; /**< Non-zero caps the bytes of vertices,
+        and their world coordinates, kept in memory: loading keeps none,
+        dxf_copy_vertices(), flattening and topology read them back
+        from the file by blocks and drop the least recently used past
+        the cap.  compact_step is ignored.  0, the default, keeps every
+        vertex */
+} dxf_load_options_t;
+
+/** Longest string dxf_probe() keeps, including the NULL. */
+#define DXF_INFO_VALUE_MAX 32
+
+/**
+ * Drawing metadata.
+ * Filled by dxf_probe() from the HEADER section alone.
+ */
+typedef struct _dxf_info_t {
+    char version[DXF_INFO_VALUE_MAX]; /**< $ACADVER, e.g. "AC1027", or "" */
+    char codepage[DXF_INFO_VALUE_MAX]; /**< $DWGCODEPAGE, e.g. "ANSI_1252",
+        or "" */
+    int units; /**< $INSUNITS, -1 if not set */
+    int has_extents; /**< Non-zero if $EXTMIN and $EXTMAX are both set */
+    double extmin[3]; /**< $EXTMIN */
+    double extmax[3]; /**< $EXTMAX */
+    dxf_off_t bytes_read; /**< Bytes read from the file */
+} dxf_info_t;
+
+/** Max sections reported by dxf_get_stats(). */
+#define DXF_STATS_MAX_SECTIONS 16
+/** Max distinct record types reported by dxf_get_stats(). */
+#define DXF_STATS_MAX_RECORD_TYPES 64
+/** Max length of a name reported by dxf_get_stats(), including NULL. */
+#define DXF_STATS_NAME_MAX 32
+
+/**
+ * Load phases.
+ * Phases that load time is attributed to in dxf_stats_t.
+ */
+typedef enum {
+    dxfPhaseIO, /**< Reading bytes from the file. */
+    dxfPhaseTokenize, /**< Splitting, trimming and validating lines. */
+    dxfPhaseDecode, /**< Converting group codes and dispatching records. */
+    dxfPhaseIndex, /**< Building indexes after the scan. */
+    dxfPhaseCnt /**< Number of phases. */
+} dxf_phase_t;
+
+/**
+ * Named counter.
+ * A count and the time spent, keyed by section or record type name.
+ */
+typedef struct _dxf_stats_named_t {
+    char name[DXF_STATS_NAME_MAX]; /**< Section or record type name */
+    unsigned long long count; /**< Number of occurrences */
+    double seconds; /**< Time spent, sections only */
+} dxf_stats_named_t;
+
+/**
+ * Load statistics.
+ * Filled in by dxf_get_stats() for a loaded drawing.
+ */
+typedef struct _dxf_stats_t {
+    unsigned long long bytes_read; /**< Bytes consumed from the file */
+    unsigned long long line_cnt; /**< Lines read */
+    unsigned long long record_cnt; /**< Group code/value records read */
+    /** Records per group code value type, indexed by dxf_type_t
+    (see DXF_GROUP_TYPE) */
+    unsigned long long type_cnt[DXF_TYPE_CNT];
+    unsigned long long unknown_type_cnt; /**< Records with unmapped codes */
+    /** Group 0 records (entities, objects, table entries) by type */
+    dxf_stats_named_t record_type[DXF_STATS_MAX_RECORD_TYPES];
+    int record_type_cnt; /**< Entries used in record_type */
+    /** Group 0 records whose type did not fit in record_type */
+    unsigned long long record_type_overflow;
+    dxf_stats_named_t section[DXF_STATS_MAX_SECTIONS]; /**< Per section */
+    int section_cnt; /**< Entries used in section */
+    /** Load time per phase, in seconds.  I/O, tokenize and decode are
+    estimated by sampling and scaled to the measured scan time. */
+    double phase_seconds[dxfPhaseCnt];
+    double total_seconds; /**< Wall time of the whole load */
+    unsigned long long bytes_allocated; /**< Bytes requested from heap */
+} dxf_stats_t;
+
+/**
+Record id.
+Records (entities, objects, table entries, blocks, classes) are numbered
+from 0 in file order.
+*/
+typedef uint32_t dxf_record_id_t;
+
+/** Record id that refers to no record. */
+#define DXF_RECORD_NONE ((dxf_record_id_t)0xFFFFFFFF)
+
+/**
+ * Pointer.
+ * A reference from one record to another by handle (groups 330-369 and
+ * 390-399), resolved to a record id while loading.
+ */
+typedef struct _dxf_pointer_t {
+    int group_code; /**< Pointer group code */
+    uint64_t handle; /**< Handle pointed at */
+    dxf_record_id_t target; /**< Record with that handle, or
+        DXF_RECORD_NONE if the drawing has none */
+} dxf_pointer_t;
+
+/**
+ * Record details.
+ * Filled in by dxf_get_record().  Strings are valid until dxf_unload().
+ */
+typedef struct _dxf_record_info_t {
+    const char *type; /**< Group 0 value, e.g. "LINE" */
+    const char *section; /**< Section name, NULL if the section never
+        ended */
+    uint64_t handle; /**< Group 5 (105 for DIMSTYLE), 0 if none */
+    dxf_record_id_t owner; /**< Record of the owner (the 330 pointer outside
+        any 102 group), or DXF_RECORD_NONE */
+    dxf_off_t offset; /**< File offset of the group 0 line */
+    dxf_off_t line; /**< Line number of the group 0 line */
+    size_t pointer_cnt; /**< Number of pointers, see dxf_get_pointers() */
+} dxf_record_info_t;
+
+/** Alignment in bytes of the vertex buffer, see dxf_get_vertices(). */
+#define DXF_VERTEX_ALIGN 64
+
+/**
+ * Path.
+ * A run of connected vertices in a dxf_geometry_t.
+ */
+typedef struct _dxf_path_t {
+    dxf_record_id_t record; /**< Entity the path belongs to; the top level
+        INSERT for geometry expanded from blocks */
+    size_t first; /**< Index of the first vertex */
+    size_t cnt; /**< Number of vertices */
+    int closed; /**< Non-zero if the last vertex connects to the first */
+} dxf_path_t;
+
+/**
+ * Flattened geometry.
+ * Paths of straight segments in world coordinates, packed into one vertex
+ * buffer.  Initialize with dxf_geometry_init(), release with
+ * dxf_geometry_free().
+ */
+typedef struct _dxf_geometry_t {
+    double *vertex; /**< x, y, z of each vertex */
+    size_t vertex_cnt; /**< Vertices used */
+    size_t vertex_cap; /**< Vertices allocated */
+    dxf_path_t *path; /**< Paths */
+    size_t path_cnt; /**< Paths used */
+    size_t path_cap; /**< Paths allocated */
+} dxf_geometry_t;
+
+/**
+ * Endpoint topology.
+ * Connectivity of the LINE, ARC, LWPOLYLINE and POLYLINE entities of the
+ * ENTITIES section: each entity is an edge between the nodes its two ends
+ * snap to.  Graph arrays are in compressed sparse row (CSR) form.
+ * Initialize with dxf_topology_init(), release with dxf_topology_free().
+ */
+typedef struct _dxf_topology_t {
+    double *node; /**< x, y, z of each node, in world coordinates */
+    size_t node_cnt; /**< Number of nodes */
+    dxf_record_id_t *edge_record; /**< Entity of each edge */
+    uint32_t *edge_node; /**< Start and end node of each edge, 2 per edge;
+        both the same for closed polylines */
+    size_t edge_cnt; /**< Number of edges */
+    size_t *adjacency_offset; /**< Edges at node i are adjacency[
+        adjacency_offset[i]] up to adjacency[adjacency_offset[i + 1]] */
+    uint32_t *adjacency; /**< Edge ids; a closed edge is listed twice */
+    uint32_t *component; /**< Connected component of each node */
+    size_t component_cnt; /**< Number of connected components */
+    size_t *chain_offset; /**< Edges of chain i are chain_edge[
+        chain_offset[i]] up to chain_edge[chain_offset[i + 1]] */
+    uint32_t *chain_edge; /**< Edge ids, in walking order */
+    int *chain_closed; /**< Non-zero if chain i ends where it starts */
+    size_t chain_cnt; /**< Number of chains */
+} dxf_topology_t;
+
+/**
+ * Entity query.
+ * Selects entities, in ENTITIES and in block definitions, by type, layer,
+ * color, linetype and block through bitmaps built while loading.
+ * Operands are pushed on a stack and combined in postfix order, e.g. all
+ * TEXT on layers A-ANNO-* with color 7:
+ *
+ * \code
+dxf_query_begin(dxf, &q);
+dxf_query_type(q, "TEXT");
+dxf_query_layer(q, "A-ANNO-*");
+dxf_query_and(q);
+dxf_query_color(q, 7);
+dxf_query_and(q);
+dxf_query_run(q, ids, max, &cnt);
+dxf_query_end(q);
+ * \endcode
+ *
+ * Errors stick: after a failed call every later call but dxf_query_end()
+ * returns the same error.  Valid until dxf_unload().
+ */
+typedef struct _dxf_query_t dxf_query_t;
+
+/**
+ * Dictionary entry.
+ * A name and the object it stands for, see dxf_get_dict_entries().
+ */
+typedef struct _dxf_dict_entry_t {
+    const char *name; /**< Entry name, group 3 */
+    uint64_t handle; /**< Handle of the object, group 350 or 360 */
+    dxf_record_id_t record; /**< Record of the object, DXF_RECORD_NONE if
+        the handle is not in the drawing */
+    int hard; /**< Non-zero if the dictionary owns the object (360) */
+} dxf_dict_entry_t;
+
+/**
+ * Extended data iterator.
+ * Walks the extended data groups (1000 to 1071) of one record.  Loading
+ * only notes where they are in the file; dxf_xdata_begin() reads them
+ * back, and each dxf_xdata_next() decodes one group:
+ *
+ * \code
+dxf_xdata_begin(dxf, id, &x);
+while(dxf_xdata_next(x, &code, &value) == dxfErrorOk) {
+    ...
+}
+dxf_xdata_end(x);
+ * \endcode
+ */
+typedef struct _dxf_xdata_t dxf_xdata_t;
+
+/**
+ * Drawing catalog.
+ * HEADER variables and LAYER table names of many drawings, one column per
+ * variable, in a file written by dxf_catalog_build() and mapped by
+ * dxf_catalog_open().  E.g. every drawing in millimeters defining layer
+ * WALL:
+ *
+ * \code
+dxf_catalog_open("archive.cat", &c);
+dxf_catalog_select(c, "$INSUNITS", "4", "WALL", files, max, &cnt);
+dxf_catalog_close(c);
+ * \endcode
+ */
+typedef struct _dxf_catalog_t dxf_catalog_t;
+
 /* API functions */
 dxf_error_t dxf_load(dxf_handle_t *handle, const char *filename);
+void dxf_load_options_init(dxf_load_options_t *options);
+dxf_error_t dxf_load_ex(dxf_handle_t *handle, const char *filename,
+    const dxf_load_options_t *options);
 dxf_error_t dxf_unload(dxf_handle_t handle);
+dxf_error_t dxf_probe(const char *filename, dxf_info_t *info);
+dxf_error_t dxf_share(const dxf_handle_t handle, int *fd);
+dxf_error_t dxf_attach(dxf_handle_t *handle, int fd);
 dxf_error_t dxf_print(dxf_handle_t handle, FILE *fp);
 
 dxf_error_t dxf_has_var(const dxf_handle_t handle, const char *name);
+dxf_error_t dxf_get_var_cnt(const dxf_handle_t handle, size_t *cnt);
+dxf_error_t dxf_get_var(const dxf_handle_t handle, size_t i,
+    const char **name, const char **value);
+dxf_error_t dxf_get_layer_cnt(const dxf_handle_t handle, size_t *cnt);
+dxf_error_t dxf_get_layer(const dxf_handle_t handle, size_t i,
+    const char **name);
+
+dxf_error_t dxf_parse_handle(const char *s, uint64_t *object);
+dxf_error_t dxf_get_record_cnt(const dxf_handle_t handle, size_t *cnt);
+dxf_error_t dxf_get_record(const dxf_handle_t handle, dxf_record_id_t id,
+    dxf_record_info_t *info);
+dxf_error_t dxf_lookup_handle(const dxf_handle_t handle, uint64_t object,
+    dxf_record_id_t *id);
+dxf_error_t dxf_get_pointers(const dxf_handle_t handle, dxf_record_id_t id,
+    const dxf_pointer_t **pointers, size_t *cnt);
+dxf_error_t dxf_resolve_owner(const dxf_handle_t handle, dxf_record_id_t id,
+    dxf_record_id_t *owner);
+
+dxf_error_t dxf_get_vertices(const dxf_handle_t handle,
+    const double **vertex, size_t *cnt);
+dxf_error_t dxf_copy_vertices(const dxf_handle_t handle, int world,
+    size_t first, size_t cnt, double *vertex);
+dxf_error_t dxf_get_world_vertices(const dxf_handle_t handle,
+    const double **vertex, size_t *cnt);
+dxf_error_t dxf_get_entity_points(const dxf_handle_t handle,
+    dxf_record_id_t id, int world, double p[3], double q[3]);
+dxf_error_t dxf_get_entity_vertices(const dxf_handle_t handle,
+    dxf_record_id_t id, size_t *first, size_t *cnt);
+void dxf_transform_init(double transform[12], const double translate[3],
+    const double scale[3], double rotation);
+void dxf_transform_vertices(const double *vertex, size_t cnt,
+    const double transform[12], double *out);
+void dxf_bbox_vertices(const double *vertex, size_t cnt, double min[3],
+    double max[3]);
+
+void dxf_geometry_init(dxf_geometry_t *geometry);
+void dxf_geometry_free(dxf_geometry_t *geometry);
+dxf_error_t dxf_flatten(const dxf_handle_t handle, dxf_record_id_t id,
+    double tolerance, dxf_geometry_t *geometry);
+dxf_error_t dxf_tessellate(const dxf_handle_t handle, double tolerance,
+    const dxf_geometry_t **geometry);
+dxf_error_t dxf_flatten_block(const dxf_handle_t handle, const char *name,
+    double tolerance, dxf_geometry_t *geometry);
+dxf_error_t dxf_get_insert_transforms(const dxf_handle_t handle,
+    dxf_record_id_t id, double (*transform)[12], size_t max, size_t *cnt);
+
+void dxf_topology_init(dxf_topology_t *topology);
+void dxf_topology_free(dxf_topology_t *topology);
+dxf_error_t dxf_build_topology(const dxf_handle_t handle, double tolerance,
+    dxf_topology_t *topology);
+
+dxf_error_t dxf_text_search(const dxf_handle_t handle, const char *pattern,
+    dxf_record_id_t *ids, size_t max, size_t *cnt);
+dxf_error_t dxf_get_text(const dxf_handle_t handle, dxf_record_id_t id,
+    char *text, size_t size, size_t *len);
+dxf_error_t dxf_decode_string(const dxf_handle_t handle, const char *raw,
+    char *text, size_t size, size_t *len);
+
+dxf_error_t dxf_get_named_object_dict(const dxf_handle_t handle,
+    dxf_record_id_t *id);
+dxf_error_t dxf_get_dict_entries(const dxf_handle_t handle,
+    dxf_record_id_t id, const dxf_dict_entry_t **entries, size_t *cnt);
+dxf_error_t dxf_find_dict_entry(const dxf_handle_t handle, dxf_record_id_t id,
+    const char *name, dxf_record_id_t *entry);
+
+dxf_error_t dxf_xdata_begin(const dxf_handle_t handle, dxf_record_id_t id,
+    dxf_xdata_t **xdata);
+dxf_error_t dxf_xdata_next(dxf_xdata_t *xdata, int *group_code,
+    const char **value);
+dxf_error_t dxf_xdata_raw(const dxf_xdata_t *xdata, const char **bytes,
+    size_t *len);
+void dxf_xdata_end(dxf_xdata_t *xdata);
+
+dxf_error_t dxf_query_begin(const dxf_handle_t handle, dxf_query_t **query);
+dxf_error_t dxf_query_type(dxf_query_t *query, const char *pattern);
+dxf_error_t dxf_query_layer(dxf_query_t *query, const char *pattern);
+dxf_error_t dxf_query_linetype(dxf_query_t *query, const char *pattern);
+dxf_error_t dxf_query_block(dxf_query_t *query, const char *pattern);
+dxf_error_t dxf_query_color(dxf_query_t *query, int color);
+dxf_error_t dxf_query_and(dxf_query_t *query);
+dxf_error_t dxf_query_or(dxf_query_t *query);
+dxf_error_t dxf_query_not(dxf_query_t *query);
+dxf_error_t dxf_query_run(dxf_query_t *query, dxf_record_id_t *ids,
+    size_t max, size_t *cnt);
+void dxf_query_end(dxf_query_t *query);
+
+dxf_error_t dxf_catalog_build(const char *path, const char *const *files,
+    size_t file_cnt, int threads);
+dxf_error_t dxf_catalog_open(const char *path, dxf_catalog_t **catalog);
+void dxf_catalog_close(dxf_catalog_t *catalog);
+size_t dxf_catalog_file_cnt(const dxf_catalog_t *catalog);
+const char *dxf_catalog_file(const dxf_catalog_t *catalog, size_t file);
+const char *dxf_catalog_value(const dxf_catalog_t *catalog, size_t file,
+    const char *var);
+dxf_error_t dxf_catalog_select(const dxf_catalog_t *catalog, const char *var,
+    const char *value, const char *layer, uint32_t *files, size_t max,
+    size_t *cnt);
+
+dxf_error_t dxf_set_trace_sink(FILE *fp);
+
+dxf_error_t dxf_get_stats(const dxf_handle_t handle, dxf_stats_t *stats);
+dxf_error_t dxf_print_stats(const dxf_handle_t handle, FILE *fp);
 
 dxf_error_t dxf_get_last_error(const dxf_handle_t handle,
     dxf_error_detail_t *error);
@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include "dxf_batch.h"
+#include "dxf_block.h"
+#include "dxf_tess.h"
+#include "dxf_trace.h"
+
+/* Work shared by the workers of one build */
+typedef struct _dxf_batch_job_t {
+    dxf_model_t *model; /* Record store */
+    double tolerance; /* Rounded tolerance */
+    dxf_geometry_t *chunk; /* Paths of each chunk of DXF_BATCH_CHUNK */
+    size_t chunk_cnt; /* Number of chunks */
+    size_t *path_cnt; /* Paths of entity i at i + 1, for the prefix sum */
+    pthread_mutex_t lock; /* Guards next and err */
+    size_t next; /* Next chunk to take */
+    dxf_error_t err; /* First failure, dxfErrorOk if none */
+} dxf_batch_job_t;
+
+/* Worker: takes chunks until none are left */
+static void *_dxf_batch_worker(void *arg) {
+    dxf_batch_job_t *job = (dxf_batch_job_t*)arg;
+    dxf_model_t *model = job->model;
+    dxf_vertex_scratch_t scratch;
+    dxf_mat_t identity;
+    size_t k, i, end;
+
+    dxf_trace_begin("chunk", "tessellate", NULL);
+    dxf_mat_identity(identity);
+    dxf_vertex_scratch_init(&scratch);
+    for(;;) {
+        (void)pthread_mutex_lock(&job->lock);
+        k = job->next++;
+        (void)pthread_mutex_unlock(&job->lock);
+        if(k >= job->chunk_cnt) {
+            break;
+        }
+        end = (k + 1) * DXF_BATCH_CHUNK;
+        if(end > model->entity_cnt) {
+            end = model->entity_cnt;
+        }
+        for(i = k * DXF_BATCH_CHUNK; i < end; i++) {
+            const dxf_entity_t *e = &model->entity[i];
+            size_t before = job->chunk[k].path_cnt;
+            if(e->block != DXF_INDEX_NONE) {
+                continue;
+            }
+            if(dxf_block_flatten(model, e, job->tolerance, identity,
+                e->record, &job->chunk[k], 0, &scratch) == 0) {
+                (void)pthread_mutex_lock(&job->lock);
+                if(job->err == dxfErrorOk) {
+                    job->err = (scratch.err != dxfErrorOk) ? scratch.err :
+                        dxfErrorNoMemory;
+                }
+                (void)pthread_mutex_unlock(&job->lock);
+                break;
+            }
+            job->path_cnt[i + 1] = job->chunk[k].path_cnt - before;
+        }
+    }
+    dxf_vertex_scratch_free(&scratch);
+    dxf_trace_end("chunk", "tessellate");
+    return NULL;
+}
+
+/* Packs the chunks into one buffer, in entity order */
+static int _dxf_batch_pack(dxf_batch_job_t *job, dxf_batch_t *b) {
+    dxf_geometry_t *g = &b->geometry;
+    size_t vertex_cnt = 0, path_cnt = 0, k, i;
+
+    for(k = 0; k < job->chunk_cnt; k++) {
+        vertex_cnt += job->chunk[k].vertex_cnt;
+        path_cnt += job->chunk[k].path_cnt;
+    }
+    g->vertex = (double*)malloc((vertex_cnt > 0 ? vertex_cnt : 1) * 3 *
+        sizeof(double));
+    g->path = (dxf_path_t*)malloc((path_cnt > 0 ? path_cnt : 1) *
+        sizeof(dxf_path_t));
+    if((g->vertex == NULL) || (g->path == NULL)) {
+        return 0;
+    }
+    g->vertex_cap = vertex_cnt;
+    g->path_cap = path_cnt;
+    for(k = 0; k < job->chunk_cnt; k++) {
+        const dxf_geometry_t *c = &job->chunk[k];
+        if(c->vertex_cnt > 0) {
+            memcpy(&g->vertex[3 * g->vertex_cnt], c->vertex,
+                3 * c->vertex_cnt * sizeof(double));
+        }
+        for(i = 0; i < c->path_cnt; i++) {
+            g->path[g->path_cnt + i] = c->path[i];
+            g->path[g->path_cnt + i].first += g->vertex_cnt;
+        }
+        g->vertex_cnt += c->vertex_cnt;
+        g->path_cnt += c->path_cnt;
+    }
+
+    /* Path counts to offsets */
+    for(i = 0; i < job->model->entity_cnt; i++) {
+        job->path_cnt[i + 1] += job->path_cnt[i];
+    }
+    b->entity_path = job->path_cnt;
+    job->path_cnt = (size_t*)NULL;
+    return 1;
+}
+
+/* Flattens the drawing with worker threads; NULL on failure, with err */
+static dxf_batch_t *_dxf_batch_build(dxf_model_t *model, double tolerance,
+    int threads, dxf_error_t *err) {
+    pthread_t tid[DXF_BATCH_MAX_THREADS];
+    dxf_batch_job_t job;
+    dxf_batch_t *b;
+    size_t k;
+    int i, ok;
+
+    *err = dxfErrorNoMemory;
+    if((b = (dxf_batch_t*)calloc(1, sizeof(*b))) == NULL) {
+        return (dxf_batch_t*)NULL;
+    }
+    b->tolerance = tolerance;
+    dxf_geometry_init(&b->geometry);
+
+    memset(&job, 0, sizeof(job));
+    job.model = model;
+    job.tolerance = tolerance;
+    job.chunk_cnt = (model->entity_cnt + DXF_BATCH_CHUNK - 1) /
+        DXF_BATCH_CHUNK;
+    job.chunk = (dxf_geometry_t*)calloc(job.chunk_cnt + 1,
+        sizeof(dxf_geometry_t));
+    job.path_cnt = (size_t*)calloc(model->entity_cnt + 1, sizeof(size_t));
+    if((job.chunk == NULL) || (job.path_cnt == NULL)) {
+        free(job.chunk);
+        free(job.path_cnt);
+        free(b);
+        return (dxf_batch_t*)NULL;
+    }
+    (void)pthread_mutex_init(&job.lock, NULL);
+
+    /* One thread per CPU, but no more than there are chunks */
+    if(threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if((size_t)threads > job.chunk_cnt) {
+        threads = (int)job.chunk_cnt;
+    }
+    if(threads > DXF_BATCH_MAX_THREADS) {
+        threads = DXF_BATCH_MAX_THREADS;
+    }
+    if(threads < 1) {
+        threads = 1;
+    }
+
+    /* The calling thread works too */
+    for(i = 1; i < threads; i++) {
+        if(pthread_create(&tid[i], NULL, _dxf_batch_worker, &job) != 0) {
+            /* The others take its share */
+            tid[i] = pthread_self();
+        }
+    }
+    (void)_dxf_batch_worker(&job);
+    for(i = 1; i < threads; i++) {
+        if(pthread_equal(tid[i], pthread_self()) == 0) {
+            (void)pthread_join(tid[i], NULL);
+        }
+    }
+    (void)pthread_mutex_destroy(&job.lock);
+
+    ok = (job.err == dxfErrorOk) && (_dxf_batch_pack(&job, b) != 0);
+    if(job.err != dxfErrorOk) {
+        *err = job.err;
+    }
+    for(k = 0; k < job.chunk_cnt; k++) {
+        dxf_geometry_free(&job.chunk[k]);
+    }
+    free(job.chunk);
+    free(job.path_cnt);
+    if(ok == 0) {
+        dxf_geometry_free(&b->geometry);
+        free(b->entity_path);
+        free(b);
+        return (dxf_batch_t*)NULL;
+    }
+    *err = dxfErrorOk;
+    return b;
+}
+
+/* Cached drawing at a rounded tolerance; the caller holds batch_lock */
+static dxf_batch_t *_dxf_batch_cached(dxf_model_t *model, double tolerance) {
+    dxf_batch_t *b;
+
+    for(b = model->batch; b != NULL; b = b->next) {
+        if(b->tolerance == tolerance) {
+            break;
+        }
+    }
+    return b;
+}
+
+const dxf_batch_t *dxf_batch_get(dxf_model_t *model, double tolerance,
+    int threads, dxf_error_t *err) {
+    dxf_batch_t *b;
+
+    assert(model != NULL);
+    assert(tolerance > 0.0);
+    assert(err != NULL);
+    tolerance = dxf_tess_round_tolerance(tolerance);
+    *err = dxfErrorOk;
+
+    /* Held while building, so concurrent callers share one build */
+    (void)pthread_mutex_lock(&model->batch_lock);
+    if((b = _dxf_batch_cached(model, tolerance)) == NULL) {
+        dxf_trace_begin("flatten", "tessellate", NULL);
+        if((b = _dxf_batch_build(model, tolerance, threads, err)) != NULL) {
+            b->next = model->batch;
+            model->batch = b;
+        }
+        dxf_trace_end("flatten", "tessellate");
+    }
+    (void)pthread_mutex_unlock(&model->batch_lock);
+    return b;
+}
+
+const dxf_batch_t *dxf_batch_find(dxf_model_t *model, double tolerance) {
+    dxf_batch_t *b;
+
+    assert(model != NULL);
+    (void)pthread_mutex_lock(&model->batch_lock);
+    b = _dxf_batch_cached(model, dxf_tess_round_tolerance(tolerance));
+    (void)pthread_mutex_unlock(&model->batch_lock);
+    return b;
+}
+
+void dxf_batch_free_caches(dxf_model_t *model) {
+    dxf_batch_t *b;
+
+    assert(model != NULL);
+    while((b = model->batch) != NULL) {
+        model->batch = b->next;
+        dxf_geometry_free(&b->geometry);
+        free(b->entity_path);
+        free(b);
+    }
+}
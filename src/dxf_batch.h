@@ -0,0 +1,59 @@
+/** @file dxf_batch.h
+ *  @brief Drawing-wide tessellation.
+ *
+ * Internal parallel flattening of every entity of the ENTITIES section into
+ * one packed buffer, cached in the record store per tolerance.
+ */
+#ifndef _DXF_BATCH_H_
+#define _DXF_BATCH_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* Entities a worker takes at a time */
+#define DXF_BATCH_CHUNK 256
+
+/* Upper bound on worker threads */
+#define DXF_BATCH_MAX_THREADS 64
+
+/* The flattened drawing at one tolerance */
+typedef struct _dxf_batch_t {
+    double tolerance; /* Power of two the drawing was flattened to */
+    dxf_geometry_t geometry; /* Paths of every entity, in file order */
+    size_t *entity_path; /* Paths of entity i are entity_path[i] up to
+        entity_path[i + 1]; none for entities of block definitions */
+    struct _dxf_batch_t *next;
+} dxf_batch_t;
+
+/**
+Gets the drawing flattened to a tolerance, building and caching it on
+first use.  Entities are split into chunks flattened by worker threads.
+Safe to call from several threads.
+
+@param  model   Record store.
+@param  tolerance   Chordal tolerance in world coordinates, rounded down to
+    a power of two.
+@param  threads Number of worker threads, 0 for one per online CPU.
+@param  err On failure, contains the error code.
+@returns The flattened drawing, NULL on failure.
+*/
+const dxf_batch_t *dxf_batch_get(dxf_model_t *model, double tolerance,
+    int threads, dxf_error_t *err);
+
+/**
+Gets the drawing flattened to a tolerance if it is cached.
+
+@param  model   Record store.
+@param  tolerance   Chordal tolerance, rounded as by dxf_batch_get().
+@returns The flattened drawing, NULL if not cached.
+*/
+const dxf_batch_t *dxf_batch_find(dxf_model_t *model, double tolerance);
+
+/**
+Frees every cached drawing.
+
+@param  model   Record store.
+*/
+void dxf_batch_free_caches(dxf_model_t *model);
+
+#endif
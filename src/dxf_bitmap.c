@@ -0,0 +1,374 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "dxf_bitmap.h"
+
+/* Bits set in a word */
+static uint32_t _dxf_bitmap_popcount(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (uint32_t)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static void _dxf_bitmap_container_free(dxf_bitmap_container_t *c) {
+    free(c->array);
+    free(c->words);
+}
+
+void dxf_bitmap_init(dxf_bitmap_t *b) {
+    assert(b != NULL);
+    memset(b, 0, sizeof(*b));
+}
+
+void dxf_bitmap_free(dxf_bitmap_t *b) {
+    size_t i;
+
+    assert(b != NULL);
+    for(i = 0; i < b->cnt; i++) {
+        _dxf_bitmap_container_free(&b->container[i]);
+    }
+    free(b->container);
+    dxf_bitmap_init(b);
+}
+
+/* Appends an empty container */
+static dxf_bitmap_container_t *_dxf_bitmap_add_container(dxf_bitmap_t *b,
+    uint32_t key) {
+    dxf_bitmap_container_t *c;
+
+    if(b->cnt == b->cap) {
+        size_t cap = (b->cap == 0) ? 4 : 2 * b->cap;
+        if((c = (dxf_bitmap_container_t*)realloc(b->container, cap *
+            sizeof(*c))) == NULL) {
+            return (dxf_bitmap_container_t*)NULL;
+        }
+        b->container = c;
+        b->cap = cap;
+    }
+    c = &b->container[b->cnt++];
+    memset(c, 0, sizeof(*c));
+    c->key = key;
+    return c;
+}
+
+/* Turns an array container into a bitmap one */
+static int _dxf_bitmap_to_words(dxf_bitmap_container_t *c) {
+    uint32_t i;
+
+    if((c->words = (uint64_t*)calloc(DXF_BITMAP_WORDS, sizeof(uint64_t))) ==
+        NULL) {
+        return 0;
+    }
+    for(i = 0; i < c->cnt; i++) {
+        c->words[c->array[i] >> 6] |= (uint64_t)1 << (c->array[i] & 63);
+    }
+    free(c->array);
+    c->array = (uint16_t*)NULL;
+    c->cap = 0;
+    return 1;
+}
+
+int dxf_bitmap_append(dxf_bitmap_t *b, uint32_t id) {
+    uint32_t key = id >> 16;
+    uint16_t low = (uint16_t)(id & 0xFFFF);
+    dxf_bitmap_container_t *c;
+
+    assert(b != NULL);
+    c = (b->cnt > 0) ? &b->container[b->cnt - 1] :
+        (dxf_bitmap_container_t*)NULL;
+    assert((c == NULL) || (c->key <= key));
+    if((c == NULL) || (c->key != key)) {
+        if((c = _dxf_bitmap_add_container(b, key)) == NULL) {
+            return 0;
+        }
+    }
+    if(c->words != NULL) {
+        c->words[low >> 6] |= (uint64_t)1 << (low & 63);
+        c->cnt++;
+        return 1;
+    }
+    assert((c->cnt == 0) || (c->array[c->cnt - 1] < low));
+    if(c->cnt == DXF_BITMAP_ARRAY_MAX) {
+        if(_dxf_bitmap_to_words(c) == 0) {
+            return 0;
+        }
+        c->words[low >> 6] |= (uint64_t)1 << (low & 63);
+        c->cnt++;
+        return 1;
+    }
+    if(c->cnt == c->cap) {
+        uint32_t cap = (c->cap == 0) ? 16 : 2 * c->cap;
+        uint16_t *a;
+        if(cap > DXF_BITMAP_ARRAY_MAX) {
+            cap = DXF_BITMAP_ARRAY_MAX;
+        }
+        if((a = (uint16_t*)realloc(c->array, cap * sizeof(uint16_t))) ==
+            NULL) {
+            return 0;
+        }
+        c->array = a;
+        c->cap = cap;
+    }
+    c->array[c->cnt++] = low;
+    return 1;
+}
+
+/* Expands a container into words */
+static void _dxf_bitmap_words(const dxf_bitmap_container_t *c,
+    uint64_t *words) {
+    uint32_t i;
+
+    if(c->words != NULL) {
+        memcpy(words, c->words, DXF_BITMAP_WORDS * sizeof(uint64_t));
+        return;
+    }
+    memset(words, 0, DXF_BITMAP_WORDS * sizeof(uint64_t));
+    for(i = 0; i < c->cnt; i++) {
+        words[c->array[i] >> 6] |= (uint64_t)1 << (c->array[i] & 63);
+    }
+}
+
+/* Stores cnt sorted values as a container, as an array while sparse */
+static int _dxf_bitmap_store_array(dxf_bitmap_t *out, uint32_t key,
+    const uint16_t *v, uint32_t cnt) {
+    dxf_bitmap_container_t *c;
+
+    if(cnt == 0) {
+        return 1;
+    }
+    if((c = _dxf_bitmap_add_container(out, key)) == NULL) {
+        return 0;
+    }
+    if((c->array = (uint16_t*)malloc(cnt * sizeof(uint16_t))) == NULL) {
+        out->cnt--;
+        return 0;
+    }
+    memcpy(c->array, v, cnt * sizeof(uint16_t));
+    c->cnt = c->cap = cnt;
+    return (cnt <= DXF_BITMAP_ARRAY_MAX) || (_dxf_bitmap_to_words(c) != 0);
+}
+
+/* Stores words as a container, as an array if sparse enough */
+static int _dxf_bitmap_store_words(dxf_bitmap_t *out, uint32_t key,
+    const uint64_t *words) {
+    uint16_t v[DXF_BITMAP_ARRAY_MAX];
+    dxf_bitmap_container_t *c;
+    uint32_t cnt = 0, i;
+
+    for(i = 0; i < DXF_BITMAP_WORDS; i++) {
+        cnt += _dxf_bitmap_popcount(words[i]);
+    }
+    if(cnt <= DXF_BITMAP_ARRAY_MAX) {
+        uint32_t n = 0;
+        for(i = 0; i < DXF_BITMAP_WORDS; i++) {
+            uint64_t w = words[i];
+            while(w != 0) {
+                uint64_t low = w & (~w + 1);
+                v[n++] = (uint16_t)(64 * i + _dxf_bitmap_popcount(low - 1));
+                w ^= low;
+            }
+        }
+        return _dxf_bitmap_store_array(out, key, v, cnt);
+    }
+    if((c = _dxf_bitmap_add_container(out, key)) == NULL) {
+        return 0;
+    }
+    if((c->words = (uint64_t*)malloc(DXF_BITMAP_WORDS *
+        sizeof(uint64_t))) == NULL) {
+        out->cnt--;
+        return 0;
+    }
+    memcpy(c->words, words, DXF_BITMAP_WORDS * sizeof(uint64_t));
+    c->cnt = cnt;
+    return 1;
+}
+
+/* Combines two array containers by merging them */
+static int _dxf_bitmap_merge(const dxf_bitmap_container_t *a,
+    const dxf_bitmap_container_t *b, dxf_bitmap_op_t op,
+    dxf_bitmap_t *out) {
+    uint16_t v[2 * DXF_BITMAP_ARRAY_MAX];
+    uint32_t i = 0, j = 0, n = 0;
+
+    while((i < a->cnt) && (j < b->cnt)) {
+        if(a->array[i] < b->array[j]) {
+            if(op != dxfBitmapAnd) {
+                v[n++] = a->array[i];
+            }
+            i++;
+        } else if(a->array[i] > b->array[j]) {
+            if(op == dxfBitmapOr) {
+                v[n++] = b->array[j];
+            }
+            j++;
+        } else {
+            if(op != dxfBitmapAndNot) {
+                v[n++] = a->array[i];
+            }
+            i++;
+            j++;
+        }
+    }
+    for(; (op != dxfBitmapAnd) && (i < a->cnt); i++) {
+        v[n++] = a->array[i];
+    }
+    for(; (op == dxfBitmapOr) && (j < b->cnt); j++) {
+        v[n++] = b->array[j];
+    }
+    return _dxf_bitmap_store_array(out, a->key, v, n);
+}
+
+/*
+Keeps the ids of an array container that are set (or, with set 0, clear)
+in a bitmap container with the same key.
+*/
+static int _dxf_bitmap_probe(const dxf_bitmap_container_t *a,
+    const dxf_bitmap_container_t *b, int set, dxf_bitmap_t *out) {
+    uint16_t v[DXF_BITMAP_ARRAY_MAX];
+    uint32_t i, n = 0;
+
+    for(i = 0; i < a->cnt; i++) {
+        if((int)((b->words[a->array[i] >> 6] >> (a->array[i] & 63)) & 1) ==
+            set) {
+            v[n++] = a->array[i];
+        }
+    }
+    return _dxf_bitmap_store_array(out, a->key, v, n);
+}
+
+/* Combines two containers with the same key */
+static int _dxf_bitmap_combine(const dxf_bitmap_container_t *a,
+    const dxf_bitmap_container_t *b, dxf_bitmap_op_t op,
+    dxf_bitmap_t *out) {
+    uint64_t wa[DXF_BITMAP_WORDS], wb[DXF_BITMAP_WORDS];
+    uint32_t i;
+
+    if((a->array != NULL) && (b->array != NULL)) {
+        return _dxf_bitmap_merge(a, b, op, out);
+    }
+
+    /* Probing a sparse array against a bitmap beats expanding it */
+    if((op != dxfBitmapOr) && (a->array != NULL)) {
+        return _dxf_bitmap_probe(a, b, (op == dxfBitmapAnd), out);
+    }
+    if((op == dxfBitmapAnd) && (b->array != NULL)) {
+        return _dxf_bitmap_probe(b, a, 1, out);
+    }
+
+    _dxf_bitmap_words(a, wa);
+    _dxf_bitmap_words(b, wb);
+    switch(op) {
+        case dxfBitmapAnd:
+            for(i = 0; i < DXF_BITMAP_WORDS; i++) {
+                wa[i] &= wb[i];
+            }
+            break;
+        case dxfBitmapOr:
+            for(i = 0; i < DXF_BITMAP_WORDS; i++) {
+                wa[i] |= wb[i];
+            }
+            break;
+        case dxfBitmapAndNot:
+            for(i = 0; i < DXF_BITMAP_WORDS; i++) {
+                wa[i] &= ~wb[i];
+            }
+            break;
+    }
+    return _dxf_bitmap_store_words(out, a->key, wa);
+}
+
+/* Copies a container */
+static int _dxf_bitmap_copy(const dxf_bitmap_container_t *c,
+    dxf_bitmap_t *out) {
+    return (c->array != NULL) ?
+        _dxf_bitmap_store_array(out, c->key, c->array, c->cnt) :
+        _dxf_bitmap_store_words(out, c->key, c->words);
+}
+
+int dxf_bitmap_op(const dxf_bitmap_t *a, const dxf_bitmap_t *b,
+    dxf_bitmap_op_t op, dxf_bitmap_t *out) {
+    size_t i = 0, j = 0;
+    int ok = 1;
+
+    assert((a != NULL) && (b != NULL) && (out != NULL));
+    assert((out != a) && (out != b));
+    dxf_bitmap_free(out);
+    while((ok != 0) && (i < a->cnt) && (j < b->cnt)) {
+        const dxf_bitmap_container_t *ca = &a->container[i];
+        const dxf_bitmap_container_t *cb = &b->container[j];
+        if(ca->key < cb->key) {
+            ok = (op == dxfBitmapAnd) || (_dxf_bitmap_copy(ca, out) != 0);
+            i++;
+        } else if(ca->key > cb->key) {
+            ok = (op != dxfBitmapOr) || (_dxf_bitmap_copy(cb, out) != 0);
+            j++;
+        } else {
+            ok = _dxf_bitmap_combine(ca, cb, op, out);
+            i++;
+            j++;
+        }
+    }
+    for(; (ok != 0) && (op != dxfBitmapAnd) && (i < a->cnt); i++) {
+        ok = _dxf_bitmap_copy(&a->container[i], out);
+    }
+    for(; (ok != 0) && (op == dxfBitmapOr) && (j < b->cnt); j++) {
+        ok = _dxf_bitmap_copy(&b->container[j], out);
+    }
+    return ok;
+}
+
+size_t dxf_bitmap_cnt(const dxf_bitmap_t *b) {
+    size_t cnt = 0, i;
+
+    assert(b != NULL);
+    for(i = 0; i < b->cnt; i++) {
+        cnt += b->container[i].cnt;
+    }
+    return cnt;
+}
+
+size_t dxf_bitmap_ids(const dxf_bitmap_t *b, uint32_t *ids, size_t max) {
+    size_t n = 0, i;
+    uint32_t j;
+
+    assert(b != NULL);
+    for(i = 0; i < b->cnt; i++) {
+        const dxf_bitmap_container_t *c = &b->container[i];
+        uint32_t high = c->key << 16;
+        if(n + c->cnt <= max) {
+            if(c->array != NULL) {
+                for(j = 0; j < c->cnt; j++) {
+                    ids[n + j] = high | c->array[j];
+                }
+            } else {
+                size_t k = n;
+                for(j = 0; j < DXF_BITMAP_WORDS; j++) {
+                    uint64_t w = c->words[j];
+                    while(w != 0) {
+                        uint64_t low = w & (~w + 1);
+                        ids[k++] = high | (64 * j +
+                            _dxf_bitmap_popcount(low - 1));
+                        w ^= low;
+                    }
+                }
+            }
+        } else if(n < max) {
+            /* Partly fits, take it id by id */
+            if(c->array != NULL) {
+                for(j = 0; (j < c->cnt) && (n + j < max); j++) {
+                    ids[n + j] = high | c->array[j];
+                }
+            } else {
+                size_t k = n;
+                for(j = 0; (j < 65536) && (k < max); j++) {
+                    if(((c->words[j >> 6] >> (j & 63)) & 1) != 0) {
+                        ids[k++] = high | j;
+                    }
+                }
+            }
+        }
+        n += c->cnt;
+    }
+    return n;
+}
@@ -0,0 +1,87 @@
+/** @file dxf_bitmap.h
+ *  @brief Compressed id sets.
+ *
+ * Internal Roaring-style bitmaps of 32-bit ids: ids are grouped by their
+ * high 16 bits into containers that hold either a sorted array of the low
+ * 16 bits, while sparse, or a 65536-bit bitmap once dense.
+ */
+#ifndef _DXF_BITMAP_H_
+#define _DXF_BITMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Containers with more ids than this are bitmaps */
+#define DXF_BITMAP_ARRAY_MAX 4096
+
+/* 64-bit words of a bitmap container */
+#define DXF_BITMAP_WORDS 1024
+
+/* Ids sharing their high 16 bits */
+typedef struct _dxf_bitmap_container_t {
+    uint32_t key; /* High 16 bits of the ids */
+    uint32_t cnt; /* Ids held */
+    uint32_t cap; /* Capacity of array */
+    uint16_t *array; /* Sorted low 16 bits, NULL for a bitmap container */
+    uint64_t *words; /* DXF_BITMAP_WORDS words, NULL for an array one */
+} dxf_bitmap_container_t;
+
+/* Set of ids, containers in key order */
+typedef struct _dxf_bitmap_t {
+    dxf_bitmap_container_t *container;
+    size_t cnt; /* Containers used */
+    size_t cap; /* Containers allocated */
+} dxf_bitmap_t;
+
+/* Set operations */
+typedef enum { dxfBitmapAnd, dxfBitmapOr, dxfBitmapAndNot }
+    dxf_bitmap_op_t;
+
+/**
+Initializes an empty bitmap.
+*/
+void dxf_bitmap_init(dxf_bitmap_t *b);
+
+/**
+Frees a bitmap, leaving it empty.
+*/
+void dxf_bitmap_free(dxf_bitmap_t *b);
+
+/**
+Adds an id greater than every id the bitmap holds.
+
+@param  b   Bitmap.
+@param  id  Id.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_bitmap_append(dxf_bitmap_t *b, uint32_t id);
+
+/**
+Combines two bitmaps.
+
+@param  a   First operand.
+@param  b   Second operand.
+@param  op  a AND b, a OR b, or a AND NOT b.
+@param  out Initialized bitmap receiving the result, replacing its
+    contents; may not be a or b.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_bitmap_op(const dxf_bitmap_t *a, const dxf_bitmap_t *b,
+    dxf_bitmap_op_t op, dxf_bitmap_t *out);
+
+/**
+Number of ids in a bitmap.
+*/
+size_t dxf_bitmap_cnt(const dxf_bitmap_t *b);
+
+/**
+Copies the ids of a bitmap in increasing order.
+
+@param  b   Bitmap.
+@param  ids Array of at least max ids, may be NULL if max is 0.
+@param  max Size of ids.
+@returns Number of ids in the bitmap, which may exceed max.
+*/
+size_t dxf_bitmap_ids(const dxf_bitmap_t *b, uint32_t *ids, size_t max);
+
+#endif
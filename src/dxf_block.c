@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "dxf_block.h"
+
+/* One flattened definition of a block */
+typedef struct _dxf_block_cache_t {
+    double tolerance; /* Power of two the definition was flattened to */
+    int depth; /* Depth it was built at if DXF_BLOCK_MAX_DEPTH cut it short,
+        -1 if complete and so valid at any depth */
+    dxf_geometry_t geometry; /* Paths in block coordinates */
+    struct _dxf_block_cache_t *next;
+} dxf_block_cache_t;
+
+/* Number of MINSERT columns or rows, 0 and 1 both mean one */
+#define DXF_BLOCK_CELLS(n) (((n) > 1) ? (size_t)(n) : 1)
+
+/* Transform of one MINSERT cell: block coordinates to world */
+static void _dxf_block_cell(const dxf_entity_t *e, const dxf_mat_t m,
+    size_t col, size_t row, dxf_mat_t out) {
+    double a = e->s[DXF_S_50] * M_PI / 180.0;
+    double ca = cos(a), sa = sin(a);
+    double sx = e->s[DXF_S_41], sy = e->s[DXF_S_42], sz = e->s[DXF_S_43];
+    double ox = (double)col * e->s[DXF_S_44];
+    double oy = (double)row * e->s[DXF_S_45];
+    dxf_mat_t local, ocs, tmp;
+
+    /* T(p) * Rz(a) * T(offset) * S, the base point is applied by caller */
+    dxf_mat_identity(local);
+    local[0] = ca * sx;
+    local[1] = -sa * sy;
+    local[4] = sa * sx;
+    local[5] = ca * sy;
+    local[10] = sz;
+    local[3] = e->p[0] + ca * ox - sa * oy;
+    local[7] = e->p[1] + sa * ox + ca * oy;
+    local[11] = e->p[2];
+    if(dxf_mat_ocs(e->n, ocs) != 0) {
+        dxf_mat_mul(ocs, local, tmp);
+        dxf_mat_mul(m, tmp, out);
+    } else {
+        dxf_mat_mul(m, local, out);
+    }
+}
+
+/* Full transform of a cell, including the block base point */
+static void _dxf_block_cell_base(const dxf_model_t *model,
+    const dxf_entity_t *e, const dxf_mat_t m, size_t col, size_t row,
+    dxf_mat_t out) {
+    const double *base = model->block[e->name].base;
+    dxf_mat_t cell, shift;
+
+    _dxf_block_cell(e, m, col, row, cell);
+    dxf_mat_identity(shift);
+    shift[3] = -base[0];
+    shift[7] = -base[1];
+    shift[11] = -base[2];
+    dxf_mat_mul(cell, shift, out);
+}
+
+size_t dxf_block_insert_transforms(const dxf_model_t *model,
+    const dxf_entity_t *e, const dxf_mat_t m, dxf_mat_t *cell, size_t max) {
+    size_t cols = DXF_BLOCK_CELLS(e->i70), rows = DXF_BLOCK_CELLS(e->i71);
+    size_t r, c, i = 0;
+
+    assert(e->kind == dxfKindInsert);
+    if(e->name == DXF_INDEX_NONE) {
+        return 0;
+    }
+    for(r = 0; r < rows; r++) {
+        for(c = 0; c < cols; c++, i++) {
+            if((cell != NULL) && (i < max)) {
+                _dxf_block_cell_base(model, e, m, c, r, cell[i]);
+            }
+        }
+    }
+    return i;
+}
+
+/* First of a cache list usable at a tolerance and depth, NULL if none;
+   called locked */
+static dxf_block_cache_t *_dxf_block_match(dxf_block_cache_t *c,
+    double tolerance, int depth) {
+    for(; c != NULL; c = c->next) {
+        if((c->tolerance == tolerance) &&
+            ((c->depth < 0) || (c->depth == depth))) {
+            break;
+        }
+    }
+    return c;
+}
+
+static int _dxf_block_flatten(dxf_model_t *model, const dxf_entity_t *e,
+    double tolerance, const dxf_mat_t m, dxf_record_id_t record,
+    dxf_geometry_t *g, int depth, dxf_vertex_scratch_t *scratch,
+    int *truncated);
+
+/* Definition of a block at a rounded tolerance, built and cached on first
+   use; NULL on failure */
+static const dxf_block_cache_t *_dxf_block_definition(dxf_model_t *model,
+    uint32_t block, double tolerance, int depth,
+    dxf_vertex_scratch_t *scratch) {
+    dxf_block_t *b = &model->block[block];
+    dxf_block_cache_t *c, *other;
+    dxf_mat_t identity;
+    uint32_t i;
+    int truncated = 0;
+
+    (void)pthread_mutex_lock(&model->lock);
+    c = _dxf_block_match(b->cache, tolerance, depth);
+    (void)pthread_mutex_unlock(&model->lock);
+    if(c != NULL) {
+        return c;
+    }
+
+    /* Built unlocked, nested definitions lock for themselves */
+    if((c = (dxf_block_cache_t*)calloc(1, sizeof(*c))) == NULL) {
+        return (const dxf_block_cache_t*)NULL;
+    }
+    c->tolerance = tolerance;
+    dxf_geometry_init(&c->geometry);
+    dxf_mat_identity(identity);
+    for(i = b->first; i < b->first + b->cnt; i++) {
+        const dxf_entity_t *e = &model->entity[i];
+        if(_dxf_block_flatten(model, e, tolerance, identity, e->record,
+            &c->geometry, depth, scratch, &truncated) == 0) {
+            dxf_geometry_free(&c->geometry);
+            free(c);
+            return (const dxf_block_cache_t*)NULL;
+        }
+    }
+    c->depth = (truncated != 0) ? depth : -1;
+
+    /* Another thread may have built the same one meanwhile */
+    (void)pthread_mutex_lock(&model->lock);
+    other = _dxf_block_match(b->cache, tolerance, depth);
+    if(other == NULL) {
+        c->next = b->cache;
+        b->cache = c;
+    }
+    (void)pthread_mutex_unlock(&model->lock);
+    if(other != NULL) {
+        dxf_geometry_free(&c->geometry);
+        free(c);
+        c = other;
+    }
+    return c;
+}
+
+const dxf_geometry_t *dxf_block_definition(dxf_model_t *model,
+    uint32_t block, double tolerance, int depth,
+    dxf_vertex_scratch_t *scratch) {
+    const dxf_block_cache_t *c;
+
+    if((c = _dxf_block_definition(model, block,
+        dxf_tess_round_tolerance(tolerance), depth, scratch)) == NULL) {
+        return (const dxf_geometry_t*)NULL;
+    }
+    return &c->geometry;
+}
+
+/* dxf_block_flatten(), setting truncated if DXF_BLOCK_MAX_DEPTH cut any
+   nested definition short */
+static int _dxf_block_flatten(dxf_model_t *model, const dxf_entity_t *e,
+    double tolerance, const dxf_mat_t m, dxf_record_id_t record,
+    dxf_geometry_t *g, int depth, dxf_vertex_scratch_t *scratch,
+    int *truncated) {
+    const dxf_block_cache_t *def;
+    size_t cols, rows, r, c;
+    dxf_mat_t cell;
+    double scale;
+
+    if(e->kind != dxfKindInsert) {
+        scale = dxf_mat_scale(m);
+        return dxf_tess_entity(model, e, (scale > 0.0) ? tolerance / scale :
+            tolerance, m, record, g, scratch);
+    }
+
+    /* Unknown or undefined block, or a reference cycle */
+    if((e->name == DXF_INDEX_NONE) ||
+        (model->block[e->name].record == DXF_RECORD_NONE)) {
+        return 1;
+    }
+    if(depth >= DXF_BLOCK_MAX_DEPTH) {
+        *truncated = 1;
+        return 1;
+    }
+
+    /* Every cell has the same scale, so they share one definition */
+    _dxf_block_cell_base(model, e, m, 0, 0, cell);
+    if((scale = dxf_mat_scale(cell)) == 0.0) {
+        return 1;
+    }
+    if((def = _dxf_block_definition(model, e->name,
+        dxf_tess_round_tolerance(tolerance / scale), depth + 1, scratch)) ==
+        NULL) {
+        return 0;
+    }
+    if(def->depth >= 0) {
+        *truncated = 1;
+    }
+    cols = DXF_BLOCK_CELLS(e->i70);
+    rows = DXF_BLOCK_CELLS(e->i71);
+    for(r = 0; r < rows; r++) {
+        for(c = 0; c < cols; c++) {
+            if((r > 0) || (c > 0)) {
+                _dxf_block_cell_base(model, e, m, c, r, cell);
+            }
+            if(dxf_geometry_append(g, &def->geometry, cell, record) == 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int dxf_block_flatten(dxf_model_t *model, const dxf_entity_t *e,
+    double tolerance, const dxf_mat_t m, dxf_record_id_t record,
+    dxf_geometry_t *g, int depth, dxf_vertex_scratch_t *scratch) {
+    int truncated = 0;
+
+    return _dxf_block_flatten(model, e, tolerance, m, record, g, depth,
+        scratch, &truncated);
+}
+
+void dxf_block_free_caches(dxf_model_t *model) {
+    size_t i;
+
+    assert(model != NULL);
+    for(i = 0; i < model->block_cap; i++) {
+        dxf_block_cache_t *c = model->block[i].cache;
+        while(c != NULL) {
+            dxf_block_cache_t *next = c->next;
+            dxf_geometry_free(&c->geometry);
+            free(c);
+            c = next;
+        }
+        model->block[i].cache = (struct _dxf_block_cache_t*)NULL;
+    }
+}
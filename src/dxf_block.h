@@ -0,0 +1,77 @@
+/** @file dxf_block.h
+ *  @brief Block instancing.
+ *
+ * Internal expansion of INSERT entities (nested inserts, MINSERT arrays)
+ * into world space, through a cache of flattened block definitions that
+ * every insert of a block shares.
+ */
+#ifndef _DXF_BLOCK_H_
+#define _DXF_BLOCK_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+#include "dxf_tess.h"
+
+/* Nesting deeper than this is treated as a reference cycle */
+#define DXF_BLOCK_MAX_DEPTH 16
+
+/**
+Gets the flattened definition of a block, in block coordinates, building
+and caching it on first use.  A definition cut short by
+DXF_BLOCK_MAX_DEPTH is only reused at the depth it was built at, so a
+shallower insert of the same block gets its full nesting.  Safe to call
+from several threads; cached definitions stay valid until the store is
+freed.
+
+@param  model   Record store.
+@param  block   Block id.
+@param  tolerance   Chordal tolerance in block coordinates; rounded down to
+    a power of two so nearby tolerances share one definition.
+@param  depth   Nesting depth of the block.
+@param  scratch Scratch for vertices not held in memory.
+@returns The definition, NULL on failure, see dxf_tess_entity().
+*/
+const dxf_geometry_t *dxf_block_definition(dxf_model_t *model,
+    uint32_t block, double tolerance, int depth,
+    dxf_vertex_scratch_t *scratch);
+
+/**
+Computes the block to world transforms of an INSERT, one per MINSERT
+cell, row by row.
+
+@param  model   Record store.
+@param  e   INSERT entity.
+@param  m   Transform applied after the insert's own.
+@param  cell    Array of at least max transforms, or NULL to count.
+@param  max Size of cell.
+@returns Number of cells (columns * rows).
+*/
+size_t dxf_block_insert_transforms(const dxf_model_t *model,
+    const dxf_entity_t *e, const dxf_mat_t m, dxf_mat_t *cell, size_t max);
+
+/**
+Flattens an entity, expanding INSERTs through the block cache.
+Safe to call from several threads.
+
+@param  model   Record store.
+@param  e   Entity.
+@param  tolerance   Chordal tolerance in world coordinates.
+@param  m   Transform from the entity's coordinates to world.
+@param  record  Record the paths are attributed to.
+@param  g   Geometry the paths are appended to.
+@param  depth   Nesting depth of the entity.
+@param  scratch Scratch for vertices not held in memory.
+@returns 1 on success, 0 on failure, see dxf_tess_entity().
+*/
+int dxf_block_flatten(dxf_model_t *model, const dxf_entity_t *e,
+    double tolerance, const dxf_mat_t m, dxf_record_id_t record,
+    dxf_geometry_t *g, int depth, dxf_vertex_scratch_t *scratch);
+
+/**
+Frees every cached definition.
+
+@param  model   Record store.
+*/
+void dxf_block_free_caches(dxf_model_t *model);
+
+#endif
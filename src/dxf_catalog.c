@@ -0,0 +1,687 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dxf_catalog.h"
+#include "dxf_index.h"
+#include "dxf_trace.h"
+
+/* Rounds a file offset up to 8 bytes */
+#define DXF_CATALOG_ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+
+/* HEADER variables and layers of one drawing */
+typedef struct _dxf_catalog_scan_t {
+    char *buf; /* Variable names and values, then layer names, each
+        NULL-terminated */
+    size_t var_cnt; /* Name and value pairs in buf */
+    size_t layer_cnt; /* Layer names in buf, after the variables */
+} dxf_catalog_scan_t;
+
+/* Work shared by the workers of one build */
+typedef struct _dxf_catalog_job_t {
+    const char *const *files; /* Drawings */
+    size_t file_cnt;
+    dxf_catalog_scan_t *scan; /* One per drawing */
+    pthread_mutex_t lock; /* Guards next and failed */
+    size_t next; /* Next drawing to take */
+    int failed; /* Non-zero if an allocation failed */
+} dxf_catalog_job_t;
+
+/* A mapped catalog */
+struct _dxf_catalog_t {
+    void *map; /* Mapping of the whole file */
+    size_t size; /* Bytes mapped */
+    const dxf_catalog_header_t *h; /* Header, at the start of map */
+    const uint32_t *file; /* Arrays of the header, in place */
+    const uint32_t *column;
+    const uint32_t *value;
+    const uint32_t *layer;
+    const uint32_t *member_first;
+    const uint32_t *member;
+    const uint64_t *string;
+    const char *chars;
+};
+
+/* Copies what the catalog keeps of a loaded drawing; 0 if allocation
+   failed */
+static int _dxf_catalog_copy(dxf_handle_t dxf, dxf_catalog_scan_t *scan) {
+    const char *name, *value;
+    size_t len = 0, i, n;
+    char *p;
+
+    (void)dxf_get_var_cnt(dxf, &scan->var_cnt);
+    (void)dxf_get_layer_cnt(dxf, &scan->layer_cnt);
+    for(i = 0; i < scan->var_cnt; i++) {
+        (void)dxf_get_var(dxf, i, &name, &value);
+        len += strlen(name) + strlen(value) + 2;
+    }
+    for(i = 0; i < scan->layer_cnt; i++) {
+        (void)dxf_get_layer(dxf, i, &name);
+        len += strlen(name) + 1;
+    }
+    if((p = scan->buf = (char*)malloc(len + 1)) == NULL) {
+        return 0;
+    }
+    for(i = 0; i < scan->var_cnt; i++) {
+        (void)dxf_get_var(dxf, i, &name, &value);
+        memcpy(p, name, n = strlen(name) + 1);
+        p += n;
+        memcpy(p, value, n = strlen(value) + 1);
+        p += n;
+    }
+    for(i = 0; i < scan->layer_cnt; i++) {
+        (void)dxf_get_layer(dxf, i, &name);
+        memcpy(p, name, n = strlen(name) + 1);
+        p += n;
+    }
+    return 1;
+}
+
+/* Worker: loads drawings up to the end of TABLES until none are left */
+static void *_dxf_catalog_worker(void *arg) {
+    dxf_catalog_job_t *job = (dxf_catalog_job_t*)arg;
+    dxf_load_options_t options;
+    dxf_handle_t dxf;
+    size_t k;
+    int failed;
+
+    dxf_load_options_init(&options);
+    options.validate = dxfValidateFast;
+    options.threads = 1;
+    options.last_section = DXF_CATALOG_LAST_SECTION;
+    for(;;) {
+        (void)pthread_mutex_lock(&job->lock);
+        k = job->next++;
+        failed = job->failed;
+        (void)pthread_mutex_unlock(&job->lock);
+        if((k >= job->file_cnt) || (failed != 0)) {
+            break;
+        }
+
+        /* Drawings that fail to load are cataloged without variables */
+        if(dxf_load_ex(&dxf, job->files[k], &options) != dxfErrorOk) {
+            continue;
+        }
+        if(_dxf_catalog_copy(dxf, &job->scan[k]) == 0) {
+            (void)pthread_mutex_lock(&job->lock);
+            job->failed = 1;
+            (void)pthread_mutex_unlock(&job->lock);
+        }
+        (void)dxf_unload(dxf);
+    }
+    return NULL;
+}
+
+/* Pads what follows size bytes to 8 bytes */
+static int _dxf_catalog_pad(FILE *fp, uint64_t size) {
+    static const char pad[8] = { 0 };
+    size_t n = (size_t)(DXF_CATALOG_ALIGN(size) - size);
+
+    return (n == 0) || (fwrite(pad, n, 1, fp) == 1);
+}
+
+/* Writes an array, padded to 8 bytes */
+static int _dxf_catalog_write(FILE *fp, const void *p, size_t size) {
+    return ((size == 0) || (fwrite(p, size, 1, fp) == 1)) &&
+        _dxf_catalog_pad(fp, size);
+}
+
+/* Lays out and writes the catalog */
+static dxf_error_t _dxf_catalog_save(const char *path, dxf_names_t *strings,
+    const uint32_t *file, size_t file_cnt, const dxf_names_t *columns,
+    uint32_t *const *value, const dxf_names_t *layers,
+    const uint32_t *member_first, const uint32_t *member) {
+    dxf_catalog_header_t h;
+    uint32_t *column, *layer;
+    uint64_t *string;
+    size_t i;
+    FILE *fp;
+    int ok;
+
+    /* Column and layer names become strings too */
+    column = (uint32_t*)malloc((columns->cnt + 1) * sizeof(uint32_t));
+    layer = (uint32_t*)malloc((layers->cnt + 1) * sizeof(uint32_t));
+    ok = (column != NULL) && (layer != NULL);
+    for(i = 0; ok && (i < columns->cnt); i++) {
+        column[i] = dxf_names_intern(strings, columns->name[i],
+            strlen(columns->name[i]));
+        ok = (column[i] != DXF_INDEX_NONE);
+    }
+    for(i = 0; ok && (i < layers->cnt); i++) {
+        layer[i] = dxf_names_intern(strings, layers->name[i],
+            strlen(layers->name[i]));
+        ok = (layer[i] != DXF_INDEX_NONE);
+    }
+    string = ok ? (uint64_t*)malloc((strings->cnt + 1) * sizeof(uint64_t)) :
+        (uint64_t*)NULL;
+    if(string == NULL) {
+        free(column);
+        free(layer);
+        return dxfErrorNoMemory;
+    }
+    string[0] = 0;
+    for(i = 0; i < strings->cnt; i++) {
+        string[i + 1] = string[i] + strlen(strings->name[i]) + 1;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DXF_CATALOG_MAGIC, sizeof(h.magic));
+    h.version = DXF_CATALOG_VERSION;
+    h.file_cnt = (uint32_t)file_cnt;
+    h.column_cnt = (uint32_t)columns->cnt;
+    h.layer_cnt = (uint32_t)layers->cnt;
+    h.string_cnt = (uint32_t)strings->cnt;
+    h.member_cnt = member_first[layers->cnt];
+    h.file = DXF_CATALOG_ALIGN(sizeof(h));
+    h.column = h.file + DXF_CATALOG_ALIGN(file_cnt * sizeof(uint32_t));
+    h.value = h.column + DXF_CATALOG_ALIGN(columns->cnt * sizeof(uint32_t));
+    h.layer = h.value + DXF_CATALOG_ALIGN(columns->cnt * file_cnt *
+        sizeof(uint32_t));
+    h.member_first = h.layer + DXF_CATALOG_ALIGN(layers->cnt *
+        sizeof(uint32_t));
+    h.member = h.member_first + DXF_CATALOG_ALIGN((layers->cnt + 1) *
+        sizeof(uint32_t));
+    h.string = h.member + DXF_CATALOG_ALIGN(h.member_cnt *
+        sizeof(uint32_t));
+    h.chars = h.string + (strings->cnt + 1) * sizeof(uint64_t);
+    h.size = h.chars + DXF_CATALOG_ALIGN(string[strings->cnt]);
+
+    if((fp = fopen(path, "wb")) == NULL) {
+        free(column);
+        free(layer);
+        free(string);
+        return dxfErrorOpenFailed;
+    }
+    ok = _dxf_catalog_write(fp, &h, sizeof(h)) &&
+        _dxf_catalog_write(fp, file, file_cnt * sizeof(uint32_t)) &&
+        _dxf_catalog_write(fp, column, columns->cnt * sizeof(uint32_t));
+    for(i = 0; ok && (i < columns->cnt); i++) {
+        ok = (file_cnt == 0) || (fwrite(value[i], file_cnt *
+            sizeof(uint32_t), 1, fp) == 1);
+    }
+    ok = ok && _dxf_catalog_pad(fp, columns->cnt * file_cnt *
+        sizeof(uint32_t)) &&
+        _dxf_catalog_write(fp, layer, layers->cnt * sizeof(uint32_t)) &&
+        _dxf_catalog_write(fp, member_first, (layers->cnt + 1) *
+        sizeof(uint32_t)) &&
+        _dxf_catalog_write(fp, member, h.member_cnt * sizeof(uint32_t)) &&
+        _dxf_catalog_write(fp, string, (strings->cnt + 1) *
+        sizeof(uint64_t));
+    for(i = 0; ok && (i < strings->cnt); i++) {
+        ok = (fwrite(strings->name[i], strlen(strings->name[i]) + 1, 1,
+            fp) == 1);
+    }
+    ok = ok && _dxf_catalog_pad(fp, string[strings->cnt]);
+    ok = (fclose(fp) == 0) && ok;
+    free(column);
+    free(layer);
+    free(string);
+    return ok ? dxfErrorOk : dxfErrorWriteFailed;
+}
+
+/* Turns the scans into columns and the layer table, then saves them */
+static dxf_error_t _dxf_catalog_merge(const char *path,
+    const char *const *files, const dxf_catalog_scan_t *scan,
+    size_t file_cnt) {
+    dxf_names_t strings, columns, layers;
+    uint32_t **value = (uint32_t**)NULL, *file, *pair, *member_first,
+        *member;
+    size_t value_cap = 0, pair_cnt = 0, i, j;
+    dxf_error_t err = dxfErrorNoMemory;
+    const char *p;
+
+    memset(&strings, 0, sizeof(strings));
+    memset(&columns, 0, sizeof(columns));
+    memset(&layers, 0, sizeof(layers));
+    for(i = 0; i < file_cnt; i++) {
+        pair_cnt += scan[i].layer_cnt;
+    }
+    file = (uint32_t*)malloc((file_cnt + 1) * sizeof(uint32_t));
+    pair = (uint32_t*)malloc((2 * pair_cnt + 1) * sizeof(uint32_t));
+    member = (uint32_t*)malloc((pair_cnt + 1) * sizeof(uint32_t));
+    if((file == NULL) || (pair == NULL) || (member == NULL)) {
+        goto done;
+    }
+
+    /* One column per variable name, in order of first appearance */
+    for(i = 0, pair_cnt = 0; i < file_cnt; i++) {
+        if((file[i] = dxf_names_intern(&strings, files[i],
+            strlen(files[i]))) == DXF_INDEX_NONE) {
+            goto done;
+        }
+        for(j = 0, p = scan[i].buf; j < scan[i].var_cnt; j++) {
+            uint32_t c = dxf_names_intern(&columns, p, strlen(p));
+            if(c == DXF_INDEX_NONE) {
+                goto done;
+            }
+            if(c == value_cap) {
+                uint32_t **v = (uint32_t**)realloc(value, (value_cap + 1) *
+                    sizeof(uint32_t*));
+                if(v == NULL) {
+                    goto done;
+                }
+                value = v;
+                if((value[value_cap] = (uint32_t*)malloc((file_cnt + 1) *
+                    sizeof(uint32_t))) == NULL) {
+                    goto done;
+                }
+                memset(value[value_cap++], 0xFF, (file_cnt + 1) *
+                    sizeof(uint32_t));
+            }
+            p += strlen(p) + 1;
+            /* The first value wins for variables written twice */
+            if((value[c][i] == DXF_INDEX_NONE) && ((value[c][i] =
+                dxf_names_intern(&strings, p, strlen(p))) ==
+                DXF_INDEX_NONE)) {
+                goto done;
+            }
+            p += strlen(p) + 1;
+        }
+        for(j = 0; j < scan[i].layer_cnt; j++) {
+            if((pair[2 * pair_cnt] = dxf_names_intern(&layers, p,
+                strlen(p))) == DXF_INDEX_NONE) {
+                goto done;
+            }
+            pair[2 * pair_cnt++ + 1] = (uint32_t)i;
+            p += strlen(p) + 1;
+        }
+    }
+
+    /* Layer membership as CSR, drawings in order */
+    if((member_first = (uint32_t*)calloc(layers.cnt + 2, sizeof(uint32_t)))
+        == NULL) {
+        goto done;
+    }
+    for(i = 0; i < pair_cnt; i++) {
+        member_first[pair[2 * i] + 1]++;
+    }
+    for(i = 0; i < layers.cnt; i++) {
+        member_first[i + 1] += member_first[i];
+    }
+    for(i = 0; i < pair_cnt; i++) {
+        member[member_first[pair[2 * i]]++] = pair[2 * i + 1];
+    }
+    for(i = layers.cnt; i > 0; i--) {
+        member_first[i] = member_first[i - 1];
+    }
+    member_first[0] = 0;
+
+    err = _dxf_catalog_save(path, &strings, file, file_cnt, &columns, value,
+        &layers, member_first, member);
+    free(member_first);
+
+done:
+    for(i = 0; i < value_cap; i++) {
+        free(value[i]);
+    }
+    free(value);
+    free(file);
+    free(pair);
+    free(member);
+    dxf_names_free(&strings);
+    dxf_names_free(&columns);
+    dxf_names_free(&layers);
+    return err;
+}
+
+/**
+Builds a catalog of drawings: the HEADER variables and LAYER table names
+of each, in a columnar file for dxf_catalog_open().  Drawings are only
+read up to the end of their TABLES section, several at a time by worker
+threads.  Drawings that cannot be loaded are cataloged without variables
+or layers.
+
+@param  path    Catalog file to write.
+@param  files   Paths of the drawings, as they will be reported.
+@param  file_cnt    Number of drawings.
+@param  threads Number of worker threads, 0 for one per online CPU.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_catalog_build(const char *path, const char *const *files,
+    size_t file_cnt, int threads) {
+    pthread_t tid[DXF_CATALOG_MAX_THREADS];
+    dxf_catalog_job_t job;
+    dxf_error_t err;
+    size_t i;
+    int t;
+
+    assert(path != NULL);
+    assert((files != NULL) || (file_cnt == 0));
+    if(file_cnt >= DXF_INDEX_NONE) {
+        return dxfErrorInvalidFile;
+    }
+    memset(&job, 0, sizeof(job));
+    job.files = files;
+    job.file_cnt = file_cnt;
+    if((job.scan = (dxf_catalog_scan_t*)calloc(file_cnt + 1,
+        sizeof(dxf_catalog_scan_t))) == NULL) {
+        return dxfErrorNoMemory;
+    }
+    (void)pthread_mutex_init(&job.lock, NULL);
+
+    /* One thread per CPU, but no more than there are drawings */
+    if(threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if((size_t)threads > file_cnt) {
+        threads = (int)file_cnt;
+    }
+    if(threads > DXF_CATALOG_MAX_THREADS) {
+        threads = DXF_CATALOG_MAX_THREADS;
+    }
+    if(threads < 1) {
+        threads = 1;
+    }
+
+    /* The calling thread works too */
+    dxf_trace_begin("catalog", "scan", path);
+    for(t = 1; t < threads; t++) {
+        if(pthread_create(&tid[t], NULL, _dxf_catalog_worker, &job) != 0) {
+            /* The others take its share */
+            tid[t] = pthread_self();
+        }
+    }
+    (void)_dxf_catalog_worker(&job);
+    for(t = 1; t < threads; t++) {
+        if(pthread_equal(tid[t], pthread_self()) == 0) {
+            (void)pthread_join(tid[t], NULL);
+        }
+    }
+    (void)pthread_mutex_destroy(&job.lock);
+    dxf_trace_end("catalog", "scan");
+
+    err = (job.failed != 0) ? dxfErrorNoMemory :
+        _dxf_catalog_merge(path, files, job.scan, file_cnt);
+    for(i = 0; i < file_cnt; i++) {
+        free(job.scan[i].buf);
+    }
+    free(job.scan);
+    dxf_trace_flush();
+    return err;
+}
+
+/* Non-zero if an array of ids lies inside the file and every id is below
+   limit (or DXF_INDEX_NONE, if none is allowed) */
+static int _dxf_catalog_ids(const dxf_catalog_t *c, uint64_t offset,
+    uint64_t cnt, uint32_t limit, int none) {
+    const uint32_t *id = (const uint32_t*)((const char*)c->map + offset);
+    uint64_t i;
+
+    if((offset > c->size) || (cnt > (c->size - offset) / sizeof(uint32_t))) {
+        return 0;
+    }
+    for(i = 0; i < cnt; i++) {
+        if((id[i] >= limit) && ((none == 0) || (id[i] != DXF_INDEX_NONE))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Checks every offset and id of a mapped catalog, so lookups need not */
+static int _dxf_catalog_check(const dxf_catalog_t *c) {
+    const dxf_catalog_header_t *h = c->h;
+    uint64_t i, chars;
+
+    if((c->size < sizeof(*h)) || (memcmp(h->magic, DXF_CATALOG_MAGIC,
+        sizeof(h->magic)) != 0) || (h->version != DXF_CATALOG_VERSION) ||
+        (h->size != c->size)) {
+        return 0;
+    }
+    if(((h->file | h->column | h->value | h->layer | h->member_first |
+        h->member | h->string) & 7) != 0) {
+        return 0;
+    }
+    if(!_dxf_catalog_ids(c, h->file, h->file_cnt, h->string_cnt, 0) ||
+        !_dxf_catalog_ids(c, h->column, h->column_cnt, h->string_cnt, 0) ||
+        !_dxf_catalog_ids(c, h->value, (uint64_t)h->column_cnt *
+        h->file_cnt, h->string_cnt, 1) ||
+        !_dxf_catalog_ids(c, h->layer, h->layer_cnt, h->string_cnt, 0) ||
+        !_dxf_catalog_ids(c, h->member_first, (uint64_t)h->layer_cnt + 1,
+        h->member_cnt + 1, 0) ||
+        !_dxf_catalog_ids(c, h->member, h->member_cnt, h->file_cnt, 0)) {
+        return 0;
+    }
+    for(i = 0; i < h->layer_cnt; i++) {
+        if(c->member_first[i] > c->member_first[i + 1]) {
+            return 0;
+        }
+    }
+    if((c->member_first[0] != 0) ||
+        (c->member_first[h->layer_cnt] != h->member_cnt)) {
+        return 0;
+    }
+
+    /* Strings: increasing offsets, each NULL-terminated inside chars */
+    if((h->string > c->size) || (((uint64_t)h->string_cnt + 1) >
+        (c->size - h->string) / sizeof(uint64_t)) || (h->chars > c->size)) {
+        return 0;
+    }
+    chars = c->size - h->chars;
+    if(c->string[0] != 0) {
+        return 0;
+    }
+    for(i = 0; i < h->string_cnt; i++) {
+        if((c->string[i + 1] <= c->string[i]) ||
+            (c->string[i + 1] > chars) ||
+            (c->chars[c->string[i + 1] - 1] != '\0')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+Opens a catalog written by dxf_catalog_build().  The file is mapped and
+used in place; nothing is copied.
+
+@param  path    Catalog file.
+@param  catalog On success, the catalog; close it with dxf_catalog_close().
+@returns dxfErrorOk on success, dxfErrorInvalidCatalog if the file is not
+a catalog of this build, error code otherwise.
+*/
+dxf_error_t dxf_catalog_open(const char *path, dxf_catalog_t **catalog) {
+    struct stat st;
+    dxf_catalog_t *c;
+    int fd;
+
+    assert(path != NULL);
+    assert(catalog != NULL);
+    if((fd = open(path, O_RDONLY)) == -1) {
+        return dxfErrorOpenFailed;
+    }
+    if((fstat(fd, &st) == -1) || (st.st_size < (off_t)sizeof(
+        dxf_catalog_header_t)) || ((uint64_t)st.st_size > (uint64_t)SIZE_MAX)) {
+        (void)close(fd);
+        return dxfErrorInvalidCatalog;
+    }
+    if((c = (dxf_catalog_t*)calloc(1, sizeof(*c))) == NULL) {
+        (void)close(fd);
+        return dxfErrorNoMemory;
+    }
+    c->size = (size_t)st.st_size;
+    c->map = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void)close(fd);
+    if(c->map == MAP_FAILED) {
+        free(c);
+        return dxfErrorBadFd;
+    }
+    c->h = (const dxf_catalog_header_t*)c->map;
+    if(c->h->size == c->size) {
+        const char *base = (const char*)c->map;
+        c->file = (const uint32_t*)(base + c->h->file);
+        c->column = (const uint32_t*)(base + c->h->column);
+        c->value = (const uint32_t*)(base + c->h->value);
+        c->layer = (const uint32_t*)(base + c->h->layer);
+        c->member_first = (const uint32_t*)(base + c->h->member_first);
+        c->member = (const uint32_t*)(base + c->h->member);
+        c->string = (const uint64_t*)(base + c->h->string);
+        c->chars = base + c->h->chars;
+    }
+    if((c->h->size != c->size) || (_dxf_catalog_check(c) == 0)) {
+        dxf_catalog_close(c);
+        return dxfErrorInvalidCatalog;
+    }
+    *catalog = c;
+    return dxfErrorOk;
+}
+
+/**
+Closes a catalog.
+
+@param  catalog Catalog, may be NULL.
+*/
+void dxf_catalog_close(dxf_catalog_t *catalog) {
+    if(catalog != NULL) {
+        (void)munmap(catalog->map, catalog->size);
+        free(catalog);
+    }
+}
+
+/**
+Gets the number of drawings in a catalog.
+
+@param  catalog Catalog.
+@returns The number of drawings.
+*/
+size_t dxf_catalog_file_cnt(const dxf_catalog_t *catalog) {
+    assert(catalog != NULL);
+    return catalog->h->file_cnt;
+}
+
+/**
+Gets the path of a drawing, as given to dxf_catalog_build().
+
+@param  catalog Catalog.
+@param  file    Drawing index, less than dxf_catalog_file_cnt().
+@returns The path, valid until dxf_catalog_close().
+*/
+const char *dxf_catalog_file(const dxf_catalog_t *catalog, size_t file) {
+    assert(catalog != NULL);
+    assert(file < catalog->h->file_cnt);
+    return &catalog->chars[catalog->string[catalog->file[file]]];
+}
+
+/* Column of a variable, DXF_INDEX_NONE if no drawing has it */
+static uint32_t _dxf_catalog_column(const dxf_catalog_t *c, const char *var) {
+    uint32_t i;
+
+    for(i = 0; i < c->h->column_cnt; i++) {
+        if(strcmp(&c->chars[c->string[c->column[i]]], var) == 0) {
+            return i;
+        }
+    }
+    return DXF_INDEX_NONE;
+}
+
+/**
+Gets the value of a HEADER variable in one drawing, as written.
+
+@param  catalog Catalog.
+@param  file    Drawing index, less than dxf_catalog_file_cnt().
+@param  var Variable name, e.g. "$INSUNITS".
+@returns The value, valid until dxf_catalog_close(); NULL if the drawing
+does not set the variable.
+*/
+const char *dxf_catalog_value(const dxf_catalog_t *catalog, size_t file,
+    const char *var) {
+    uint32_t col, id;
+
+    assert(catalog != NULL);
+    assert(file < catalog->h->file_cnt);
+    assert(var != NULL);
+    if(((col = _dxf_catalog_column(catalog, var)) == DXF_INDEX_NONE) ||
+        ((id = catalog->value[(size_t)col * catalog->h->file_cnt + file]) ==
+        DXF_INDEX_NONE)) {
+        return (const char*)NULL;
+    }
+    return &catalog->chars[catalog->string[id]];
+}
+
+/* Case-insensitive string compare, as layer names are */
+static int _dxf_catalog_casecmp(const char *a, const char *b) {
+    while((*a != '\0') && (tolower((unsigned char)*a) ==
+        tolower((unsigned char)*b))) {
+        a++;
+        b++;
+    }
+    return tolower((unsigned char)*a) - tolower((unsigned char)*b);
+}
+
+/**
+Selects the drawings of a catalog where a HEADER variable has a value,
+a layer exists, or both.  Variable values are compared as written, e.g.
+"4" for $INSUNITS; layer names ignore case.  Only the variable's column
+and the layer's member list are scanned.
+
+@param  catalog Catalog.
+@param  var Variable name, or NULL for any drawing.
+@param  value   Value var must have, or NULL for any drawing setting var.
+@param  layer   Layer name the LAYER table must hold, or NULL for any.
+@param  files   Array of max drawing indexes, or NULL to only count.
+@param  max Size of files.
+@param  cnt On success, contains the number of drawings, which may exceed
+    max.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_catalog_select(const dxf_catalog_t *catalog, const char *var,
+    const char *value, const char *layer, uint32_t *files, size_t max,
+    size_t *cnt) {
+    const uint32_t *column = (const uint32_t*)NULL;
+    unsigned char *defines = (unsigned char*)NULL;
+    uint32_t want = DXF_INDEX_NONE, col, i, l;
+
+    assert(catalog != NULL);
+    assert(cnt != NULL);
+    *cnt = 0;
+    if(var != NULL) {
+        if((col = _dxf_catalog_column(catalog, var)) == DXF_INDEX_NONE) {
+            return dxfErrorOk;
+        }
+        column = &catalog->value[(size_t)col * catalog->h->file_cnt];
+        if(value != NULL) {
+            for(i = 0; i < catalog->h->string_cnt; i++) {
+                if(strcmp(&catalog->chars[catalog->string[i]], value) == 0) {
+                    want = i;
+                    break;
+                }
+            }
+            if(want == DXF_INDEX_NONE) {
+                return dxfErrorOk;
+            }
+        }
+    }
+    if(layer != NULL) {
+        if((defines = (unsigned char*)calloc(catalog->h->file_cnt + 1, 1)) ==
+            NULL) {
+            return dxfErrorNoMemory;
+        }
+        for(l = 0; l < catalog->h->layer_cnt; l++) {
+            if(_dxf_catalog_casecmp(&catalog->chars[catalog->string[
+                catalog->layer[l]]], layer) == 0) {
+                for(i = catalog->member_first[l];
+                    i < catalog->member_first[l + 1]; i++) {
+                    defines[catalog->member[i]] = 1;
+                }
+            }
+        }
+    }
+    for(i = 0; i < catalog->h->file_cnt; i++) {
+        if(((column != NULL) && ((column[i] == DXF_INDEX_NONE) ||
+            ((want != DXF_INDEX_NONE) && (column[i] != want)))) ||
+            ((defines != NULL) && (defines[i] == 0))) {
+            continue;
+        }
+        if((files != NULL) && ((*cnt) < max)) {
+            files[*cnt] = i;
+        }
+        (*cnt)++;
+    }
+    free(defines);
+    return dxfErrorOk;
+}
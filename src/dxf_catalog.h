@@ -0,0 +1,49 @@
+/** @file dxf_catalog.h
+ *  @brief Cross-drawing catalog.
+ *
+ * Internal layout of the catalog file written by dxf_catalog_build(): a
+ * fixed header followed by 8-byte aligned arrays, in native byte order, so
+ * the file is used in place once mapped.  Every string (paths, variable
+ * names and values, layer names) is stored once and referred to by id.
+ */
+#ifndef _DXF_CATALOG_H_
+#define _DXF_CATALOG_H_
+
+#include "dxf.h"
+
+/* First bytes of a catalog */
+#define DXF_CATALOG_MAGIC "DXFCAT\r\n"
+
+/* Bumped whenever the layout changes */
+#define DXF_CATALOG_VERSION 1
+
+/* Upper bound on worker threads */
+#define DXF_CATALOG_MAX_THREADS 64
+
+/* Section the catalog reads each drawing up to */
+#define DXF_CATALOG_LAST_SECTION "TABLES"
+
+/* Catalog file header; offsets are from the start of the file */
+typedef struct _dxf_catalog_header_t {
+    char magic[8]; /* DXF_CATALOG_MAGIC */
+    uint32_t version; /* DXF_CATALOG_VERSION */
+    uint32_t file_cnt; /* Drawings */
+    uint32_t column_cnt; /* Distinct HEADER variables */
+    uint32_t layer_cnt; /* Distinct layer names */
+    uint32_t string_cnt; /* Distinct strings */
+    uint32_t member_cnt; /* Layer and drawing pairs */
+    uint64_t file; /* file_cnt string ids: path of each drawing */
+    uint64_t column; /* column_cnt string ids: variable names */
+    uint64_t value; /* column_cnt columns of file_cnt string ids, value of
+        the variable in each drawing or DXF_INDEX_NONE */
+    uint64_t layer; /* layer_cnt string ids: layer names */
+    uint64_t member_first; /* layer_cnt + 1 entries: drawings defining layer
+        l are member[member_first[l]] up to member[member_first[l + 1]] */
+    uint64_t member; /* member_cnt drawing indexes, increasing per layer */
+    uint64_t string; /* string_cnt + 1 uint64_t: string s is the
+        NULL-terminated chars[string[s]] */
+    uint64_t chars; /* Bytes of every string */
+    uint64_t size; /* Size of the file */
+} dxf_catalog_header_t;
+
+#endif
@@ -0,0 +1,409 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "dxf_compact.h"
+
+/* Zigzag code of a delta, small magnitudes first */
+#define DXF_COMPACT_ZIGZAG(d) (((uint64_t)(d) << 1) ^ (uint64_t)((d) >> 63))
+
+/* Delta of a zigzag code */
+#define DXF_COMPACT_UNZIGZAG(z) ((int64_t)((z) >> 1) ^ -(int64_t)((z) & 1))
+
+/* Bits of the first value of each axis of a run */
+#define DXF_COMPACT_FIRST_BITS 32
+
+/* Coordinate of axis a of vertex i of the uncompressed buffers */
+#define DXF_COMPACT_COORD(model, i, a) \
+    (((a) < 3) ? (model)->vertex[4 * (i) + (a)] : \
+    (model)->world[4 * (i) + (a) - 3])
+
+/* Writes width bits of v at bit pos; bits are zeroed */
+static void _dxf_compact_put(uint64_t *bits, uint64_t pos, uint64_t v,
+    unsigned int width) {
+    size_t word = (size_t)(pos >> 6);
+    unsigned int off = (unsigned int)(pos & 63);
+
+    if(width == 0) {
+        return;
+    }
+    bits[word] |= v << off;
+    if(off + width > 64) {
+        bits[word + 1] |= v >> (64 - off);
+    }
+}
+
+/* Reads width bits at bit pos */
+static uint64_t _dxf_compact_get(const uint64_t *bits, uint64_t pos,
+    unsigned int width) {
+    size_t word = (size_t)(pos >> 6);
+    unsigned int off = (unsigned int)(pos & 63);
+    uint64_t v;
+
+    if(width == 0) {
+        return 0;
+    }
+    v = bits[word] >> off;
+    if(off + width > 64) {
+        v |= bits[word + 1] << (64 - off);
+    }
+    return (width == 64) ? v : (v & ((UINT64_C(1) << width) - 1));
+}
+
+/* Quantized axis a of vertex i */
+static int64_t _dxf_compact_quantize(const dxf_model_t *model,
+    const dxf_compact_t *c, size_t i, int a) {
+    return (int64_t)floor((DXF_COMPACT_COORD(model, i, a) - c->origin[a]) /
+        c->step + 0.5);
+}
+
+/*
+Adds the bits of one run to bits and fills in its widths and w kind.
+Returns 0 if a coordinate is not finite, so cannot be quantized.
+*/
+static int _dxf_compact_measure(const dxf_model_t *model,
+    const dxf_compact_t *c, dxf_compact_run_t *r, uint64_t *bits) {
+    size_t i;
+    int a;
+
+    for(a = 0; a < DXF_COMPACT_AXES; a++) {
+        uint64_t widest = 0;
+        int64_t prev = 0;
+        for(i = 0; i < r->cnt; i++) {
+            int64_t q;
+            if(!isfinite(DXF_COMPACT_COORD(model, r->first + i, a))) {
+                return 0;
+            }
+            q = _dxf_compact_quantize(model, c, r->first + i, a);
+            if(i > 0) {
+                widest |= DXF_COMPACT_ZIGZAG(q - prev);
+            }
+            prev = q;
+        }
+        for(r->width[a] = 0; widest != 0; widest >>= 1) {
+            r->width[a]++;
+        }
+        *bits += DXF_COMPACT_FIRST_BITS + (uint64_t)(r->cnt - 1) *
+            r->width[a];
+    }
+    r->w_kind = DXF_COMPACT_W_ZERO;
+    for(i = 0; i < r->cnt; i++) {
+        if(model->vertex[4 * (r->first + i) + 3] != 0.0) {
+            break;
+        }
+    }
+    if(i < r->cnt) {
+        r->w_kind = DXF_COMPACT_W_ONE;
+        for(i = 0; i < r->cnt; i++) {
+            if(model->vertex[4 * (r->first + i) + 3] != 1.0) {
+                r->w_kind = DXF_COMPACT_W_LIST;
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+/* Writes the values of one run */
+static void _dxf_compact_pack(const dxf_model_t *model, dxf_compact_t *c,
+    const dxf_compact_run_t *r) {
+    uint64_t pos = r->bit;
+    size_t i;
+    int a;
+
+    for(a = 0; a < DXF_COMPACT_AXES; a++) {
+        int64_t prev = _dxf_compact_quantize(model, c, r->first, a);
+        _dxf_compact_put(c->bits, pos, (uint64_t)prev,
+            DXF_COMPACT_FIRST_BITS);
+        pos += DXF_COMPACT_FIRST_BITS;
+        for(i = 1; i < r->cnt; i++) {
+            int64_t q = _dxf_compact_quantize(model, c, r->first + i, a);
+            _dxf_compact_put(c->bits, pos, DXF_COMPACT_ZIGZAG(q - prev),
+                r->width[a]);
+            pos += r->width[a];
+            prev = q;
+        }
+    }
+    if(r->w_kind == DXF_COMPACT_W_LIST) {
+        for(i = 0; i < r->cnt; i++) {
+            c->w[r->w + i] = model->vertex[4 * (r->first + i) + 3];
+        }
+    }
+}
+
+/* Appends a run of cnt vertices from first */
+static int _dxf_compact_run(dxf_compact_t *c, size_t *cap, size_t first,
+    size_t cnt) {
+    while(cnt > 0) {
+        uint32_t n = (cnt > UINT32_MAX) ? UINT32_MAX : (uint32_t)cnt;
+        if(c->run_cnt == *cap) {
+            size_t m = (*cap == 0) ? 256 : 2 * (*cap);
+            void *p = realloc(c->run, m * sizeof(dxf_compact_run_t));
+            if(p == NULL) {
+                return 0;
+            }
+            c->run = (dxf_compact_run_t*)p;
+            *cap = m;
+        }
+        memset(&c->run[c->run_cnt], 0, sizeof(dxf_compact_run_t));
+        c->run[c->run_cnt].first = first;
+        c->run[c->run_cnt++].cnt = n;
+        first += n;
+        cnt -= n;
+    }
+    return 1;
+}
+
+/* Frees a compact store */
+static void _dxf_compact_free(dxf_compact_t *c) {
+    if(c != NULL) {
+        free(c->run);
+        free(c->bits);
+        free(c->w);
+        free(c);
+    }
+}
+
+dxf_error_t dxf_compact_encode(dxf_model_t *model, double step) {
+    dxf_compact_t *c;
+    double min[3], max[3], wmin[3], wmax[3];
+    uint64_t bits = 0;
+    size_t cap = 0, next = 0, w_cnt = 0, i;
+    int a;
+
+    assert(model != NULL);
+    assert(step > 0.0);
+    if(model->vertex_cnt == 0) {
+        return dxfErrorOk;
+    }
+
+    /* Origin and span of both buffers */
+    dxf_bbox_vertices(model->vertex, model->vertex_cnt, min, max);
+    dxf_bbox_vertices(model->world, model->vertex_cnt, wmin, wmax);
+    for(a = 0; a < 3; a++) {
+        if(!isfinite(min[a]) || !isfinite(max[a]) || !isfinite(wmin[a]) ||
+            !isfinite(wmax[a]) || ((max[a] - min[a]) / step >=
+            DXF_COMPACT_MAX) || ((wmax[a] - wmin[a]) / step >=
+            DXF_COMPACT_MAX)) {
+            return dxfErrorInvalidPrecision;
+        }
+    }
+    if((c = (dxf_compact_t*)calloc(1, sizeof(*c))) == NULL) {
+        return dxfErrorNoMemory;
+    }
+    c->step = step;
+    for(a = 0; a < 3; a++) {
+        c->origin[a] = min[a];
+        c->origin[a + 3] = wmin[a];
+    }
+
+    /* One run per entity, in vertex order, and one per gap */
+    for(i = 0; i < model->entity_cnt; i++) {
+        const dxf_entity_t *e = &model->entity[i];
+        if(e->vertex_cnt == 0) {
+            continue;
+        }
+        if(((e->vertex > next) &&
+            (_dxf_compact_run(c, &cap, next, e->vertex - next) == 0)) ||
+            (_dxf_compact_run(c, &cap, e->vertex, e->vertex_cnt) == 0)) {
+            _dxf_compact_free(c);
+            return dxfErrorNoMemory;
+        }
+        next = e->vertex + e->vertex_cnt;
+    }
+    if((next < model->vertex_cnt) &&
+        (_dxf_compact_run(c, &cap, next, model->vertex_cnt - next) == 0)) {
+        _dxf_compact_free(c);
+        return dxfErrorNoMemory;
+    }
+    for(i = 0; i < c->run_cnt; i++) {
+        dxf_compact_run_t *r = &c->run[i];
+        r->bit = bits;
+        if(_dxf_compact_measure(model, c, r, &bits) == 0) {
+            _dxf_compact_free(c);
+            return dxfErrorInvalidPrecision;
+        }
+        if(r->w_kind == DXF_COMPACT_W_LIST) {
+            r->w = w_cnt;
+            w_cnt += r->cnt;
+        }
+    }
+
+    /* One spare word so reads may straddle the last one */
+    c->bits = (uint64_t*)calloc((size_t)(bits >> 6) + 2, sizeof(uint64_t));
+    c->w = (double*)malloc((w_cnt + 1) * sizeof(double));
+    if((c->bits == NULL) || (c->w == NULL)) {
+        _dxf_compact_free(c);
+        return dxfErrorNoMemory;
+    }
+    for(i = 0; i < c->run_cnt; i++) {
+        _dxf_compact_pack(model, c, &c->run[i]);
+    }
+    c->bytes = sizeof(*c) + c->run_cnt * sizeof(dxf_compact_run_t) +
+        ((size_t)(bits >> 6) + 2) * sizeof(uint64_t) +
+        (w_cnt + 1) * sizeof(double);
+
+    free(model->vertex);
+    free(model->world);
+    model->vertex = (double*)NULL;
+    model->world = (double*)NULL;
+    model->vertex_cap = 0;
+    model->compact = c;
+    return dxfErrorOk;
+}
+
+/* Run holding vertex i */
+static size_t _dxf_compact_find(const dxf_compact_t *c, size_t i) {
+    size_t lo = 0, hi = c->run_cnt;
+
+    while(hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(c->run[mid].first <= i) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+Kernel: converts a block of quantized x, y, z (four int32 per vertex, the
+last unused) to doubles and appends w.  With SSE2 x and y convert and scale
+in one register.
+*/
+static void _dxf_compact_kernel(const int32_t *q, size_t cnt,
+    const double origin[3], double step, const dxf_compact_run_t *r,
+    const double *w, size_t skip, double *out) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    {
+        __m128d s = _mm_set1_pd(step);
+        __m128d oxy = _mm_set_pd(origin[1], origin[0]);
+        __m128d oz = _mm_set_sd(origin[2]);
+
+        for(; i < cnt; i++) {
+            __m128i ixy = _mm_loadl_epi64((const __m128i*)&q[4 * i]);
+            __m128d xy = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(ixy), s), oxy);
+            __m128d z = _mm_add_sd(_mm_mul_sd(_mm_cvtsi32_sd(oz,
+                q[4 * i + 2]), s), oz);
+            __m128d wv = _mm_set_sd((r->w_kind == DXF_COMPACT_W_LIST) ?
+                w[skip + i] : (double)r->w_kind);
+            _mm_storeu_pd(&out[4 * i], xy);
+            _mm_storeu_pd(&out[4 * i + 2], _mm_unpacklo_pd(z, wv));
+        }
+    }
+#endif
+    for(; i < cnt; i++) {
+        out[4 * i] = origin[0] + step * q[4 * i];
+        out[4 * i + 1] = origin[1] + step * q[4 * i + 1];
+        out[4 * i + 2] = origin[2] + step * q[4 * i + 2];
+        out[4 * i + 3] = (r->w_kind == DXF_COMPACT_W_LIST) ? w[skip + i] :
+            (double)r->w_kind;
+    }
+}
+
+void dxf_compact_decode(const dxf_compact_t *compact, int world,
+    size_t first, size_t cnt, double *out) {
+    const dxf_compact_t *c = compact;
+    int32_t q[4 * DXF_COMPACT_BLOCK];
+    size_t k;
+
+    assert(c != NULL);
+    assert((out != NULL) || (cnt == 0));
+    if(cnt == 0) {
+        return;
+    }
+    for(k = _dxf_compact_find(c, first); cnt > 0; k++) {
+        const dxf_compact_run_t *r = &c->run[k];
+        const double *w = (r->w_kind == DXF_COMPACT_W_LIST) ?
+            &c->w[r->w] : (const double*)NULL;
+        uint64_t pos[3];
+        int64_t v[3];
+        size_t i = 0, skip = first - r->first;
+        size_t end = (skip + cnt < r->cnt) ? skip + cnt : r->cnt;
+        int a, b = (world != 0) ? 3 : 0;
+
+        /* Axis a of the run starts after the axes before it */
+        pos[0] = r->bit;
+        for(a = 0; a < b; a++) {
+            pos[0] += DXF_COMPACT_FIRST_BITS + (uint64_t)(r->cnt - 1) *
+                r->width[a];
+        }
+        for(a = 0; a < 3; a++) {
+            if(a > 0) {
+                pos[a] = pos[a - 1] + (uint64_t)(r->cnt - 1) *
+                    r->width[b + a - 1];
+            }
+            v[a] = (int64_t)_dxf_compact_get(c->bits, pos[a],
+                DXF_COMPACT_FIRST_BITS);
+            pos[a] += DXF_COMPACT_FIRST_BITS;
+        }
+
+        /* Deltas are summed from the start of the run, converted from
+           the first vertex asked for */
+        while(i < end) {
+            size_t n = 0, from = i;
+            for(; (i < end) && (n < DXF_COMPACT_BLOCK); i++) {
+                if(i > 0) {
+                    for(a = 0; a < 3; a++) {
+                        v[a] += DXF_COMPACT_UNZIGZAG(_dxf_compact_get(
+                            c->bits, pos[a], r->width[b + a]));
+                        pos[a] += r->width[b + a];
+                    }
+                }
+                if(i >= skip) {
+                    q[4 * n] = (int32_t)v[0];
+                    q[4 * n + 1] = (int32_t)v[1];
+                    q[4 * n + 2] = (int32_t)v[2];
+                    n++;
+                } else {
+                    from = i + 1;
+                }
+            }
+            _dxf_compact_kernel(q, n, &c->origin[b], c->step, r, w, from,
+                out);
+            out += 4 * n;
+        }
+        cnt -= end - skip;
+        first = r->first + r->cnt;
+    }
+}
+
+int dxf_compact_expand(dxf_model_t *model) {
+    void *v = NULL, *w = NULL;
+    int ok = 1;
+
+    assert(model != NULL);
+    (void)pthread_rwlock_wrlock(&model->compact_lock);
+    if(model->compact != NULL) {
+        size_t n = model->vertex_cnt * 4 * sizeof(double);
+        if((posix_memalign(&v, DXF_VERTEX_ALIGN, n) != 0) ||
+            (posix_memalign(&w, DXF_VERTEX_ALIGN, n) != 0)) {
+            free(v);
+            ok = 0;
+        } else {
+            dxf_compact_decode(model->compact, 0, 0, model->vertex_cnt,
+                (double*)v);
+            dxf_compact_decode(model->compact, 1, 0, model->vertex_cnt,
+                (double*)w);
+            model->vertex = (double*)v;
+            model->world = (double*)w;
+            model->vertex_cap = model->vertex_cnt;
+            _dxf_compact_free(model->compact);
+            model->compact = (struct _dxf_compact_t*)NULL;
+        }
+    }
+    (void)pthread_rwlock_unlock(&model->compact_lock);
+    return ok;
+}
+
+void dxf_compact_free(dxf_model_t *model) {
+    assert(model != NULL);
+    _dxf_compact_free(model->compact);
+    model->compact = (struct _dxf_compact_t*)NULL;
+}
@@ -0,0 +1,92 @@
+/** @file dxf_compact.h
+ *  @brief Compact vertex buffers.
+ *
+ * Internal quantized form of the vertex buffer and its world coordinates,
+ * kept instead of the doubles when a drawing is loaded with a compact
+ * step.  Coordinates become fixed-point offsets from the buffer's lower
+ * corner; each entity's run of vertices stores, per axis, its first value
+ * and then zigzag deltas bit-packed at the run's widest delta.
+ */
+#ifndef _DXF_COMPACT_H_
+#define _DXF_COMPACT_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* Axes of a run: x, y and z of the vertex buffer, then of world */
+#define DXF_COMPACT_AXES 6
+
+/* Largest quantized coordinate */
+#define DXF_COMPACT_MAX 2147483647.0
+
+/* Vertices decoded per kernel call */
+#define DXF_COMPACT_BLOCK 256
+
+/* w of every vertex of a run: 0, 1 or kept in the w array */
+#define DXF_COMPACT_W_ZERO 0
+#define DXF_COMPACT_W_ONE 1
+#define DXF_COMPACT_W_LIST 2
+
+/* The vertices of one entity, or of a gap between entities */
+typedef struct _dxf_compact_run_t {
+    size_t first; /* First vertex, numbered as in the vertex buffer */
+    uint64_t bit; /* First bit of the run in bits */
+    size_t w; /* First w of the run in w, for DXF_COMPACT_W_LIST */
+    uint32_t cnt; /* Vertices */
+    uint8_t width[DXF_COMPACT_AXES]; /* Bits per delta, per axis */
+    uint8_t w_kind; /* DXF_COMPACT_W_* */
+} dxf_compact_run_t;
+
+/* Quantized vertex buffers */
+typedef struct _dxf_compact_t {
+    double step; /* Quantization step */
+    double origin[DXF_COMPACT_AXES]; /* Lower corner, per axis */
+    dxf_compact_run_t *run; /* Runs, in vertex order */
+    size_t run_cnt;
+    uint64_t *bits; /* Packed values of every run */
+    double *w; /* w of runs whose w is neither all 0 nor all 1 */
+    size_t bytes; /* Bytes held */
+} dxf_compact_t;
+
+/**
+Replaces the vertex buffer and its world coordinates by their compact
+form.  Called once, after dxf_ocs_to_wcs().
+
+@param  model   Record store.
+@param  step    Quantization step, > 0; decoded coordinates are within
+    step / 2 of the originals.
+@returns dxfErrorOk on success, dxfErrorInvalidPrecision if a coordinate
+is not finite or the drawing spans more than DXF_COMPACT_MAX steps,
+dxfErrorNoMemory if allocation failed.  On failure the doubles are kept.
+*/
+dxf_error_t dxf_compact_encode(dxf_model_t *model, double step);
+
+/**
+Decodes a range of the vertex buffer or of its world coordinates.
+
+@param  compact Compact buffers.
+@param  world   Non-zero for world coordinates.
+@param  first   First vertex.
+@param  cnt Number of vertices.
+@param  out Receives cnt vertices of x, y, z, w.
+*/
+void dxf_compact_decode(const dxf_compact_t *compact, int world,
+    size_t first, size_t cnt, double *out);
+
+/**
+Decodes the compact buffers back into doubles for good, if the store
+holds them compact.  Safe to call from several threads.
+
+@param  model   Record store.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_compact_expand(dxf_model_t *model);
+
+/**
+Frees the compact buffers.
+
+@param  model   Record store.
+*/
+void dxf_compact_free(dxf_model_t *model);
+
+#endif
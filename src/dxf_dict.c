@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include "dxf_dict.h"
+#include "dxf_group.h"
+
+/* Dictionary index under construction */
+typedef struct _dxf_dict_build_t {
+    dxf_dict_index_t *index;
+    size_t dict_cap;
+    size_t entry_first_cap;
+    size_t entry_cnt;
+    size_t entry_cap;
+    size_t *name; /* Offset of each entry's name in names */
+    size_t name_cap;
+    char *value; /* Value of the group being read */
+    size_t names_cnt;
+    size_t names_cap;
+} dxf_dict_build_t;
+
+/* Grows an array to hold at least cnt + need elements */
+static int _dxf_dict_reserve(void **array, size_t cnt, size_t need,
+    size_t *cap, size_t size) {
+    void *p;
+    size_t n = *cap;
+
+    if(cnt + need <= n) {
+        return 1;
+    }
+    while(cnt + need > n) {
+        n = (n == 0) ? 256 : 2 * n;
+    }
+    if((p = realloc(*array, n * size)) == NULL) {
+        return 0;
+    }
+    *array = p;
+    *cap = n;
+    return 1;
+}
+
+/* Reads a group: code and value, the value NULL-terminated in place */
+static dxf_error_t _dxf_dict_group(dxf_group_reader_t *rd, int *group_code,
+    char *value) {
+    const char *line;
+    size_t len;
+    dxf_error_t err;
+
+    if((err = dxf_group_read(rd, group_code, &line, &len)) != dxfErrorOk) {
+        return err;
+    }
+    memcpy(value, line, len);
+    value[len] = '\0';
+    return dxfErrorOk;
+}
+
+/* Reads the entries of the dictionary at the reader's position */
+static dxf_error_t _dxf_dict_read(const dxf_model_t *model,
+    dxf_group_reader_t *rd, dxf_dict_build_t *b, const char *type) {
+    dxf_dict_index_t *t = b->index;
+    char *value = b->value;
+    size_t name = 0; /* Pending name offset */
+    int has_name = 0; /* A group 3 awaits its pointer */
+    int in_group = 0; /* Inside a 102 "{..." group */
+    int group_code;
+    dxf_error_t err;
+
+    /* The record must still be where loading found it */
+    if((err = _dxf_dict_group(rd, &group_code, value)) != dxfErrorOk) {
+        return err;
+    }
+    if((group_code != 0) || (strcmp(value, type) != 0)) {
+        return dxfErrorInvalidFormat;
+    }
+    for(;;) {
+        if((err = _dxf_dict_group(rd, &group_code, value)) != dxfErrorOk) {
+            return err;
+        }
+        if(group_code == 0) {
+            return dxfErrorOk;
+        }
+        if(group_code == 102) {
+            in_group = (value[0] == '{');
+            continue;
+        }
+        if(in_group) {
+            continue;
+        }
+        if(group_code == 3) {
+            size_t len = strlen(value);
+            if(_dxf_dict_reserve((void**)&t->names, b->names_cnt, len + 1,
+                &b->names_cap, 1) == 0) {
+                return dxfErrorNoMemory;
+            }
+            name = b->names_cnt;
+            memcpy(&t->names[name], value, len + 1);
+            b->names_cnt += len + 1;
+            has_name = 1;
+        } else if(((group_code == 350) || (group_code == 360)) && has_name) {
+            dxf_dict_entry_t *e;
+            if((_dxf_dict_reserve((void**)&t->entry, b->entry_cnt, 1,
+                &b->entry_cap, sizeof(dxf_dict_entry_t)) == 0) ||
+                (_dxf_dict_reserve((void**)&b->name, b->entry_cnt, 1,
+                &b->name_cap, sizeof(size_t)) == 0)) {
+                return dxfErrorNoMemory;
+            }
+            e = &t->entry[b->entry_cnt];
+            b->name[b->entry_cnt++] = name;
+            e->name = (const char*)NULL;
+            e->handle = 0;
+            (void)dxf_model_parse_handle(value, &e->handle);
+            e->record = (e->handle != 0) ?
+                dxf_handle_index_find(&model->handles, e->handle) :
+                DXF_RECORD_NONE;
+            e->hard = (group_code == 360);
+            has_name = 0;
+        }
+    }
+}
+
+/* Frees an index */
+static void _dxf_dict_index_free(dxf_dict_index_t *t) {
+    if(t != NULL) {
+        free(t->dict);
+        free(t->entry_first);
+        free(t->entry);
+        free(t->names);
+        free(t);
+    }
+}
+
+/* Reads every dictionary back from the file */
+static dxf_error_t _dxf_dict_build(const dxf_model_t *model,
+    const char *filename, dxf_dict_index_t **index) {
+    static const char *const types[] = { "DICTIONARY",
+        "ACDBDICTIONARYWDFLT" };
+    uint32_t type_id[sizeof(types) / sizeof(types[0])];
+    dxf_group_reader_t rd;
+    char *block;
+    int fd;
+    dxf_dict_build_t b;
+    dxf_error_t err = dxfErrorOk;
+    size_t i, k;
+
+    memset(&b, 0, sizeof(b));
+    block = (char*)malloc(DXF_DICT_BLOCK_SIZE);
+    b.value = (char*)malloc(DXF_DICT_BLOCK_SIZE);
+    b.index = (dxf_dict_index_t*)calloc(1, sizeof(dxf_dict_index_t));
+    if((block == NULL) || (b.value == NULL) || (b.index == NULL)) {
+        err = dxfErrorNoMemory;
+        goto done;
+    }
+    if((fd = open(filename, O_RDONLY)) == -1) {
+        err = dxfErrorOpenFailed;
+        goto done;
+    }
+    dxf_group_reader_open(&rd, fd, block, DXF_DICT_BLOCK_SIZE);
+    for(k = 0; k < sizeof(types) / sizeof(types[0]); k++) {
+        type_id[k] = dxf_names_find(&model->types, types[k]);
+    }
+
+    /* Dictionaries only live in OBJECTS, read in file order */
+    for(i = model->objects_first; (err == dxfErrorOk) &&
+        (i < model->record_cnt); i++) {
+        for(k = 0; k < sizeof(types) / sizeof(types[0]); k++) {
+            if((type_id[k] != DXF_INDEX_NONE) &&
+                (model->record[i].type == type_id[k])) {
+                break;
+            }
+        }
+        if(k == sizeof(types) / sizeof(types[0])) {
+            continue;
+        }
+        if((_dxf_dict_reserve((void**)&b.index->dict, b.index->dict_cnt, 1,
+            &b.dict_cap, sizeof(dxf_record_id_t)) == 0) ||
+            (_dxf_dict_reserve((void**)&b.index->entry_first,
+            b.index->dict_cnt, 2, &b.entry_first_cap, sizeof(size_t)) == 0)) {
+            err = dxfErrorNoMemory;
+            break;
+        }
+        b.index->dict[b.index->dict_cnt] = (dxf_record_id_t)i;
+        b.index->entry_first[b.index->dict_cnt++] = b.entry_cnt;
+        dxf_group_seek(&rd, model->record[i].offset);
+        err = _dxf_dict_read(model, &rd, &b, types[k]);
+    }
+    (void)close(fd);
+    if(err != dxfErrorOk) {
+        goto done;
+    }
+    if(b.index->dict_cnt == 0) {
+        b.index->entry_first = (size_t*)malloc(sizeof(size_t));
+        if(b.index->entry_first == NULL) {
+            err = dxfErrorNoMemory;
+            goto done;
+        }
+    }
+    b.index->entry_first[b.index->dict_cnt] = b.entry_cnt;
+
+    /* Names no longer move */
+    for(i = 0; i < b.entry_cnt; i++) {
+        b.index->entry[i].name = &b.index->names[b.name[i]];
+    }
+
+done:
+    free(block);
+    free(b.value);
+    free(b.name);
+    if(err != dxfErrorOk) {
+        _dxf_dict_index_free(b.index);
+        return err;
+    }
+    *index = b.index;
+    return dxfErrorOk;
+}
+
+dxf_error_t dxf_dict_index(dxf_model_t *model, const char *filename,
+    const dxf_dict_index_t **index) {
+    dxf_error_t err = dxfErrorOk;
+
+    assert(model != NULL);
+    assert(filename != NULL);
+    assert(index != NULL);
+    (void)pthread_mutex_lock(&model->dict_lock);
+    if(model->dict_index == NULL) {
+        err = _dxf_dict_build(model, filename, &model->dict_index);
+    }
+    *index = model->dict_index;
+    (void)pthread_mutex_unlock(&model->dict_lock);
+    return err;
+}
+
+int dxf_dict_entries(const dxf_dict_index_t *index, dxf_record_id_t record,
+    const dxf_dict_entry_t **entries, size_t *cnt) {
+    size_t lo = 0, hi;
+
+    assert(index != NULL);
+    hi = index->dict_cnt;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(index->dict[mid] < record) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if((lo == index->dict_cnt) || (index->dict[lo] != record)) {
+        return 0;
+    }
+    *entries = &index->entry[index->entry_first[lo]];
+    *cnt = index->entry_first[lo + 1] - index->entry_first[lo];
+    return 1;
+}
+
+void dxf_dict_free_index(dxf_model_t *model) {
+    assert(model != NULL);
+    _dxf_dict_index_free(model->dict_index);
+    model->dict_index = (struct _dxf_dict_index_t*)NULL;
+}
@@ -0,0 +1,59 @@
+/** @file dxf_dict.h
+ *  @brief Object dictionaries.
+ *
+ * Internal dictionary tree of the OBJECTS section.  Loading only indexes
+ * objects (offset, handle, type); the first access reads every DICTIONARY
+ * back from the file for its entry names and pointers.
+ */
+#ifndef _DXF_DICT_H_
+#define _DXF_DICT_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* Size of the block dictionaries are read back through */
+#define DXF_DICT_BLOCK_SIZE 65536
+
+/* Entries of every dictionary */
+typedef struct _dxf_dict_index_t {
+    dxf_record_id_t *dict; /* Dictionary records, increasing */
+    size_t dict_cnt;
+    size_t *entry_first; /* Entries of dict[i] are entry[entry_first[i]]
+        up to entry[entry_first[i + 1]] */
+    dxf_dict_entry_t *entry; /* Entries, in file order per dictionary */
+    char *names; /* Entry names, NULL-terminated, entry[].name points in */
+} dxf_dict_index_t;
+
+/**
+Gets the dictionary index of a drawing, building it on first use.  Safe
+to call from several threads.
+
+@param  model   Record store.
+@param  filename    File the drawing was loaded from.
+@param  index   On success, the index.
+@returns dxfErrorOk on success, error code otherwise; a failed build is
+retried by the next call.
+*/
+dxf_error_t dxf_dict_index(dxf_model_t *model, const char *filename,
+    const dxf_dict_index_t **index);
+
+/**
+Gets the entries of a dictionary.
+
+@param  index   Dictionary index.
+@param  record  Record id.
+@param  entries On success, the entries.
+@param  cnt On success, the number of entries.
+@returns 1 on success, 0 if the record is not a dictionary.
+*/
+int dxf_dict_entries(const dxf_dict_index_t *index, dxf_record_id_t record,
+    const dxf_dict_entry_t **entries, size_t *cnt);
+
+/**
+Frees the dictionary index.
+
+@param  model   Record store.
+*/
+void dxf_dict_free_index(dxf_model_t *model);
+
+#endif
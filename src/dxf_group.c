@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+#include "dxf_group.h"
+#include "util.h"
+
+dxf_error_t dxf_group_code(const char *p, size_t len, int *group_code,
+    size_t *column) {
+    const char *end = p + len; /* End of line */
+    const char *digits; /* First non-blank */
+    unsigned int d; /* Current digit */
+    int code; /* Accumulated code */
+    int neg = 0; /* Leading minus seen */
+
+    while((p < end) && DXF_IS_BLANK(*p)) {
+        p++;
+    }
+    digits = p;
+    if((p < end) && (*p == '-')) {
+        neg = 1;
+        p++;
+    }
+
+    /* Fast path: codes are written as 1 to 3 digits, so unroll those */
+    if((p == end) || ((d = (unsigned int)(*p - '0')) > 9)) {
+        goto bad;
+    }
+    code = (int)d;
+    p++;
+    if((p < end) && ((d = (unsigned int)(*p - '0')) <= 9)) {
+        code = code * 10 + (int)d;
+        p++;
+        if((p < end) && ((d = (unsigned int)(*p - '0')) <= 9)) {
+            code = code * 10 + (int)d;
+            p++;
+            /* Slow path: 4 to 9 digits (XDATA and beyond) */
+            while((p < end) && ((d = (unsigned int)(*p - '0')) <= 9)) {
+                if(code >= 100000000) {
+                    /* A tenth digit would not fit */
+                    goto bad;
+                }
+                code = code * 10 + (int)d;
+                p++;
+            }
+        }
+    }
+
+    /* Anything after the digits must be blank (usually just CR) */
+    while(p < end) {
+        if(!DXF_IS_BLANK(*p)) {
+            goto bad;
+        }
+        p++;
+    }
+
+    *group_code = neg ? -code : code;
+    return dxfErrorOk;
+
+bad:
+    *column = (size_t)(p - digits);
+    if((p < end) && (isascii((int)*p) == 0)) {
+        return dxfErrorNonASCII;
+    }
+    return dxfErrorDigitExpected;
+}
+
+void dxf_group_trim(const char **line, size_t *len) {
+    const char *p = *line;
+    size_t n = *len;
+
+    while((n > 0) && (isspace((int)(unsigned char)*p) != 0)) {
+        p++;
+        n--;
+    }
+    while((n > 0) && (isspace((int)(unsigned char)p[n - 1]) != 0)) {
+        n--;
+    }
+    *line = p;
+    *len = n;
+}
+
+void dxf_group_reader_init(dxf_group_reader_t *rd, const char *buf,
+    size_t size) {
+    assert(rd != NULL);
+    assert((buf != NULL) || (size == 0));
+    rd->buf = buf;
+    rd->block = (char*)NULL;
+    rd->block_size = 0;
+    rd->fd = -1;
+    rd->stream = 0;
+    rd->size = size;
+    rd->pos = 0;
+    rd->base = 0;
+    rd->eof = 1;
+    rd->io_seconds = 0.0;
+}
+
+void dxf_group_reader_open(dxf_group_reader_t *rd, int fd, char *block,
+    size_t block_size) {
+    assert(rd != NULL);
+    assert(block != NULL);
+    assert(block_size > 0);
+    rd->buf = block;
+    rd->block = block;
+    rd->block_size = block_size;
+    rd->fd = fd;
+    rd->stream = 0;
+    rd->size = 0;
+    rd->pos = 0;
+    rd->base = 0;
+    rd->eof = 0;
+    rd->io_seconds = 0.0;
+}
+
+void dxf_group_reader_stream(dxf_group_reader_t *rd, int fd, char *block,
+    size_t block_size) {
+    dxf_group_reader_open(rd, fd, block, block_size);
+    rd->stream = 1;
+}
+
+void dxf_group_seek(dxf_group_reader_t *rd, dxf_off_t offset) {
+    assert(rd != NULL);
+    assert(rd->stream == 0);
+    if((offset >= rd->base) && (offset <= rd->base + (dxf_off_t)rd->size)) {
+        rd->pos = (size_t)(offset - rd->base);
+    } else if(rd->block == NULL) {
+        /* Past the end of the buffer */
+        rd->pos = rd->size;
+    } else {
+        rd->base = offset;
+        rd->size = 0;
+        rd->pos = 0;
+        rd->eof = 0;
+    }
+}
+
+dxf_error_t dxf_group_line(dxf_group_reader_t *rd, const char **line,
+    size_t *len) {
+    const char *nl; /* End of line */
+    size_t scanned = 0; /* Bytes after pos already searched for NL */
+    double t0; /* Refill start */
+    ssize_t n;
+
+    while((nl = (const char*)memchr(rd->buf + rd->pos + scanned, '\n',
+        rd->size - rd->pos - scanned)) == NULL) {
+        scanned = rd->size - rd->pos;
+        if(rd->eof != 0) {
+            /* Last line without NL */
+            if(scanned == 0) {
+                return dxfErrorEOF;
+            }
+            nl = rd->buf + rd->size;
+            break;
+        }
+
+        /* Slide the partial line to the front; scanned counts from pos */
+        if(rd->pos > 0) {
+            memmove(rd->block, rd->block + rd->pos, rd->size - rd->pos);
+            rd->size -= rd->pos;
+            rd->base += (dxf_off_t)rd->pos;
+            rd->pos = 0;
+        }
+        if(rd->size == rd->block_size) {
+            return dxfErrorLineTooLong;
+        }
+        t0 = util_now();
+        do {
+            n = (rd->stream != 0) ? read(rd->fd, rd->block + rd->size,
+                rd->block_size - rd->size) : pread(rd->fd,
+                rd->block + rd->size, rd->block_size - rd->size,
+                (off_t)(rd->base + (dxf_off_t)rd->size));
+        } while((n == -1) && (errno == EINTR));
+        rd->io_seconds += util_now() - t0;
+        if(n == -1) {
+            return dxfErrorFgets;
+        }
+        if(n == 0) {
+            rd->eof = 1;
+        }
+        rd->size += (size_t)n;
+    }
+    *line = rd->buf + rd->pos;
+    *len = (size_t)(nl - *line);
+    rd->pos += *len + ((nl < rd->buf + rd->size) ? 1 : 0);
+    return dxfErrorOk;
+}
+
+dxf_error_t dxf_group_read(dxf_group_reader_t *rd, int *group_code,
+    const char **value, size_t *len) {
+    const char *line;
+    size_t n, column;
+    dxf_error_t err;
+
+    if(((err = dxf_group_line(rd, &line, &n)) != dxfErrorOk) ||
+        ((err = dxf_group_code(line, n, group_code, &column)) != dxfErrorOk) ||
+        ((err = dxf_group_line(rd, value, len)) != dxfErrorOk)) {
+        return err;
+    }
+    dxf_group_trim(value, len);
+    return dxfErrorOk;
+}
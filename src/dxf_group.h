@@ -0,0 +1,129 @@
+/** @file dxf_group.h
+ *  @brief Group reader.
+ *
+ * Internal reading of group code and value lines, shared by loading and by
+ * every path that reads a drawing back from its file afterwards (probing,
+ * extended data, dictionaries, spilled vertices), so that each accepts
+ * exactly what loading accepted.  Lines end at NL; the last one may end
+ * at the end of the file instead.  Loading reads a mapping of the whole
+ * file, or a stream refilled with read() so that pipes load too.
+ */
+#ifndef _DXF_GROUP_H_
+#define _DXF_GROUP_H_
+
+#include "dxf.h"
+
+/* Whitespace accepted around group codes */
+#define DXF_IS_BLANK(c) (((c) == ' ') || ((c) == '\t') || ((c) == '\r') || \
+    ((c) == '\v') || ((c) == '\f'))
+
+/* Lines of a buffer held in memory, or of a file read a block at a time */
+typedef struct _dxf_group_reader_t {
+    const char *buf; /* Block, or the whole buffer */
+    char *block; /* Block read into, NULL if buf holds everything */
+    size_t block_size; /* Bytes block holds at most */
+    int fd; /* File the block is read from, -1 if none */
+    int stream; /* Non-zero if refilled with read(), which cannot seek */
+    size_t size; /* Bytes in buf */
+    size_t pos; /* Start of the next line in buf */
+    dxf_off_t base; /* File offset of buf[0] */
+    int eof; /* Non-zero once buf holds the last byte */
+    double io_seconds; /* Time spent refilling the block */
+} dxf_group_reader_t;
+
+/**
+Parses a group code line.  Skips leading blanks, accumulates an optionally
+negative decimal code of at most 9 digits and accepts trailing blanks.
+
+@param  p   Line, without its NL.
+@param  len Line length.
+@param  group_code  On success, contains the group code.
+@param  column  On failure, contains the offset of the offending character
+    from the first non-blank one.
+@returns dxfErrorOk on success, dxfErrorNonASCII or dxfErrorDigitExpected
+otherwise.
+*/
+dxf_error_t dxf_group_code(const char *p, size_t len, int *group_code,
+    size_t *column);
+
+/**
+Trims a value line of leading and trailing whitespace.
+
+@param  line    Line, without its NL; on return, its first kept byte.
+@param  len Line length; on return, the trimmed length.
+*/
+void dxf_group_trim(const char **line, size_t *len);
+
+/**
+Starts reading lines of a buffer held in memory.
+
+@param  rd  Reader.
+@param  buf Buffer, file offset 0.
+@param  size    Bytes of buf.
+*/
+void dxf_group_reader_init(dxf_group_reader_t *rd, const char *buf,
+    size_t size);
+
+/**
+Starts reading lines of a file a block at a time, from offset 0.
+
+@param  rd  Reader.
+@param  fd  File descriptor, read with pread().
+@param  block   Block of block_size bytes; no line may be longer.
+@param  block_size  Bytes of block.
+*/
+void dxf_group_reader_open(dxf_group_reader_t *rd, int fd, char *block,
+    size_t block_size);
+
+/**
+Starts reading lines of a stream a block at a time, from its current
+position, which counts as offset 0.  Cannot be moved with dxf_group_seek().
+
+@param  rd  Reader.
+@param  fd  File descriptor, read with read().
+@param  block   Block of block_size bytes; no line may be longer.
+@param  block_size  Bytes of block.
+*/
+void dxf_group_reader_stream(dxf_group_reader_t *rd, int fd, char *block,
+    size_t block_size);
+
+/**
+Moves a reader to a file offset, keeping the block if it holds it.
+
+@param  rd  Reader, not a stream.
+@param  offset  File offset, at the start of a line.
+*/
+void dxf_group_seek(dxf_group_reader_t *rd, dxf_off_t offset);
+
+/**
+Reads the next line.
+
+@param  rd  Reader.
+@param  line    On success, points to the line, without its NL; valid until
+    the next call.
+@param  len On success, contains the line length.
+@returns dxfErrorOk on success, dxfErrorEOF past the last line,
+dxfErrorLineTooLong if a line does not fit the block, dxfErrorFgets if
+reading failed.
+*/
+dxf_error_t dxf_group_line(dxf_group_reader_t *rd, const char **line,
+    size_t *len);
+
+/**
+Reads the next group, as loading parsed it.
+
+@param  rd  Reader.
+@param  group_code  On success, contains the group code.
+@param  value   On success, points to the trimmed value, not NULL-terminated;
+    valid until the next call.
+@param  len On success, contains the value length.
+@returns dxfErrorOk on success, error code of dxf_group_line() or
+dxf_group_code() otherwise.
+*/
+dxf_error_t dxf_group_read(dxf_group_reader_t *rd, int *group_code,
+    const char **value, size_t *len);
+
+/* File offset of the next line */
+#define DXF_GROUP_OFFSET(rd) ((rd)->base + (dxf_off_t)(rd)->pos)
+
+#endif
@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "dxf_index.h"
+
+/* Fibonacci hashing spreads sequential handles over the whole table */
+#define DXF_INDEX_HASH64(k) ((size_t)(((k) * 0x9E3779B97F4A7C15ULL) >> 32))
+
+/* FNV-1a */
+static uint32_t _dxf_names_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for(i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+int dxf_handle_index_init(dxf_handle_index_t *idx, size_t cnt,
+    unsigned long long *allocated) {
+    size_t slots = 16;
+
+    assert(idx != NULL);
+    while(slots < 2 * cnt) {
+        slots <<= 1;
+    }
+    memset(idx, 0, sizeof(*idx));
+    if((idx->slot = (dxf_handle_slot_t*)calloc(slots,
+        sizeof(dxf_handle_slot_t))) == NULL) {
+        return 0;
+    }
+    if(allocated != NULL) {
+        (*allocated) += slots * sizeof(dxf_handle_slot_t);
+    }
+    idx->mask = slots - 1;
+    return 1;
+}
+
+int dxf_handle_index_insert(dxf_handle_index_t *idx, uint64_t key,
+    uint32_t value) {
+    size_t i;
+
+    assert((idx != NULL) && (idx->slot != NULL));
+    assert(key != 0);
+    assert(idx->cnt < idx->mask);
+    for(i = DXF_INDEX_HASH64(key) & idx->mask; idx->slot[i].key != 0;
+        i = (i + 1) & idx->mask) {
+        if(idx->slot[i].key == key) {
+            return 0;
+        }
+    }
+    idx->slot[i].key = key;
+    idx->slot[i].value = value;
+    idx->cnt++;
+    return 1;
+}
+
+uint32_t dxf_handle_index_find(const dxf_handle_index_t *idx, uint64_t key) {
+    size_t i;
+
+    assert(idx != NULL);
+    if((idx->slot == NULL) || (key == 0)) {
+        return DXF_INDEX_NONE;
+    }
+    for(i = DXF_INDEX_HASH64(key) & idx->mask; idx->slot[i].key != 0;
+        i = (i + 1) & idx->mask) {
+        if(idx->slot[i].key == key) {
+            return idx->slot[i].value;
+        }
+    }
+    return DXF_INDEX_NONE;
+}
+
+void dxf_handle_index_free(dxf_handle_index_t *idx) {
+    assert(idx != NULL);
+    free(idx->slot);
+    memset(idx, 0, sizeof(*idx));
+}
+
+/* Finds the slot holding s, or the empty slot where it belongs */
+static size_t _dxf_names_slot(const dxf_names_t *names, const char *s,
+    size_t len, uint32_t h) {
+    size_t i;
+
+    for(i = h & names->mask; names->slot[i] != DXF_INDEX_NONE;
+        i = (i + 1) & names->mask) {
+        uint32_t id = names->slot[i];
+        if((names->hash[id] == h) && (strncmp(names->name[id], s, len) == 0)
+            && (names->name[id][len] == '\0')) {
+            break;
+        }
+    }
+    return i;
+}
+
+/* Doubles the slots and rehashes every name */
+static int _dxf_names_grow(dxf_names_t *names) {
+    size_t slots = (names->mask == 0) ? 64 : 2 * (names->mask + 1);
+    uint32_t *slot;
+    size_t i;
+
+    if((slot = (uint32_t*)malloc(slots * sizeof(uint32_t))) == NULL) {
+        return 0;
+    }
+    if(names->allocated != NULL) {
+        (*names->allocated) += slots * sizeof(uint32_t);
+    }
+    memset(slot, 0xFF, slots * sizeof(uint32_t));
+    free(names->slot);
+    names->slot = slot;
+    names->mask = slots - 1;
+    for(i = 0; i < names->cnt; i++) {
+        size_t j;
+        for(j = names->hash[i] & names->mask; slot[j] != DXF_INDEX_NONE;
+            j = (j + 1) & names->mask) {
+        }
+        slot[j] = (uint32_t)i;
+    }
+    return 1;
+}
+
+uint32_t dxf_names_intern(dxf_names_t *names, const char *s, size_t len) {
+    uint32_t h = _dxf_names_hash(s, len);
+    size_t i;
+    char *copy;
+
+    assert(names != NULL);
+    assert(s != NULL);
+
+    /* Keep the load at or below half */
+    if((2 * (names->cnt + 1) > names->mask) &&
+        (_dxf_names_grow(names) == 0)) {
+        return DXF_INDEX_NONE;
+    }
+    i = _dxf_names_slot(names, s, len, h);
+    if(names->slot[i] != DXF_INDEX_NONE) {
+        return names->slot[i];
+    }
+
+    if(names->cnt == names->cap) {
+        size_t cap = (names->cap == 0) ? 16 : 2 * names->cap;
+        char **name;
+        uint32_t *hash;
+        if((name = (char**)realloc(names->name, cap * sizeof(char*))) ==
+            NULL) {
+            return DXF_INDEX_NONE;
+        }
+        names->name = name;
+        if((hash = (uint32_t*)realloc(names->hash, cap * sizeof(uint32_t)))
+            == NULL) {
+            return DXF_INDEX_NONE;
+        }
+        names->hash = hash;
+        if(names->allocated != NULL) {
+            (*names->allocated) += cap * (sizeof(char*) + sizeof(uint32_t));
+        }
+        names->cap = cap;
+    }
+    if((copy = (char*)malloc(len + 1)) == NULL) {
+        return DXF_INDEX_NONE;
+    }
+    if(names->allocated != NULL) {
+        (*names->allocated) += len + 1;
+    }
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    names->name[names->cnt] = copy;
+    names->hash[names->cnt] = h;
+    names->slot[i] = (uint32_t)names->cnt;
+    return (uint32_t)names->cnt++;
+}
+
+uint32_t dxf_names_find(const dxf_names_t *names, const char *s) {
+    size_t len;
+
+    assert(names != NULL);
+    assert(s != NULL);
+    if(names->mask == 0) {
+        return DXF_INDEX_NONE;
+    }
+    len = strlen(s);
+    return names->slot[_dxf_names_slot(names, s, len,
+        _dxf_names_hash(s, len))];
+}
+
+void dxf_names_free(dxf_names_t *names) {
+    size_t i;
+
+    assert(names != NULL);
+    for(i = 0; i < names->cnt; i++) {
+        free(names->name[i]);
+    }
+    free(names->name);
+    free(names->hash);
+    free(names->slot);
+    names->name = (char**)NULL;
+    names->hash = (uint32_t*)NULL;
+    names->slot = (uint32_t*)NULL;
+    names->cnt = names->cap = names->mask = 0;
+}
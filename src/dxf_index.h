@@ -0,0 +1,100 @@
+/** @file dxf_index.h
+ *  @brief Hash tables used by the DXF model.
+ *
+ * Internal flat open-addressing tables: 64-bit handles to 32-bit record
+ * ids, and interned names to dense 32-bit ids.
+ */
+#ifndef _DXF_INDEX_H_
+#define _DXF_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Value returned by lookups that find nothing */
+#define DXF_INDEX_NONE ((uint32_t)0xFFFFFFFF)
+
+/* One slot of a handle index; key 0 marks an empty slot */
+typedef struct _dxf_handle_slot_t {
+    uint64_t key; /* Handle */
+    uint32_t value; /* Record id */
+} dxf_handle_slot_t;
+
+/* Handle to record id table, sized once for a known number of keys */
+typedef struct _dxf_handle_index_t {
+    dxf_handle_slot_t *slot; /* Slots, a power of two of them */
+    size_t mask; /* Slot count - 1 */
+    size_t cnt; /* Keys stored */
+} dxf_handle_index_t;
+
+/* Interned names, ids are dense and in order of first appearance */
+typedef struct _dxf_names_t {
+    char **name; /* Names by id */
+    uint32_t *hash; /* Hash of each name by id */
+    size_t cnt; /* Names stored */
+    size_t cap; /* Capacity of name and hash */
+    uint32_t *slot; /* Open-addressing slots holding ids */
+    size_t mask; /* Slot count - 1, slot is empty if 0 slots */
+    unsigned long long *allocated; /* Bytes allocated counter, or NULL */
+} dxf_names_t;
+
+/**
+Allocates a handle index for up to cnt keys at no more than half load.
+
+@param  idx Index.
+@param  cnt Number of keys that will be inserted.
+@param  allocated   Counter incremented by the bytes allocated, or NULL.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_handle_index_init(dxf_handle_index_t *idx, size_t cnt,
+    unsigned long long *allocated);
+
+/**
+Inserts a handle.  The first record inserted for a handle is kept.
+
+@param  idx Index.
+@param  key Handle, non-zero.
+@param  value   Record id.
+@returns 1 if inserted, 0 if the handle was already present.
+*/
+int dxf_handle_index_insert(dxf_handle_index_t *idx, uint64_t key,
+    uint32_t value);
+
+/**
+Looks up a handle.
+
+@param  idx Index.
+@param  key Handle.
+@returns Record id, DXF_INDEX_NONE if not present.
+*/
+uint32_t dxf_handle_index_find(const dxf_handle_index_t *idx, uint64_t key);
+
+/**
+Frees a handle index.
+*/
+void dxf_handle_index_free(dxf_handle_index_t *idx);
+
+/**
+Interns a name.
+
+@param  names   Name table, zeroed before first use.
+@param  s   Name, need not be terminated.
+@param  len Length of s.
+@returns Id of the name, DXF_INDEX_NONE if allocation failed.
+*/
+uint32_t dxf_names_intern(dxf_names_t *names, const char *s, size_t len);
+
+/**
+Looks up a name without adding it.
+
+@param  names   Name table.
+@param  s   NULL-terminated name.
+@returns Id of the name, DXF_INDEX_NONE if not present.
+*/
+uint32_t dxf_names_find(const dxf_names_t *names, const char *s);
+
+/**
+Frees a name table.
+*/
+void dxf_names_free(dxf_names_t *names);
+
+#endif
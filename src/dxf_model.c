@@ -0,0 +1,788 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "dxf_model.h"
+#include "dxf_block.h"
+#include "dxf_batch.h"
+#include "dxf_text.h"
+#include "dxf_dict.h"
+#include "dxf_compact.h"
+#include "dxf_spill.h"
+#include "dxf_share.h"
+#include "util.h"
+
+/* Pointer groups: soft/hard pointers and owners, hard pointer handles */
+#define DXF_IS_POINTER(c) ((((c) >= 330) && ((c) <= 369)) || \
+    (((c) >= 390) && ((c) <= 399)))
+
+/* Entity types with geometry */
+static const struct {
+    const char *type;
+    dxf_kind_t kind;
+} g_kinds[] = {
+    { "LINE", dxfKindLine },
+    { "POINT", dxfKindPoint },
+    { "CIRCLE", dxfKindCircle },
+    { "ARC", dxfKindArc },
+    { "ELLIPSE", dxfKindEllipse },
+    { "LWPOLYLINE", dxfKindLwPolyline },
+    { "POLYLINE", dxfKindPolyline },
+    { "SPLINE", dxfKindSpline },
+    { "TEXT", dxfKindText },
+    { "MTEXT", dxfKindMText },
+    { "ATTRIB", dxfKindText },
+    { "ATTDEF", dxfKindText },
+    { "INSERT", dxfKindInsert }
+};
+
+/* Grows an array to hold at least one more element */
+static int _dxf_model_reserve(dxf_model_t *model, void **array, size_t cnt,
+    size_t *cap, size_t size) {
+    void *p;
+    size_t n;
+
+    if(cnt < (*cap)) {
+        return 1;
+    }
+    n = ((*cap) == 0) ? 1024 : 2 * (*cap);
+    if((p = realloc(*array, n * size)) == NULL) {
+        return 0;
+    }
+    if(model->allocated != NULL) {
+        (*model->allocated) += n * size;
+    }
+    *array = p;
+    *cap = n;
+    return 1;
+}
+
+/* Makes sure the block with the given name id has an entry */
+static int _dxf_model_block(dxf_model_t *model, uint32_t id) {
+    while(id >= model->block_cap) {
+        size_t i = model->block_cap;
+        if(_dxf_model_reserve(model, (void**)&model->block, i,
+            &model->block_cap, sizeof(dxf_block_t)) == 0) {
+            return 0;
+        }
+        for(; i < model->block_cap; i++) {
+            memset(&model->block[i], 0, sizeof(dxf_block_t));
+            model->block[i].record = DXF_RECORD_NONE;
+        }
+    }
+    return 1;
+}
+
+/* Interns a block name, making sure the block has an entry */
+static uint32_t _dxf_model_block_name(dxf_model_t *model, const char *name) {
+    uint32_t id = dxf_names_intern(&model->block_names, name, strlen(name));
+
+    if((id == DXF_INDEX_NONE) || (_dxf_model_block(model, id) == 0)) {
+        return DXF_INDEX_NONE;
+    }
+    return id;
+}
+
+/* Grows the vertex array like _dxf_model_reserve(), keeping it aligned */
+static int _dxf_model_reserve_vertex(dxf_model_t *model) {
+    void *p;
+    size_t n;
+
+    if(model->vertex_cnt < model->vertex_cap) {
+        return 1;
+    }
+    n = (model->vertex_cap == 0) ? 1024 : 2 * model->vertex_cap;
+    if(posix_memalign(&p, DXF_VERTEX_ALIGN, n * 4 * sizeof(double)) != 0) {
+        return 0;
+    }
+    if(model->vertex_cnt > 0) {
+        memcpy(p, model->vertex, model->vertex_cnt * 4 * sizeof(double));
+    }
+    free(model->vertex);
+    free(model->world);
+    if(model->allocated != NULL) {
+        (*model->allocated) += n * 4 * sizeof(double);
+    }
+    model->vertex = (double*)p;
+    model->vertex_cap = n;
+    return 1;
+}
+
+/* Appends a vertex to the current entity */
+static double *_dxf_model_vertex(dxf_model_t *model, double x, double w) {
+    double *v;
+
+    if(_dxf_model_reserve_vertex(model) == 0) {
+        return (double*)NULL;
+    }
+    v = &model->vertex[4 * model->vertex_cnt++];
+    v[0] = x;
+    v[1] = 0.0;
+    v[2] = 0.0;
+    v[3] = w;
+    return v;
+}
+
+/* Appends a text group of the current entity, raw */
+static int _dxf_model_text(dxf_model_t *model, const dxf_entity_t *e,
+    const char *value) {
+    size_t len = strlen(value);
+    dxf_text_span_t *t;
+
+    /* MTEXT chunks of one entity are consecutive */
+    if((model->text_span_cnt == 0) ||
+        (model->text_span[model->text_span_cnt - 1].record != e->record)) {
+        if(_dxf_model_reserve(model, (void**)&model->text_span,
+            model->text_span_cnt, &model->text_span_cap,
+            sizeof(dxf_text_span_t)) == 0) {
+            return 0;
+        }
+        t = &model->text_span[model->text_span_cnt++];
+        t->record = e->record;
+        t->mtext = (e->kind == dxfKindMText);
+        t->first = model->text_cnt;
+        t->len = 0;
+    }
+    while(model->text_cnt + len > model->text_cap) {
+        if(_dxf_model_reserve(model, (void**)&model->text, model->text_cap,
+            &model->text_cap, 1) == 0) {
+            return 0;
+        }
+    }
+    memcpy(&model->text[model->text_cnt], value, len);
+    model->text_cnt += len;
+    model->text_span[model->text_span_cnt - 1].len += len;
+    return 1;
+}
+
+/* Closes the current record, committing anything it left pending */
+static int _dxf_model_finish(dxf_model_t *model) {
+    if(model->block_record != 0) {
+        uint32_t id = model->block_name;
+        model->block_record = 0;
+        if(id != DXF_INDEX_NONE) {
+            dxf_block_t *b = &model->block[id];
+            b->record = model->cur;
+            memcpy(b->base, model->block_base, sizeof(b->base));
+            b->first = (uint32_t)model->entity_cnt;
+            b->cnt = 0;
+            model->cur_block = id;
+        }
+    }
+    if(model->cur_vertex != 0) {
+        model->cur_vertex = 0;
+        /* Spline frame control points are not part of the outline */
+        if((model->vertex_flags & 16) == 0) {
+            double *v;
+            if((v = _dxf_model_vertex(model, 0.0, 0.0)) == NULL) {
+                return 0;
+            }
+            memcpy(v, model->vertex_p, sizeof(model->vertex_p));
+            model->entity[model->polyline].vertex_cnt++;
+        }
+    }
+    if((model->cur_entity != DXF_INDEX_NONE) && (model->weight_cnt > 0)) {
+        dxf_entity_t *e = &model->entity[model->cur_entity];
+        uint32_t i;
+        for(i = 0; (i < model->weight_cnt) && (i < e->vertex_cnt); i++) {
+            model->vertex[4 * (e->vertex - model->vertex_base + i) + 3] =
+                model->weight[i];
+        }
+    }
+    model->cur_entity = DXF_INDEX_NONE;
+    model->layer_record = 0;
+    model->keep_all = 0;
+    model->keep_props = 0;
+    return 1;
+}
+
+/* Starts an entity for the current record */
+static int _dxf_model_begin_entity(dxf_model_t *model, const char *type) {
+    dxf_entity_t *e;
+    size_t i;
+
+    if(_dxf_model_reserve(model, (void**)&model->entity, model->entity_cnt,
+        &model->entity_cap, sizeof(dxf_entity_t)) == 0) {
+        return 0;
+    }
+    e = &model->entity[model->entity_cnt];
+    memset(e, 0, sizeof(*e));
+    e->record = model->cur;
+    e->kind = dxfKindNone;
+    for(i = 0; i < sizeof(g_kinds) / sizeof(g_kinds[0]); i++) {
+        if(strcmp(type, g_kinds[i].type) == 0) {
+            e->kind = g_kinds[i].kind;
+            break;
+        }
+    }
+    e->block = model->cur_block;
+    e->name = DXF_INDEX_NONE;
+    e->layer = DXF_INDEX_NONE;
+    e->linetype = DXF_INDEX_NONE;
+    e->color = DXF_COLOR_BYLAYER;
+    e->n[2] = 1.0;
+    /* The previous entity is complete; a window drops its vertices */
+    if(model->vertex_window != 0) {
+        model->vertex_base += model->vertex_cnt;
+        model->vertex_cnt = 0;
+    }
+    e->vertex = model->vertex_base + model->vertex_cnt;
+    e->knot = model->knot_cnt;
+    if(e->kind == dxfKindInsert) {
+        e->s[DXF_S_41] = e->s[DXF_S_42] = e->s[DXF_S_43] = 1.0;
+    } else if(e->kind == dxfKindEllipse) {
+        e->s[DXF_S_42] = 2.0 * M_PI;
+    }
+    if(e->kind == dxfKindPolyline) {
+        model->polyline = (uint32_t)model->entity_cnt;
+    }
+    model->cur_entity = (uint32_t)model->entity_cnt++;
+    if(model->defer_geometry != 0) {
+        model->keep_props = 1;
+    } else {
+        model->keep_all = 1;
+    }
+    model->weight_cnt = 0;
+    return 1;
+}
+
+void dxf_model_init(dxf_model_t *model, unsigned long long *allocated) {
+    assert(model != NULL);
+    memset(model, 0, sizeof(*model));
+    model->cur = DXF_INDEX_NONE;
+    model->cur_entity = DXF_INDEX_NONE;
+    model->cur_block = DXF_INDEX_NONE;
+    model->polyline = DXF_INDEX_NONE;
+    model->objects_first = DXF_INDEX_NONE;
+    model->allocated = allocated;
+    model->types.allocated = allocated;
+    model->block_names.allocated = allocated;
+    model->layers.allocated = allocated;
+    model->linetypes.allocated = allocated;
+    model->table_layers.allocated = allocated;
+    (void)pthread_mutex_init(&model->lock, NULL);
+    (void)pthread_mutex_init(&model->batch_lock, NULL);
+    (void)pthread_mutex_init(&model->text_lock, NULL);
+    (void)pthread_mutex_init(&model->dict_lock, NULL);
+    (void)pthread_rwlock_init(&model->compact_lock, NULL);
+    (void)pthread_mutex_init(&model->spill_lock, NULL);
+    (void)pthread_mutex_init(&model->geometry_lock, NULL);
+}
+
+void dxf_model_begin_section(dxf_model_t *model, const char *name,
+    uint32_t section) {
+    assert(model != NULL);
+    assert(name != NULL);
+    model->section = section;
+    model->cur_block = DXF_INDEX_NONE;
+    model->polyline = DXF_INDEX_NONE;
+    if(strcmp(name, "BLOCKS") == 0) {
+        model->section_kind = dxfSectionBlocks;
+    } else if(strcmp(name, "ENTITIES") == 0) {
+        model->section_kind = dxfSectionEntities;
+    } else if(strcmp(name, "TABLES") == 0) {
+        model->section_kind = dxfSectionTables;
+    } else if(strcmp(name, "OBJECTS") == 0) {
+        model->section_kind = dxfSectionObjects;
+    } else {
+        model->section_kind = dxfSectionOther;
+    }
+}
+
+int dxf_model_begin_record(dxf_model_t *model, const char *type,
+    dxf_off_t offset, dxf_off_t line) {
+    dxf_record_t *r;
+    uint32_t id;
+
+    assert(model != NULL);
+    assert(type != NULL);
+    assert(model->record_cnt < DXF_INDEX_NONE);
+
+    if((_dxf_model_finish(model) == 0) ||
+        (_dxf_model_reserve(model, (void**)&model->record, model->record_cnt,
+        &model->record_cap, sizeof(dxf_record_t)) == 0) ||
+        ((id = dxf_names_intern(&model->types, type, strlen(type))) ==
+        DXF_INDEX_NONE)) {
+        return 0;
+    }
+    r = &model->record[model->record_cnt];
+    r->handle = 0;
+    r->offset = offset;
+    r->line = line;
+    r->pointer = model->pointer_cnt;
+    r->pointer_cnt = 0;
+    r->owner = DXF_INDEX_NONE;
+    r->type = id;
+    r->section = model->section;
+    model->cur = (uint32_t)model->record_cnt++;
+    model->in_group = 0;
+
+    if(model->section_kind == dxfSectionOther) {
+        return 1;
+    }
+
+    /* Objects are only indexed; dxf_dict.c reads dictionaries back */
+    if(model->section_kind == dxfSectionObjects) {
+        if(model->objects_first == DXF_INDEX_NONE) {
+            model->objects_first = model->cur;
+        }
+        return 1;
+    }
+
+    /* Layer names, for drawings that define a layer without using it */
+    if(model->section_kind == dxfSectionTables) {
+        if(strcmp(type, "LAYER") == 0) {
+            model->layer_record = 1;
+            model->keep_all = 1;
+        }
+        return 1;
+    }
+
+    /* Vertices of the last POLYLINE, up to SEQEND */
+    if(strcmp(type, "VERTEX") == 0) {
+        if((model->polyline != DXF_INDEX_NONE) &&
+            (model->defer_geometry == 0)) {
+            model->cur_vertex = 1;
+            model->keep_all = 1;
+            memset(model->vertex_p, 0, sizeof(model->vertex_p));
+            model->vertex_flags = 0;
+        }
+        return 1;
+    }
+    model->polyline = DXF_INDEX_NONE;
+    if(strcmp(type, "SEQEND") == 0) {
+        return 1;
+    }
+
+    /* Block definitions */
+    if(model->section_kind == dxfSectionBlocks) {
+        if(strcmp(type, "BLOCK") == 0) {
+            model->cur_block = DXF_INDEX_NONE;
+            model->block_record = 1;
+            model->block_name = DXF_INDEX_NONE;
+            memset(model->block_base, 0, sizeof(model->block_base));
+            model->keep_all = 1;
+            return 1;
+        }
+        if(strcmp(type, "ENDBLK") == 0) {
+            if(model->cur_block != DXF_INDEX_NONE) {
+                dxf_block_t *b = &model->block[model->cur_block];
+                b->cnt = (uint32_t)model->entity_cnt - b->first;
+            }
+            model->cur_block = DXF_INDEX_NONE;
+            return 1;
+        }
+        if(model->cur_block == DXF_INDEX_NONE) {
+            return 1;
+        }
+    }
+    return _dxf_model_begin_entity(model, type);
+}
+
+void dxf_model_end_record(dxf_model_t *model) {
+    assert(model != NULL);
+    (void)_dxf_model_finish(model);
+    model->cur = DXF_INDEX_NONE;
+}
+
+/* Adds a group of the current entity */
+static int _dxf_model_entity_group(dxf_model_t *model, int group_code,
+    const char *value) {
+    dxf_entity_t *e = &model->entity[model->cur_entity];
+    double *v;
+
+    /* Extrusion, the same for every entity */
+    if((group_code >= 210) && (group_code <= 230) &&
+        (group_code % 10 == 0)) {
+        e->n[(group_code - 210) / 10] = util_atof(value);
+        return 1;
+    }
+
+    /* Properties, the same for every entity */
+    if(group_code == 8) {
+        e->layer = dxf_names_intern(&model->layers, value, strlen(value));
+        return (e->layer != DXF_INDEX_NONE);
+    } else if(group_code == 6) {
+        e->linetype = dxf_names_intern(&model->linetypes, value,
+            strlen(value));
+        return (e->linetype != DXF_INDEX_NONE);
+    } else if(group_code == 62) {
+        e->color = atoi(value);
+        return 1;
+    }
+
+    /* Text: group 1, which MTEXT splits into group 3 chunks before it */
+    if(((group_code == 1) && ((e->kind == dxfKindText) ||
+        (e->kind == dxfKindMText))) || ((group_code == 3) &&
+        (e->kind == dxfKindMText))) {
+        return _dxf_model_text(model, e, value);
+    }
+
+    switch(e->kind) {
+        case dxfKindNone:
+            return 1;
+        case dxfKindLwPolyline:
+            if(group_code == 10) {
+                if(_dxf_model_vertex(model, util_atof(value),
+                    0.0) == NULL) {
+                    return 0;
+                }
+                /* The store may have moved */
+                e = &model->entity[model->cur_entity];
+                e->vertex_cnt++;
+                return 1;
+            }
+            v = (e->vertex_cnt > 0) ? &model->vertex[4 * (e->vertex -
+                model->vertex_base + e->vertex_cnt - 1)] : (double*)NULL;
+            if((group_code == 20) && (v != NULL)) {
+                v[1] = util_atof(value);
+            } else if((group_code == 42) && (v != NULL)) {
+                v[3] = util_atof(value);
+            } else if(group_code == 38) {
+                e->p[2] = util_atof(value);
+            } else if(group_code == 70) {
+                e->i70 = atoi(value);
+            }
+            return 1;
+        case dxfKindSpline:
+            if(group_code == 10) {
+                if(_dxf_model_vertex(model, util_atof(value),
+                    1.0) == NULL) {
+                    return 0;
+                }
+                e = &model->entity[model->cur_entity];
+                e->vertex_cnt++;
+                return 1;
+            }
+            v = (e->vertex_cnt > 0) ? &model->vertex[4 * (e->vertex -
+                model->vertex_base + e->vertex_cnt - 1)] : (double*)NULL;
+            if(((group_code == 20) || (group_code == 30)) && (v != NULL)) {
+                v[(group_code - 10) / 10] = util_atof(value);
+            } else if(group_code == 40) {
+                if(_dxf_model_reserve(model, (void**)&model->knot,
+                    model->knot_cnt, &model->knot_cap, sizeof(double)) ==
+                    0) {
+                    return 0;
+                }
+                model->knot[model->knot_cnt++] = util_atof(value);
+                e->knot_cnt++;
+            } else if(group_code == 41) {
+                /* Weights may come before the control points */
+                if(_dxf_model_reserve(model, (void**)&model->weight,
+                    model->weight_cnt, &model->weight_cap, sizeof(double)) ==
+                    0) {
+                    return 0;
+                }
+                model->weight[model->weight_cnt++] = util_atof(value);
+            } else if(group_code == 70) {
+                e->i70 = atoi(value);
+            } else if(group_code == 71) {
+                e->i71 = atoi(value);
+            }
+            return 1;
+        case dxfKindInsert:
+            if(group_code == 2) {
+                if((e->name = _dxf_model_block_name(model, value)) ==
+                    DXF_INDEX_NONE) {
+                    return 0;
+                }
+                return 1;
+            }
+            break;
+        default:
+            break;
+    }
+
+    /* Points and scalars, as written */
+    if((group_code >= 10) && (group_code <= 31)) {
+        if(group_code % 10 == 0) {
+            e->p[group_code / 10 - 1] = util_atof(value);
+        } else if(group_code % 10 == 1) {
+            e->q[group_code / 10 - 1] = util_atof(value);
+        }
+    } else if((group_code >= 40) && (group_code <= 45)) {
+        e->s[DXF_S_40 + group_code - 40] = util_atof(value);
+    } else if((group_code == 50) || (group_code == 51)) {
+        e->s[DXF_S_50 + group_code - 50] = util_atof(value);
+    } else if(group_code == 70) {
+        e->i70 = atoi(value);
+    } else if(group_code == 71) {
+        e->i71 = atoi(value);
+    }
+    return 1;
+}
+
+int dxf_model_add_xdata(dxf_model_t *model, dxf_off_t start, dxf_off_t end) {
+    dxf_xdata_span_t *x;
+
+    if(model->cur == DXF_INDEX_NONE) {
+        return 1;
+    }
+    if((model->xdata_span_cnt == 0) ||
+        (model->xdata_span[model->xdata_span_cnt - 1].record != model->cur)) {
+        if(_dxf_model_reserve(model, (void**)&model->xdata_span,
+            model->xdata_span_cnt, &model->xdata_span_cap,
+            sizeof(dxf_xdata_span_t)) == 0) {
+            return 0;
+        }
+        x = &model->xdata_span[model->xdata_span_cnt++];
+        x->record = model->cur;
+        x->offset = start;
+    } else {
+        x = &model->xdata_span[model->xdata_span_cnt - 1];
+    }
+    x->length = end - x->offset;
+    return 1;
+}
+
+int dxf_model_add_group(dxf_model_t *model, int group_code,
+    const char *value) {
+    dxf_record_t *r;
+
+    if(model->cur == DXF_INDEX_NONE) {
+        return 1;
+    }
+    r = &model->record[model->cur];
+    if((group_code == 5) || (group_code == 105)) {
+        if(r->handle == 0) {
+            (void)dxf_model_parse_handle(value, &r->handle);
+        }
+        return 1;
+    } else if(group_code == 102) {
+        /* "{ACAD_REACTORS" ... "}" */
+        model->in_group = (value[0] == '{');
+        return 1;
+    } else if(DXF_IS_POINTER(group_code)) {
+        dxf_pointer_t *p;
+        if(_dxf_model_reserve(model, (void**)&model->pointer,
+            model->pointer_cnt, &model->pointer_cap, sizeof(dxf_pointer_t))
+            == 0) {
+            return 0;
+        }
+        p = &model->pointer[model->pointer_cnt++];
+        p->group_code = group_code;
+        p->target = DXF_RECORD_NONE;
+        if(dxf_model_parse_handle(value, &p->handle) == 0) {
+            p->handle = 0;
+        }
+        if((group_code == 330) && (model->in_group == 0) &&
+            (r->owner == DXF_INDEX_NONE)) {
+            r->owner = r->pointer_cnt;
+        }
+        r->pointer_cnt++;
+        return 1;
+    }
+
+    if(model->cur_entity != DXF_INDEX_NONE) {
+        return _dxf_model_entity_group(model, group_code, value);
+    }
+    if(model->cur_vertex != 0) {
+        if((group_code == 10) || (group_code == 20) || (group_code == 30)) {
+            model->vertex_p[group_code / 10 - 1] = util_atof(value);
+        } else if(group_code == 42) {
+            model->vertex_p[3] = util_atof(value);
+        } else if(group_code == 70) {
+            model->vertex_flags = atoi(value);
+        }
+    } else if(model->layer_record != 0) {
+        if((group_code == 2) && (dxf_names_intern(&model->table_layers,
+            value, strlen(value)) == DXF_INDEX_NONE)) {
+            return 0;
+        }
+    } else if(model->block_record != 0) {
+        if(group_code == 2) {
+            if((model->block_name = _dxf_model_block_name(model, value)) ==
+                DXF_INDEX_NONE) {
+                return 0;
+            }
+        } else if((group_code == 10) || (group_code == 20) ||
+            (group_code == 30)) {
+            model->block_base[group_code / 10 - 1] = util_atof(value);
+        }
+    }
+    return 1;
+}
+
+int dxf_model_build_index(dxf_model_t *model) {
+    size_t i;
+
+    assert(model != NULL);
+    dxf_model_end_record(model);
+    if(dxf_handle_index_init(&model->handles, model->record_cnt,
+        model->allocated) == 0) {
+        return 0;
+    }
+    for(i = 0; i < model->record_cnt; i++) {
+        if(model->record[i].handle != 0) {
+            (void)dxf_handle_index_insert(&model->handles,
+                model->record[i].handle, (uint32_t)i);
+        }
+    }
+    for(i = 0; i < model->pointer_cnt; i++) {
+        model->pointer[i].target = dxf_handle_index_find(&model->handles,
+            model->pointer[i].handle);
+    }
+
+    /* Record to entity map */
+    if((model->record_entity = (uint32_t*)malloc((model->record_cnt + 1) *
+        sizeof(uint32_t))) == NULL) {
+        return 0;
+    }
+    if(model->allocated != NULL) {
+        (*model->allocated) += (model->record_cnt + 1) * sizeof(uint32_t);
+    }
+    memset(model->record_entity, 0xFF, (model->record_cnt + 1) *
+        sizeof(uint32_t));
+    for(i = 0; i < model->entity_cnt; i++) {
+        dxf_entity_t *e = &model->entity[i];
+        model->record_entity[e->record] = (uint32_t)i;
+        if((e->layer == DXF_INDEX_NONE) && ((e->layer =
+            dxf_names_intern(&model->layers, "0", 1)) == DXF_INDEX_NONE)) {
+            return 0;
+        }
+        if((e->linetype == DXF_INDEX_NONE) && ((e->linetype =
+            dxf_names_intern(&model->linetypes, "BYLAYER", 7)) ==
+            DXF_INDEX_NONE)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void dxf_model_free(dxf_model_t *model) {
+    assert(model != NULL);
+    dxf_block_free_caches(model);
+    dxf_batch_free_caches(model);
+    dxf_text_free_index(model);
+    dxf_dict_free_index(model);
+    dxf_compact_free(model);
+    dxf_spill_free(model);
+    dxf_share_detach(model);
+    free(model->record);
+    free(model->pointer);
+    free(model->entity);
+    free(model->record_entity);
+    free(model->vertex);
+    free(model->world);
+    free(model->knot);
+    free(model->weight);
+    free(model->block);
+    free(model->text);
+    free(model->text_span);
+    free(model->xdata_span);
+    dxf_names_free(&model->types);
+    dxf_names_free(&model->block_names);
+    dxf_names_free(&model->layers);
+    dxf_names_free(&model->linetypes);
+    dxf_names_free(&model->table_layers);
+    dxf_handle_index_free(&model->handles);
+    (void)pthread_mutex_destroy(&model->lock);
+    (void)pthread_mutex_destroy(&model->batch_lock);
+    (void)pthread_mutex_destroy(&model->text_lock);
+    (void)pthread_mutex_destroy(&model->dict_lock);
+    (void)pthread_rwlock_destroy(&model->compact_lock);
+    (void)pthread_mutex_destroy(&model->spill_lock);
+    (void)pthread_mutex_destroy(&model->geometry_lock);
+    dxf_model_init(model, model->allocated);
+}
+
+dxf_error_t dxf_model_copy_vertices(dxf_model_t *model, int world,
+    size_t first, size_t cnt, double *out) {
+    assert(model != NULL);
+    assert((out != NULL) || (cnt == 0));
+    assert(first + cnt <= model->vertex_cnt);
+
+    /* Decoders share the lock; only expanding the store excludes them */
+    (void)pthread_rwlock_rdlock(&model->compact_lock);
+    if(model->compact != NULL) {
+        dxf_compact_decode(model->compact, world, first, cnt, out);
+        (void)pthread_rwlock_unlock(&model->compact_lock);
+        return dxfErrorOk;
+    }
+    (void)pthread_rwlock_unlock(&model->compact_lock);
+
+    /* A store that is not compact never becomes compact */
+    return dxf_spill_copy(model, world, first, cnt, out);
+}
+
+void dxf_vertex_scratch_init(dxf_vertex_scratch_t *scratch) {
+    assert(scratch != NULL);
+    scratch->v = (double*)NULL;
+    scratch->cap = 0;
+    scratch->err = dxfErrorOk;
+}
+
+void dxf_vertex_scratch_free(dxf_vertex_scratch_t *scratch) {
+    assert(scratch != NULL);
+    free(scratch->v);
+    dxf_vertex_scratch_init(scratch);
+}
+
+const double *dxf_model_entity_vertices(dxf_model_t *model,
+    const dxf_entity_t *e, int world, dxf_vertex_scratch_t *scratch) {
+    const double *v;
+    dxf_error_t err;
+
+    assert(model != NULL);
+    assert((e != NULL) && (e->vertex_cnt > 0));
+    assert(scratch != NULL);
+
+    /* Buffers in memory stay until the store is freed */
+    v = (const double*)NULL;
+    (void)pthread_rwlock_rdlock(&model->compact_lock);
+    if(model->compact == NULL) {
+        (void)pthread_mutex_lock(&model->spill_lock);
+        if(model->spill == NULL) {
+            v = (world != 0) ? model->world : model->vertex;
+        }
+        (void)pthread_mutex_unlock(&model->spill_lock);
+    }
+    (void)pthread_rwlock_unlock(&model->compact_lock);
+    if(v != NULL) {
+        return &v[4 * e->vertex];
+    }
+
+    if(e->vertex_cnt > scratch->cap) {
+        void *p = realloc(scratch->v, e->vertex_cnt * 4 * sizeof(double));
+        if(p == NULL) {
+            scratch->err = dxfErrorNoMemory;
+            return (const double*)NULL;
+        }
+        scratch->v = (double*)p;
+        scratch->cap = e->vertex_cnt;
+    }
+    if((err = dxf_model_copy_vertices(model, world, e->vertex, e->vertex_cnt,
+        scratch->v)) != dxfErrorOk) {
+        scratch->err = err;
+        return (const double*)NULL;
+    }
+    return scratch->v;
+}
+
+int dxf_model_parse_handle(const char *s, uint64_t *handle) {
+    uint64_t h = 0;
+    int n;
+
+    assert(s != NULL);
+    assert(handle != NULL);
+    for(n = 0; s[n] != '\0'; n++) {
+        unsigned int c = (unsigned char)s[n];
+        unsigned int d;
+        if(c - '0' <= 9) {
+            d = c - '0';
+        } else if((c | 0x20) - 'a' <= 5) {
+            d = (c | 0x20) - 'a' + 10;
+        } else {
+            return 0;
+        }
+        if(n == 16) {
+            return 0;
+        }
+        h = (h << 4) | d;
+    }
+    if(n == 0) {
+        return 0;
+    }
+    *handle = h;
+    return 1;
+}
@@ -0,0 +1,387 @@
+/** @file dxf_model.h
+ *  @brief DXF record store.
+ *
+ * Internal store of every record (group 0 to the next group 0) outside the
+ * HEADER section, filled group by group during the scan, plus the handle
+ * index built once the scan is done.  Entities with geometry and block
+ * definitions are kept alongside the records.
+ */
+#ifndef _DXF_MODEL_H_
+#define _DXF_MODEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "dxf.h"
+#include "dxf_index.h"
+
+/* One record */
+typedef struct _dxf_record_t {
+    uint64_t handle; /* Group 5 (105 for DIMSTYLE), 0 if none */
+    dxf_off_t offset; /* File offset of the group 0 line */
+    dxf_off_t line; /* Line number of the group 0 line */
+    size_t pointer; /* First of this record's entries in pointer */
+    uint32_t pointer_cnt; /* Number of pointers */
+    uint32_t owner; /* Owner pointer, relative to pointer, or
+        DXF_INDEX_NONE */
+    uint32_t type; /* Id of the group 0 value in types */
+    uint32_t section; /* Index of the section in the drawing */
+} dxf_record_t;
+
+/* Sections the store treats differently */
+typedef enum { dxfSectionOther, dxfSectionTables, dxfSectionBlocks,
+    dxfSectionEntities, dxfSectionObjects } dxf_section_kind_t;
+
+/* Entities with geometry */
+typedef enum { dxfKindNone, dxfKindLine, dxfKindPoint, dxfKindCircle,
+    dxfKindArc, dxfKindEllipse, dxfKindLwPolyline, dxfKindPolyline,
+    dxfKindSpline, dxfKindText, dxfKindInsert, dxfKindMText } dxf_kind_t;
+
+/* Polyline flags (group 70) */
+#define DXF_POLYLINE_CLOSED 1
+#define DXF_POLYLINE_3D 8
+#define DXF_POLYLINE_MESH (16 | 64)
+
+/* Entities whose points are in their OCS; the rest are in WCS */
+#define DXF_ENTITY_IS_OCS(e) (((e)->kind == dxfKindCircle) || \
+    ((e)->kind == dxfKindArc) || ((e)->kind == dxfKindLwPolyline) || \
+    ((e)->kind == dxfKindText) || ((e)->kind == dxfKindInsert) || \
+    (((e)->kind == dxfKindPolyline) && \
+    (((e)->i70 & (DXF_POLYLINE_3D | DXF_POLYLINE_MESH)) == 0)))
+
+/* Spline flags (group 70) */
+#define DXF_SPLINE_CLOSED 1
+
+/* Color numbers (group 62) with a meaning of their own */
+#define DXF_COLOR_BYBLOCK 0
+#define DXF_COLOR_BYLAYER 256
+
+/* Scalar groups kept per entity, index into dxf_entity_t.s */
+#define DXF_S_40 0
+#define DXF_S_41 1
+#define DXF_S_42 2
+#define DXF_S_43 3
+#define DXF_S_44 4
+#define DXF_S_45 5
+#define DXF_S_50 6
+#define DXF_S_51 7
+#define DXF_S_CNT 8
+
+/*
+An entity, with the groups its geometry needs.  Points are as written,
+in the entity's OCS where the entity has one.
+*/
+typedef struct _dxf_entity_t {
+    dxf_record_id_t record; /* Record of the entity */
+    uint32_t kind; /* dxf_kind_t */
+    uint32_t block; /* Block defining the entity, DXF_INDEX_NONE outside
+        BLOCKS */
+    uint32_t name; /* INSERT: block id of group 2 */
+    uint32_t layer; /* Id of the group 8 layer name in layers */
+    uint32_t linetype; /* Id of the group 6 linetype name in linetypes */
+    int color; /* Group 62, DXF_COLOR_BYLAYER if absent */
+    int i70; /* Group 70: flags, INSERT column count */
+    int i71; /* Group 71: INSERT row count, SPLINE degree */
+    double p[3]; /* Group 10 (LWPOLYLINE: z is the 38 elevation) */
+    double q[3]; /* Group 11 */
+    double n[3]; /* Group 210 extrusion */
+    double wp[3]; /* p in WCS, filled by dxf_ocs_to_wcs() */
+    double wq[3]; /* q in WCS */
+    double s[DXF_S_CNT]; /* Scalars, see DXF_S_* */
+    size_t vertex; /* First vertex in the store's vertex array */
+    size_t knot; /* First knot in the store's knot array */
+    uint32_t vertex_cnt; /* Polyline vertices, SPLINE control points */
+    uint32_t knot_cnt; /* SPLINE knots */
+} dxf_entity_t;
+
+/* Per-block cache of flattened definitions, owned by dxf_block.c */
+struct _dxf_block_cache_t;
+
+/* Flattened drawings by tolerance, owned by dxf_batch.c */
+struct _dxf_batch_t;
+
+/* Quantized vertex buffers, owned by dxf_compact.c */
+struct _dxf_compact_t;
+
+/* Vertex buffers read back from the file, owned by dxf_spill.c */
+struct _dxf_spill_t;
+
+/* Dictionaries of OBJECTS, owned by dxf_dict.c */
+struct _dxf_dict_index_t;
+
+/* Trigram index of entity text, owned by dxf_text.c */
+struct _dxf_text_index_t;
+
+/* Text of a TEXT, MTEXT, ATTRIB or ATTDEF entity, raw as written */
+typedef struct _dxf_text_span_t {
+    dxf_record_id_t record; /* Record of the entity */
+    int mtext; /* Non-zero if MTEXT formatting codes apply */
+    size_t first; /* First byte in the store's text array */
+    size_t len; /* Bytes: group 1, after the group 3 chunks of MTEXT */
+} dxf_text_span_t;
+
+/* Extended data of a record, left in the file until read */
+typedef struct _dxf_xdata_span_t {
+    dxf_record_id_t record; /* Record holding the data */
+    dxf_off_t offset; /* File offset of the first group code line */
+    dxf_off_t length; /* Bytes up to the end of the last value line */
+} dxf_xdata_span_t;
+
+/* A block definition, indexed by the id of its name in block_names */
+typedef struct _dxf_block_t {
+    dxf_record_id_t record; /* BLOCK record, DXF_RECORD_NONE if the block
+        is referenced but never defined */
+    double base[3]; /* Base point, group 10 */
+    uint32_t first; /* First entity of the definition */
+    uint32_t cnt; /* Number of entities */
+    struct _dxf_block_cache_t *cache; /* Flattened definitions */
+} dxf_block_t;
+
+/* Record store */
+typedef struct _dxf_model_t {
+    dxf_record_t *record; /* Records, in file order */
+    size_t record_cnt;
+    size_t record_cap;
+    dxf_pointer_t *pointer; /* Pointers of all records, by record */
+    size_t pointer_cnt;
+    size_t pointer_cap;
+    dxf_names_t types; /* Record type names */
+    dxf_handle_index_t handles; /* Handle to record id */
+    dxf_entity_t *entity; /* Entities, in file order */
+    size_t entity_cnt;
+    size_t entity_cap;
+    uint32_t *record_entity; /* Entity of each record or DXF_INDEX_NONE,
+        filled by dxf_model_build_index() */
+    double *vertex; /* x, y, z, w per vertex; w is the bulge of polyline
+        vertices, the weight of SPLINE control points.  Aligned to
+        DXF_VERTEX_ALIGN */
+    size_t vertex_cnt;
+    size_t vertex_cap;
+    size_t vertex_base; /* Number of vertex[0], non-zero only while
+        loading with vertex_window set */
+    int vertex_window; /* Non-zero to keep only the vertices of the
+        current entity while loading, see dxf_spill.h */
+    double *world; /* vertex in WCS, same layout, filled by
+        dxf_ocs_to_wcs(); 2D polylines get their elevation as z */
+    double *knot; /* SPLINE knots */
+    size_t knot_cnt;
+    size_t knot_cap;
+    dxf_names_t block_names; /* Block names, id is the block id */
+    dxf_names_t layers; /* Layer names of entities */
+    dxf_names_t linetypes; /* Linetype names of entities */
+    dxf_names_t table_layers; /* Names of the LAYER table entries */
+    dxf_block_t *block; /* Blocks by id */
+    size_t block_cap;
+    pthread_mutex_t lock; /* Guards the block cache lists */
+    struct _dxf_batch_t *batch; /* Flattened drawings */
+    pthread_mutex_t batch_lock; /* Guards batch */
+    char *text; /* Raw text of entities, not NULL-terminated */
+    size_t text_cnt;
+    size_t text_cap;
+    dxf_text_span_t *text_span; /* Text of each text entity, in file
+        order */
+    size_t text_span_cnt;
+    size_t text_span_cap;
+    struct _dxf_text_index_t *text_index; /* Built on first search */
+    pthread_mutex_t text_lock; /* Guards text_index */
+    uint32_t objects_first; /* First record of OBJECTS, the named object
+        dictionary; DXF_INDEX_NONE if none */
+    struct _dxf_dict_index_t *dict_index; /* Built on first access */
+    pthread_mutex_t dict_lock; /* Guards dict_index */
+    dxf_xdata_span_t *xdata_span; /* Extended data, in file order */
+    size_t xdata_span_cnt;
+    size_t xdata_span_cap;
+    struct _dxf_compact_t *compact; /* Quantized vertex and world, NULL
+        unless loaded compact; vertex and world are NULL while set */
+    pthread_rwlock_t compact_lock; /* Guards compact: decoding reads it,
+        dxf_compact_expand() writes it */
+    struct _dxf_spill_t *spill; /* Blocks of vertex and world read back
+        from the file, NULL unless loaded with a budget; vertex and world
+        are NULL while set */
+    pthread_mutex_t spill_lock; /* Guards spill */
+    int defer_geometry; /* Non-zero to leave the geometry of entities in
+        the file while loading, until dxf_spill_geometry() reads it */
+    pthread_mutex_t geometry_lock; /* Guards defer_geometry */
+    const void *share; /* Shared segment the arrays point into, see
+        dxf_share.h; NULL unless attached */
+    size_t share_size;
+    const uint16_t *codepage; /* Code page of raw strings, NULL if UTF-8;
+        set after loading */
+    uint32_t cur; /* Record receiving groups, DXF_INDEX_NONE if none */
+    int in_group; /* Non-zero inside a 102 "{..." group of cur */
+    dxf_section_kind_t section_kind; /* Kind of the current section */
+    uint32_t section; /* Index of the current section */
+    uint32_t cur_entity; /* Entity receiving groups, DXF_INDEX_NONE */
+    uint32_t cur_block; /* Block being defined, DXF_INDEX_NONE */
+    int block_record; /* Current record is a BLOCK */
+    int layer_record; /* Current record is a LAYER table entry */
+    uint32_t block_name; /* Pending BLOCK name id, DXF_INDEX_NONE */
+    double block_base[3]; /* Pending BLOCK base point */
+    uint32_t polyline; /* POLYLINE receiving VERTEX records */
+    int cur_vertex; /* Current record is a VERTEX of polyline */
+    int keep_all; /* Current record needs every group */
+    int keep_props; /* Current entity needs only its properties and text,
+        its geometry being deferred */
+    double vertex_p[4]; /* Pending VERTEX x, y, z, bulge */
+    int vertex_flags; /* Pending VERTEX group 70 */
+    double *weight; /* Weights of the current SPLINE */
+    uint32_t weight_cnt;
+    size_t weight_cap;
+    unsigned long long *allocated; /* Bytes allocated counter */
+} dxf_model_t;
+
+/* Vertices of one entity, copied out of a store that does not hold its
+   vertex buffer in memory */
+typedef struct _dxf_vertex_scratch_t {
+    double *v; /* x, y, z, w of each vertex */
+    size_t cap; /* Vertices v holds */
+    dxf_error_t err; /* First failure to get vertices, dxfErrorOk if none */
+} dxf_vertex_scratch_t;
+
+/**
+Initializes an empty record store.
+
+@param  model   Record store.
+@param  allocated   Counter incremented by the bytes allocated, or NULL.
+*/
+void dxf_model_init(dxf_model_t *model, unsigned long long *allocated);
+
+/**
+Starts a section; records that follow belong to it.
+
+@param  model   Record store.
+@param  name    Section name.
+@param  section Index the section will have.
+*/
+void dxf_model_begin_section(dxf_model_t *model, const char *name,
+    uint32_t section);
+
+/**
+Starts a record; following groups belong to it until the next call or
+dxf_model_end_record().
+
+@param  model   Record store.
+@param  type    Group 0 value.
+@param  offset  File offset of the group 0 line.
+@param  line    Line number of the group 0 line.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_model_begin_record(dxf_model_t *model, const char *type,
+    dxf_off_t offset, dxf_off_t line);
+
+/**
+Ends the current record without starting another (ENDSEC, HEADER).
+
+@param  model   Record store.
+*/
+void dxf_model_end_record(dxf_model_t *model);
+
+/* Groups dxf_model_add_group() keeps; anything else can skip the call */
+#define DXF_MODEL_KEEPS(model, c) (((model)->keep_all != 0) || \
+    ((c) == 5) || ((c) == 102) || ((c) == 105) || \
+    (((c) >= 330) && ((c) <= 369)) || (((c) >= 390) && ((c) <= 399)) || \
+    (((model)->keep_props != 0) && ((((c) >= 1) && ((c) <= 3)) || \
+    ((c) == 6) || ((c) == 8) || ((c) == 62))))
+
+/**
+Adds a group to the current record, if any.
+Only handles, 102 groups, pointers, the properties, text and geometry of
+entities, block definitions and the names of layers are kept; entity
+geometry is skipped while defer_geometry is set.
+
+@param  model   Record store.
+@param  group_code  Group code.
+@param  value   Trimmed value.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_model_add_group(dxf_model_t *model, int group_code,
+    const char *value);
+
+/* Extended data groups, kept by dxf_model_add_xdata() */
+#define DXF_MODEL_IS_XDATA(c) (((c) >= 1000) && ((c) <= 1071))
+
+/**
+Adds an extended data group to the current record, if any, by where it
+is in the file.  The groups of a record are consecutive, so the record
+keeps a single span, from its first group to the end of its last.
+
+@param  model   Record store.
+@param  start   File offset of the group code line.
+@param  end File offset after the value line.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_model_add_xdata(dxf_model_t *model, dxf_off_t start, dxf_off_t end);
+
+/**
+Builds the handle index, resolves every pointer to a record id and maps
+records to entities.  Entities without a layer or linetype get "0" and
+"BYLAYER".
+Called once, after the scan.
+
+@param  model   Record store.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_model_build_index(dxf_model_t *model);
+
+/**
+Frees everything held by a record store.
+
+@param  model   Record store.
+*/
+void dxf_model_free(dxf_model_t *model);
+
+/**
+Copies a range of the vertex buffer or of its world coordinates, decoding
+it if the store holds it compact, reading it back if spilled.  Safe to
+call from several threads.
+
+@param  model   Record store.
+@param  world   Non-zero for world coordinates.
+@param  first   First vertex.
+@param  cnt Number of vertices, first + cnt no more than vertex_cnt.
+@param  out Receives cnt vertices of x, y, z, w.
+@returns dxfErrorOk on success, error code of dxf_spill_copy() otherwise.
+*/
+dxf_error_t dxf_model_copy_vertices(dxf_model_t *model, int world,
+    size_t first, size_t cnt, double *out);
+
+/**
+Initializes an empty vertex scratch.
+
+@param  scratch Scratch.
+*/
+void dxf_vertex_scratch_init(dxf_vertex_scratch_t *scratch);
+
+/**
+Frees a vertex scratch.
+
+@param  scratch Scratch.
+*/
+void dxf_vertex_scratch_free(dxf_vertex_scratch_t *scratch);
+
+/**
+Gets the vertices of an entity for reading: in place if the store holds
+its vertex buffer in memory, otherwise copied into scratch, so that
+geometry never brings a compact or spilled store back into memory.  Safe
+to call from several threads, each with its own scratch.
+
+@param  model   Record store.
+@param  e   Entity.
+@param  world   Non-zero for world coordinates.
+@param  scratch Scratch, grown as needed; on failure, err holds the error.
+@returns The e->vertex_cnt vertices of x, y, z, w, valid until the next
+call with scratch; NULL on failure.
+*/
+const double *dxf_model_entity_vertices(dxf_model_t *model,
+    const dxf_entity_t *e, int world, dxf_vertex_scratch_t *scratch);
+
+/**
+Parses a hexadecimal handle.
+
+@param  s   NULL-terminated string of 1 to 16 hex digits.
+@param  handle  On success, contains the handle.
+@returns 1 on success, 0 if s is not a handle.
+*/
+int dxf_model_parse_handle(const char *s, uint64_t *handle);
+
+#endif
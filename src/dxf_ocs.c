@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "dxf_ocs.h"
+#include "dxf_tess.h"
+
+/* An entity to convert, keyed by its extrusion */
+typedef struct _dxf_ocs_key_t {
+    double n[3]; /* Extrusion */
+    uint32_t entity; /* Entity index */
+} dxf_ocs_key_t;
+
+/* Orders keys by extrusion, so equal ones are adjacent */
+static int _dxf_ocs_compare(const void *a, const void *b) {
+    const double *na = ((const dxf_ocs_key_t*)a)->n;
+    const double *nb = ((const dxf_ocs_key_t*)b)->n;
+    int i;
+
+    for(i = 0; i < 3; i++) {
+        if(na[i] != nb[i]) {
+            return (na[i] < nb[i]) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/* Non-zero for the default extrusion, whose OCS is the WCS */
+static int _dxf_ocs_is_default(const double n[3]) {
+    return (n[0] == 0.0) && (n[1] == 0.0) && (n[2] > 0.0);
+}
+
+/* Converts the points of a run of entities sharing an OCS, in batches */
+static void _dxf_ocs_points(dxf_model_t *model, const dxf_ocs_key_t *key,
+    size_t cnt, const dxf_mat_t m) {
+    double in[4 * 2 * DXF_OCS_BATCH], out[4 * 2 * DXF_OCS_BATCH];
+    size_t i, j, n;
+
+    for(i = 0; i < cnt; i += DXF_OCS_BATCH) {
+        n = (cnt - i < DXF_OCS_BATCH) ? cnt - i : DXF_OCS_BATCH;
+        for(j = 0; j < n; j++) {
+            const dxf_entity_t *e = &model->entity[key[i + j].entity];
+            memcpy(&in[8 * j], e->p, sizeof(e->p));
+            memcpy(&in[8 * j + 4], e->q, sizeof(e->q));
+            in[8 * j + 3] = in[8 * j + 7] = 0.0;
+        }
+        dxf_transform_vertices(in, 2 * n, m, out);
+        for(j = 0; j < n; j++) {
+            dxf_entity_t *e = &model->entity[key[i + j].entity];
+            memcpy(e->wp, &out[8 * j], sizeof(e->wp));
+            memcpy(e->wq, &out[8 * j + 4], sizeof(e->wq));
+        }
+    }
+}
+
+/* Converts the vertices of one entity */
+static void _dxf_ocs_vertices(dxf_model_t *model, const dxf_entity_t *e,
+    const dxf_mat_t ocs) {
+    const double *v = &model->vertex[4 * e->vertex];
+    double *w = &model->world[4 * e->vertex];
+    dxf_mat_t m;
+    int r;
+
+    if((e->vertex_cnt == 0) || (model->world == NULL)) {
+        return;
+    }
+    if(!DXF_ENTITY_IS_OCS(e)) {
+        memcpy(w, v, 4 * e->vertex_cnt * sizeof(double));
+        return;
+    }
+
+    /* 2D: vertex z is ignored, the elevation is the entity's */
+    memcpy(m, ocs, sizeof(m));
+    for(r = 0; r < 3; r++) {
+        m[4 * r + 3] += m[4 * r + 2] * e->p[2];
+        m[4 * r + 2] = 0.0;
+    }
+    dxf_transform_vertices(v, e->vertex_cnt, m, w);
+}
+
+int dxf_ocs_to_wcs(dxf_model_t *model) {
+    dxf_ocs_key_t *key;
+    dxf_mat_t m;
+    size_t cnt = 0, i, j;
+
+    assert(model != NULL);
+
+    /* Spilled vertices are converted as dxf_spill.c reads them back */
+    if((model->vertex_cnt > 0) && (model->spill == NULL)) {
+        void *p;
+        if(posix_memalign(&p, DXF_VERTEX_ALIGN, model->vertex_cnt * 4 *
+            sizeof(double)) != 0) {
+            return 0;
+        }
+        model->world = (double*)p;
+        if(model->allocated != NULL) {
+            (*model->allocated) += model->vertex_cnt * 4 * sizeof(double);
+        }
+    }
+
+    /* WCS entities and the default extrusion need no basis */
+    dxf_mat_identity(m);
+    for(i = 0; i < model->entity_cnt; i++) {
+        dxf_entity_t *e = &model->entity[i];
+        if(DXF_ENTITY_IS_OCS(e) && !_dxf_ocs_is_default(e->n)) {
+            cnt++;
+            continue;
+        }
+        memcpy(e->wp, e->p, sizeof(e->wp));
+        memcpy(e->wq, e->q, sizeof(e->wq));
+        _dxf_ocs_vertices(model, e, m);
+    }
+    if(cnt == 0) {
+        return 1;
+    }
+
+    /* The rest, one basis per distinct extrusion */
+    if((key = (dxf_ocs_key_t*)malloc(cnt * sizeof(dxf_ocs_key_t))) == NULL) {
+        return 0;
+    }
+    for(i = 0, j = 0; i < model->entity_cnt; i++) {
+        const dxf_entity_t *e = &model->entity[i];
+        if(DXF_ENTITY_IS_OCS(e) && !_dxf_ocs_is_default(e->n)) {
+            memcpy(key[j].n, e->n, sizeof(key[j].n));
+            key[j++].entity = (uint32_t)i;
+        }
+    }
+    qsort(key, cnt, sizeof(dxf_ocs_key_t), _dxf_ocs_compare);
+    for(i = 0; i < cnt; i = j) {
+        for(j = i + 1; (j < cnt) && (_dxf_ocs_compare(&key[i], &key[j]) ==
+            0); j++) {
+        }
+        (void)dxf_mat_ocs(key[i].n, m);
+        _dxf_ocs_points(model, &key[i], j - i, m);
+        for(; i < j; i++) {
+            _dxf_ocs_vertices(model, &model->entity[key[i].entity], m);
+        }
+    }
+    free(key);
+    return 1;
+}
@@ -0,0 +1,28 @@
+/** @file dxf_ocs.h
+ *  @brief Object to world coordinates.
+ *
+ * Internal pass that converts the points and vertices of every entity
+ * from its object coordinate system (OCS) to world coordinates (WCS).
+ */
+#ifndef _DXF_OCS_H_
+#define _DXF_OCS_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* Points gathered per kernel call */
+#define DXF_OCS_BATCH 256
+
+/**
+Fills the world coordinates of every entity (wp, wq) and of the vertex
+buffer (world).  Entities are grouped by extrusion so the arbitrary axis
+basis is computed once per group, and their points are transformed in
+batches by dxf_transform_vertices().
+Called once, after dxf_model_build_index().
+
+@param  model   Record store.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_ocs_to_wcs(dxf_model_t *model);
+
+#endif
@@ -0,0 +1,394 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include "dxf_query.h"
+
+/* Allocates cnt empty bitmaps */
+static dxf_bitmap_t *_dxf_query_bitmaps(size_t cnt) {
+    return (dxf_bitmap_t*)calloc((cnt > 0) ? cnt : 1, sizeof(dxf_bitmap_t));
+}
+
+/* Frees cnt bitmaps and the array */
+static void _dxf_query_free_bitmaps(dxf_bitmap_t *b, size_t cnt) {
+    size_t i;
+
+    if(b != NULL) {
+        for(i = 0; i < cnt; i++) {
+            dxf_bitmap_free(&b[i]);
+        }
+        free(b);
+    }
+}
+
+int dxf_query_index_build(dxf_query_index_t *index,
+    const dxf_model_t *model) {
+    size_t i;
+
+    assert(index != NULL);
+    assert(model != NULL);
+    index->type_cnt = model->types.cnt;
+    index->layer_cnt = model->layers.cnt;
+    index->linetype_cnt = model->linetypes.cnt;
+    index->block_cnt = model->block_names.cnt;
+    index->type = _dxf_query_bitmaps(index->type_cnt);
+    index->layer = _dxf_query_bitmaps(index->layer_cnt);
+    index->linetype = _dxf_query_bitmaps(index->linetype_cnt);
+    index->color = _dxf_query_bitmaps(2 * DXF_QUERY_COLOR_MAX + 1);
+    index->block = _dxf_query_bitmaps(index->block_cnt);
+    if((index->type == NULL) || (index->layer == NULL) ||
+        (index->linetype == NULL) || (index->color == NULL) ||
+        (index->block == NULL)) {
+        return 0;
+    }
+
+    /* Entities are in file order, so every bitmap is built by appending */
+    for(i = 0; i < model->entity_cnt; i++) {
+        const dxf_entity_t *e = &model->entity[i];
+        dxf_record_id_t id = e->record;
+        if((dxf_bitmap_append(&index->all, id) == 0) ||
+            (dxf_bitmap_append(&index->type[model->record[id].type], id) ==
+            0) || (dxf_bitmap_append(&index->layer[e->layer], id) == 0) ||
+            (dxf_bitmap_append(&index->linetype[e->linetype], id) == 0)) {
+            return 0;
+        }
+        if((e->color >= -DXF_QUERY_COLOR_MAX) &&
+            (e->color <= DXF_QUERY_COLOR_MAX) &&
+            (dxf_bitmap_append(&index->color[e->color +
+            DXF_QUERY_COLOR_MAX], id) == 0)) {
+            return 0;
+        }
+        if((e->block != DXF_INDEX_NONE) &&
+            (dxf_bitmap_append(&index->block[e->block], id) == 0)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void dxf_query_index_free(dxf_query_index_t *index) {
+    assert(index != NULL);
+    dxf_bitmap_free(&index->all);
+    _dxf_query_free_bitmaps(index->type, index->type_cnt);
+    _dxf_query_free_bitmaps(index->layer, index->layer_cnt);
+    _dxf_query_free_bitmaps(index->linetype, index->linetype_cnt);
+    _dxf_query_free_bitmaps(index->color, 2 * DXF_QUERY_COLOR_MAX + 1);
+    _dxf_query_free_bitmaps(index->block, index->block_cnt);
+    memset(index, 0, sizeof(*index));
+}
+
+dxf_query_t *dxf_query_new(const dxf_query_index_t *index,
+    const dxf_model_t *model) {
+    dxf_query_t *query;
+    int i;
+
+    if((query = (dxf_query_t*)calloc(1, sizeof(*query))) == NULL) {
+        return (dxf_query_t*)NULL;
+    }
+    query->index = index;
+    query->model = model;
+    for(i = 0; i < DXF_QUERY_MAX_DEPTH; i++) {
+        dxf_bitmap_init(&query->stack[i]);
+    }
+    query->error = dxfErrorOk;
+    return query;
+}
+
+/*
+Matches one wildcard pattern, case-insensitively: * any run, ? one.  On a
+mismatch after a *, the * takes one more character and matching resumes;
+only the last * needs retrying, so the time is at most pattern times
+string length.
+*/
+static int _dxf_query_match_one(const char *p, const char *end,
+    const char *s) {
+    const char *star = (const char*)NULL; /* Pattern after the last * */
+    const char *retry = (const char*)NULL; /* Where that * resumes in s */
+
+    while(*s != '\0') {
+        if((p < end) && (*p == '*')) {
+            star = ++p;
+            retry = s;
+        } else if((p < end) && ((*p == '?') ||
+            (toupper((unsigned char)*p) == toupper((unsigned char)*s)))) {
+            p++;
+            s++;
+        } else if(star != NULL) {
+            p = star;
+            s = ++retry;
+        } else {
+            return 0;
+        }
+    }
+    while((p < end) && (*p == '*')) {
+        p++;
+    }
+    return (p == end);
+}
+
+/* Matches a comma separated list of wildcard patterns */
+static int _dxf_query_match(const char *pattern, const char *s) {
+    const char *comma;
+
+    for(;;) {
+        if((comma = strchr(pattern, ',')) == NULL) {
+            return _dxf_query_match_one(pattern, pattern + strlen(pattern),
+                s);
+        }
+        if(_dxf_query_match_one(pattern, comma, s) != 0) {
+            return 1;
+        }
+        pattern = comma + 1;
+    }
+}
+
+/* Pushes an operand computed by the caller into the next free slot */
+static dxf_bitmap_t *_dxf_query_push(dxf_query_t *query) {
+    if(query->error != dxfErrorOk) {
+        return (dxf_bitmap_t*)NULL;
+    }
+    if(query->depth == DXF_QUERY_MAX_DEPTH) {
+        query->error = dxfErrorInvalidQuery;
+        return (dxf_bitmap_t*)NULL;
+    }
+    return &query->stack[query->depth];
+}
+
+/* Pushes the union of the bitmaps of every name matching a pattern */
+static dxf_error_t _dxf_query_names(dxf_query_t *query,
+    const dxf_names_t *names, const dxf_bitmap_t *bitmap,
+    const char *pattern) {
+    dxf_bitmap_t *top, tmp;
+    size_t i;
+
+    assert(pattern != NULL);
+    if((top = _dxf_query_push(query)) == NULL) {
+        return query->error;
+    }
+    dxf_bitmap_free(top);
+    dxf_bitmap_init(&tmp);
+    for(i = 0; i < names->cnt; i++) {
+        if((bitmap[i].cnt == 0) ||
+            (_dxf_query_match(pattern, names->name[i]) == 0)) {
+            continue;
+        }
+        if(dxf_bitmap_op(top, &bitmap[i], dxfBitmapOr, &tmp) == 0) {
+            dxf_bitmap_free(&tmp);
+            query->error = dxfErrorNoMemory;
+            return query->error;
+        }
+        dxf_bitmap_free(top);
+        *top = tmp;
+        dxf_bitmap_init(&tmp);
+    }
+    query->depth++;
+    return dxfErrorOk;
+}
+
+/**
+Pushes the entities whose type (group 0) matches a pattern.
+Patterns are case-insensitive; * matches any run of characters, ? any one
+character, and a comma separates alternatives.
+
+@param  query   Query.
+@param  pattern Pattern, e.g. "TEXT,MTEXT".
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_query_type(dxf_query_t *query, const char *pattern) {
+    assert(query != NULL);
+    return _dxf_query_names(query, &query->model->types, query->index->type,
+        pattern);
+}
+
+/**
+Pushes the entities whose layer (group 8) matches a pattern, see
+dxf_query_type().  Entities without a layer are on layer "0".
+
+@param  query   Query.
+@param  pattern Pattern, e.g. "A-ANNO-*".
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_query_layer(dxf_query_t *query, const char *pattern) {
+    assert(query != NULL);
+    return _dxf_query_names(query, &query->model->layers,
+        query->index->layer, pattern);
+}
+
+/**
+Pushes the entities whose linetype (group 6) matches a pattern, see
+dxf_query_type().  Entities without a linetype are "BYLAYER".
+
+@param  query   Query.
+@param  pattern Pattern, e.g. "DASHED*".
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_query_linetype(dxf_query_t *query, const char *pattern) {
+    assert(query != NULL);
+    return _dxf_query_names(query, &query->model->linetypes,
+        query->index->linetype, pattern);
+}
+
+/**
+Pushes the entities of the block definitions whose name (group 2) matches
+a pattern, see dxf_query_type().  The entities of the ENTITIES section
+are those of no block: push "*" and negate it with dxf_query_not().
+
+@param  query   Query.
+@param  pattern Pattern, e.g. "DOOR*".
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_query_block(dxf_query_t *query, const char *pattern) {
+    assert(query != NULL);
+    return _dxf_query_names(query, &query->model->block_names,
+        query->index->block, pattern);
+}
+
+/**
+Pushes the entities with a color number (group 62).  Entities without
+one are 256 (BYLAYER).
+
+@param  query   Query.
+@param  color   Color number.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_query_color(dxf_query_t *query, int color) {
+    dxf_bitmap_t *top, empty;
+
+    assert(query != NULL);
+    if((top = _dxf_query_push(query)) == NULL) {
+        return query->error;
+    }
+    dxf_bitmap_init(&empty);
+    if((color < -DXF_QUERY_COLOR_MAX) || (color > DXF_QUERY_COLOR_MAX)) {
+        dxf_bitmap_free(top);
+    } else if(dxf_bitmap_op(&query->index->color[color +
+        DXF_QUERY_COLOR_MAX], &empty, dxfBitmapOr, top) == 0) {
+        query->error = dxfErrorNoMemory;
+        return query->error;
+    }
+    query->depth++;
+    return dxfErrorOk;
+}
+
+/* Replaces the two top operands by their combination */
+static dxf_error_t _dxf_query_combine(dxf_query_t *query,
+    dxf_bitmap_op_t op) {
+    dxf_bitmap_t tmp;
+
+    if(query->error != dxfErrorOk) {
+        return query->error;
+    }
+    if(query->depth < 2) {
+        query->error = dxfErrorInvalidQuery;
+        return query->error;
+    }
+    dxf_bitmap_init(&tmp);
+    if(dxf_bitmap_op(&query->stack[query->depth - 2],
+        &query->stack[query->depth - 1], op, &tmp) == 0) {
+        dxf_bitmap_free(&tmp);
+        query->error = dxfErrorNoMemory;
+        return query->error;
+    }
+    dxf_bitmap_free(&query->stack[query->depth - 2]);
+    dxf_bitmap_free(&query->stack[query->depth - 1]);
+    query->stack[query->depth - 2] = tmp;
+    query->depth--;
+    return dxfErrorOk;
+}
+
+/**
+Replaces the two top operands by the entities in both.
+
+@param  query   Query.
+@returns dxfErrorOk on success, dxfErrorInvalidQuery if fewer than two
+operands are stacked, error code otherwise.
+*/
+dxf_error_t dxf_query_and(dxf_query_t *query) {
+    assert(query != NULL);
+    return _dxf_query_combine(query, dxfBitmapAnd);
+}
+
+/**
+Replaces the two top operands by the entities in either.
+
+@param  query   Query.
+@returns dxfErrorOk on success, dxfErrorInvalidQuery if fewer than two
+operands are stacked, error code otherwise.
+*/
+dxf_error_t dxf_query_or(dxf_query_t *query) {
+    assert(query != NULL);
+    return _dxf_query_combine(query, dxfBitmapOr);
+}
+
+/**
+Replaces the top operand by every other entity.
+
+@param  query   Query.
+@returns dxfErrorOk on success, dxfErrorInvalidQuery if no operand is
+stacked, error code otherwise.
+*/
+dxf_error_t dxf_query_not(dxf_query_t *query) {
+    dxf_bitmap_t tmp;
+
+    assert(query != NULL);
+    if(query->error != dxfErrorOk) {
+        return query->error;
+    }
+    if(query->depth < 1) {
+        query->error = dxfErrorInvalidQuery;
+        return query->error;
+    }
+    dxf_bitmap_init(&tmp);
+    if(dxf_bitmap_op(&query->index->all, &query->stack[query->depth - 1],
+        dxfBitmapAndNot, &tmp) == 0) {
+        dxf_bitmap_free(&tmp);
+        query->error = dxfErrorNoMemory;
+        return query->error;
+    }
+    dxf_bitmap_free(&query->stack[query->depth - 1]);
+    query->stack[query->depth - 1] = tmp;
+    return dxfErrorOk;
+}
+
+/**
+Gets the result of a query: the record ids of the entities of its single
+remaining operand, in file order.  The query is left as it was, so it can
+be run again with a larger array.
+
+@param  query   Query.
+@param  ids Array of max record ids, or NULL to only count.
+@param  max Size of ids.
+@param  cnt On success, contains the number of entities, which may
+    exceed max.
+@returns dxfErrorOk on success, dxfErrorInvalidQuery unless exactly one
+operand is stacked, error code otherwise.
+*/
+dxf_error_t dxf_query_run(dxf_query_t *query, dxf_record_id_t *ids,
+    size_t max, size_t *cnt) {
+    assert(query != NULL);
+    assert(cnt != NULL);
+    if(query->error != dxfErrorOk) {
+        return query->error;
+    }
+    if(query->depth != 1) {
+        return dxfErrorInvalidQuery;
+    }
+    *cnt = dxf_bitmap_ids(&query->stack[0], ids, (ids != NULL) ? max : 0);
+    return dxfErrorOk;
+}
+
+/**
+Frees a query.
+
+@param  query   Query, may be NULL.
+*/
+void dxf_query_end(dxf_query_t *query) {
+    int i;
+
+    if(query != NULL) {
+        for(i = 0; i < DXF_QUERY_MAX_DEPTH; i++) {
+            dxf_bitmap_free(&query->stack[i]);
+        }
+        free(query);
+    }
+}
@@ -0,0 +1,70 @@
+/** @file dxf_query.h
+ *  @brief Entity queries.
+ *
+ * Internal bitmap index of the entities of a drawing by type, layer,
+ * color, linetype and defining block, and the query stack that combines
+ * its bitmaps.
+ */
+#ifndef _DXF_QUERY_H_
+#define _DXF_QUERY_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+#include "dxf_bitmap.h"
+
+/* Colors indexed, from -DXF_QUERY_COLOR_MAX (layer off) to the max */
+#define DXF_QUERY_COLOR_MAX 257
+
+/* Operands a query can stack */
+#define DXF_QUERY_MAX_DEPTH 16
+
+/* Record ids of entities, by property */
+typedef struct _dxf_query_index_t {
+    dxf_bitmap_t all; /* Every entity */
+    dxf_bitmap_t *type; /* By type id in the store's types */
+    size_t type_cnt;
+    dxf_bitmap_t *layer; /* By layer id */
+    size_t layer_cnt;
+    dxf_bitmap_t *linetype; /* By linetype id */
+    size_t linetype_cnt;
+    dxf_bitmap_t *color; /* By color + DXF_QUERY_COLOR_MAX */
+    dxf_bitmap_t *block; /* Entities of block definitions, by block id */
+    size_t block_cnt;
+} dxf_query_index_t;
+
+/* A query being built, operands on a stack */
+struct _dxf_query_t {
+    const dxf_query_index_t *index; /* Index of the drawing */
+    const dxf_model_t *model; /* Record store of the drawing */
+    dxf_bitmap_t stack[DXF_QUERY_MAX_DEPTH]; /* Operands */
+    int depth; /* Operands stacked */
+    dxf_error_t error; /* First error, reported by every later call */
+};
+
+/**
+Builds the index of every entity of a record store.
+Called once, after dxf_model_build_index().
+
+@param  index   Index, zeroed.
+@param  model   Record store.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_query_index_build(dxf_query_index_t *index,
+    const dxf_model_t *model);
+
+/**
+Frees an index.
+*/
+void dxf_query_index_free(dxf_query_index_t *index);
+
+/**
+Creates an empty query over an index.
+
+@param  index   Index.
+@param  model   Record store the index was built from.
+@returns The query, NULL if allocation failed.
+*/
+dxf_query_t *dxf_query_new(const dxf_query_index_t *index,
+    const dxf_model_t *model);
+
+#endif
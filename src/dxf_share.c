@@ -0,0 +1,334 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* memfd_create() */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dxf_share.h"
+
+/* Name tables of a store, in segment order */
+#define DXF_SHARE_TABLES(model) { &(model)->types, &(model)->block_names, \
+    &(model)->layers, &(model)->linetypes, &(model)->table_layers }
+
+/* Bytes per element of every array, in this build */
+static void _dxf_share_sizes(uint64_t size[dxfShareArrayCnt]) {
+    size[dxfShareRecord] = sizeof(dxf_record_t);
+    size[dxfSharePointer] = sizeof(dxf_pointer_t);
+    size[dxfShareEntity] = sizeof(dxf_entity_t);
+    size[dxfShareRecordEntity] = sizeof(uint32_t);
+    size[dxfShareVertex] = 4 * sizeof(double);
+    size[dxfShareWorld] = 4 * sizeof(double);
+    size[dxfShareKnot] = sizeof(double);
+    size[dxfShareBlock] = sizeof(dxf_block_t);
+    size[dxfShareText] = 1;
+    size[dxfShareTextSpan] = sizeof(dxf_text_span_t);
+    size[dxfShareXdataSpan] = sizeof(dxf_xdata_span_t);
+    size[dxfShareHandles] = sizeof(dxf_handle_slot_t);
+    size[dxfShareNames] = 1;
+    size[dxfShareExtra] = 1;
+}
+
+/* Creates an anonymous segment */
+static int _dxf_share_open(void) {
+#ifdef MFD_ALLOW_SEALING
+    return memfd_create("dxf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    char name[64];
+    unsigned int i;
+    int fd = -1;
+
+    /* A name only until it is unlinked */
+    for(i = 0; (fd == -1) && (i < 16); i++) {
+        (void)snprintf(name, sizeof(name), "/dxf-%ld-%lx-%u", (long)getpid(),
+            (unsigned long)(size_t)&fd, i);
+        if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) != -1) {
+            (void)shm_unlink(name);
+        }
+    }
+    return fd;
+#endif
+}
+
+dxf_error_t dxf_share_create(dxf_model_t *model, const void *extra,
+    size_t extra_size, int *fd) {
+    const dxf_names_t *table[DXF_SHARE_NAME_TABLES] =
+        DXF_SHARE_TABLES(model);
+    const void *src[dxfShareArrayCnt];
+    dxf_share_header_t h;
+    char *names, *map;
+    size_t names_size = 0, i;
+    uint64_t at;
+    dxf_error_t err = dxfErrorOk;
+    int a, t, f;
+
+    assert(model != NULL);
+    assert((extra != NULL) || (extra_size == 0));
+    assert(fd != NULL);
+
+    /* Names, table after table */
+    for(t = 0; t < DXF_SHARE_NAME_TABLES; t++) {
+        for(i = 0; i < table[t]->cnt; i++) {
+            names_size += strlen(table[t]->name[i]) + 1;
+        }
+    }
+    if((names = (char*)malloc(names_size + 1)) == NULL) {
+        return dxfErrorNoMemory;
+    }
+    names_size = 0;
+    for(t = 0; t < DXF_SHARE_NAME_TABLES; t++) {
+        for(i = 0; i < table[t]->cnt; i++) {
+            size_t len = strlen(table[t]->name[i]) + 1;
+            memcpy(&names[names_size], table[t]->name[i], len);
+            names_size += len;
+        }
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DXF_SHARE_MAGIC, sizeof(h.magic));
+    h.version = DXF_SHARE_VERSION;
+    h.objects_first = model->objects_first;
+    _dxf_share_sizes(h.size);
+    src[dxfShareRecord] = model->record;
+    h.cnt[dxfShareRecord] = model->record_cnt;
+    src[dxfSharePointer] = model->pointer;
+    h.cnt[dxfSharePointer] = model->pointer_cnt;
+    src[dxfShareEntity] = model->entity;
+    h.cnt[dxfShareEntity] = model->entity_cnt;
+    src[dxfShareRecordEntity] = model->record_entity;
+    h.cnt[dxfShareRecordEntity] = (model->record_entity != NULL) ?
+        model->record_cnt + 1 : 0;
+    src[dxfShareVertex] = (const void*)NULL; /* Both copied below */
+    h.cnt[dxfShareVertex] = model->vertex_cnt;
+    src[dxfShareWorld] = (const void*)NULL;
+    h.cnt[dxfShareWorld] = model->vertex_cnt;
+    src[dxfShareKnot] = model->knot;
+    h.cnt[dxfShareKnot] = model->knot_cnt;
+    src[dxfShareBlock] = model->block;
+    h.cnt[dxfShareBlock] = model->block_names.cnt;
+    src[dxfShareText] = model->text;
+    h.cnt[dxfShareText] = model->text_cnt;
+    src[dxfShareTextSpan] = model->text_span;
+    h.cnt[dxfShareTextSpan] = model->text_span_cnt;
+    src[dxfShareXdataSpan] = model->xdata_span;
+    h.cnt[dxfShareXdataSpan] = model->xdata_span_cnt;
+    src[dxfShareHandles] = model->handles.slot;
+    h.cnt[dxfShareHandles] = (model->handles.slot != NULL) ?
+        model->handles.mask + 1 : 0;
+    h.handle_cnt = model->handles.cnt;
+    src[dxfShareNames] = names;
+    h.cnt[dxfShareNames] = names_size;
+    src[dxfShareExtra] = extra;
+    h.cnt[dxfShareExtra] = extra_size;
+    for(t = 0; t < DXF_SHARE_NAME_TABLES; t++) {
+        h.names[t] = table[t]->cnt;
+    }
+    at = DXF_SHARE_ROUND(sizeof(h));
+    for(a = 0; a < dxfShareArrayCnt; a++) {
+        h.offset[a] = at;
+        at += DXF_SHARE_ROUND(h.cnt[a] * h.size[a]);
+    }
+    h.total = at;
+
+    /* Fill through a writable mapping, then seal */
+    if((f = _dxf_share_open()) == -1) {
+        free(names);
+        return dxfErrorOpenFailed;
+    }
+    if((at > (uint64_t)SIZE_MAX) || (ftruncate(f, (off_t)at) == -1) ||
+        ((map = (char*)mmap(NULL, (size_t)at, PROT_READ | PROT_WRITE,
+        MAP_SHARED, f, 0)) == (char*)MAP_FAILED)) {
+        free(names);
+        (void)close(f);
+        return dxfErrorWriteFailed;
+    }
+    memcpy(map, &h, sizeof(h));
+    for(a = 0; (a < dxfShareArrayCnt) && (err == dxfErrorOk); a++) {
+        if((a == dxfShareVertex) || (a == dxfShareWorld)) {
+            /* Straight into the segment if compact or spilled */
+            err = dxf_model_copy_vertices(model, a == dxfShareWorld, 0,
+                model->vertex_cnt, (double*)(map + h.offset[a]));
+        } else if(h.cnt[a] > 0) {
+            memcpy(map + h.offset[a], src[a],
+                (size_t)(h.cnt[a] * h.size[a]));
+        }
+    }
+    if(err != dxfErrorOk) {
+        (void)munmap(map, (size_t)at);
+        free(names);
+        (void)close(f);
+        return err;
+    }
+    for(i = 0; i < h.cnt[dxfShareBlock]; i++) {
+        ((dxf_block_t*)(map + h.offset[dxfShareBlock]))[i].cache =
+            (struct _dxf_block_cache_t*)NULL;
+    }
+    (void)munmap(map, (size_t)at);
+    free(names);
+#ifdef F_ADD_SEALS
+    (void)fcntl(f, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE |
+        F_SEAL_SEAL);
+#endif
+    *fd = f;
+    return dxfErrorOk;
+}
+
+/* Checks the header of a mapped segment, so the arrays can be used as is */
+static int _dxf_share_check(const dxf_share_header_t *h, size_t size) {
+    uint64_t expect[dxfShareArrayCnt], names = 0, cnt = 0, i;
+    const char *s;
+    int a, t;
+
+    if((size < sizeof(*h)) || (memcmp(h->magic, DXF_SHARE_MAGIC,
+        sizeof(h->magic)) != 0) || (h->version != DXF_SHARE_VERSION) ||
+        (h->total != size)) {
+        return 0;
+    }
+    _dxf_share_sizes(expect);
+    for(a = 0; a < dxfShareArrayCnt; a++) {
+        if((h->size[a] != expect[a]) ||
+            ((h->offset[a] & (DXF_SHARE_ALIGN - 1)) != 0) ||
+            (h->offset[a] > size) ||
+            (h->cnt[a] > (size - h->offset[a]) / h->size[a])) {
+            return 0;
+        }
+    }
+    if(((h->cnt[dxfShareRecordEntity] != 0) &&
+        (h->cnt[dxfShareRecordEntity] != h->cnt[dxfShareRecord] + 1)) ||
+        (h->cnt[dxfShareWorld] != h->cnt[dxfShareVertex]) ||
+        ((h->cnt[dxfShareHandles] & (h->cnt[dxfShareHandles] - 1)) != 0) ||
+        (h->handle_cnt > h->cnt[dxfShareHandles]) ||
+        (h->cnt[dxfShareBlock] > h->names[1])) {
+        return 0;
+    }
+
+    /* Every name NULL-terminated inside the names */
+    s = (const char*)h + h->offset[dxfShareNames];
+    for(t = 0; t < DXF_SHARE_NAME_TABLES; t++) {
+        names += h->names[t];
+    }
+    for(i = 0; i < h->cnt[dxfShareNames]; i++) {
+        cnt += (s[i] == '\0');
+    }
+    return (cnt == names) && ((h->cnt[dxfShareNames] == 0) ||
+        (s[h->cnt[dxfShareNames] - 1] == '\0'));
+}
+
+dxf_error_t dxf_share_attach(dxf_model_t *model, int fd, const void **extra,
+    size_t *extra_size) {
+    dxf_names_t *table[DXF_SHARE_NAME_TABLES] = DXF_SHARE_TABLES(model);
+    const dxf_share_header_t *h;
+    const char *base, *s;
+    struct stat st;
+    void *map;
+    uint64_t i;
+    int t;
+
+    assert(model != NULL);
+    assert(model->record_cnt == 0);
+    assert(extra != NULL);
+    assert(extra_size != NULL);
+    if((fstat(fd, &st) == -1) || (st.st_size < (off_t)sizeof(*h)) ||
+        ((uint64_t)st.st_size > (uint64_t)SIZE_MAX)) {
+        return dxfErrorInvalidShare;
+    }
+    if((map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd,
+        0)) == MAP_FAILED) {
+        return dxfErrorBadFd;
+    }
+    model->share = map;
+    model->share_size = (size_t)st.st_size;
+    h = (const dxf_share_header_t*)map;
+    base = (const char*)map;
+    if(_dxf_share_check(h, model->share_size) == 0) {
+        return dxfErrorInvalidShare;
+    }
+
+    /* Arrays, used in place; nothing writes to them after loading */
+    model->record = (dxf_record_t*)(base + h->offset[dxfShareRecord]);
+    model->record_cnt = model->record_cap = (size_t)h->cnt[dxfShareRecord];
+    model->pointer = (dxf_pointer_t*)(base + h->offset[dxfSharePointer]);
+    model->pointer_cnt = model->pointer_cap =
+        (size_t)h->cnt[dxfSharePointer];
+    model->entity = (dxf_entity_t*)(base + h->offset[dxfShareEntity]);
+    model->entity_cnt = model->entity_cap = (size_t)h->cnt[dxfShareEntity];
+    model->record_entity = (h->cnt[dxfShareRecordEntity] > 0) ?
+        (uint32_t*)(base + h->offset[dxfShareRecordEntity]) : (uint32_t*)NULL;
+    model->vertex_cnt = model->vertex_cap = (size_t)h->cnt[dxfShareVertex];
+    if(model->vertex_cnt > 0) {
+        model->vertex = (double*)(base + h->offset[dxfShareVertex]);
+        model->world = (double*)(base + h->offset[dxfShareWorld]);
+    }
+    model->knot = (double*)(base + h->offset[dxfShareKnot]);
+    model->knot_cnt = model->knot_cap = (size_t)h->cnt[dxfShareKnot];
+    model->text = (char*)(base + h->offset[dxfShareText]);
+    model->text_cnt = model->text_cap = (size_t)h->cnt[dxfShareText];
+    model->text_span = (dxf_text_span_t*)(base +
+        h->offset[dxfShareTextSpan]);
+    model->text_span_cnt = model->text_span_cap =
+        (size_t)h->cnt[dxfShareTextSpan];
+    model->xdata_span = (dxf_xdata_span_t*)(base +
+        h->offset[dxfShareXdataSpan]);
+    model->xdata_span_cnt = model->xdata_span_cap =
+        (size_t)h->cnt[dxfShareXdataSpan];
+    if(h->cnt[dxfShareHandles] > 0) {
+        model->handles.slot = (dxf_handle_slot_t*)(base +
+            h->offset[dxfShareHandles]);
+        model->handles.mask = (size_t)h->cnt[dxfShareHandles] - 1;
+        model->handles.cnt = (size_t)h->handle_cnt;
+    }
+    model->objects_first = h->objects_first;
+
+    /* Names hold pointers and blocks their caches: both are copied */
+    s = base + h->offset[dxfShareNames];
+    for(t = 0; t < DXF_SHARE_NAME_TABLES; t++) {
+        for(i = 0; i < h->names[t]; i++) {
+            size_t len = strlen(s);
+            if(dxf_names_intern(table[t], s, len) == DXF_INDEX_NONE) {
+                return dxfErrorNoMemory;
+            }
+            s += len + 1;
+        }
+    }
+    if(model->block_names.cnt > 0) {
+        if((model->block = (dxf_block_t*)malloc(model->block_names.cnt *
+            sizeof(dxf_block_t))) == NULL) {
+            return dxfErrorNoMemory;
+        }
+        model->block_cap = model->block_names.cnt;
+        memset(model->block, 0, model->block_cap * sizeof(dxf_block_t));
+        for(i = 0; i < model->block_cap; i++) {
+            model->block[i].record = DXF_RECORD_NONE;
+        }
+        memcpy(model->block, base + h->offset[dxfShareBlock],
+            (size_t)h->cnt[dxfShareBlock] * sizeof(dxf_block_t));
+    }
+    *extra = base + h->offset[dxfShareExtra];
+    *extra_size = (size_t)h->cnt[dxfShareExtra];
+    return dxfErrorOk;
+}
+
+void dxf_share_detach(dxf_model_t *model) {
+    assert(model != NULL);
+    if(model->share == NULL) {
+        return;
+    }
+    model->record = (dxf_record_t*)NULL;
+    model->pointer = (dxf_pointer_t*)NULL;
+    model->entity = (dxf_entity_t*)NULL;
+    model->record_entity = (uint32_t*)NULL;
+    model->vertex = (double*)NULL;
+    model->world = (double*)NULL;
+    model->knot = (double*)NULL;
+    model->text = (char*)NULL;
+    model->text_span = (dxf_text_span_t*)NULL;
+    model->xdata_span = (dxf_xdata_span_t*)NULL;
+    model->handles.slot = (dxf_handle_slot_t*)NULL;
+    (void)munmap((void*)model->share, model->share_size);
+    model->share = NULL;
+    model->share_size = 0;
+}
@@ -0,0 +1,94 @@
+/** @file dxf_share.h
+ *  @brief Drawings shared between processes.
+ *
+ * Internal layout of the shared memory segment written by dxf_share(): a
+ * fixed header followed by the store's arrays, each aligned to
+ * DXF_SHARE_ALIGN, in native byte order.  Every array holds ids and
+ * offsets only, so dxf_attach() maps the segment read-only and points the
+ * store at it in place.  Names, block definitions and anything built on
+ * first use stay per process.
+ */
+#ifndef _DXF_SHARE_H_
+#define _DXF_SHARE_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* First bytes of a segment */
+#define DXF_SHARE_MAGIC "DXFSHM\r\n"
+
+/* Bumped whenever the layout changes */
+#define DXF_SHARE_VERSION 1
+
+/* Alignment of every array, at least DXF_VERTEX_ALIGN */
+#define DXF_SHARE_ALIGN 64
+
+/* Rounds a size up to DXF_SHARE_ALIGN */
+#define DXF_SHARE_ROUND(n) \
+    (((uint64_t)(n) + DXF_SHARE_ALIGN - 1) & ~(uint64_t)(DXF_SHARE_ALIGN - 1))
+
+/* Arrays of a segment */
+typedef enum { dxfShareRecord, dxfSharePointer, dxfShareEntity,
+    dxfShareRecordEntity, dxfShareVertex, dxfShareWorld, dxfShareKnot,
+    dxfShareBlock, dxfShareText, dxfShareTextSpan, dxfShareXdataSpan,
+    dxfShareHandles, dxfShareNames, dxfShareExtra, dxfShareArrayCnt }
+    dxf_share_array_t;
+
+/* Name tables of the store, in the order of dxfShareNames */
+#define DXF_SHARE_NAME_TABLES 5
+
+/* Segment header; offsets are from the start of the segment */
+typedef struct _dxf_share_header_t {
+    char magic[8]; /* DXF_SHARE_MAGIC */
+    uint32_t version; /* DXF_SHARE_VERSION */
+    uint32_t objects_first; /* First record of OBJECTS */
+    uint64_t offset[dxfShareArrayCnt]; /* Array offsets */
+    uint64_t cnt[dxfShareArrayCnt]; /* Elements per array */
+    uint64_t size[dxfShareArrayCnt]; /* Bytes per element, as built */
+    uint64_t names[DXF_SHARE_NAME_TABLES]; /* Names per table; the tables
+        are consecutive NULL-terminated strings in dxfShareNames */
+    uint64_t handle_cnt; /* Keys in dxfShareHandles */
+    uint64_t total; /* Size of the segment */
+} dxf_share_header_t;
+
+/**
+Writes a store into a new shared memory segment, sealed once written where
+the system allows.  A compact or spilled store copies its vertices into
+the segment through dxf_model_copy_vertices() and stays as it is.
+
+@param  model   Record store.
+@param  extra   Bytes the caller keeps alongside, given back by
+    dxf_share_attach().
+@param  extra_size  Bytes of extra.
+@param  fd  On success, the segment; the caller closes it.
+@returns dxfErrorOk on success, dxfErrorOpenFailed if no segment could be
+created, dxfErrorWriteFailed if it could not be sized or filled,
+dxfErrorNoMemory if allocation failed.
+*/
+dxf_error_t dxf_share_create(dxf_model_t *model, const void *extra,
+    size_t extra_size, int *fd);
+
+/**
+Maps a segment written by dxf_share_create() and points an empty store at
+it.  The mapping is released by dxf_model_free().
+
+@param  model   Record store, initialized and empty.
+@param  fd  Segment.
+@param  extra   On success, points to the caller's bytes in the segment.
+@param  extra_size  On success, contains their size.
+@returns dxfErrorOk on success, dxfErrorInvalidShare if fd is not a
+segment of this build, dxfErrorBadFd if it cannot be mapped,
+dxfErrorNoMemory if allocation failed.  On failure the store is left for
+dxf_model_free().
+*/
+dxf_error_t dxf_share_attach(dxf_model_t *model, int fd, const void **extra,
+    size_t *extra_size);
+
+/**
+Unmaps the segment of an attached store and forgets the arrays in it.
+
+@param  model   Record store.
+*/
+void dxf_share_detach(dxf_model_t *model);
+
+#endif
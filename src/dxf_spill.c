@@ -0,0 +1,514 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dxf_spill.h"
+#include "dxf_ocs.h"
+#include "util.h"
+#include "dxf_group.h"
+
+/* Reads the next group: code, and the value NULL-terminated in value */
+static dxf_error_t _dxf_spill_group(dxf_spill_t *s, dxf_group_reader_t *rd,
+    int *group_code) {
+    const char *line;
+    size_t len;
+    dxf_error_t err;
+
+    if((err = dxf_group_read(rd, group_code, &line, &len)) != dxfErrorOk) {
+        return err;
+    }
+    if(len >= s->value_cap) {
+        size_t n = (s->value_cap == 0) ? 256 : s->value_cap;
+        void *p;
+        while(len >= n) {
+            n *= 2;
+        }
+        if((p = realloc(s->value, n)) == NULL) {
+            return dxfErrorNoMemory;
+        }
+        s->value = (char*)p;
+        s->value_cap = n;
+    }
+    memcpy(s->value, line, len);
+    s->value[len] = '\0';
+    return dxfErrorOk;
+}
+
+/* Maps the file on first use */
+static dxf_error_t _dxf_spill_map(dxf_spill_t *s) {
+    struct stat st;
+    void *map;
+    int fd;
+
+    if(s->map != NULL) {
+        return dxfErrorOk;
+    }
+    if((fd = open(s->filename, O_RDONLY)) == -1) {
+        return dxfErrorOpenFailed;
+    }
+    if((fstat(fd, &st) == -1) || (st.st_size <= 0) ||
+        ((uint64_t)st.st_size > (uint64_t)SIZE_MAX) ||
+        ((map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd,
+        0)) == MAP_FAILED)) {
+        (void)close(fd);
+        return dxfErrorBadFd;
+    }
+    (void)close(fd);
+    (void)madvise(map, (size_t)st.st_size, MADV_RANDOM);
+    s->map = (const char*)map;
+    s->size = (size_t)st.st_size;
+    return dxfErrorOk;
+}
+
+/*
+Drops the pages of the map wholly inside [from, to), as loading drops the
+pages it has parsed, so reading blocks back does not keep the file
+resident.
+*/
+static void _dxf_spill_release(const dxf_spill_t *s, dxf_off_t from,
+    dxf_off_t to) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_t first, last;
+
+    if((page <= 0) || (from >= to) || ((uint64_t)to > (uint64_t)s->size)) {
+        return;
+    }
+    first = ((size_t)from + (size_t)page - 1) / (size_t)page * (size_t)page;
+    last = (size_t)to / (size_t)page * (size_t)page;
+    if(first < last) {
+        (void)madvise((void*)(s->map + first), last - first, MADV_DONTNEED);
+    }
+}
+
+/*
+Feeds the records of an entity to a scratch store the way loading did:
+its own, then the VERTEX records of a POLYLINE.
+*/
+static dxf_error_t _dxf_spill_feed(const dxf_model_t *model, dxf_spill_t *s,
+    dxf_group_reader_t *rd, dxf_model_t *scratch, const dxf_entity_t *e) {
+    const dxf_record_t *r = &model->record[e->record];
+    dxf_off_t at;
+    int group_code;
+    dxf_error_t err;
+
+    /* The record must still be where loading found it */
+    dxf_group_seek(rd, r->offset);
+    if(((uint64_t)r->offset >= (uint64_t)s->size) ||
+        (_dxf_spill_group(s, rd, &group_code) != dxfErrorOk) ||
+        (group_code != 0) ||
+        (strcmp(s->value, model->types.name[r->type]) != 0)) {
+        return dxfErrorInvalidFormat;
+    }
+    if(dxf_model_begin_record(scratch, s->value, r->offset, r->line) == 0) {
+        return dxfErrorNoMemory;
+    }
+
+    /* Groups up to the next record; VERTEX records go with a POLYLINE */
+    for(;;) {
+        at = DXF_GROUP_OFFSET(rd);
+        if((err = _dxf_spill_group(s, rd, &group_code)) != dxfErrorOk) {
+            return (err == dxfErrorEOF) ? dxfErrorOk : err;
+        }
+        if(group_code == 0) {
+            if((e->kind != dxfKindPolyline) ||
+                (strcmp(s->value, "VERTEX") != 0)) {
+                return dxfErrorOk;
+            }
+            if(dxf_model_begin_record(scratch, s->value, at, r->line) == 0) {
+                return dxfErrorNoMemory;
+            }
+        } else if(DXF_MODEL_KEEPS(scratch, group_code) &&
+            (dxf_model_add_group(scratch, group_code, s->value) == 0)) {
+            return dxfErrorNoMemory;
+        }
+    }
+}
+
+/*
+Parses the vertices of a block again, feeding its entities to a scratch
+store, then takes the scratch store's buffers.
+*/
+static dxf_error_t _dxf_spill_read(const dxf_model_t *model, dxf_spill_t *s,
+    dxf_spill_block_t *b) {
+    dxf_model_t scratch;
+    dxf_group_reader_t rd;
+    dxf_error_t err = dxfErrorOk;
+    dxf_off_t from = 0;
+    size_t fed = 0;
+    uint32_t i;
+
+    dxf_model_init(&scratch, (unsigned long long*)NULL);
+    dxf_model_begin_section(&scratch, "ENTITIES", 0);
+    dxf_group_reader_init(&rd, s->map, s->size);
+    for(i = b->first; (i < b->first + b->cnt) && (err == dxfErrorOk); i++) {
+        const dxf_entity_t *e = &model->entity[i];
+        if(e->vertex_cnt > 0) {
+            if(fed == 0) {
+                from = model->record[e->record].offset;
+            }
+            err = _dxf_spill_feed(model, s, &rd, &scratch, e);
+            fed++;
+        }
+    }
+    dxf_model_end_record(&scratch);
+    if(fed > 0) {
+        _dxf_spill_release(s, from, DXF_GROUP_OFFSET(&rd));
+    }
+    if((err == dxfErrorOk) && ((scratch.entity_cnt != fed) ||
+        (scratch.vertex_cnt != b->vertex_cnt))) {
+        err = dxfErrorInvalidFormat;
+    }
+    if((err == dxfErrorOk) && (dxf_ocs_to_wcs(&scratch) == 0)) {
+        err = dxfErrorNoMemory;
+    }
+    if(err == dxfErrorOk) {
+        b->v = scratch.vertex;
+        b->world = scratch.world;
+        b->bytes = (scratch.vertex_cap + scratch.vertex_cnt) * 4 *
+            sizeof(double);
+        scratch.vertex = (double*)NULL;
+        scratch.world = (double*)NULL;
+        s->reads++;
+    }
+    dxf_model_free(&scratch);
+    return err;
+}
+
+/* Takes a block out of the recently used list */
+static void _dxf_spill_unlink(dxf_spill_t *s, uint32_t k) {
+    dxf_spill_block_t *b = &s->block[k];
+
+    if(b->prev != DXF_INDEX_NONE) {
+        s->block[b->prev].next = b->next;
+    } else {
+        s->head = b->next;
+    }
+    if(b->next != DXF_INDEX_NONE) {
+        s->block[b->next].prev = b->prev;
+    } else {
+        s->tail = b->prev;
+    }
+    b->prev = DXF_INDEX_NONE;
+    b->next = DXF_INDEX_NONE;
+}
+
+/* Makes a block the most recently used */
+static void _dxf_spill_push(dxf_spill_t *s, uint32_t k) {
+    dxf_spill_block_t *b = &s->block[k];
+
+    b->prev = DXF_INDEX_NONE;
+    b->next = s->head;
+    if(s->head != DXF_INDEX_NONE) {
+        s->block[s->head].prev = k;
+    } else {
+        s->tail = k;
+    }
+    s->head = k;
+}
+
+/* Frees the vertices of a block */
+static void _dxf_spill_drop(dxf_spill_block_t *b) {
+    free(b->v);
+    free(b->world);
+    b->v = (double*)NULL;
+    b->world = (double*)NULL;
+    b->bytes = 0;
+}
+
+/* Block holding vertex i */
+static uint32_t _dxf_spill_find(const dxf_spill_t *s, size_t i) {
+    size_t lo = 0, hi = s->block_cnt;
+
+    while(hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(s->block[mid].vertex <= i) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return (uint32_t)lo;
+}
+
+/* Frees a spilled store */
+static void _dxf_spill_free(dxf_spill_t *s) {
+    size_t i;
+
+    if(s == NULL) {
+        return;
+    }
+    for(i = 0; i < s->block_cnt; i++) {
+        _dxf_spill_drop(&s->block[i]);
+    }
+    if(s->map != NULL) {
+        (void)munmap((void*)s->map, s->size);
+    }
+    free(s->block);
+    free(s->value);
+    free(s->filename);
+    free(s);
+}
+
+int dxf_spill_init(dxf_model_t *model, const char *filename, size_t budget) {
+    dxf_spill_t *s;
+    size_t cap = 0, i;
+
+    assert(model != NULL);
+    assert(filename != NULL);
+    assert(model->vertex_window != 0);
+    assert(budget > 0);
+
+    /* Only the last entity's vertices were kept */
+    free(model->vertex);
+    model->vertex = (double*)NULL;
+    model->vertex_cap = 0;
+    model->vertex_cnt += model->vertex_base;
+    model->vertex_base = 0;
+    model->vertex_window = 0;
+    if((s = (dxf_spill_t*)calloc(1, sizeof(*s))) == NULL) {
+        return 0;
+    }
+    s->budget = budget;
+    s->head = DXF_INDEX_NONE;
+    s->tail = DXF_INDEX_NONE;
+    model->spill = s;
+    if((s->filename = util_strdup(filename)) == NULL) {
+        return 0;
+    }
+
+    /* Whole entities, at least DXF_SPILL_BLOCK vertices per block */
+    for(i = 0; i < model->entity_cnt; i++) {
+        const dxf_entity_t *e = &model->entity[i];
+        dxf_spill_block_t *b;
+        if(e->vertex_cnt == 0) {
+            continue;
+        }
+        if((s->block_cnt == 0) ||
+            (s->block[s->block_cnt - 1].vertex_cnt >= DXF_SPILL_BLOCK)) {
+            if(s->block_cnt == cap) {
+                size_t n = (cap == 0) ? 256 : 2 * cap;
+                void *p = realloc(s->block, n * sizeof(dxf_spill_block_t));
+                if(p == NULL) {
+                    return 0;
+                }
+                s->block = (dxf_spill_block_t*)p;
+                cap = n;
+            }
+            b = &s->block[s->block_cnt++];
+            memset(b, 0, sizeof(*b));
+            b->first = (uint32_t)i;
+            b->vertex = e->vertex;
+            b->prev = DXF_INDEX_NONE;
+            b->next = DXF_INDEX_NONE;
+        }
+        b = &s->block[s->block_cnt - 1];
+        b->cnt = (uint32_t)i + 1 - b->first;
+        b->vertex_cnt += e->vertex_cnt;
+    }
+    return 1;
+}
+
+dxf_error_t dxf_spill_copy(dxf_model_t *model, int world, size_t first,
+    size_t cnt, double *out) {
+    dxf_spill_t *s;
+    dxf_error_t err = dxfErrorOk;
+    uint32_t k;
+
+    assert(model != NULL);
+    assert((out != NULL) || (cnt == 0));
+    assert(first + cnt <= model->vertex_cnt);
+    if(cnt == 0) {
+        return dxfErrorOk;
+    }
+    (void)pthread_mutex_lock(&model->spill_lock);
+    if((s = model->spill) == NULL) {
+        /* Buffers in memory stay until the store is freed */
+        (void)pthread_mutex_unlock(&model->spill_lock);
+        memcpy(out, &((world != 0) ? model->world : model->vertex)[4 * first],
+            4 * cnt * sizeof(double));
+        return dxfErrorOk;
+    }
+    if((err = _dxf_spill_map(s)) != dxfErrorOk) {
+        (void)pthread_mutex_unlock(&model->spill_lock);
+        return err;
+    }
+    for(k = _dxf_spill_find(s, first); cnt > 0; k++) {
+        dxf_spill_block_t *b = &s->block[k];
+        size_t skip = first - b->vertex;
+        size_t n = (cnt < b->vertex_cnt - skip) ? cnt : b->vertex_cnt - skip;
+
+        if(b->v == NULL) {
+            if((err = _dxf_spill_read(model, s, b)) != dxfErrorOk) {
+                break;
+            }
+            s->resident += b->bytes;
+        } else {
+            _dxf_spill_unlink(s, k);
+        }
+        _dxf_spill_push(s, k);
+        memcpy(out, &((world != 0) ? b->world : b->v)[4 * skip],
+            4 * n * sizeof(double));
+        out += 4 * n;
+        first += n;
+        cnt -= n;
+
+        /* Least recently used first, never the block just read */
+        while((s->resident > s->budget) && (s->tail != k)) {
+            uint32_t t = s->tail;
+            s->resident -= s->block[t].bytes;
+            _dxf_spill_unlink(s, t);
+            _dxf_spill_drop(&s->block[t]);
+        }
+    }
+    (void)pthread_mutex_unlock(&model->spill_lock);
+    return err;
+}
+
+dxf_error_t dxf_spill_expand(dxf_model_t *model) {
+    dxf_spill_t *s;
+    dxf_error_t err = dxfErrorOk;
+    void *v = NULL, *w = NULL;
+    size_t i;
+
+    assert(model != NULL);
+    (void)pthread_mutex_lock(&model->spill_lock);
+    if(((s = model->spill) == NULL) || (model->vertex_cnt == 0)) {
+        _dxf_spill_free(s);
+        model->spill = (struct _dxf_spill_t*)NULL;
+        (void)pthread_mutex_unlock(&model->spill_lock);
+        return dxfErrorOk;
+    }
+
+    /* Both buffers stay in memory from now on, so both must fit */
+    if(model->vertex_cnt > s->budget / (2 * 4 * sizeof(double))) {
+        err = dxfErrorOverBudget;
+    } else if((posix_memalign(&v, DXF_VERTEX_ALIGN, model->vertex_cnt * 4 *
+        sizeof(double)) != 0) || (posix_memalign(&w, DXF_VERTEX_ALIGN,
+        model->vertex_cnt * 4 * sizeof(double)) != 0)) {
+        err = dxfErrorNoMemory;
+    } else {
+        err = _dxf_spill_map(s);
+    }
+
+    /* Blocks not in memory are read, copied and dropped one at a time */
+    for(i = 0; (i < s->block_cnt) && (err == dxfErrorOk); i++) {
+        dxf_spill_block_t *b = &s->block[i];
+        int resident = (b->v != NULL);
+        if((resident == 0) &&
+            ((err = _dxf_spill_read(model, s, b)) != dxfErrorOk)) {
+            break;
+        }
+        memcpy(&((double*)v)[4 * b->vertex], b->v,
+            4 * b->vertex_cnt * sizeof(double));
+        memcpy(&((double*)w)[4 * b->vertex], b->world,
+            4 * b->vertex_cnt * sizeof(double));
+        if(resident == 0) {
+            _dxf_spill_drop(b);
+        }
+    }
+    if(err != dxfErrorOk) {
+        free(v);
+        free(w);
+    } else {
+        model->vertex = (double*)v;
+        model->world = (double*)w;
+        model->vertex_cap = model->vertex_cnt;
+        _dxf_spill_free(s);
+        model->spill = (struct _dxf_spill_t*)NULL;
+    }
+    (void)pthread_mutex_unlock(&model->spill_lock);
+    return err;
+}
+
+void dxf_spill_free(dxf_model_t *model) {
+    assert(model != NULL);
+    _dxf_spill_free(model->spill);
+    model->spill = (struct _dxf_spill_t*)NULL;
+}
+
+/* Takes the geometry of every entity of a scratch store fed all of them */
+static void _dxf_spill_take(dxf_model_t *model, dxf_model_t *scratch) {
+    size_t i;
+
+    for(i = 0; i < model->entity_cnt; i++) {
+        dxf_entity_t *e = &model->entity[i];
+        const dxf_entity_t *g = &scratch->entity[i];
+        e->i70 = g->i70;
+        e->i71 = g->i71;
+        memcpy(e->p, g->p, sizeof(e->p));
+        memcpy(e->q, g->q, sizeof(e->q));
+        memcpy(e->n, g->n, sizeof(e->n));
+        memcpy(e->s, g->s, sizeof(e->s));
+        e->vertex = g->vertex;
+        e->knot = g->knot;
+        e->vertex_cnt = g->vertex_cnt;
+        e->knot_cnt = g->knot_cnt;
+    }
+    model->vertex = scratch->vertex;
+    model->vertex_cnt = scratch->vertex_cnt;
+    model->vertex_cap = scratch->vertex_cap;
+    model->knot = scratch->knot;
+    model->knot_cnt = scratch->knot_cnt;
+    model->knot_cap = scratch->knot_cap;
+    scratch->vertex = (double*)NULL;
+    scratch->knot = (double*)NULL;
+}
+
+dxf_error_t dxf_spill_geometry(dxf_model_t *model, const char *filename) {
+    dxf_spill_t s;
+    dxf_model_t scratch;
+    dxf_group_reader_t rd;
+    dxf_error_t err = dxfErrorOk;
+    size_t i;
+
+    assert(model != NULL);
+    assert(filename != NULL);
+    (void)pthread_mutex_lock(&model->geometry_lock);
+    if(model->defer_geometry == 0) {
+        (void)pthread_mutex_unlock(&model->geometry_lock);
+        return dxfErrorOk;
+    }
+
+    /* Every entity in file order, in one pass over the mapped file */
+    memset(&s, 0, sizeof(s));
+    s.filename = (char*)filename;
+    dxf_model_init(&scratch, (unsigned long long*)NULL);
+    dxf_model_begin_section(&scratch, "ENTITIES", 0);
+    if((model->entity_cnt > 0) && ((err = _dxf_spill_map(&s)) ==
+        dxfErrorOk)) {
+        (void)madvise((void*)s.map, s.size, MADV_SEQUENTIAL);
+        dxf_group_reader_init(&rd, s.map, s.size);
+        for(i = 0; (i < model->entity_cnt) && (err == dxfErrorOk); i++) {
+            err = _dxf_spill_feed(model, &s, &rd, &scratch,
+                &model->entity[i]);
+        }
+    }
+    dxf_model_end_record(&scratch);
+    if((err == dxfErrorOk) && (scratch.entity_cnt != model->entity_cnt)) {
+        err = dxfErrorInvalidFormat;
+    }
+    if(err == dxfErrorOk) {
+        _dxf_spill_take(model, &scratch);
+        if(dxf_ocs_to_wcs(model) == 0) {
+            /* Taken again by the next call */
+            free(model->vertex);
+            free(model->knot);
+            model->vertex = model->knot = (double*)NULL;
+            model->vertex_cnt = model->vertex_cap = 0;
+            model->knot_cnt = model->knot_cap = 0;
+            err = dxfErrorNoMemory;
+        } else {
+            model->defer_geometry = 0;
+        }
+    }
+    dxf_model_free(&scratch);
+    if(s.map != NULL) {
+        (void)munmap((void*)s.map, s.size);
+    }
+    free(s.value);
+    (void)pthread_mutex_unlock(&model->geometry_lock);
+    return err;
+}
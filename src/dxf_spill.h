@@ -0,0 +1,120 @@
+/** @file dxf_spill.h
+ *  @brief Vertex buffers read back from the file.
+ *
+ * Internal store of the vertex buffer and its world coordinates for a
+ * drawing loaded with a resident byte budget.  Loading keeps only the
+ * vertices of the entity being read; afterwards entities are grouped in
+ * blocks of about DXF_SPILL_BLOCK vertices, each parsed again from the
+ * mapped file on first access and dropped, least recently used first,
+ * once the blocks in memory exceed the budget.  The pages a block was
+ * parsed from are released after each read, so the map does not count
+ * against the budget either.
+ *
+ * A drawing loaded without a budget or compact_step leaves the geometry of
+ * its entities in the file the same way, and reads all of it back in one
+ * pass the first time any of it is needed.
+ */
+#ifndef _DXF_SPILL_H_
+#define _DXF_SPILL_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* Fewest vertices per block, unless the drawing has fewer */
+#define DXF_SPILL_BLOCK 4096
+
+/* A run of entities whose vertices are read back together */
+typedef struct _dxf_spill_block_t {
+    uint32_t first; /* First entity */
+    uint32_t cnt; /* Entities */
+    size_t vertex; /* First vertex, numbered as in the vertex buffer */
+    size_t vertex_cnt; /* Vertices */
+    double *v; /* Vertices, NULL unless in memory */
+    double *world; /* v in WCS */
+    size_t bytes; /* Bytes held by v and world */
+    uint32_t prev; /* More recently used block, DXF_INDEX_NONE */
+    uint32_t next; /* Less recently used block, DXF_INDEX_NONE */
+} dxf_spill_block_t;
+
+/* Blocks of a drawing and the file they are read from */
+typedef struct _dxf_spill_t {
+    dxf_spill_block_t *block; /* Blocks, in vertex order */
+    size_t block_cnt;
+    size_t budget; /* Bytes blocks may hold */
+    size_t resident; /* Bytes blocks hold */
+    uint32_t head; /* Most recently used block in memory */
+    uint32_t tail; /* Least recently used block in memory */
+    char *filename; /* File the drawing was loaded from */
+    const char *map; /* Mapped file, NULL until the first read */
+    size_t size; /* Bytes mapped */
+    char *value; /* Value of the group being read */
+    size_t value_cap;
+    unsigned long long reads; /* Blocks parsed again */
+} dxf_spill_t;
+
+/**
+Replaces the vertex buffer by blocks read back on access.  The store must
+have been loaded with vertex_window set, so it holds only the vertices of
+its last entity; vertex_cnt becomes the count of the whole drawing.
+Called once, after dxf_model_build_index() and before dxf_ocs_to_wcs().
+
+@param  model   Record store.
+@param  filename    File the drawing was loaded from, read back later.
+@param  budget  Bytes the blocks in memory may hold, > 0.  The block being
+    read is kept even if it alone exceeds the budget.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_spill_init(dxf_model_t *model, const char *filename, size_t budget);
+
+/**
+Copies a range of the vertex buffer or of its world coordinates, reading
+back the blocks that hold it.  Copies from the vertex buffer if the store
+is not spilled.  Safe to call from several threads.
+
+@param  model   Record store.
+@param  world   Non-zero for world coordinates.
+@param  first   First vertex.
+@param  cnt Number of vertices, first + cnt no more than vertex_cnt.
+@param  out Receives cnt vertices of x, y, z, w.
+@returns dxfErrorOk on success, dxfErrorOpenFailed or dxfErrorBadFd if
+the file cannot be mapped, dxfErrorInvalidFormat if it no longer holds the
+vertices loading found, dxfErrorNoMemory if allocation failed.
+*/
+dxf_error_t dxf_spill_copy(dxf_model_t *model, int world, size_t first,
+    size_t cnt, double *out);
+
+/**
+Reads every block back into a vertex buffer and world coordinates for
+good, if the store is spilled and both fit its budget.  Safe to call from
+several threads.
+
+@param  model   Record store.
+@returns dxfErrorOk on success, dxfErrorOverBudget if the buffers would
+exceed the budget, error code of dxf_spill_copy() otherwise; on failure
+the store stays spilled.
+*/
+dxf_error_t dxf_spill_expand(dxf_model_t *model);
+
+/**
+Parses the geometry of every entity again from the file, for a store
+loaded with defer_geometry set: points, scalars, extrusion, vertices and
+knots, then the world coordinates.  Clears defer_geometry on success;
+does nothing once it is clear.  Safe to call from several threads.
+
+@param  model   Record store.
+@param  filename    File the drawing was loaded from.
+@returns dxfErrorOk on success, dxfErrorOpenFailed or dxfErrorBadFd if the
+file cannot be mapped, dxfErrorInvalidFormat if it no longer holds the
+entities loading found, dxfErrorNoMemory if allocation failed; on failure
+the geometry stays deferred.
+*/
+dxf_error_t dxf_spill_geometry(dxf_model_t *model, const char *filename);
+
+/**
+Frees the blocks and unmaps the file.
+
+@param  model   Record store.
+*/
+void dxf_spill_free(dxf_model_t *model);
+
+#endif
@@ -0,0 +1,80 @@
+/** @file dxf_string.h
+ *  @brief String value decoding.
+ *
+ * Internal decoding of raw group values to UTF-8, done on access only: ^
+ * control character escapes, \\U+XXXX escapes and the single byte code
+ * pages $DWGCODEPAGE names.  Most values need none of it, which a quick
+ * scan tells apart so they are returned as written.
+ */
+#ifndef _DXF_STRING_H_
+#define _DXF_STRING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bytes of UTF-8 a single input byte may decode to */
+#define DXF_STRING_EXPANSION 3
+
+/**
+Finds the code page raw strings of a drawing are written in.  Drawings
+from AutoCAD 2007 (AC1021) on are UTF-8 whatever $DWGCODEPAGE says; older
+ones with an unknown code page are taken as ANSI_1252.  The double byte
+code pages ANSI_932, ANSI_936, ANSI_949 and ANSI_950 are not decoded:
+their high bytes are copied as written, not mistaken for ANSI_1252.
+
+@param  version $ACADVER, NULL if not set.
+@param  codepage    $DWGCODEPAGE, NULL if not set.
+@returns The code points of bytes 0x80 to 0xFF, NULL if high bytes are
+copied as written (UTF-8 or a double byte code page).
+*/
+const uint16_t *dxf_string_codepage(const char *version,
+    const char *codepage);
+
+/**
+Checks whether a string decodes to itself: no high byte, no ^ and, with
+escapes, no backslash.
+
+@param  s   String, as written.
+@param  len Bytes of s.
+@param  escapes Non-zero if \\U+XXXX escapes are decoded.
+@returns Non-zero if decoding would not change s.
+*/
+int dxf_string_plain(const char *s, size_t len, int escapes);
+
+/**
+Encodes a code point of the basic multilingual plane as UTF-8.
+
+@param  c   Code point, below 0x10000.
+@param  out Receives 1 to 3 bytes.
+@returns The bytes written.
+*/
+size_t dxf_string_utf8(uint32_t c, char *out);
+
+/**
+Decodes a \\U+XXXX escape at the start of a string.
+
+@param  s   String, as written.
+@param  len Bytes of s.
+@param  out Receives the character as 1 to 3 bytes of UTF-8.
+@param  n   On success, contains the bytes written to out.
+@returns The bytes of s the escape takes, 0 if s does not start with one.
+*/
+size_t dxf_string_unicode(const char *s, size_t len, char *out, size_t *n);
+
+/**
+Decodes a raw string to UTF-8: ^ followed by @ to _ is the control
+character 0x00 to 0x1F and "^ " a caret, high bytes are mapped through the
+code page and, with escapes, \\U+XXXX is the character XXXX.
+
+@param  s   String, as written.
+@param  len Bytes of s.
+@param  map Code page, see dxf_string_codepage(); NULL to copy high bytes.
+@param  escapes Non-zero to decode \\U+XXXX escapes.
+@param  out Receives the text, at least DXF_STRING_EXPANSION * len bytes;
+    not NULL-terminated.
+@returns The bytes written to out.
+*/
+size_t dxf_string_decode(const char *s, size_t len, const uint16_t *map,
+    int escapes, char *out);
+
+#endif
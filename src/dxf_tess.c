@@ -0,0 +1,598 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "dxf_tess.h"
+
+/* Extrusions closer than this to the Z axis use the world Y axis */
+#define DXF_OCS_LIMIT (1.0 / 64.0)
+
+void dxf_mat_identity(dxf_mat_t m) {
+    memset(m, 0, sizeof(dxf_mat_t));
+    m[0] = m[5] = m[10] = 1.0;
+}
+
+void dxf_mat_mul(const dxf_mat_t a, const dxf_mat_t b, dxf_mat_t out) {
+    int r, c;
+
+    assert((out != a) && (out != b));
+    for(r = 0; r < 3; r++) {
+        for(c = 0; c < 4; c++) {
+            out[4 * r + c] = a[4 * r] * b[c] + a[4 * r + 1] * b[4 + c] +
+                a[4 * r + 2] * b[8 + c];
+        }
+        out[4 * r + 3] += a[4 * r + 3];
+    }
+}
+
+int dxf_mat_ocs(const double n[3], dxf_mat_t m) {
+    double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    double nz[3], ax[3], ay[3];
+    int i;
+
+    dxf_mat_identity(m);
+    if((len == 0.0) || ((n[0] == 0.0) && (n[1] == 0.0) && (n[2] > 0.0))) {
+        return 0;
+    }
+    for(i = 0; i < 3; i++) {
+        nz[i] = n[i] / len;
+    }
+
+    /* Arbitrary axis algorithm */
+    if((fabs(nz[0]) < DXF_OCS_LIMIT) && (fabs(nz[1]) < DXF_OCS_LIMIT)) {
+        /* Wy x N */
+        ax[0] = nz[2];
+        ax[1] = 0.0;
+        ax[2] = -nz[0];
+    } else {
+        /* Wz x N */
+        ax[0] = -nz[1];
+        ax[1] = nz[0];
+        ax[2] = 0.0;
+    }
+    len = sqrt(ax[0] * ax[0] + ax[1] * ax[1] + ax[2] * ax[2]);
+    for(i = 0; i < 3; i++) {
+        ax[i] /= len;
+    }
+    ay[0] = nz[1] * ax[2] - nz[2] * ax[1];
+    ay[1] = nz[2] * ax[0] - nz[0] * ax[2];
+    ay[2] = nz[0] * ax[1] - nz[1] * ax[0];
+    for(i = 0; i < 3; i++) {
+        m[4 * i] = ax[i];
+        m[4 * i + 1] = ay[i];
+        m[4 * i + 2] = nz[i];
+    }
+    return 1;
+}
+
+double dxf_mat_scale(const dxf_mat_t m) {
+    double s = 0.0;
+    int c;
+
+    for(c = 0; c < 3; c++) {
+        double l = sqrt(m[c] * m[c] + m[4 + c] * m[4 + c] +
+            m[8 + c] * m[8 + c]);
+        if(l > s) {
+            s = l;
+        }
+    }
+    return s;
+}
+
+void dxf_mat_apply(const dxf_mat_t m, const double in[3], double out[3]) {
+    double x = in[0], y = in[1], z = in[2];
+
+    out[0] = m[0] * x + m[1] * y + m[2] * z + m[3];
+    out[1] = m[4] * x + m[5] * y + m[6] * z + m[7];
+    out[2] = m[8] * x + m[9] * y + m[10] * z + m[11];
+}
+
+void dxf_geometry_init(dxf_geometry_t *geometry) {
+    assert(geometry != NULL);
+    memset(geometry, 0, sizeof(*geometry));
+}
+
+void dxf_geometry_free(dxf_geometry_t *geometry) {
+    assert(geometry != NULL);
+    free(geometry->vertex);
+    free(geometry->path);
+    dxf_geometry_init(geometry);
+}
+
+/* Makes room for cnt more vertices */
+static int _dxf_geometry_reserve(dxf_geometry_t *g, size_t cnt) {
+    double *v;
+    size_t cap;
+
+    if(g->vertex_cnt + cnt <= g->vertex_cap) {
+        return 1;
+    }
+    for(cap = (g->vertex_cap == 0) ? 256 : g->vertex_cap;
+        cap < g->vertex_cnt + cnt; cap *= 2) {
+    }
+    if((v = (double*)realloc(g->vertex, 3 * cap * sizeof(double))) ==
+        NULL) {
+        return 0;
+    }
+    g->vertex = v;
+    g->vertex_cap = cap;
+    return 1;
+}
+
+int dxf_geometry_begin_path(dxf_geometry_t *g, dxf_record_id_t record) {
+    dxf_path_t *p;
+
+    if(g->path_cnt == g->path_cap) {
+        size_t cap = (g->path_cap == 0) ? 64 : 2 * g->path_cap;
+        if((p = (dxf_path_t*)realloc(g->path, cap * sizeof(dxf_path_t))) ==
+            NULL) {
+            return 0;
+        }
+        g->path = p;
+        g->path_cap = cap;
+    }
+    p = &g->path[g->path_cnt];
+    p->record = record;
+    p->first = g->vertex_cnt;
+    p->cnt = 0;
+    p->closed = 0;
+    return 1;
+}
+
+int dxf_geometry_add_vertex(dxf_geometry_t *g, double x, double y,
+    double z) {
+    double *v;
+
+    if(_dxf_geometry_reserve(g, 1) == 0) {
+        return 0;
+    }
+    v = &g->vertex[3 * g->vertex_cnt++];
+    v[0] = x;
+    v[1] = y;
+    v[2] = z;
+    g->path[g->path_cnt].cnt++;
+    return 1;
+}
+
+void dxf_geometry_end_path(dxf_geometry_t *g, int closed) {
+    if(g->path[g->path_cnt].cnt > 0) {
+        g->path[g->path_cnt].closed = closed;
+        g->path_cnt++;
+    }
+}
+
+int dxf_geometry_append_paths(dxf_geometry_t *g, const dxf_geometry_t *src,
+    size_t first, size_t cnt, const dxf_mat_t m, dxf_record_id_t record) {
+    size_t i, j;
+
+    assert(first + cnt <= src->path_cnt);
+    for(i = first; i < first + cnt; i++) {
+        const dxf_path_t *sp = &src->path[i];
+        if((dxf_geometry_begin_path(g, (record == DXF_RECORD_NONE) ?
+            sp->record : record) == 0) ||
+            (_dxf_geometry_reserve(g, sp->cnt) == 0)) {
+            return 0;
+        }
+        for(j = 0; j < sp->cnt; j++) {
+            dxf_mat_apply(m, &src->vertex[3 * (sp->first + j)],
+                &g->vertex[3 * (g->vertex_cnt + j)]);
+        }
+        g->vertex_cnt += sp->cnt;
+        g->path[g->path_cnt].cnt = sp->cnt;
+        dxf_geometry_end_path(g, sp->closed);
+    }
+    return 1;
+}
+
+int dxf_geometry_append(dxf_geometry_t *g, const dxf_geometry_t *src,
+    const dxf_mat_t m, dxf_record_id_t record) {
+    return (_dxf_geometry_reserve(g, src->vertex_cnt) != 0) &&
+        (dxf_geometry_append_paths(g, src, 0, src->path_cnt, m, record) != 0);
+}
+
+/* Number of chords for an arc of the given sweep and radius */
+static size_t _dxf_tess_segments(double sweep, double radius,
+    double tolerance) {
+    double x = 1.0 - tolerance / radius;
+    double n;
+
+    if(x < -1.0) {
+        x = -1.0;
+    }
+    n = ceil(fabs(sweep) / (2.0 * acos(x)));
+    if(!(n >= 1.0)) {
+        return 1;
+    }
+    return (n > DXF_TESS_MAX_SEGMENTS) ? DXF_TESS_MAX_SEGMENTS : (size_t)n;
+}
+
+/*
+Emits the points of an arc in its plane at height z, start excluded when
+skip_first is set.  Angles in radians.
+*/
+static int _dxf_tess_arc(dxf_geometry_t *g, const dxf_mat_t m,
+    const double c[3], double radius, double start, double sweep,
+    double tolerance, int skip_first, size_t min_segments) {
+    size_t n = _dxf_tess_segments(sweep, radius, tolerance);
+    size_t i;
+
+    if(n < min_segments) {
+        n = min_segments;
+    }
+    for(i = (skip_first != 0) ? 1 : 0; i <= n; i++) {
+        double a = start + sweep * (double)i / (double)n;
+        double p[3], w[3];
+        p[0] = c[0] + radius * cos(a);
+        p[1] = c[1] + radius * sin(a);
+        p[2] = c[2];
+        dxf_mat_apply(m, p, w);
+        if(dxf_geometry_add_vertex(g, w[0], w[1], w[2]) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Emits a polyline segment from a to b with a bulge, a excluded */
+static int _dxf_tess_bulge(dxf_geometry_t *g, const dxf_mat_t m,
+    const double a[3], const double b[3], double bulge, double tolerance) {
+    double dx = b[0] - a[0], dy = b[1] - a[1];
+    double chord = sqrt(dx * dx + dy * dy);
+    double c[3], w[3], k, theta;
+
+    if((fabs(bulge) < 1e-12) || (chord == 0.0)) {
+        dxf_mat_apply(m, b, w);
+        return dxf_geometry_add_vertex(g, w[0], w[1], w[2]);
+    }
+
+    /* Included angle 4 atan(bulge), center left of a->b for positive */
+    theta = 4.0 * atan(bulge);
+    k = (1.0 - bulge * bulge) / (4.0 * bulge);
+    c[0] = (a[0] + b[0]) / 2.0 - k * dy;
+    c[1] = (a[1] + b[1]) / 2.0 + k * dx;
+    c[2] = a[2];
+    return _dxf_tess_arc(g, m, c, chord / (2.0 * fabs(sin(theta / 2.0))),
+        atan2(a[1] - c[1], a[0] - c[0]), theta, tolerance, 1, 1);
+}
+
+/* Emits the vertices v of a polyline, bulges flattened */
+static int _dxf_tess_polyline(dxf_geometry_t *g, const double *v,
+    const dxf_entity_t *e, double tolerance, const dxf_mat_t m, int is_3d) {
+    int closed = ((e->i70 & DXF_POLYLINE_CLOSED) != 0);
+    double a[3], b[3], w[3];
+    uint32_t i;
+
+    a[0] = v[0];
+    a[1] = v[1];
+    a[2] = (is_3d != 0) ? v[2] : e->p[2];
+    dxf_mat_apply(m, a, w);
+    if(dxf_geometry_add_vertex(g, w[0], w[1], w[2]) == 0) {
+        return 0;
+    }
+    for(i = 1; i < e->vertex_cnt + ((closed != 0) ? 1 : 0); i++) {
+        const double *vb = &v[4 * (i % e->vertex_cnt)];
+        b[0] = vb[0];
+        b[1] = vb[1];
+        b[2] = (is_3d != 0) ? vb[2] : e->p[2];
+        /* The bulge of a vertex applies to the segment that starts there */
+        if(_dxf_tess_bulge(g, m, a, b, (is_3d != 0) ? 0.0 : v[4 * (i - 1) +
+            3], tolerance) == 0) {
+            return 0;
+        }
+        memcpy(a, b, sizeof(a));
+    }
+
+    /* The closing segment ends on the first vertex, drop the duplicate */
+    if((closed != 0) && (g->path[g->path_cnt].cnt > 1)) {
+        g->path[g->path_cnt].cnt--;
+        g->vertex_cnt--;
+    }
+    return 1;
+}
+
+/* Emits an ELLIPSE, in WCS with its normal along the extrusion */
+static int _dxf_tess_ellipse(dxf_geometry_t *g, const dxf_entity_t *e,
+    double tolerance, const dxf_mat_t m, int *closed) {
+    const double *n = e->n, *ma = e->q;
+    double a = sqrt(ma[0] * ma[0] + ma[1] * ma[1] + ma[2] * ma[2]);
+    double b = a * e->s[DXF_S_40];
+    double start = e->s[DXF_S_41], sweep = e->s[DXF_S_42] - start;
+    double mi[3], len, p[3], w[3];
+    size_t cnt, i;
+    int full;
+
+    if((a == 0.0) || (b <= 0.0)) {
+        return 1;
+    }
+    /* Minor axis: extrusion x major, scaled to the ratio */
+    mi[0] = n[1] * ma[2] - n[2] * ma[1];
+    mi[1] = n[2] * ma[0] - n[0] * ma[2];
+    mi[2] = n[0] * ma[1] - n[1] * ma[0];
+    if((len = sqrt(mi[0] * mi[0] + mi[1] * mi[1] + mi[2] * mi[2])) == 0.0) {
+        return 1;
+    }
+    for(i = 0; i < 3; i++) {
+        mi[i] *= b / len;
+    }
+    if(sweep <= 0.0) {
+        sweep += 2.0 * M_PI;
+    }
+    full = (sweep >= 2.0 * M_PI - 1e-12);
+
+    /* Sharpest curvature, at the ends of the major axis, bounds the error */
+    cnt = _dxf_tess_segments(sweep, (b < a) ? b * b / a : a, tolerance);
+    if((full != 0) && (cnt < 3)) {
+        cnt = 3;
+    }
+    for(i = 0; i < cnt + ((full != 0) ? 0 : 1); i++) {
+        double t = start + sweep * (double)i / (double)cnt;
+        double ct = cos(t), st = sin(t);
+        p[0] = e->p[0] + ct * ma[0] + st * mi[0];
+        p[1] = e->p[1] + ct * ma[1] + st * mi[1];
+        p[2] = e->p[2] + ct * ma[2] + st * mi[2];
+        dxf_mat_apply(m, p, w);
+        if(dxf_geometry_add_vertex(g, w[0], w[1], w[2]) == 0) {
+            return 0;
+        }
+    }
+    *closed = full;
+    return 1;
+}
+
+/*
+Evaluates a span of a B-spline at DXF_TESS_LANES parameters at once with
+de Boor's algorithm, in homogeneous coordinates.  Every step runs the same
+arithmetic across the lanes, so the inner loops vectorize.
+
+@param  cp  Control points x, y, z, w of the span, degree + 1 of them.
+@param  knot    Knots, knot[0] is the first one the span's basis uses.
+@param  degree  Degree.
+@param  u   Parameters, all within the span.
+@param  out On return, x, y, z per lane, divided by the weight.
+*/
+static void _dxf_tess_de_boor(const double *cp, const double *knot,
+    int degree, const double u[DXF_TESS_LANES],
+    double out[3][DXF_TESS_LANES]) {
+    double d[DXF_TESS_MAX_DEGREE + 1][4][DXF_TESS_LANES];
+    int i, r, c, l;
+
+    for(i = 0; i <= degree; i++) {
+        for(c = 0; c < 4; c++) {
+            /* Weighted, w itself in the last coordinate */
+            double v = (c < 3) ? cp[4 * i + c] * cp[4 * i + 3] :
+                cp[4 * i + 3];
+            for(l = 0; l < DXF_TESS_LANES; l++) {
+                d[i][c][l] = v;
+            }
+        }
+    }
+    for(r = 1; r <= degree; r++) {
+        for(i = degree; i >= r; i--) {
+            double k0 = knot[i], k1 = knot[i + 1 + degree - r];
+            double span = (k1 > k0) ? 1.0 / (k1 - k0) : 0.0;
+            double alpha[DXF_TESS_LANES];
+            for(l = 0; l < DXF_TESS_LANES; l++) {
+                alpha[l] = (u[l] - k0) * span;
+            }
+            for(c = 0; c < 4; c++) {
+                for(l = 0; l < DXF_TESS_LANES; l++) {
+                    d[i][c][l] = (1.0 - alpha[l]) * d[i - 1][c][l] +
+                        alpha[l] * d[i][c][l];
+                }
+            }
+        }
+    }
+    for(l = 0; l < DXF_TESS_LANES; l++) {
+        double w = (d[degree][3][l] != 0.0) ? 1.0 / d[degree][3][l] : 0.0;
+        for(c = 0; c < 3; c++) {
+            out[c][l] = d[degree][c][l] * w;
+        }
+    }
+}
+
+/*
+Chords for one span: a polynomial piece of degree d deviates from its chords
+by at most d (d - 1) max|second difference of its control points| / (8 n^2).
+*/
+static size_t _dxf_tess_span_segments(const double *cp, int degree,
+    double tolerance) {
+    double dd = 0.0, n;
+    int i, c;
+
+    if(degree < 2) {
+        return 1;
+    }
+    for(i = 0; i + 2 <= degree; i++) {
+        double s = 0.0;
+        for(c = 0; c < 3; c++) {
+            double x = cp[4 * i + c] - 2.0 * cp[4 * (i + 1) + c] +
+                cp[4 * (i + 2) + c];
+            s += x * x;
+        }
+        if(s > dd) {
+            dd = s;
+        }
+    }
+    n = ceil(sqrt((double)(degree * (degree - 1)) * sqrt(dd) /
+        (8.0 * tolerance)));
+    if(!(n >= 1.0)) {
+        return 1;
+    }
+    return (n > DXF_TESS_MAX_SEGMENTS) ? DXF_TESS_MAX_SEGMENTS : (size_t)n;
+}
+
+/* Emits a SPLINE from its control points cp, in WCS */
+static int _dxf_tess_spline(dxf_geometry_t *g, const dxf_model_t *model,
+    const double *cp, const dxf_entity_t *e, double tolerance,
+    const dxf_mat_t m, int *closed) {
+    const double *knot = &model->knot[e->knot];
+    size_t cnt = e->vertex_cnt;
+    int degree = (e->i71 > 0) ? e->i71 : 3;
+    double uniform[2 * (DXF_TESS_MAX_DEGREE + 1)];
+    double u[DXF_TESS_LANES], out[3][DXF_TESS_LANES], p[3], w[3];
+    size_t j, i, n;
+    int l, first = 1;
+
+    if((cnt < 2) || (degree > DXF_TESS_MAX_DEGREE)) {
+        return 1;
+    }
+    if((size_t)degree >= cnt) {
+        degree = (int)cnt - 1;
+    }
+    if(e->knot_cnt != cnt + degree + 1) {
+        /* Missing or inconsistent knots: clamped uniform, one span */
+        if(cnt != (size_t)degree + 1) {
+            return 1;
+        }
+        for(i = 0; i < 2 * (size_t)(degree + 1); i++) {
+            uniform[i] = (i <= (size_t)degree) ? 0.0 : 1.0;
+        }
+        knot = uniform;
+    }
+
+    /* Span j covers [knot[j], knot[j + 1]), control points j - degree..j */
+    for(j = (size_t)degree; j < cnt; j++) {
+        const double *span_cp = &cp[4 * (j - degree)];
+        double k0 = knot[j], k1 = knot[j + 1];
+        if(!(k1 > k0)) {
+            continue;
+        }
+        n = _dxf_tess_span_segments(span_cp, degree, tolerance);
+        /* Points i = 1..n of the span, point 0 only for the first one */
+        for(i = (first != 0) ? 0 : 1; i <= n; i += DXF_TESS_LANES) {
+            size_t batch = n + 1 - i;
+            if(batch > DXF_TESS_LANES) {
+                batch = DXF_TESS_LANES;
+            }
+            for(l = 0; l < DXF_TESS_LANES; l++) {
+                size_t k = i + (((size_t)l < batch) ? (size_t)l : 0);
+                u[l] = k0 + (k1 - k0) * (double)k / (double)n;
+            }
+            _dxf_tess_de_boor(span_cp, &knot[j - degree], degree, u, out);
+            for(l = 0; (size_t)l < batch; l++) {
+                p[0] = out[0][l];
+                p[1] = out[1][l];
+                p[2] = out[2][l];
+                dxf_mat_apply(m, p, w);
+                if(dxf_geometry_add_vertex(g, w[0], w[1], w[2]) == 0) {
+                    return 0;
+                }
+            }
+        }
+        first = 0;
+    }
+
+    /* Closed splines end where they start, drop the duplicate */
+    if(((e->i70 & DXF_SPLINE_CLOSED) != 0) && (g->path[g->path_cnt].cnt > 2)) {
+        const double *a = &g->vertex[3 * g->path[g->path_cnt].first];
+        const double *b = &g->vertex[3 * (g->vertex_cnt - 1)];
+        if((fabs(a[0] - b[0]) <= tolerance) && (fabs(a[1] - b[1]) <=
+            tolerance) && (fabs(a[2] - b[2]) <= tolerance)) {
+            g->path[g->path_cnt].cnt--;
+            g->vertex_cnt--;
+            *closed = 1;
+        }
+    }
+    return 1;
+}
+
+double dxf_tess_round_tolerance(double tolerance) {
+    int exp;
+
+    (void)frexp(tolerance, &exp);
+    return ldexp(0.5, exp);
+}
+
+int dxf_tess_entity(dxf_model_t *model, const dxf_entity_t *e,
+    double tolerance, const dxf_mat_t m, dxf_record_id_t record,
+    dxf_geometry_t *g, dxf_vertex_scratch_t *scratch) {
+    dxf_mat_t ocs, f; /* OCS to WCS, full transform */
+    const double *v = (const double*)NULL; /* Vertices of e */
+    double w[3];
+    int closed = 0;
+    int ok = 1;
+
+    assert(model != NULL);
+    assert(e != NULL);
+    assert(tolerance > 0.0);
+
+    /* Entities defined in their OCS; 3D polylines are in WCS */
+    if(DXF_ENTITY_IS_OCS(e) && (dxf_mat_ocs(e->n, ocs) != 0)) {
+        dxf_mat_mul(m, ocs, f);
+    } else {
+        memcpy(f, m, sizeof(f));
+    }
+
+    /* Polylines and splines read their vertices wherever they are kept */
+    if((e->vertex_cnt > 0) && ((e->kind == dxfKindLwPolyline) ||
+        (e->kind == dxfKindSpline) || ((e->kind == dxfKindPolyline) &&
+        ((e->i70 & DXF_POLYLINE_MESH) == 0))) &&
+        ((v = dxf_model_entity_vertices(model, e, 0, scratch)) == NULL)) {
+        return 0;
+    }
+
+    if(dxf_geometry_begin_path(g, record) == 0) {
+        return 0;
+    }
+    switch(e->kind) {
+        case dxfKindLine:
+            dxf_mat_apply(f, e->p, w);
+            ok = dxf_geometry_add_vertex(g, w[0], w[1], w[2]);
+            dxf_mat_apply(f, e->q, w);
+            ok = ok && dxf_geometry_add_vertex(g, w[0], w[1], w[2]);
+            break;
+        case dxfKindPoint:
+            dxf_mat_apply(f, e->p, w);
+            ok = dxf_geometry_add_vertex(g, w[0], w[1], w[2]);
+            break;
+        case dxfKindCircle:
+            if(e->s[DXF_S_40] > 0.0) {
+                /* The last point would repeat the first */
+                ok = _dxf_tess_arc(g, f, e->p, e->s[DXF_S_40], 0.0,
+                    2.0 * M_PI, tolerance, 1, 3);
+                closed = 1;
+            }
+            break;
+        case dxfKindArc:
+            if(e->s[DXF_S_40] > 0.0) {
+                double start = e->s[DXF_S_50] * M_PI / 180.0;
+                double end = e->s[DXF_S_51] * M_PI / 180.0;
+                if(end <= start) {
+                    end += 2.0 * M_PI;
+                }
+                ok = _dxf_tess_arc(g, f, e->p, e->s[DXF_S_40], start,
+                    end - start, tolerance, 0, 1);
+            }
+            break;
+        case dxfKindLwPolyline:
+            if(v != NULL) {
+                ok = _dxf_tess_polyline(g, v, e, tolerance, f, 0);
+            }
+            closed = ((e->i70 & DXF_POLYLINE_CLOSED) != 0);
+            break;
+        case dxfKindPolyline:
+            if(((e->i70 & DXF_POLYLINE_MESH) == 0) && (v != NULL)) {
+                ok = _dxf_tess_polyline(g, v, e, tolerance, f,
+                    ((e->i70 & DXF_POLYLINE_3D) != 0));
+                closed = ((e->i70 & DXF_POLYLINE_CLOSED) != 0);
+            }
+            break;
+        case dxfKindEllipse:
+            ok = _dxf_tess_ellipse(g, e, tolerance, f, &closed);
+            break;
+        case dxfKindSpline:
+            if(v != NULL) {
+                ok = _dxf_tess_spline(g, model, v, e, tolerance, f,
+                    &closed);
+            }
+            break;
+        default:
+            /* No outline (text) or flattened elsewhere (INSERT) */
+            break;
+    }
+    if(ok == 0) {
+        return 0;
+    }
+    dxf_geometry_end_path(g, closed);
+    return 1;
+}
@@ -0,0 +1,117 @@
+/** @file dxf_tess.h
+ *  @brief Curve flattening.
+ *
+ * Internal helpers that turn entities into polylines within a chordal
+ * tolerance, and the affine transforms used to place them.
+ */
+#ifndef _DXF_TESS_H_
+#define _DXF_TESS_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* Upper bound on segments emitted for one curve */
+#define DXF_TESS_MAX_SEGMENTS 65536
+
+/* Spline parameters evaluated together */
+#define DXF_TESS_LANES 8
+
+/* Highest SPLINE degree flattened */
+#define DXF_TESS_MAX_DEGREE 11
+
+/* Affine transform, three rows of x, y, z and translation */
+typedef double dxf_mat_t[12];
+
+/**
+Sets a transform to identity.
+*/
+void dxf_mat_identity(dxf_mat_t m);
+
+/**
+Multiplies two transforms, out = a * b (b applied first).
+out may not alias a or b.
+*/
+void dxf_mat_mul(const dxf_mat_t a, const dxf_mat_t b, dxf_mat_t out);
+
+/**
+Builds the OCS to WCS transform of an extrusion direction with the
+arbitrary axis algorithm.
+
+@param  n   Extrusion direction, need not be normalized.
+@param  m   On return, the transform; identity for +Z or a zero vector.
+@returns Non-zero if the transform is not the identity.
+*/
+int dxf_mat_ocs(const double n[3], dxf_mat_t m);
+
+/**
+Largest factor a transform scales lengths by.
+*/
+double dxf_mat_scale(const dxf_mat_t m);
+
+/**
+Applies a transform to a point.
+*/
+void dxf_mat_apply(const dxf_mat_t m, const double in[3], double out[3]);
+
+/**
+Starts a path in a geometry buffer.
+
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_geometry_begin_path(dxf_geometry_t *g, dxf_record_id_t record);
+
+/**
+Appends a vertex to the current path.
+
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_geometry_add_vertex(dxf_geometry_t *g, double x, double y,
+    double z);
+
+/**
+Ends the current path, dropping it if it has no vertices.
+*/
+void dxf_geometry_end_path(dxf_geometry_t *g, int closed);
+
+/**
+Appends every path of src, transformed, attributed to record unless it is
+DXF_RECORD_NONE.
+
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_geometry_append(dxf_geometry_t *g, const dxf_geometry_t *src,
+    const dxf_mat_t m, dxf_record_id_t record);
+
+/**
+Appends paths first to first + cnt - 1 of src, as dxf_geometry_append().
+
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_geometry_append_paths(dxf_geometry_t *g, const dxf_geometry_t *src,
+    size_t first, size_t cnt, const dxf_mat_t m, dxf_record_id_t record);
+
+/**
+Rounds a tolerance down to a power of two, so nearby tolerances share
+cached results without ever being coarser than asked.
+*/
+double dxf_tess_round_tolerance(double tolerance);
+
+/**
+Flattens one entity other than INSERT into paths.
+
+@param  model   Record store.
+@param  e   Entity.
+@param  tolerance   Max distance between a curve and its chords, in the
+    entity's coordinates.
+@param  m   Transform applied after OCS to WCS.
+@param  record  Record the paths are attributed to.
+@param  g   Geometry the paths are appended to.
+@param  scratch Scratch for vertices not held in memory.
+@returns 1 on success, 0 on failure: allocation failed, or getting the
+vertices did, with scratch->err set.
+*/
+int dxf_tess_entity(dxf_model_t *model, const dxf_entity_t *e,
+    double tolerance, const dxf_mat_t m, dxf_record_id_t record,
+    dxf_geometry_t *g, dxf_vertex_scratch_t *scratch);
+
+#endif
@@ -0,0 +1,348 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include "dxf_text.h"
+#include "dxf_string.h"
+
+/* Trigram of three bytes */
+#define DXF_TEXT_GRAM(p) ((uint32_t)(unsigned char)(p)[0] << 16 | \
+    (uint32_t)(unsigned char)(p)[1] << 8 | (uint32_t)(unsigned char)(p)[2])
+
+size_t dxf_text_decode(const char *s, size_t len, int mtext, char *out) {
+    size_t i = 0, n = 0, k, m;
+    long c;
+
+    assert((s != NULL) || (len == 0));
+    assert(out != NULL);
+    while(i < len) {
+        /* %%d degree, %%p plus-minus, %%c diameter, %%nnn character;
+           %%o, %%u and %%k toggle over, under and strike through */
+        if((s[i] == '%') && (i + 2 < len) && (s[i + 1] == '%')) {
+            switch(tolower((unsigned char)s[i + 2])) {
+                case 'd':
+                    n += dxf_string_utf8(0xB0, &out[n]);
+                    i += 3;
+                    continue;
+                case 'p':
+                    n += dxf_string_utf8(0xB1, &out[n]);
+                    i += 3;
+                    continue;
+                case 'c':
+                    n += dxf_string_utf8(0x2300, &out[n]);
+                    i += 3;
+                    continue;
+                case '%':
+                    out[n++] = '%';
+                    i += 3;
+                    continue;
+                case 'o':
+                case 'u':
+                case 'k':
+                    i += 3;
+                    continue;
+                default:
+                    for(k = 0, c = 0; (k < 3) && (i + 2 + k < len) &&
+                        isdigit((unsigned char)s[i + 2 + k]); k++) {
+                        c = 10 * c + (s[i + 2 + k] - '0');
+                    }
+                    if(k == 3) {
+                        n += dxf_string_utf8((uint32_t)c, &out[n]);
+                        i += 5;
+                        continue;
+                    }
+                    break;
+            }
+        }
+        if((s[i] == '\\') && (i + 1 < len)) {
+            if((k = dxf_string_unicode(&s[i], len - i, &out[n], &m)) > 0) {
+                n += m;
+                i += k;
+                continue;
+            }
+            if(mtext) {
+                switch(s[i + 1]) {
+                    case 'P':
+                        out[n++] = '\n';
+                        i += 2;
+                        continue;
+                    case '~':
+                        out[n++] = ' ';
+                        i += 2;
+                        continue;
+                    case '\\':
+                    case '{':
+                    case '}':
+                        out[n++] = s[i + 1];
+                        i += 2;
+                        continue;
+                    case 'L':
+                    case 'l':
+                    case 'O':
+                    case 'o':
+                    case 'K':
+                    case 'k':
+                        i += 2;
+                        continue;
+                    case 'S':
+                        /* Stacked a^b, a/b or a#b up to ';' */
+                        for(i += 2; (i < len) && (s[i] != ';'); i++) {
+                            out[n++] = ((s[i] == '^') || (s[i] == '#')) ?
+                                '/' : s[i];
+                        }
+                        i++;
+                        continue;
+                    case 'A':
+                    case 'C':
+                    case 'c':
+                    case 'F':
+                    case 'f':
+                    case 'H':
+                    case 'p':
+                    case 'Q':
+                    case 'T':
+                    case 'W':
+                        /* Codes with an argument up to ';' */
+                        for(i += 2; (i < len) && (s[i] != ';'); i++) {
+                        }
+                        i++;
+                        continue;
+                    default:
+                        break;
+                }
+            }
+        }
+        if(mtext && ((s[i] == '{') || (s[i] == '}'))) {
+            i++;
+            continue;
+        }
+        out[n++] = s[i++];
+    }
+    return n;
+}
+
+size_t dxf_text_span_decode(const dxf_model_t *model,
+    const dxf_text_span_t *span, char *out) {
+    const char *raw;
+    size_t n;
+
+    assert(model != NULL);
+    assert(span != NULL);
+    assert(out != NULL);
+    raw = &model->text[span->first];
+    if(dxf_string_plain(raw, span->len, 0)) {
+        return dxf_text_decode(raw, span->len, span->mtext, out);
+    }
+    /* The code page may triple the length, which out is sized for;
+       formatting codes only ever shrink text, so they are decoded in
+       place */
+    n = dxf_string_decode(raw, span->len, model->codepage, 0, out);
+    return dxf_text_decode(out, n, span->mtext, out);
+}
+
+/* Orders trigram and span pairs */
+static int _dxf_text_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+/* Frees an index */
+static void _dxf_text_index_free(dxf_text_index_t *t) {
+    if(t != NULL) {
+        free(t->folded);
+        free(t->folded_first);
+        free(t->gram);
+        free(t->gram_first);
+        free(t->posting);
+        free(t);
+    }
+}
+
+/* Decodes and folds every span, then indexes the trigrams */
+static dxf_text_index_t *_dxf_text_index_build(const dxf_model_t *model) {
+    dxf_text_index_t *t;
+    uint64_t *pair;
+    size_t pair_cnt = 0, i, j, n;
+
+    if((t = (dxf_text_index_t*)calloc(1, sizeof(*t))) == NULL) {
+        return (dxf_text_index_t*)NULL;
+    }
+    /* Code pages and escapes may make the text longer */
+    t->folded = (char*)malloc((dxf_string_plain(model->text, model->text_cnt,
+        0) ? 1 : DXF_STRING_EXPANSION) * model->text_cnt + 1);
+    t->folded_first = (size_t*)malloc((model->text_span_cnt + 1) *
+        sizeof(size_t));
+    if((t->folded == NULL) || (t->folded_first == NULL)) {
+        _dxf_text_index_free(t);
+        return (dxf_text_index_t*)NULL;
+    }
+    for(i = 0, n = 0; i < model->text_span_cnt; i++) {
+        const dxf_text_span_t *s = &model->text_span[i];
+        size_t len = dxf_text_span_decode(model, s, &t->folded[n]);
+        t->folded_first[i] = n;
+        for(j = n; j < n + len; j++) {
+            t->folded[j] = (char)tolower((unsigned char)t->folded[j]);
+        }
+        n += len;
+        if(len >= 3) {
+            pair_cnt += len - 2;
+        }
+    }
+    t->folded_first[model->text_span_cnt] = n;
+
+    /* Trigram and span pairs; sorting groups them by trigram, spans in
+       order, and brings duplicates together */
+    if((pair = (uint64_t*)malloc((pair_cnt + 1) * sizeof(uint64_t))) ==
+        NULL) {
+        _dxf_text_index_free(t);
+        return (dxf_text_index_t*)NULL;
+    }
+    for(i = 0, n = 0; i < model->text_span_cnt; i++) {
+        for(j = t->folded_first[i]; j + 3 <= t->folded_first[i + 1]; j++) {
+            pair[n++] = (uint64_t)DXF_TEXT_GRAM(&t->folded[j]) << 32 | i;
+        }
+    }
+    qsort(pair, pair_cnt, sizeof(uint64_t), _dxf_text_cmp);
+
+    t->gram = (uint32_t*)malloc((pair_cnt + 1) * sizeof(uint32_t));
+    t->gram_first = (size_t*)malloc((pair_cnt + 2) * sizeof(size_t));
+    t->posting = (uint32_t*)malloc((pair_cnt + 1) * sizeof(uint32_t));
+    if((t->gram == NULL) || (t->gram_first == NULL) ||
+        (t->posting == NULL)) {
+        free(pair);
+        _dxf_text_index_free(t);
+        return (dxf_text_index_t*)NULL;
+    }
+    for(i = 0, n = 0; i < pair_cnt; i++) {
+        uint32_t g = (uint32_t)(pair[i] >> 32);
+        if((i > 0) && (pair[i] == pair[i - 1])) {
+            continue;
+        }
+        if((t->gram_cnt == 0) || (t->gram[t->gram_cnt - 1] != g)) {
+            t->gram[t->gram_cnt] = g;
+            t->gram_first[t->gram_cnt++] = n;
+        }
+        t->posting[n++] = (uint32_t)pair[i];
+    }
+    t->gram_first[t->gram_cnt] = n;
+    free(pair);
+    return t;
+}
+
+/* Postings of a trigram; sets cnt to 0 if no text holds it */
+static const uint32_t *_dxf_text_postings(const dxf_text_index_t *t,
+    uint32_t g, size_t *cnt) {
+    size_t lo = 0, hi = t->gram_cnt;
+
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(t->gram[mid] < g) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if((lo == t->gram_cnt) || (t->gram[lo] != g)) {
+        *cnt = 0;
+        return (const uint32_t*)NULL;
+    }
+    *cnt = t->gram_first[lo + 1] - t->gram_first[lo];
+    return &t->posting[t->gram_first[lo]];
+}
+
+/* Non-zero if the folded text of a span contains a folded pattern */
+static int _dxf_text_contains(const dxf_text_index_t *t, size_t span,
+    const char *pattern, size_t len) {
+    const char *s = &t->folded[t->folded_first[span]];
+    size_t n = t->folded_first[span + 1] - t->folded_first[span], i;
+
+    for(i = 0; i + len <= n; i++) {
+        if((s[i] == pattern[0]) && (memcmp(&s[i], pattern, len) == 0)) {
+            return 1;
+        }
+    }
+    return (len == 0);
+}
+
+int dxf_text_search_model(dxf_model_t *model, const char *pattern,
+    dxf_record_id_t *ids, size_t max, size_t *cnt) {
+    const dxf_text_index_t *t;
+    const uint32_t *candidate = (const uint32_t*)NULL;
+    size_t len, candidate_cnt, i;
+    char *folded;
+
+    assert(model != NULL);
+    assert(pattern != NULL);
+    assert(cnt != NULL);
+
+    (void)pthread_mutex_lock(&model->text_lock);
+    if(model->text_index == NULL) {
+        model->text_index = _dxf_text_index_build(model);
+    }
+    t = model->text_index;
+    (void)pthread_mutex_unlock(&model->text_lock);
+    len = strlen(pattern);
+    if((t == NULL) || ((folded = (char*)malloc(len + 1)) == NULL)) {
+        return 0;
+    }
+    for(i = 0; i < len; i++) {
+        folded[i] = (char)tolower((unsigned char)pattern[i]);
+    }
+
+    /* The rarest trigram of the pattern narrows the texts to check; shorter
+       patterns check every text */
+    candidate_cnt = model->text_span_cnt;
+    for(i = 0; i + 3 <= len; i++) {
+        size_t n;
+        const uint32_t *p = _dxf_text_postings(t, DXF_TEXT_GRAM(&folded[i]),
+            &n);
+        if((candidate == NULL) || (n < candidate_cnt)) {
+            candidate = p;
+            candidate_cnt = n;
+        }
+        if(n == 0) {
+            break;
+        }
+    }
+
+    *cnt = 0;
+    for(i = 0; i < candidate_cnt; i++) {
+        size_t span = (candidate != NULL) ? candidate[i] : i;
+        if(_dxf_text_contains(t, span, folded, len)) {
+            if((ids != NULL) && ((*cnt) < max)) {
+                ids[*cnt] = model->text_span[span].record;
+            }
+            (*cnt)++;
+        }
+    }
+    free(folded);
+    return 1;
+}
+
+const dxf_text_span_t *dxf_text_span(const dxf_model_t *model,
+    dxf_record_id_t record) {
+    size_t lo = 0, hi;
+
+    assert(model != NULL);
+    hi = model->text_span_cnt;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(model->text_span[mid].record < record) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if((lo == model->text_span_cnt) ||
+        (model->text_span[lo].record != record)) {
+        return (const dxf_text_span_t*)NULL;
+    }
+    return &model->text_span[lo];
+}
+
+void dxf_text_free_index(dxf_model_t *model) {
+    assert(model != NULL);
+    _dxf_text_index_free(model->text_index);
+    model->text_index = (struct _dxf_text_index_t*)NULL;
+}
@@ -0,0 +1,88 @@
+/** @file dxf_text.h
+ *  @brief Entity text search.
+ *
+ * Internal decoding of the formatting codes of TEXT, MTEXT, ATTRIB and
+ * ATTDEF strings, and a trigram index over the decoded text, built on the
+ * first search.
+ */
+#ifndef _DXF_TEXT_H_
+#define _DXF_TEXT_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* Trigram index over the text of every text entity */
+typedef struct _dxf_text_index_t {
+    char *folded; /* Decoded text of each span, ASCII letters lowered */
+    size_t *folded_first; /* Span i is folded[folded_first[i]] up to
+        folded[folded_first[i + 1]] */
+    uint32_t *gram; /* Distinct trigrams, three bytes each, increasing */
+    size_t gram_cnt;
+    size_t *gram_first; /* Spans holding gram g are posting[gram_first[g]]
+        up to posting[gram_first[g + 1]] */
+    uint32_t *posting; /* Span ids, increasing for each trigram */
+} dxf_text_index_t;
+
+/**
+Decodes the formatting codes of a string: %%d, %%p, %%c and %%nnn
+specials, \\U+XXXX escapes and, for MTEXT, the backslash codes and
+braces.  Paragraph breaks become newlines, stacked fractions a/b.
+The result is never longer than the input, and out may be s.
+
+@param  s   String, as written.
+@param  len Bytes of s.
+@param  mtext   Non-zero to decode MTEXT codes.
+@param  out Receives the UTF-8 text, at least len bytes; not
+    NULL-terminated.
+@returns The bytes written to out.
+*/
+size_t dxf_text_decode(const char *s, size_t len, int mtext, char *out);
+
+/**
+Decodes the text of an entity to UTF-8: ^ escapes and the drawing's code
+page first, then the formatting codes.  Text with neither is passed
+straight to dxf_text_decode().
+
+@param  model   Record store.
+@param  span    Text of the entity.
+@param  out Receives the text, at least DXF_STRING_EXPANSION * span->len
+    bytes; not NULL-terminated.
+@returns The bytes written to out.
+*/
+size_t dxf_text_span_decode(const dxf_model_t *model,
+    const dxf_text_span_t *span, char *out);
+
+/**
+Finds the text entities whose decoded text contains a string, ignoring
+ASCII case.  Builds the index on first use; safe to call from several
+threads.
+
+@param  model   Record store.
+@param  pattern Substring to look for, as UTF-8.
+@param  ids Array of max record ids, or NULL to only count.
+@param  max Size of ids.
+@param  cnt On success, contains the number of entities found, which may
+    exceed max.
+@returns 1 on success, 0 if allocation failed.
+*/
+int dxf_text_search_model(dxf_model_t *model, const char *pattern,
+    dxf_record_id_t *ids, size_t max, size_t *cnt);
+
+/**
+Gets the raw text of an entity.
+
+@param  model   Record store.
+@param  record  Record id.
+@returns The span, NULL if the record has no text.
+*/
+const dxf_text_span_t *dxf_text_span(const dxf_model_t *model,
+    dxf_record_id_t record);
+
+/**
+Frees the text index.
+
+@param  model   Record store.
+*/
+void dxf_text_free_index(dxf_model_t *model);
+
+#endif
@@ -0,0 +1,555 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include "dxf_topo.h"
+#include "dxf_index.h"
+#include "dxf_tess.h"
+#include "dxf_trace.h"
+
+/* Cell coordinates are clamped to this so they fit an int64_t */
+#define DXF_TOPO_CELL_LIMIT 4.0e18
+
+/* Pairs of endpoints closer than the tolerance */
+typedef struct _dxf_topo_pairs_t {
+    uint32_t *pair; /* Endpoint ids, 2 per pair */
+    size_t cnt;
+    size_t cap;
+} dxf_topo_pairs_t;
+
+/* Work shared by the workers of one build */
+typedef struct _dxf_topo_job_t {
+    const double *point; /* x, y, z of each endpoint */
+    const int64_t *cell; /* Grid cell x, y, z of each endpoint */
+    size_t point_cnt;
+    const dxf_handle_index_t *cells; /* Cell key to cell id */
+    const uint32_t *cell_first; /* Endpoints of cell c are member[
+        cell_first[c]] up to member[cell_first[c + 1]] */
+    const uint32_t *member; /* Endpoint ids, grouped by cell */
+    double tolerance2; /* Squared snap distance */
+    int dz; /* 0 if every endpoint is in one z layer of cells */
+    size_t chunk_cnt; /* Number of chunks of DXF_TOPO_CHUNK */
+    pthread_mutex_t lock; /* Guards next and failed */
+    size_t next; /* Next chunk to take */
+    int failed; /* Non-zero if an allocation failed */
+} dxf_topo_job_t;
+
+/* A worker and the pairs it found */
+typedef struct _dxf_topo_worker_t {
+    dxf_topo_job_t *job;
+    dxf_topo_pairs_t pairs;
+} dxf_topo_worker_t;
+
+/**
+Initializes an empty topology.
+
+@param  topology    Topology.
+*/
+void dxf_topology_init(dxf_topology_t *topology) {
+    assert(topology != NULL);
+    memset(topology, 0, sizeof(*topology));
+}
+
+/**
+Frees the arrays of a topology and leaves it empty.
+
+@param  topology    Topology.
+*/
+void dxf_topology_free(dxf_topology_t *topology) {
+    assert(topology != NULL);
+    free(topology->node);
+    free(topology->edge_record);
+    free(topology->edge_node);
+    free(topology->adjacency_offset);
+    free(topology->adjacency);
+    free(topology->component);
+    free(topology->chain_offset);
+    free(topology->chain_edge);
+    free(topology->chain_closed);
+    dxf_topology_init(topology);
+}
+
+/* Grid cell of a coordinate */
+static int64_t _dxf_topo_cell(double v, double inv) {
+    double c = floor(v * inv);
+
+    /* Also catches NaN */
+    if(!(c > -DXF_TOPO_CELL_LIMIT)) {
+        c = -DXF_TOPO_CELL_LIMIT;
+    } else if(c > DXF_TOPO_CELL_LIMIT) {
+        c = DXF_TOPO_CELL_LIMIT;
+    }
+    return (int64_t)c;
+}
+
+/* Hash key of a grid cell; distinct cells may collide, which only adds
+   candidates the distance test rejects */
+static uint64_t _dxf_topo_key(int64_t x, int64_t y, int64_t z) {
+    uint64_t k = ((uint64_t)x * 0x9E3779B97F4A7C15ULL) ^
+        ((uint64_t)y * 0xC2B2AE3D27D4EB4FULL) ^
+        ((uint64_t)z * 0x165667B19E3779F9ULL);
+
+    return (k != 0) ? k : 1;
+}
+
+/* Ends of an entity in world coordinates, 0 if it is not an edge, -1 with
+   err set if its vertices could not be read */
+static int _dxf_topo_ends(dxf_model_t *model, const dxf_entity_t *e,
+    double a[3], double b[3], dxf_error_t *err) {
+    double p[3], v[4];
+    dxf_mat_t m;
+
+    switch(e->kind) {
+        case dxfKindLine:
+            memcpy(a, e->wp, 3 * sizeof(double));
+            memcpy(b, e->wq, 3 * sizeof(double));
+            return 1;
+        case dxfKindArc:
+            (void)dxf_mat_ocs(e->n, m);
+            p[0] = e->p[0] + e->s[DXF_S_40] * cos(e->s[DXF_S_50] * M_PI /
+                180.0);
+            p[1] = e->p[1] + e->s[DXF_S_40] * sin(e->s[DXF_S_50] * M_PI /
+                180.0);
+            p[2] = e->p[2];
+            dxf_mat_apply(m, p, a);
+            p[0] = e->p[0] + e->s[DXF_S_40] * cos(e->s[DXF_S_51] * M_PI /
+                180.0);
+            p[1] = e->p[1] + e->s[DXF_S_40] * sin(e->s[DXF_S_51] * M_PI /
+                180.0);
+            dxf_mat_apply(m, p, b);
+            return 1;
+        case dxfKindPolyline:
+            if((e->i70 & DXF_POLYLINE_MESH) != 0) {
+                return 0;
+            }
+            /* Fall through */
+        case dxfKindLwPolyline:
+            if(e->vertex_cnt < 2) {
+                return 0;
+            }
+            /* Only the two ends, so a compact store stays compact */
+            if((*err = dxf_model_copy_vertices(model, 1, e->vertex, 1, v)) !=
+                dxfErrorOk) {
+                return -1;
+            }
+            memcpy(a, v, 3 * sizeof(double));
+            if(((e->i70 & DXF_POLYLINE_CLOSED) == 0) && ((*err =
+                dxf_model_copy_vertices(model, 1, e->vertex + e->vertex_cnt -
+                1, 1, v)) != dxfErrorOk)) {
+                return -1;
+            }
+            memcpy(b, v, 3 * sizeof(double));
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Pairs endpoint i with the later endpoints of one cell; 0 if allocation
+   failed */
+static int _dxf_topo_scan(const dxf_topo_job_t *job, dxf_topo_pairs_t *pairs,
+    size_t i, uint32_t cell) {
+    const double *p = &job->point[3 * i];
+    uint32_t m;
+
+    for(m = job->cell_first[cell]; m < job->cell_first[cell + 1]; m++) {
+        uint32_t j = job->member[m];
+        const double *q = &job->point[3 * j];
+        double d[3];
+        if(j <= i) {
+            continue;
+        }
+        d[0] = q[0] - p[0];
+        d[1] = q[1] - p[1];
+        d[2] = q[2] - p[2];
+        if(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > job->tolerance2) {
+            continue;
+        }
+        if(pairs->cnt == pairs->cap) {
+            size_t cap = (pairs->cap > 0) ? 2 * pairs->cap : 256;
+            uint32_t *pair = (uint32_t*)realloc(pairs->pair, 2 * cap *
+                sizeof(uint32_t));
+            if(pair == NULL) {
+                return 0;
+            }
+            pairs->pair = pair;
+            pairs->cap = cap;
+        }
+        pairs->pair[2 * pairs->cnt] = (uint32_t)i;
+        pairs->pair[2 * pairs->cnt + 1] = j;
+        pairs->cnt++;
+    }
+    return 1;
+}
+
+/* Worker: takes chunks of endpoints and pairs each with the later
+   endpoints of its own and the neighbouring cells */
+static void *_dxf_topo_worker(void *arg) {
+    dxf_topo_worker_t *w = (dxf_topo_worker_t*)arg;
+    dxf_topo_job_t *job = w->job;
+    size_t k, i, end;
+    int dx, dy, dz, failed = 0;
+
+    dxf_trace_begin("chunk", "topology", NULL);
+    for(;;) {
+        /* Another worker's failure is seen at the next chunk */
+        (void)pthread_mutex_lock(&job->lock);
+        k = job->next++;
+        if(failed != 0) {
+            job->failed = 1;
+        }
+        failed = job->failed;
+        (void)pthread_mutex_unlock(&job->lock);
+        if((k >= job->chunk_cnt) || (failed != 0)) {
+            break;
+        }
+        end = (k + 1) * DXF_TOPO_CHUNK;
+        if(end > job->point_cnt) {
+            end = job->point_cnt;
+        }
+        for(i = k * DXF_TOPO_CHUNK; (i < end) && (failed == 0); i++) {
+            const int64_t *c = &job->cell[3 * i];
+            for(dz = -job->dz; dz <= job->dz; dz++) {
+                for(dy = -1; dy <= 1; dy++) {
+                    for(dx = -1; dx <= 1; dx++) {
+                        uint32_t cell = dxf_handle_index_find(job->cells,
+                            _dxf_topo_key(c[0] + dx, c[1] + dy, c[2] + dz));
+                        if((cell != DXF_INDEX_NONE) &&
+                            (_dxf_topo_scan(job, &w->pairs, i, cell) == 0)) {
+                            failed = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    dxf_trace_end("chunk", "topology");
+    return NULL;
+}
+
+/* Union-find root, halving the path on the way */
+static uint32_t _dxf_topo_find(uint32_t *parent, uint32_t i) {
+    while(parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/* Joins two sets; the smaller id becomes the root, so every root is the
+   first member of its set */
+static void _dxf_topo_union(uint32_t *parent, uint32_t a, uint32_t b) {
+    a = _dxf_topo_find(parent, a);
+    b = _dxf_topo_find(parent, b);
+    if(a < b) {
+        parent[b] = a;
+    } else if(b < a) {
+        parent[a] = b;
+    }
+}
+
+/* Ids sets by their first member, in order: id[i] is the set of i */
+static size_t _dxf_topo_number(uint32_t *parent, uint32_t *id, size_t cnt) {
+    size_t i, n = 0;
+
+    for(i = 0; i < cnt; i++) {
+        uint32_t r = _dxf_topo_find(parent, (uint32_t)i);
+        id[i] = (r == i) ? (uint32_t)n++ : id[r];
+    }
+    return n;
+}
+
+/* Groups endpoints by grid cell and finds the pairs closer than the
+   tolerance with worker threads */
+static int _dxf_topo_match(const double *point, size_t point_cnt,
+    double tolerance, int threads, uint32_t *parent) {
+    dxf_topo_worker_t worker[DXF_TOPO_MAX_THREADS];
+    pthread_t tid[DXF_TOPO_MAX_THREADS];
+    dxf_handle_index_t cells;
+    dxf_topo_job_t job;
+    int64_t *cell;
+    uint32_t *cell_of, *cell_first, *member;
+    double inv = 1.0 / tolerance;
+    size_t cell_cnt = 0, i, k;
+    int t, ok;
+
+    cell = (int64_t*)malloc((point_cnt * 3 + 1) * sizeof(int64_t));
+    cell_of = (uint32_t*)malloc((point_cnt + 1) * sizeof(uint32_t));
+    cell_first = (uint32_t*)calloc(point_cnt + 2, sizeof(uint32_t));
+    member = (uint32_t*)malloc((point_cnt + 1) * sizeof(uint32_t));
+    if((cell == NULL) || (cell_of == NULL) || (cell_first == NULL) ||
+        (member == NULL) || (dxf_handle_index_init(&cells, point_cnt,
+        NULL) == 0)) {
+        free(cell);
+        free(cell_of);
+        free(cell_first);
+        free(member);
+        return 0;
+    }
+
+    /* Cell ids in order of first use, then endpoints grouped by cell */
+    memset(&job, 0, sizeof(job));
+    for(i = 0; i < point_cnt; i++) {
+        uint64_t key;
+        for(k = 0; k < 3; k++) {
+            cell[3 * i + k] = _dxf_topo_cell(point[3 * i + k], inv);
+        }
+        key = _dxf_topo_key(cell[3 * i], cell[3 * i + 1], cell[3 * i + 2]);
+        if((cell_of[i] = dxf_handle_index_find(&cells, key)) ==
+            DXF_INDEX_NONE) {
+            cell_of[i] = (uint32_t)cell_cnt++;
+            (void)dxf_handle_index_insert(&cells, key, cell_of[i]);
+        }
+        cell_first[cell_of[i] + 1]++;
+        if(cell[3 * i + 2] != cell[2]) {
+            job.dz = 1;
+        }
+    }
+    for(i = 0; i < cell_cnt; i++) {
+        cell_first[i + 1] += cell_first[i];
+    }
+    for(i = 0; i < point_cnt; i++) {
+        member[cell_first[cell_of[i]]++] = (uint32_t)i;
+    }
+    for(i = cell_cnt; i > 0; i--) {
+        cell_first[i] = cell_first[i - 1];
+    }
+    cell_first[0] = 0;
+    free(cell_of);
+
+    job.point = point;
+    job.cell = cell;
+    job.point_cnt = point_cnt;
+    job.cells = &cells;
+    job.cell_first = cell_first;
+    job.member = member;
+    job.tolerance2 = tolerance * tolerance;
+    job.chunk_cnt = (point_cnt + DXF_TOPO_CHUNK - 1) / DXF_TOPO_CHUNK;
+    (void)pthread_mutex_init(&job.lock, NULL);
+
+    /* One thread per CPU, but no more than there are chunks */
+    if(threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if((size_t)threads > job.chunk_cnt) {
+        threads = (int)job.chunk_cnt;
+    }
+    if(threads > DXF_TOPO_MAX_THREADS) {
+        threads = DXF_TOPO_MAX_THREADS;
+    }
+    if(threads < 1) {
+        threads = 1;
+    }
+    memset(worker, 0, sizeof(worker));
+    for(t = 0; t < threads; t++) {
+        worker[t].job = &job;
+    }
+
+    /* The calling thread works too */
+    for(t = 1; t < threads; t++) {
+        if(pthread_create(&tid[t], NULL, _dxf_topo_worker, &worker[t]) != 0) {
+            /* The others take its share */
+            tid[t] = pthread_self();
+        }
+    }
+    (void)_dxf_topo_worker(&worker[0]);
+    for(t = 1; t < threads; t++) {
+        if(pthread_equal(tid[t], pthread_self()) == 0) {
+            (void)pthread_join(tid[t], NULL);
+        }
+    }
+    (void)pthread_mutex_destroy(&job.lock);
+    ok = (job.failed == 0);
+
+    /* Merging is order independent: every root ends up the first member */
+    for(t = 0; t < threads; t++) {
+        const dxf_topo_pairs_t *pairs = &worker[t].pairs;
+        for(i = 0; ok && (i < pairs->cnt); i++) {
+            _dxf_topo_union(parent, pairs->pair[2 * i],
+                pairs->pair[2 * i + 1]);
+        }
+        free(pairs->pair);
+    }
+    dxf_handle_index_free(&cells);
+    free(cell);
+    free(cell_first);
+    free(member);
+    return ok;
+}
+
+/* Degree of a node; a closed edge counts twice */
+#define DXF_TOPO_DEGREE(t, v) ((t)->adjacency_offset[(v) + 1] - \
+    (t)->adjacency_offset[v])
+
+/* Walks a chain from node v along edge e, through nodes of degree 2, and
+   appends it to the topology */
+static void _dxf_topo_walk(dxf_topology_t *t, unsigned char *seen,
+    uint32_t v, uint32_t e) {
+    size_t pos = t->chain_offset[t->chain_cnt];
+    uint32_t start = v, w;
+
+    for(;;) {
+        seen[e] = 1;
+        t->chain_edge[pos++] = e;
+        w = (t->edge_node[2 * e] == v) ? t->edge_node[2 * e + 1] :
+            t->edge_node[2 * e];
+        if((w == start) || (DXF_TOPO_DEGREE(t, w) != 2)) {
+            break;
+        }
+        e = (t->adjacency[t->adjacency_offset[w]] != e) ?
+            t->adjacency[t->adjacency_offset[w]] :
+            t->adjacency[t->adjacency_offset[w] + 1];
+        if(seen[e] != 0) {
+            break;
+        }
+        v = w;
+    }
+    t->chain_closed[t->chain_cnt] = (w == start);
+    t->chain_offset[++t->chain_cnt] = pos;
+}
+
+/* Fills adjacency, components and chains from the edge nodes */
+static int _dxf_topo_graph(dxf_topology_t *t, uint32_t *parent) {
+    unsigned char *seen;
+    size_t i, a;
+    uint32_t e;
+
+    t->adjacency_offset = (size_t*)calloc(t->node_cnt + 1, sizeof(size_t));
+    t->adjacency = (uint32_t*)malloc((2 * t->edge_cnt + 1) *
+        sizeof(uint32_t));
+    t->component = (uint32_t*)malloc((t->node_cnt + 1) * sizeof(uint32_t));
+    t->chain_offset = (size_t*)calloc(t->edge_cnt + 1, sizeof(size_t));
+    t->chain_edge = (uint32_t*)malloc((t->edge_cnt + 1) * sizeof(uint32_t));
+    t->chain_closed = (int*)malloc((t->edge_cnt + 1) * sizeof(int));
+    seen = (unsigned char*)calloc(t->edge_cnt + 1, 1);
+    if((t->adjacency_offset == NULL) || (t->adjacency == NULL) ||
+        (t->component == NULL) || (t->chain_offset == NULL) ||
+        (t->chain_edge == NULL) || (t->chain_closed == NULL) ||
+        (seen == NULL)) {
+        free(seen);
+        return 0;
+    }
+
+    /* Adjacency as CSR: degrees, offsets, then edges */
+    for(i = 0; i < 2 * t->edge_cnt; i++) {
+        t->adjacency_offset[t->edge_node[i] + 1]++;
+    }
+    for(i = 0; i < t->node_cnt; i++) {
+        t->adjacency_offset[i + 1] += t->adjacency_offset[i];
+    }
+    for(i = 0; i < 2 * t->edge_cnt; i++) {
+        t->adjacency[t->adjacency_offset[t->edge_node[i]]++] =
+            (uint32_t)(i / 2);
+    }
+    for(i = t->node_cnt; i > 0; i--) {
+        t->adjacency_offset[i] = t->adjacency_offset[i - 1];
+    }
+    t->adjacency_offset[0] = 0;
+
+    /* Components */
+    for(i = 0; i < t->node_cnt; i++) {
+        parent[i] = (uint32_t)i;
+    }
+    for(i = 0; i < t->edge_cnt; i++) {
+        _dxf_topo_union(parent, t->edge_node[2 * i], t->edge_node[2 * i + 1]);
+    }
+    t->component_cnt = _dxf_topo_number(parent, t->component, t->node_cnt);
+
+    /* Chains end at nodes of degree other than 2; what is left are loops */
+    for(i = 0; i < t->node_cnt; i++) {
+        if(DXF_TOPO_DEGREE(t, i) == 2) {
+            continue;
+        }
+        for(a = t->adjacency_offset[i]; a < t->adjacency_offset[i + 1]; a++) {
+            if(seen[e = t->adjacency[a]] == 0) {
+                _dxf_topo_walk(t, seen, (uint32_t)i, e);
+            }
+        }
+    }
+    for(e = 0; e < t->edge_cnt; e++) {
+        if(seen[e] == 0) {
+            _dxf_topo_walk(t, seen, t->edge_node[2 * e], e);
+        }
+    }
+    free(seen);
+    return 1;
+}
+
+dxf_error_t dxf_topo_build(dxf_model_t *model, double tolerance, int threads,
+    dxf_topology_t *topology) {
+    double *point;
+    uint32_t *parent, *node_of;
+    size_t i, point_cnt;
+    dxf_error_t err = dxfErrorOk;
+    int ok, edge;
+
+    assert(model != NULL);
+    assert(tolerance > 0.0);
+    assert(topology != NULL);
+    dxf_topology_free(topology);
+
+    /* Edges and their ends, two endpoints per edge */
+    dxf_trace_begin("build", "topology", NULL);
+    topology->edge_record = (dxf_record_id_t*)malloc((model->entity_cnt +
+        1) * sizeof(dxf_record_id_t));
+    point = (double*)malloc((2 * model->entity_cnt + 1) * 3 *
+        sizeof(double));
+    if((topology->edge_record == NULL) || (point == NULL)) {
+        free(point);
+        dxf_topology_free(topology);
+        dxf_trace_end("build", "topology");
+        return dxfErrorNoMemory;
+    }
+    for(i = 0; i < model->entity_cnt; i++) {
+        const dxf_entity_t *e = &model->entity[i];
+        size_t n = topology->edge_cnt;
+        if(e->block != DXF_INDEX_NONE) {
+            continue;
+        }
+        if((edge = _dxf_topo_ends(model, e, &point[6 * n],
+            &point[6 * n + 3], &err)) < 0) {
+            break;
+        }
+        if(edge != 0) {
+            topology->edge_record[topology->edge_cnt++] = e->record;
+        }
+    }
+    point_cnt = 2 * topology->edge_cnt;
+
+    /* Endpoints closer than the tolerance share a node */
+    parent = (uint32_t*)malloc((point_cnt + 1) * sizeof(uint32_t));
+    node_of = (uint32_t*)malloc((point_cnt + 1) * sizeof(uint32_t));
+    ok = (err == dxfErrorOk) && (parent != NULL) && (node_of != NULL);
+    for(i = 0; ok && (i < point_cnt); i++) {
+        parent[i] = (uint32_t)i;
+    }
+    ok = ok && _dxf_topo_match(point, point_cnt, tolerance, threads, parent);
+    if(ok) {
+        topology->node_cnt = _dxf_topo_number(parent, node_of, point_cnt);
+        topology->node = (double*)malloc((topology->node_cnt + 1) * 3 *
+            sizeof(double));
+        topology->edge_node = node_of;
+        node_of = (uint32_t*)NULL;
+        ok = (topology->node != NULL);
+    }
+    if(ok) {
+        /* A node sits on the first endpoint snapped to it */
+        for(i = 0; i < point_cnt; i++) {
+            if(parent[i] == i) {
+                memcpy(&topology->node[3 * topology->edge_node[i]],
+                    &point[3 * i], 3 * sizeof(double));
+            }
+        }
+        ok = _dxf_topo_graph(topology, parent);
+    }
+    free(point);
+    free(parent);
+    free(node_of);
+    if(!ok) {
+        dxf_topology_free(topology);
+    }
+    dxf_trace_end("build", "topology");
+    return ok ? dxfErrorOk : (err != dxfErrorOk) ? err : dxfErrorNoMemory;
+}
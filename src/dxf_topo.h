@@ -0,0 +1,37 @@
+/** @file dxf_topo.h
+ *  @brief Endpoint topology.
+ *
+ * Internal builder of the connectivity graph of LINE, ARC and polyline
+ * entities: endpoints are snapped together through a uniform grid of
+ * tolerance-sized cells, and the graph is packed into CSR arrays.
+ */
+#ifndef _DXF_TOPO_H_
+#define _DXF_TOPO_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+
+/* Endpoints a worker takes at a time */
+#define DXF_TOPO_CHUNK 4096
+
+/* Upper bound on worker threads */
+#define DXF_TOPO_MAX_THREADS 64
+
+/**
+Builds the endpoint topology of the ENTITIES section.  Each LINE, ARC,
+LWPOLYLINE and 2D/3D POLYLINE is an edge between the nodes its two ends
+snap to; ends closer than the tolerance share a node.  Neighbouring grid
+cells are searched by worker threads.
+Called after dxf_ocs_to_wcs().
+
+@param  model   Record store.
+@param  tolerance   Snap distance in world coordinates, > 0.
+@param  threads Number of worker threads, 0 for one per online CPU.
+@param  topology    Initialized topology, filled on success.
+@returns dxfErrorOk on success, error code of dxf_model_copy_vertices() or
+dxfErrorNoMemory otherwise.
+*/
+dxf_error_t dxf_topo_build(dxf_model_t *model, double tolerance, int threads,
+    dxf_topology_t *topology);
+
+#endif
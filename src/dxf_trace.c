@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "dxf.h"
+#include "dxf_trace.h"
+#include "util.h"
+
+/* Trace sink, NULL when tracing is disabled */
+static FILE *g_trace_fp = (FILE*)NULL;
+/* Non-zero if the sink was opened from DXF_TRACE and must be closed */
+static int g_trace_owned = 0;
+/* Non-zero once DXF_TRACE has been looked at */
+static int g_trace_env_checked = 0;
+/* Serializes writes from worker threads */
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Small sequential thread ids, so timelines read 1, 2, 3... */
+static int g_trace_next_tid = 1;
+static __thread int t_trace_tid = 0;
+
+/* Terminates the JSON array and releases the current sink */
+static void _dxf_trace_close(void) {
+    if(g_trace_fp != NULL) {
+        fprintf(g_trace_fp, "{}]\n");
+        (void)fflush(g_trace_fp);
+        if(g_trace_owned != 0) {
+            (void)fclose(g_trace_fp);
+        }
+    }
+    g_trace_fp = (FILE*)NULL;
+    g_trace_owned = 0;
+}
+
+static void _dxf_trace_atexit(void) {
+    (void)pthread_mutex_lock(&g_trace_lock);
+    if(g_trace_owned != 0) {
+        _dxf_trace_close();
+    }
+    (void)pthread_mutex_unlock(&g_trace_lock);
+}
+
+/* Starts a JSON array on a new sink */
+static void _dxf_trace_open(FILE *fp, int owned) {
+    _dxf_trace_close();
+    g_trace_fp = fp;
+    g_trace_owned = owned;
+    if(g_trace_fp != NULL) {
+        fprintf(g_trace_fp, "[\n");
+    }
+}
+
+/**
+Set the trace sink.
+Load phases are written to fp as Chrome trace JSON events until the sink
+is replaced or cleared.  The stream remains owned by the caller; the JSON
+array is terminated when the sink is replaced or cleared.
+
+@param  fp  Open stream, or NULL to disable tracing.
+@returns dxfErrorOk.
+*/
+dxf_error_t dxf_set_trace_sink(FILE *fp) {
+    (void)pthread_mutex_lock(&g_trace_lock);
+    g_trace_env_checked = 1;
+    _dxf_trace_open(fp, 0);
+    (void)pthread_mutex_unlock(&g_trace_lock);
+    return dxfErrorOk;
+}
+
+void dxf_trace_init(void) {
+    const char *path;
+    FILE *fp;
+
+    (void)pthread_mutex_lock(&g_trace_lock);
+    if(g_trace_env_checked == 0) {
+        g_trace_env_checked = 1;
+        if(((path = getenv("DXF_TRACE")) != NULL) && (*path != '\0') &&
+            (g_trace_fp == NULL)) {
+            if((fp = fopen(path, "w")) == NULL) {
+                perror(path);
+            } else {
+                _dxf_trace_open(fp, 1);
+                (void)atexit(_dxf_trace_atexit);
+            }
+        }
+    }
+    (void)pthread_mutex_unlock(&g_trace_lock);
+}
+
+int dxf_trace_enabled(void) {
+    return g_trace_fp != NULL;
+}
+
+/* Writes a JSON string literal */
+static void _dxf_trace_string(const char *s) {
+    fputc('"', g_trace_fp);
+    for(; *s != '\0'; s++) {
+        if((*s == '"') || (*s == '\\')) {
+            fputc('\\', g_trace_fp);
+            fputc(*s, g_trace_fp);
+        } else if((unsigned char)*s < 0x20) {
+            fprintf(g_trace_fp, "\\u%04x", (unsigned int)(unsigned char)*s);
+        } else {
+            fputc(*s, g_trace_fp);
+        }
+    }
+    fputc('"', g_trace_fp);
+}
+
+static void _dxf_trace_event(char ph, const char *cat, const char *name,
+    const char *detail) {
+    double ts = util_now() * 1e6; /* Microseconds */
+
+    (void)pthread_mutex_lock(&g_trace_lock);
+    if(g_trace_fp != NULL) {
+        if(t_trace_tid == 0) {
+            t_trace_tid = g_trace_next_tid++;
+        }
+        fprintf(g_trace_fp, "{\"ph\":\"%c\",\"pid\":%ld,\"tid\":%i,"
+            "\"ts\":%.3f,\"cat\":", ph, (long)getpid(), t_trace_tid, ts);
+        _dxf_trace_string(cat);
+        fprintf(g_trace_fp, ",\"name\":");
+        _dxf_trace_string(name);
+        if(detail != NULL) {
+            fprintf(g_trace_fp, ",\"args\":{\"detail\":");
+            _dxf_trace_string(detail);
+            fputc('}', g_trace_fp);
+        }
+        fprintf(g_trace_fp, "},\n");
+    }
+    (void)pthread_mutex_unlock(&g_trace_lock);
+}
+
+void dxf_trace_begin(const char *cat, const char *name, const char *detail) {
+    if(g_trace_fp != NULL) {
+        _dxf_trace_event('B', cat, name, detail);
+    }
+}
+
+void dxf_trace_end(const char *cat, const char *name) {
+    if(g_trace_fp != NULL) {
+        _dxf_trace_event('E', cat, name, (const char*)NULL);
+    }
+}
+
+void dxf_trace_flush(void) {
+    (void)pthread_mutex_lock(&g_trace_lock);
+    if(g_trace_fp != NULL) {
+        (void)fflush(g_trace_fp);
+    }
+    (void)pthread_mutex_unlock(&g_trace_lock);
+}
@@ -0,0 +1,44 @@
+/** @file dxf_trace.h 
+ *  @brief DXF load tracing.
+ *
+ * Internal helpers that write begin/end events in Chrome trace JSON format
+ * (chrome://tracing, Perfetto) to the sink set by dxf_set_trace_sink() or
+ * named by the DXF_TRACE environment variable.
+ */
+#ifndef _DXF_TRACE_H_
+#define _DXF_TRACE_H_
+
+/**
+Opens the sink named by DXF_TRACE, if set and no sink is active.
+Only the first call has any effect.
+*/
+void dxf_trace_init(void);
+
+/**
+Checks whether tracing is enabled.
+@returns Non-zero if events are being written.
+*/
+int dxf_trace_enabled(void);
+
+/**
+Writes a begin event for the calling thread.
+@param  cat Event category, e.g. "load", "section", "chunk", "index".
+@param  name    Event name.
+@param  detail  Optional detail shown in the event arguments, or NULL.
+*/
+void dxf_trace_begin(const char *cat, const char *name, const char *detail);
+
+/**
+Writes the end event matching the last dxf_trace_begin() with the same
+category and name on the calling thread.
+@param  cat Event category.
+@param  name    Event name.
+*/
+void dxf_trace_end(const char *cat, const char *name);
+
+/**
+Flushes buffered events to the sink.
+*/
+void dxf_trace_flush(void);
+
+#endif
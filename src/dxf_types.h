@@ -1,4 +1,4 @@
-/** @file dxf_types.h 
+/** @file dxf_types.h
  *  @brief DXF (AutoCAD Drawing Interchange Format) types
  *
  * Types
@@ -6,11 +6,36 @@
 #ifndef _DXF_TYPES_H_
 #define _DXF_TYPES_H_
 
+#include <stdint.h>
+
 /*
-If you modify this, you MUST update dxf_type_name_to_enum to match.
+If you modify this, you MUST update TYPE_S in mktypes.c to match.
 */
 typedef enum { dxfString2049, dxfDouble3d, dxfDouble, dxfInt16, dxfInt32,
         dxfString255, dxfInt64, dxfBoolean, dxfLong } dxf_type_t;
 
-#endif
+/* Number of dxf_type_t values */
+#define DXF_TYPE_CNT 9
+
+/* Type of group codes that have no assigned value type */
+#define DXF_TYPE_NONE 0xFF
+
+/* Range of valid group codes */
+#define DXF_GROUP_CODE_MIN (-5)
+#define DXF_GROUP_CODE_MAX 1071
+
+/* Generated by mktypes into dxf_types.c */
+extern const uint8_t dxf_group_type_table[];
+extern const char *dxf_type_names[];
 
+/*
+Looks up the dxf_type_t of a group code, DXF_TYPE_NONE if the code is out
+of range or unassigned.  One unsigned compare and one byte load; code is
+evaluated twice.
+*/
+#define DXF_GROUP_TYPE(code) \
+    (((unsigned int)((code) - DXF_GROUP_CODE_MIN) <= \
+    (unsigned int)(DXF_GROUP_CODE_MAX - DXF_GROUP_CODE_MIN)) ? \
+    dxf_group_type_table[(code) - DXF_GROUP_CODE_MIN] : DXF_TYPE_NONE)
+
+#endif
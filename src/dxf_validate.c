@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "dxf.h"
+#include "dxf_trace.h"
+#include "dxf_validate.h"
+
+/* Size of the block each worker reads at a time */
+#define DXF_VALIDATE_BLOCK_SIZE 65536
+
+/* Ranges smaller than this per thread are not worth splitting */
+#define DXF_VALIDATE_MIN_CHUNK (1 << 20)
+
+/* Upper bound on worker threads */
+#define DXF_VALIDATE_MAX_THREADS 64
+
+/* One worker's share of the range */
+typedef struct _dxf_validate_chunk_t {
+    int fd; /* File descriptor */
+    off_t start; /* Lines starting at or after start... */
+    off_t end; /* ...and before end belong to this chunk */
+    off_t length; /* End of the validated range */
+    int max_line_length; /* Max trimmed line length */
+    dxf_error_t io_error; /* dxfErrorOk unless the chunk could not be read */
+    dxf_off_t lines; /* Lines started, including an error line */
+    dxf_error_t code; /* First error in this chunk */
+    int column; /* Column of the first error */
+} dxf_validate_chunk_t;
+
+/* Non-zero if any byte in [p, p + len) has the high bit set */
+static int _dxf_validate_high(const unsigned char *p, size_t len) {
+    uint64_t acc = 0; /* OR of all words */
+    uint64_t w;
+    size_t i = 0;
+
+    for(; i + sizeof(w) <= len; i += sizeof(w)) {
+        memcpy(&w, p + i, sizeof(w));
+        acc |= w;
+    }
+    for(; i < len; i++) {
+        acc |= p[i];
+    }
+    return (acc & 0x8080808080808080ULL) != 0;
+}
+
+/*
+Checks one suspicious line exactly the way strict loading does: trimmed, a
+non-ASCII character before max_line_length wins, otherwise the trimmed
+length is checked.  Only lines that failed the quick checks get here.
+*/
+static int _dxf_validate_line(dxf_validate_chunk_t *c, off_t start,
+    off_t end) {
+    unsigned char buf[4096];
+    off_t first_ns = -1; /* First non-blank */
+    off_t last_ns = -1; /* Last non-blank */
+    off_t first_bad = -1; /* First non-ASCII */
+    off_t pos = start;
+    ssize_t n, i;
+
+    while(pos < end) {
+        size_t want = sizeof(buf);
+
+        if((off_t)want > end - pos) {
+            want = (size_t)(end - pos);
+        }
+        if((n = pread(c->fd, buf, want, pos)) <= 0) {
+            if((n == -1) && (errno == EINTR)) {
+                continue;
+            }
+            c->io_error = dxfErrorFgets;
+            return 0;
+        }
+        for(i = 0; i < n; i++) {
+            if((buf[i] & 0x80) != 0) {
+                if(first_bad < 0) {
+                    first_bad = pos + i;
+                }
+            } else if(isspace((int)buf[i]) != 0) {
+                continue;
+            }
+            if(first_ns < 0) {
+                first_ns = pos + i;
+            }
+            last_ns = pos + i;
+        }
+        pos += n;
+    }
+
+    if(first_ns < 0) {
+        return 1;
+    }
+    if((first_bad >= 0) && (first_bad - first_ns < c->max_line_length)) {
+        c->code = dxfErrorNonASCII;
+        c->column = (int)(first_bad - first_ns);
+        return 0;
+    }
+    if(last_ns - first_ns + 1 > c->max_line_length) {
+        c->code = dxfErrorLineTooLong;
+        c->column = c->max_line_length;
+        return 0;
+    }
+    return 1;
+}
+
+/* Ends a line: quick checks, then the exact check if needed */
+static int _dxf_validate_end_line(dxf_validate_chunk_t *c, off_t start,
+    off_t end, int high) {
+    c->lines++;
+    if((high == 0) && (end - start <= c->max_line_length)) {
+        return 1;
+    }
+    return _dxf_validate_line(c, start, end);
+}
+
+static void *_dxf_validate_chunk(void *arg) {
+    dxf_validate_chunk_t *c = (dxf_validate_chunk_t*)arg;
+    unsigned char *buf; /* Read block */
+    off_t pos; /* File offset of buf[0] */
+    off_t line_start = -1; /* Start of the current line, -1 if skipping */
+    int high = 0; /* Current line has a high bit set so far */
+    char detail[64];
+    ssize_t n;
+
+    (void)snprintf(detail, sizeof(detail), "%lld-%lld",
+        (long long)c->start, (long long)c->end);
+    dxf_trace_begin("chunk", "validate", detail);
+    if((buf = (unsigned char*)malloc(DXF_VALIDATE_BLOCK_SIZE)) == NULL) {
+        c->io_error = dxfErrorNoMemory;
+        goto done;
+    }
+
+    /* A line starts at 0 or right after a NL */
+    if(c->start == 0) {
+        line_start = 0;
+    }
+    pos = (c->start > 0) ? c->start - 1 : 0;
+    while(pos < c->length) {
+        const unsigned char *p, *e, *nl;
+        size_t want = DXF_VALIDATE_BLOCK_SIZE;
+
+        if((off_t)want > c->length - pos) {
+            want = (size_t)(c->length - pos);
+        }
+        if((n = pread(c->fd, buf, want, pos)) <= 0) {
+            if((n == -1) && (errno == EINTR)) {
+                continue;
+            }
+            c->io_error = dxfErrorFgets;
+            goto done;
+        }
+        for(p = buf, e = buf + n; p < e; p = nl + 1) {
+            if((nl = (const unsigned char*)memchr(p, '\n',
+                (size_t)(e - p))) == NULL) {
+                high |= (line_start >= 0) &&
+                    _dxf_validate_high(p, (size_t)(e - p));
+                break;
+            }
+            if(line_start >= 0) {
+                high |= _dxf_validate_high(p, (size_t)(nl - p));
+                if(_dxf_validate_end_line(c, line_start, pos + (nl - buf),
+                    high) == 0) {
+                    goto done;
+                }
+            }
+            high = 0;
+            line_start = pos + (nl - buf) + 1;
+            if(line_start >= c->end) {
+                goto done;
+            }
+        }
+        pos += n;
+    }
+
+    /* Last line without NL */
+    if((line_start >= 0) && (line_start < c->length)) {
+        (void)_dxf_validate_end_line(c, line_start, c->length, high);
+    }
+
+done:
+    free(buf);
+    dxf_trace_end("chunk", "validate");
+    return NULL;
+}
+
+dxf_error_t dxf_validate_fd(int fd, off_t length, int max_line_length,
+    int threads, dxf_validate_result_t *result) {
+    dxf_validate_chunk_t chunk[DXF_VALIDATE_MAX_THREADS];
+    pthread_t tid[DXF_VALIDATE_MAX_THREADS];
+    dxf_off_t lines = 0; /* Lines in earlier chunks */
+    off_t size; /* Bytes per chunk */
+    int i;
+
+    assert(result != NULL);
+    memset(result, 0, sizeof(*result));
+    result->code = dxfErrorOk;
+
+    /* One thread per CPU, but no chunk smaller than the minimum */
+    if(threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(threads > length / DXF_VALIDATE_MIN_CHUNK) {
+        threads = (int)(length / DXF_VALIDATE_MIN_CHUNK);
+    }
+    if(threads > DXF_VALIDATE_MAX_THREADS) {
+        threads = DXF_VALIDATE_MAX_THREADS;
+    }
+    if(threads < 1) {
+        threads = 1;
+    }
+
+    size = length / threads;
+    memset(chunk, 0, sizeof(chunk));
+    for(i = 0; i < threads; i++) {
+        chunk[i].fd = fd;
+        chunk[i].start = size * i;
+        chunk[i].end = (i + 1 == threads) ? length : size * (i + 1);
+        chunk[i].length = length;
+        chunk[i].max_line_length = max_line_length;
+        chunk[i].io_error = dxfErrorOk;
+        chunk[i].code = dxfErrorOk;
+    }
+
+    /* The calling thread takes the first chunk */
+    for(i = 1; i < threads; i++) {
+        if(pthread_create(&tid[i], NULL, _dxf_validate_chunk,
+            &chunk[i]) != 0) {
+            /* Could not start a worker, run it here instead */
+            (void)_dxf_validate_chunk(&chunk[i]);
+            tid[i] = pthread_self();
+        }
+    }
+    (void)_dxf_validate_chunk(&chunk[0]);
+    for(i = 1; i < threads; i++) {
+        if(pthread_equal(tid[i], pthread_self()) == 0) {
+            (void)pthread_join(tid[i], NULL);
+        }
+    }
+
+    /* The earliest chunk with an error holds the first error */
+    for(i = 0; i < threads; i++) {
+        if(chunk[i].code != dxfErrorOk) {
+            result->code = chunk[i].code;
+            result->line = lines + chunk[i].lines;
+            result->column = chunk[i].column;
+            return dxfErrorOk;
+        }
+        if(chunk[i].io_error != dxfErrorOk) {
+            return chunk[i].io_error;
+        }
+        lines += chunk[i].lines;
+    }
+    return dxfErrorOk;
+}
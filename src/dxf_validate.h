@@ -0,0 +1,40 @@
+/** @file dxf_validate.h
+ *  @brief Deferred DXF validation.
+ *
+ * Internal parallel pass that applies the per-character checks skipped by
+ * fast loads (ASCII only, max line length) to a byte range of a file.
+ */
+#ifndef _DXF_VALIDATE_H_
+#define _DXF_VALIDATE_H_
+
+#include <sys/types.h>
+#include "dxf.h"
+
+/**
+ * Validation result.
+ * Position of the first invalid line, as strict loading would report it.
+ */
+typedef struct _dxf_validate_result_t {
+    dxf_error_t code; /**< dxfErrorOk, dxfErrorNonASCII or
+        dxfErrorLineTooLong */
+    dxf_off_t line; /**< 1-based line number of the error */
+    int column; /**< Column within the trimmed line */
+} dxf_validate_result_t;
+
+/**
+Validates every line that starts before length in a file.
+The range is split into chunks checked by worker threads; the earliest
+error wins.
+
+@param  fd  File descriptor, read with pread() only.
+@param  length  Number of bytes to validate.
+@param  max_line_length Max trimmed line length.
+@param  threads Number of worker threads, 0 for one per online CPU.
+@param  result  On success, contains the first error, if any.
+@returns dxfErrorOk if the range could be read, dxfErrorNoMemory or
+dxfErrorFgets otherwise.
+*/
+dxf_error_t dxf_validate_fd(int fd, off_t length, int max_line_length,
+    int threads, dxf_validate_result_t *result);
+
+#endif
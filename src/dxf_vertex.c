@@ -0,0 +1,156 @@
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "dxf.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+Kernels over runs of x, y, z, w vertices, as stored in the vertex buffer.
+With SSE2 each vertex is two registers, x y and z w, so the x and y rows
+of a transform are computed together.
+*/
+
+/**
+Builds a transform that scales, then rotates about the Z axis, then
+translates: three rows of x, y, z and translation.
+
+@param  transform   On return, the transform.
+@param  translate   Translation, NULL for none.
+@param  scale   Scale per axis, NULL for none.
+@param  rotation    Counterclockwise rotation about Z, in degrees.
+*/
+void dxf_transform_init(double transform[12], const double translate[3],
+    const double scale[3], double rotation) {
+    double a = rotation * M_PI / 180.0;
+    double c = cos(a), s = sin(a);
+    double sx = 1.0, sy = 1.0, sz = 1.0;
+
+    assert(transform != NULL);
+    if(scale != NULL) {
+        sx = scale[0];
+        sy = scale[1];
+        sz = scale[2];
+    }
+    memset(transform, 0, 12 * sizeof(double));
+    transform[0] = c * sx;
+    transform[1] = -s * sy;
+    transform[4] = s * sx;
+    transform[5] = c * sy;
+    transform[10] = sz;
+    if(translate != NULL) {
+        transform[3] = translate[0];
+        transform[7] = translate[1];
+        transform[11] = translate[2];
+    }
+}
+
+/**
+Applies a transform to a run of vertices.  x, y and z are transformed,
+w is copied.  The vertices need not be aligned.
+
+@param  vertex  cnt vertices of four doubles: x, y, z, w.
+@param  cnt Number of vertices.
+@param  transform   Three rows of x, y, z and translation.
+@param  out cnt vertices receiving the result, may be vertex.
+*/
+void dxf_transform_vertices(const double *vertex, size_t cnt,
+    const double transform[12], double *out) {
+    const double *m = transform;
+    size_t i = 0;
+
+    assert((vertex != NULL) || (cnt == 0));
+    assert(transform != NULL);
+    assert((out != NULL) || (cnt == 0));
+#ifdef __SSE2__
+    {
+        /* Columns of the x and y rows, and the z row */
+        __m128d cx = _mm_set_pd(m[4], m[0]), cy = _mm_set_pd(m[5], m[1]);
+        __m128d cz = _mm_set_pd(m[6], m[2]), ct = _mm_set_pd(m[7], m[3]);
+        __m128d zx = _mm_set_pd(0.0, m[8]), zy = _mm_set_pd(0.0, m[9]);
+        __m128d zz = _mm_set_pd(0.0, m[10]), zt = _mm_set_pd(0.0, m[11]);
+
+        for(; i < cnt; i++) {
+            const double *v = &vertex[4 * i];
+            __m128d xy = _mm_loadu_pd(v), zw = _mm_loadu_pd(v + 2);
+            __m128d x = _mm_unpacklo_pd(xy, xy), y = _mm_unpackhi_pd(xy, xy);
+            __m128d z = _mm_unpacklo_pd(zw, zw);
+            __m128d rxy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(cx, x),
+                _mm_mul_pd(cy, y)), _mm_add_pd(_mm_mul_pd(cz, z), ct));
+            __m128d rz = _mm_add_pd(_mm_add_pd(_mm_mul_pd(zx, x),
+                _mm_mul_pd(zy, y)), _mm_add_pd(_mm_mul_pd(zz, z), zt));
+            _mm_storeu_pd(&out[4 * i], rxy);
+            _mm_storeu_pd(&out[4 * i + 2], _mm_move_sd(zw, rz));
+        }
+    }
+#endif
+    for(; i < cnt; i++) {
+        const double *v = &vertex[4 * i];
+        double x = v[0], y = v[1], z = v[2];
+        out[4 * i] = m[0] * x + m[1] * y + m[2] * z + m[3];
+        out[4 * i + 1] = m[4] * x + m[5] * y + m[6] * z + m[7];
+        out[4 * i + 2] = m[8] * x + m[9] * y + m[10] * z + m[11];
+        out[4 * i + 3] = v[3];
+    }
+}
+
+/**
+Computes the bounding box of a run of vertices.  NaN coordinates are
+ignored.
+
+@param  vertex  cnt vertices of four doubles: x, y, z, w.
+@param  cnt Number of vertices.
+@param  min On return, the smallest x, y and z; +HUGE_VAL if cnt is 0 or
+    every value of the axis is NaN.
+@param  max On return, the largest x, y and z; -HUGE_VAL if cnt is 0 or
+    every value of the axis is NaN.
+*/
+void dxf_bbox_vertices(const double *vertex, size_t cnt, double min[3],
+    double max[3]) {
+    size_t i = 0;
+    int c;
+
+    assert((vertex != NULL) || (cnt == 0));
+    assert((min != NULL) && (max != NULL));
+    for(c = 0; c < 3; c++) {
+        min[c] = HUGE_VAL;
+        max[c] = -HUGE_VAL;
+    }
+#ifdef __SSE2__
+    {
+        /* The w lane is computed along and dropped.  minpd and maxpd
+           return their second operand if either is NaN, so the vertex
+           goes first and a NaN keeps the running value */
+        __m128d lo_xy = _mm_set1_pd(HUGE_VAL), hi_xy = _mm_set1_pd(-HUGE_VAL);
+        __m128d lo_zw = lo_xy, hi_zw = hi_xy;
+        double t[2];
+
+        for(; i < cnt; i++) {
+            __m128d xy = _mm_loadu_pd(&vertex[4 * i]);
+            __m128d zw = _mm_loadu_pd(&vertex[4 * i + 2]);
+            lo_xy = _mm_min_pd(xy, lo_xy);
+            hi_xy = _mm_max_pd(xy, hi_xy);
+            lo_zw = _mm_min_pd(zw, lo_zw);
+            hi_zw = _mm_max_pd(zw, hi_zw);
+        }
+        _mm_storeu_pd(min, lo_xy);
+        _mm_storeu_pd(max, hi_xy);
+        _mm_storeu_pd(t, lo_zw);
+        min[2] = t[0];
+        _mm_storeu_pd(t, hi_zw);
+        max[2] = t[0];
+    }
+#endif
+    for(; i < cnt; i++) {
+        const double *v = &vertex[4 * i];
+        for(c = 0; c < 3; c++) {
+            if(v[c] < min[c]) {
+                min[c] = v[c];
+            }
+            if(v[c] > max[c]) {
+                max[c] = v[c];
+            }
+        }
+    }
+}
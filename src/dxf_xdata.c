@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include "dxf_xdata.h"
+
+const dxf_xdata_span_t *dxf_xdata_span(const dxf_model_t *model,
+    dxf_record_id_t record) {
+    size_t lo = 0, hi;
+
+    assert(model != NULL);
+    hi = model->xdata_span_cnt;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(model->xdata_span[mid].record < record) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if((lo == model->xdata_span_cnt) ||
+        (model->xdata_span[lo].record != record)) {
+        return (const dxf_xdata_span_t*)NULL;
+    }
+    return &model->xdata_span[lo];
+}
+
+/* Reads len bytes at offset, retrying short reads */
+static dxf_error_t _dxf_xdata_read(int fd, char *buf, size_t len,
+    dxf_off_t offset) {
+    ssize_t n;
+
+    while(len > 0) {
+        n = pread(fd, buf, len, (off_t)offset);
+        if((n == -1) && (errno == EINTR)) {
+            continue;
+        }
+        if(n == -1) {
+            return dxfErrorFgets;
+        }
+        if(n == 0) {
+            return dxfErrorEOF;
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += (dxf_off_t)n;
+    }
+    return dxfErrorOk;
+}
+
+dxf_error_t dxf_xdata_open(const dxf_model_t *model, const char *filename,
+    dxf_record_id_t record, dxf_xdata_t **xdata) {
+    const dxf_xdata_span_t *span;
+    dxf_xdata_t *x;
+    dxf_error_t err = dxfErrorOk;
+    int fd;
+
+    assert(model != NULL);
+    assert(filename != NULL);
+    assert(xdata != NULL);
+
+    span = dxf_xdata_span(model, record);
+    if((x = (dxf_xdata_t*)calloc(1, sizeof(*x))) == NULL) {
+        return dxfErrorNoMemory;
+    }
+    x->len = (span != NULL) ? (size_t)span->length : 0;
+    x->raw = (char*)malloc(x->len + 1);
+    x->value = (char*)malloc(x->len + 1);
+    if((x->raw == NULL) || (x->value == NULL)) {
+        dxf_xdata_end(x);
+        return dxfErrorNoMemory;
+    }
+    x->value[0] = '\0';
+    if(span != NULL) {
+        if((fd = open(filename, O_RDONLY)) == -1) {
+            dxf_xdata_end(x);
+            return dxfErrorOpenFailed;
+        }
+        err = _dxf_xdata_read(fd, x->raw, x->len, span->offset);
+        (void)close(fd);
+        if(err != dxfErrorOk) {
+            dxf_xdata_end(x);
+            return err;
+        }
+    }
+    x->raw[x->len] = '\0';
+    dxf_group_reader_init(&x->rd, x->raw, x->len);
+    *xdata = x;
+    return dxfErrorOk;
+}
+
+/**
+Gets the next extended data group of a record.
+
+@param  xdata   Iterator, see dxf_xdata_begin().
+@param  group_code  On success, contains the group code, 1000 to 1071.
+@param  value   On success, points to the value, trimmed; valid until the
+    next call.
+@returns dxfErrorOk on success, dxfErrorEOF after the last group,
+dxfErrorDigitExpected if the file changed since it was loaded.
+*/
+dxf_error_t dxf_xdata_next(dxf_xdata_t *xdata, int *group_code,
+    const char **value) {
+    const char *line;
+    size_t len;
+    int code;
+    dxf_error_t err;
+
+    assert(xdata != NULL);
+    assert(group_code != NULL);
+    assert(value != NULL);
+    if((err = dxf_group_read(&xdata->rd, &code, &line, &len)) ==
+        dxfErrorEOF) {
+        return dxfErrorEOF;
+    }
+    if((err != dxfErrorOk) || !DXF_MODEL_IS_XDATA(code)) {
+        return dxfErrorDigitExpected;
+    }
+    memcpy(xdata->value, line, len);
+    xdata->value[len] = '\0';
+    *group_code = code;
+    *value = xdata->value;
+    return dxfErrorOk;
+}
+
+/**
+Gets the extended data of a record exactly as written, group code and
+value lines alike, for writing it back out unchanged.
+
+@param  xdata   Iterator, see dxf_xdata_begin().
+@param  bytes   On success, points to the data; valid until
+    dxf_xdata_end().
+@param  len On success, contains the number of bytes, 0 if the record has
+    no extended data.
+@returns dxfErrorOk.
+*/
+dxf_error_t dxf_xdata_raw(const dxf_xdata_t *xdata, const char **bytes,
+    size_t *len) {
+    assert(xdata != NULL);
+    assert(bytes != NULL);
+    assert(len != NULL);
+    *bytes = xdata->raw;
+    *len = xdata->len;
+    return dxfErrorOk;
+}
+
+/**
+Frees an extended data iterator.
+
+@param  xdata   Iterator, see dxf_xdata_begin(); may be NULL.
+*/
+void dxf_xdata_end(dxf_xdata_t *xdata) {
+    if(xdata != NULL) {
+        free(xdata->raw);
+        free(xdata->value);
+        free(xdata);
+    }
+}
@@ -0,0 +1,46 @@
+/** @file dxf_xdata.h
+ *  @brief Extended data.
+ *
+ * Internal reading of the extended data groups (1000 to 1071) of a
+ * record.  Loading only records where they are in the file; the bytes are
+ * read back and the groups decoded when an iterator asks for them.
+ */
+#ifndef _DXF_XDATA_H_
+#define _DXF_XDATA_H_
+
+#include "dxf.h"
+#include "dxf_model.h"
+#include "dxf_group.h"
+
+/* Groups of one record, read back from the file */
+struct _dxf_xdata_t {
+    char *raw; /* The record's extended data, as written */
+    size_t len; /* Bytes of raw */
+    dxf_group_reader_t rd; /* Lines of raw */
+    char *value; /* Value of the last group, NULL-terminated */
+};
+
+/**
+Finds the extended data of a record.
+
+@param  model   Record store.
+@param  record  Record id.
+@returns The span, NULL if the record has none.
+*/
+const dxf_xdata_span_t *dxf_xdata_span(const dxf_model_t *model,
+    dxf_record_id_t record);
+
+/**
+Reads the extended data of a record back from the drawing's file.
+
+@param  model   Record store.
+@param  filename    File the drawing was loaded from.
+@param  record  Record id.
+@param  xdata   On success, an iterator over the groups; empty if the
+    record has none.
+@returns dxfErrorOk on success, error code otherwise.
+*/
+dxf_error_t dxf_xdata_open(const dxf_model_t *model, const char *filename,
+    dxf_record_id_t record, dxf_xdata_t **xdata);
+
+#endif
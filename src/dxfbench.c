@@ -0,0 +1,754 @@
+/** @file dxfbench.c
+ *  @brief DXF parse throughput benchmark.
+ *
+ * Loads each file given on the command line with every registered parse
+ * mode and reports MB/s, records/s, peak RSS and allocation counts.  Every
+ * (file, mode) pair runs in its own child process so that peak RSS and
+ * allocation counts are not polluted by earlier runs.
+ *
+ * With -p, hardware performance counters (cycles, instructions, branch
+ * misses, cache misses) are read through perf_event_open() around the parse
+ * and reported per MB parsed.  Counters that the kernel or hardware does not
+ * provide are reported as unavailable.  With -b, the counters are compared
+ * against a stored baseline and regressions make the exit status non-zero.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "dxf.h"
+
+/* Chordal tolerance of the tess mode */
+#define BENCH_TOLERANCE (1.0 / 128.0)
+
+/* Snap distance of the topo mode */
+#define BENCH_SNAP (1.0 / 1024.0)
+
+/* Vertex budget of the spill mode */
+#define BENCH_RESIDENT (1024 * 1024)
+
+/* Allocation counters, maintained by the malloc wrappers when the benchmark
+is linked with -Wl,--wrap=malloc,... (see Makefile). */
+static unsigned long g_alloc_cnt = 0;
+static unsigned long long g_alloc_bytes = 0;
+
+#ifdef BENCH_WRAP_MALLOC
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    (void)__sync_fetch_and_add(&g_alloc_cnt, 1UL);
+    (void)__sync_fetch_and_add(&g_alloc_bytes, (unsigned long long)size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    (void)__sync_fetch_and_add(&g_alloc_cnt, 1UL);
+    (void)__sync_fetch_and_add(&g_alloc_bytes,
+        (unsigned long long)(nmemb * size));
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    (void)__sync_fetch_and_add(&g_alloc_cnt, 1UL);
+    (void)__sync_fetch_and_add(&g_alloc_bytes, (unsigned long long)size);
+    return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t alignment, size_t size) {
+    (void)__sync_fetch_and_add(&g_alloc_cnt, 1UL);
+    (void)__sync_fetch_and_add(&g_alloc_bytes, (unsigned long long)size);
+    return __real_posix_memalign(ptr, alignment, size);
+}
+#endif
+
+/* A parse mode under test.  Returns 0 on success. */
+typedef struct _bench_mode_t {
+    const char *name; /* Mode name, as reported */
+    int (*run)(const char *filename); /* Loads and unloads one file */
+} bench_mode_t;
+
+static int bench_load(const char *filename) {
+    dxf_handle_t dxf;
+    dxf_error_t err;
+
+    if((err = dxf_load(&dxf, filename)) != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    (void)dxf_unload(dxf);
+    return 0;
+}
+
+static int bench_load_ex(const char *filename, dxf_validate_t validate,
+    dxf_io_t io) {
+    dxf_load_options_t options;
+    dxf_handle_t dxf;
+    dxf_error_t err;
+
+    dxf_load_options_init(&options);
+    options.validate = validate;
+    options.io = io;
+    if((err = dxf_load_ex(&dxf, filename, &options)) != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    (void)dxf_unload(dxf);
+    return 0;
+}
+
+static int bench_read(const char *filename) {
+    return bench_load_ex(filename, dxfValidateStrict, dxfIoRead);
+}
+
+static int bench_mmap(const char *filename) {
+    return bench_load_ex(filename, dxfValidateStrict, dxfIoMmap);
+}
+
+static int bench_fast(const char *filename) {
+    return bench_load_ex(filename, dxfValidateFast, dxfIoAuto);
+}
+
+static int bench_validate_after(const char *filename) {
+    return bench_load_ex(filename, dxfValidateAfter, dxfIoAuto);
+}
+
+/* Loads, then flattens every entity */
+static int bench_tess(const char *filename) {
+    const dxf_geometry_t *geometry;
+    dxf_handle_t dxf;
+    dxf_error_t err;
+
+    if((err = dxf_load(&dxf, filename)) == dxfErrorOk) {
+        err = dxf_tessellate(dxf, BENCH_TOLERANCE, &geometry);
+        (void)dxf_unload(dxf);
+    }
+    if(err != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+/* Loads, then builds the endpoint topology */
+static int bench_topo(const char *filename) {
+    dxf_topology_t topology;
+    dxf_handle_t dxf;
+    dxf_error_t err;
+
+    dxf_topology_init(&topology);
+    if((err = dxf_load(&dxf, filename)) == dxfErrorOk) {
+        err = dxf_build_topology(dxf, BENCH_SNAP, &topology);
+        dxf_topology_free(&topology);
+        (void)dxf_unload(dxf);
+    }
+    if(err != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+/* Loads, then builds the text index through one search */
+static int bench_text(const char *filename) {
+    dxf_handle_t dxf;
+    dxf_error_t err;
+    size_t cnt;
+
+    if((err = dxf_load(&dxf, filename)) == dxfErrorOk) {
+        err = dxf_text_search(dxf, "tag", NULL, 0, &cnt);
+        (void)dxf_unload(dxf);
+    }
+    if(err != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+/* Loads with the vertex buffers quantized to the flattening tolerance */
+static int bench_compact(const char *filename) {
+    dxf_load_options_t options;
+    dxf_handle_t dxf;
+    dxf_error_t err;
+
+    dxf_load_options_init(&options);
+    options.compact_step = BENCH_TOLERANCE;
+    if((err = dxf_load_ex(&dxf, filename, &options)) != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    (void)dxf_unload(dxf);
+    return 0;
+}
+
+/* Loads within a vertex budget, then reads every entity's vertices back */
+static int bench_spill(const char *filename) {
+    double vertex[4 * 1024];
+    dxf_load_options_t options;
+    dxf_handle_t dxf;
+    dxf_error_t err;
+    size_t records, id, first, cnt, i, n;
+
+    dxf_load_options_init(&options);
+    options.max_resident_bytes = BENCH_RESIDENT;
+    if((err = dxf_load_ex(&dxf, filename, &options)) == dxfErrorOk) {
+        err = dxf_get_record_cnt(dxf, &records);
+        for(id = 0; (err == dxfErrorOk) && (id < records); id++) {
+            if(dxf_get_entity_vertices(dxf, (dxf_record_id_t)id, &first,
+                &cnt) != dxfErrorOk) {
+                continue;
+            }
+            for(i = 0; (err == dxfErrorOk) && (i < cnt); i += n) {
+                n = (cnt - i < 1024) ? cnt - i : 1024;
+                err = dxf_copy_vertices(dxf, 1, first + i, n, vertex);
+            }
+        }
+        (void)dxf_unload(dxf);
+    }
+    if(err != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+/* Loads, then shares the drawing and attaches it again as a worker would */
+static int bench_share(const char *filename) {
+    dxf_handle_t dxf, worker;
+    dxf_error_t err;
+    int fd;
+
+    if((err = dxf_load(&dxf, filename)) == dxfErrorOk) {
+        if((err = dxf_share(dxf, &fd)) == dxfErrorOk) {
+            if((err = dxf_attach(&worker, fd)) == dxfErrorOk) {
+                (void)dxf_unload(worker);
+            }
+            (void)close(fd);
+        }
+        (void)dxf_unload(dxf);
+    }
+    if(err != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+/* Reads the HEADER metadata only */
+static int bench_probe(const char *filename) {
+    dxf_info_t info;
+    dxf_error_t err;
+
+    if((err = dxf_probe(filename, &info)) != dxfErrorOk) {
+        (void)dxf_print_error(err, stderr);
+        fprintf(stderr, " (%s)\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+/* Register new parse modes here */
+static const bench_mode_t g_modes[] = {
+    { "load", bench_load },
+    { "read", bench_read },
+    { "mmap", bench_mmap },
+    { "fast", bench_fast },
+    { "valafter", bench_validate_after },
+    { "tess", bench_tess },
+    { "topo", bench_topo },
+    { "text", bench_text },
+    { "probe", bench_probe },
+    { "compact", bench_compact },
+    { "spill", bench_spill },
+    { "share", bench_share }
+};
+
+/* Hardware counters */
+typedef enum { ctrCycles, ctrInstructions, ctrBranchMisses, ctrCacheMisses,
+    ctrCnt } bench_counter_t;
+
+static const char *CTR_S[] = {
+    "cycles", "instructions", "branch_misses", "cache_misses"
+};
+
+/* Measurements for one (file, mode) pair, sent back from the child */
+typedef struct _bench_result_t {
+    int ok; /* 1 if every iteration succeeded */
+    double best; /* Fastest iteration, seconds */
+    double mean; /* Mean iteration, seconds */
+    long peak_rss_kb; /* Peak resident set size, KB */
+    unsigned long allocs; /* Allocations per iteration */
+    unsigned long long alloc_bytes; /* Bytes allocated per iteration */
+    /* Counter value per iteration, negative if unavailable */
+    double counter[ctrCnt];
+} bench_result_t;
+
+/* Non-zero if hardware counters were requested (-p) */
+static int g_perf = 0;
+
+#ifdef __linux__
+/* Opens one disabled counter for this process and its threads */
+static int bench_counter_open(bench_counter_t ctr) {
+    static const unsigned long long CONFIG[] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+    };
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = CONFIG[ctr];
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0UL);
+}
+#endif
+
+/* Opens all counters; unavailable ones are left at -1 */
+static void bench_counters_open(int *fds) {
+    int c;
+
+    for(c = 0; c < ctrCnt; c++) {
+        fds[c] = -1;
+#ifdef __linux__
+        if(g_perf != 0) {
+            fds[c] = bench_counter_open((bench_counter_t)c);
+        }
+#endif
+    }
+}
+
+/* Enables (on != 0) or disables every open counter */
+static void bench_counters_enable(const int *fds, int on) {
+    int c;
+
+    for(c = 0; c < ctrCnt; c++) {
+#ifdef __linux__
+        if(fds[c] != -1) {
+            (void)ioctl(fds[c], on ? PERF_EVENT_IOC_ENABLE :
+                PERF_EVENT_IOC_DISABLE, 0);
+        }
+#else
+        (void)fds;
+        (void)on;
+#endif
+    }
+}
+
+/* Reads and closes the counters, averaging over iterations */
+static void bench_counters_close(const int *fds, int iterations,
+    double *counter) {
+    unsigned long long value;
+    int c;
+
+    for(c = 0; c < ctrCnt; c++) {
+        counter[c] = -1.0;
+        if(fds[c] == -1) {
+            continue;
+        }
+        if(read(fds[c], &value, sizeof(value)) == (ssize_t)sizeof(value)) {
+            counter[c] = (double)value / iterations;
+        }
+        (void)close(fds[c]);
+    }
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Counts bytes and records (line pairs) in a file */
+static int bench_file_size(const char *filename, unsigned long long *bytes,
+    unsigned long long *records) {
+    char buf[65536];
+    FILE *fp;
+    size_t n, i;
+    unsigned long long lines = 0;
+
+    if((fp = fopen(filename, "rb")) == NULL) {
+        perror(filename);
+        return 0;
+    }
+    *bytes = 0;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        *bytes += n;
+        for(i = 0; i < n; i++) {
+            lines += (buf[i] == '\n');
+        }
+    }
+    (void)fclose(fp);
+    *records = lines / 2;
+    return 1;
+}
+
+/* Runs one mode in the current (child) process */
+static void bench_child(const bench_mode_t *mode, const char *filename,
+    int iterations, bench_result_t *result) {
+    struct rusage usage;
+    double total = 0.0;
+    unsigned long allocs;
+    unsigned long long alloc_bytes;
+    int fds[ctrCnt]; /* Counter file descriptors */
+    int i;
+
+    memset(result, 0, sizeof(*result));
+    result->ok = 1;
+    result->best = -1.0;
+    allocs = g_alloc_cnt;
+    alloc_bytes = g_alloc_bytes;
+    bench_counters_open(fds);
+    for(i = 0; i < iterations; i++) {
+        double t0 = bench_now(), t;
+        int rc;
+
+        bench_counters_enable(fds, 1);
+        rc = mode->run(filename);
+        bench_counters_enable(fds, 0);
+        if(rc != 0) {
+            result->ok = 0;
+            return;
+        }
+        t = bench_now() - t0;
+        total += t;
+        if((result->best < 0.0) || (t < result->best)) {
+            result->best = t;
+        }
+        if(i == 0) {
+            result->allocs = g_alloc_cnt - allocs;
+            result->alloc_bytes = g_alloc_bytes - alloc_bytes;
+        }
+    }
+    result->mean = total / iterations;
+    bench_counters_close(fds, iterations, result->counter);
+    if(getrusage(RUSAGE_SELF, &usage) == 0) {
+        result->peak_rss_kb = usage.ru_maxrss;
+    }
+}
+
+/* Forks a child to run one mode, collecting its result through a pipe */
+static int bench_run(const bench_mode_t *mode, const char *filename,
+    int iterations, bench_result_t *result) {
+    int fds[2];
+    pid_t pid;
+    int status;
+    ssize_t n;
+
+    if(pipe(fds) == -1) {
+        perror("pipe");
+        return 0;
+    }
+    if((pid = fork()) == -1) {
+        perror("fork");
+        return 0;
+    }
+    if(pid == 0) {
+        (void)close(fds[0]);
+        bench_child(mode, filename, iterations, result);
+        n = write(fds[1], result, sizeof(*result));
+        _exit(n == (ssize_t)sizeof(*result) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    (void)close(fds[1]);
+    n = read(fds[0], result, sizeof(*result));
+    (void)close(fds[0]);
+    (void)waitpid(pid, &status, 0);
+    return (n == (ssize_t)sizeof(*result)) && WIFEXITED(status) &&
+        (WEXITSTATUS(status) == 0) && result->ok;
+}
+
+/* Counters per MB of one (file, mode) pair from a baseline file */
+typedef struct _bench_baseline_t {
+    char file[FILENAME_MAX]; /* Base name of the file */
+    char mode[32]; /* Parse mode */
+    double per_mb[ctrCnt]; /* Counter per MB, negative if unavailable */
+} bench_baseline_t;
+
+static bench_baseline_t *g_baseline = (bench_baseline_t*)NULL;
+static int g_baseline_cnt = 0;
+
+static const char *bench_basename(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return (slash == NULL) ? path : slash + 1;
+}
+
+/* Columns of a counter file: label, file, mode, bytes, then the counters */
+#define BENCH_BASELINE_COLUMNS (4 + ctrCnt)
+
+/* Splits a line at tabs into exactly cnt NULL-terminated fields, so that
+   file names and labels may hold spaces.  Returns 0 on any other count */
+static int bench_split_tabs(char *line, char **field, int cnt) {
+    char *tab;
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    for(;;) {
+        if(n == cnt) {
+            return 0;
+        }
+        field[n++] = line;
+        if((tab = strchr(line, '\t')) == NULL) {
+            break;
+        }
+        *tab = '\0';
+        line = tab + 1;
+    }
+    return n == cnt;
+}
+
+/* Loads a counter file written by -p; the last row per key wins */
+static int bench_baseline_load(const char *filename) {
+    char line[FILENAME_MAX * 2];
+    char *field[BENCH_BASELINE_COLUMNS], *end;
+    bench_baseline_t b, *p;
+    FILE *fp;
+    int c;
+
+    if((fp = fopen(filename, "r")) == NULL) {
+        perror(filename);
+        return 0;
+    }
+    while(fgets(line, (int)sizeof(line), fp) != NULL) {
+        if((bench_split_tabs(line, field, BENCH_BASELINE_COLUMNS) == 0) ||
+            (strlen(field[2]) >= sizeof(b.mode))) {
+            continue;
+        }
+        for(c = 0; c < ctrCnt; c++) {
+            b.per_mb[c] = strtod(field[4 + c], &end);
+            if((end == field[4 + c]) || (*end != '\0')) {
+                break;
+            }
+        }
+        if(c < ctrCnt) {
+            continue;
+        }
+        (void)snprintf(b.file, sizeof(b.file), "%s",
+            bench_basename(field[1]));
+        (void)snprintf(b.mode, sizeof(b.mode), "%s", field[2]);
+        if((p = (bench_baseline_t*)realloc(g_baseline,
+            sizeof(bench_baseline_t) * (g_baseline_cnt + 1))) == NULL) {
+            fprintf(stderr, "%s: out of memory\n", filename);
+            (void)fclose(fp);
+            return 0;
+        }
+        g_baseline = p;
+        g_baseline[g_baseline_cnt++] = b;
+    }
+    (void)fclose(fp);
+    return 1;
+}
+
+/* Compares counters per MB against the baseline.  Returns 1 on regression */
+static int bench_baseline_compare(const char *filename, const char *mode,
+    const double *per_mb, double threshold) {
+    const bench_baseline_t *b = (bench_baseline_t*)NULL;
+    int i, c, regressed = 0;
+
+    for(i = 0; i < g_baseline_cnt; i++) {
+        if((strcmp(g_baseline[i].file, bench_basename(filename)) == 0) &&
+            (strcmp(g_baseline[i].mode, mode) == 0)) {
+            b = &g_baseline[i];
+        }
+    }
+    if(b == NULL) {
+        return 0;
+    }
+    for(c = 0; c < ctrCnt; c++) {
+        double delta;
+
+        if((per_mb[c] < 0.0) || (b->per_mb[c] <= 0.0)) {
+            continue;
+        }
+        delta = (per_mb[c] - b->per_mb[c]) * 100.0 / b->per_mb[c];
+        if(delta > threshold) {
+            printf("%-32s %-10s REGRESSION %s/MB %+.1f%% (%.0f vs %.0f)\n",
+                filename, mode, CTR_S[c], delta, per_mb[c], b->per_mb[c]);
+            regressed = 1;
+        }
+    }
+    return regressed;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-i iterations] [-m mode] [-l label] "
+        "[-o results.tsv] [-p counters.tsv [-b baseline.tsv] [-t pct]] "
+        "<dxf_filename>...\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    int iterations = 5; /* Iterations per (file, mode) */
+    const char *only = NULL; /* Restrict to one mode */
+    const char *label = "dev"; /* Release label written to results */
+    const char *output = NULL; /* Machine-readable results file */
+    const char *perf_output = NULL; /* Machine-readable counters file */
+    const char *baseline = NULL; /* Counters file to compare against */
+    double threshold = 5.0; /* Regression threshold, percent */
+    FILE *out = NULL, *perf_out = NULL;
+    size_t m;
+    int opt, i, failed = 0, regressed = 0;
+
+    while((opt = getopt(argc, argv, "i:m:l:o:p:b:t:")) != -1) {
+        switch(opt) {
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            case 'm':
+                only = optarg;
+                break;
+            case 'l':
+                label = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'p':
+                perf_output = optarg;
+                g_perf = 1;
+                break;
+            case 'b':
+                baseline = optarg;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if((optind >= argc) || (iterations < 1) ||
+        ((baseline != NULL) && (g_perf == 0))) {
+        usage(argv[0]);
+    }
+    if((baseline != NULL) && (bench_baseline_load(baseline) == 0)) {
+        exit(EXIT_FAILURE);
+    }
+    if(perf_output != NULL) {
+        int exists = (access(perf_output, F_OK) == 0);
+
+        if((perf_out = fopen(perf_output, "a")) == NULL) {
+            perror(perf_output);
+            exit(EXIT_FAILURE);
+        }
+        if(!exists) {
+            fprintf(perf_out, "label\tfile\tmode\tbytes\tcycles_per_mb\t"
+                "instructions_per_mb\tbranch_misses_per_mb\t"
+                "cache_misses_per_mb\n");
+        }
+    }
+
+    if(output != NULL) {
+        int exists = (access(output, F_OK) == 0);
+
+        if((out = fopen(output, "a")) == NULL) {
+            perror(output);
+            exit(EXIT_FAILURE);
+        }
+        if(!exists) {
+            fprintf(out, "label\tfile\tmode\tbytes\trecords\tbest_s\tmean_s\t"
+                "mb_per_s\trecords_per_s\tpeak_rss_kb\tallocs\t"
+                "alloc_bytes\n");
+        }
+    }
+
+    printf("%-32s %-10s %10s %12s %12s %10s %12s\n", "file", "mode", "MB/s",
+        "records/s", "peak_rss_kb", "allocs", "alloc_bytes");
+    for(i = optind; i < argc; i++) {
+        unsigned long long bytes, records;
+
+        if(bench_file_size(argv[i], &bytes, &records) == 0) {
+            failed = 1;
+            continue;
+        }
+        for(m = 0; m < sizeof(g_modes) / sizeof(g_modes[0]); m++) {
+            bench_result_t r;
+            double mbs, rps;
+
+            if((only != NULL) && (strcmp(only, g_modes[m].name) != 0)) {
+                continue;
+            }
+            (void)fflush(stdout);
+            if(bench_run(&g_modes[m], argv[i], iterations, &r) == 0) {
+                printf("%-32s %-10s %10s\n", argv[i], g_modes[m].name,
+                    "FAILED");
+                failed = 1;
+                continue;
+            }
+            mbs = (double)bytes / (1024.0 * 1024.0) / r.best;
+            rps = (double)records / r.best;
+            printf("%-32s %-10s %10.1f %12.0f %12ld %10lu %12llu\n",
+                argv[i], g_modes[m].name, mbs, rps, r.peak_rss_kb, r.allocs,
+                r.alloc_bytes);
+            if(out != NULL) {
+                fprintf(out, "%s\t%s\t%s\t%llu\t%llu\t%.6f\t%.6f\t%.3f\t"
+                    "%.0f\t%ld\t%lu\t%llu\n", label, argv[i],
+                    g_modes[m].name, bytes, records, r.best, r.mean, mbs, rps,
+                    r.peak_rss_kb, r.allocs, r.alloc_bytes);
+            }
+            if(g_perf != 0) {
+                double per_mb[ctrCnt];
+                int c;
+
+                printf("%-32s %-10s", "", "");
+                for(c = 0; c < ctrCnt; c++) {
+                    per_mb[c] = (r.counter[c] < 0.0) ? -1.0 :
+                        r.counter[c] * 1024.0 * 1024.0 / (double)bytes;
+                    if(per_mb[c] < 0.0) {
+                        printf(" %s/MB=n/a", CTR_S[c]);
+                    } else {
+                        printf(" %s/MB=%.0f", CTR_S[c], per_mb[c]);
+                    }
+                }
+                printf("\n");
+                if(perf_out != NULL) {
+                    fprintf(perf_out, "%s\t%s\t%s\t%llu", label, argv[i],
+                        g_modes[m].name, bytes);
+                    for(c = 0; c < ctrCnt; c++) {
+                        fprintf(perf_out, "\t%.0f", per_mb[c]);
+                    }
+                    fprintf(perf_out, "\n");
+                }
+                regressed |= bench_baseline_compare(argv[i], g_modes[m].name,
+                    per_mb, threshold);
+            }
+        }
+    }
+
+    if(out != NULL) {
+        (void)fclose(out);
+    }
+    if(perf_out != NULL) {
+        (void)fclose(perf_out);
+    }
+    free(g_baseline);
+    if(failed) {
+        return EXIT_FAILURE;
+    }
+    return regressed ? 2 : EXIT_SUCCESS;
+}
@@ -0,0 +1,401 @@
+/** @file dxfgen.c
+ *  @brief Synthetic DXF corpus generator.
+ *
+ * Writes deterministic DXF files of a requested size and record mix for
+ * benchmarking.  The same seed, mix and size always produce byte-identical
+ * output, so throughput numbers can be compared from release to release.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+/* Number of layers written to the LAYER table */
+#define GEN_LAYER_CNT 32
+
+/* Number of block definitions written to the BLOCKS section */
+#define GEN_BLOCK_CNT 8
+
+/* Handle of the *Model_Space block record */
+#define GEN_MODEL_SPACE 0x1F
+
+/* Record mixes */
+typedef enum { mixHeader, mixEntity, mixPolyline, mixXdata, mixMixed } mix_t;
+
+static const char *MIX_S[] = {
+    "header", "entity", "polyline", "xdata", "mixed"
+};
+
+/* Generator state */
+typedef struct _gen_t {
+    FILE *fp; /* Output stream */
+    unsigned long long seed; /* xorshift64 state */
+    unsigned long long bytes; /* Bytes written so far */
+    unsigned long long handle; /* Next object handle */
+    mix_t mix; /* Record mix */
+} gen_t;
+
+/* Deterministic pseudo-random number (xorshift64) */
+static unsigned long long gen_rand(gen_t *gen) {
+    gen->seed ^= gen->seed << 13;
+    gen->seed ^= gen->seed >> 7;
+    gen->seed ^= gen->seed << 17;
+    return gen->seed;
+}
+
+/* Pseudo-random double in [lo, hi) */
+static double gen_double(gen_t *gen, double lo, double hi) {
+    return lo + (hi - lo) * ((double)(gen_rand(gen) >> 11) /
+        9007199254740992.0);
+}
+
+/* Pseudo-random integer in [0, n) */
+static int gen_int(gen_t *gen, int n) {
+    return (int)(gen_rand(gen) % (unsigned long long)n);
+}
+
+static void gen_str(gen_t *gen, int code, const char *value) {
+    int n = fprintf(gen->fp, "%3d\n%s\n", code, value);
+    if(n > 0) {
+        gen->bytes += (unsigned long long)n;
+    }
+}
+
+static void gen_int_rec(gen_t *gen, int code, int value) {
+    int n = fprintf(gen->fp, "%3d\n%6d\n", code, value);
+    if(n > 0) {
+        gen->bytes += (unsigned long long)n;
+    }
+}
+
+static void gen_dbl(gen_t *gen, int code, double value) {
+    int n = fprintf(gen->fp, "%3d\n%.6f\n", code, value);
+    if(n > 0) {
+        gen->bytes += (unsigned long long)n;
+    }
+}
+
+/* Writes a point as the code, code + 10, code + 20 triple */
+static void gen_pt(gen_t *gen, int code, double x, double y, double z) {
+    gen_dbl(gen, code, x);
+    gen_dbl(gen, code + 10, y);
+    gen_dbl(gen, code + 20, z);
+}
+
+/* Writes handle (5) and owner (330) of a new object */
+static void gen_handle(gen_t *gen, unsigned long long owner) {
+    char buf[32];
+
+    (void)snprintf(buf, sizeof(buf), "%llX", gen->handle++);
+    gen_str(gen, 5, buf);
+    (void)snprintf(buf, sizeof(buf), "%llX", owner);
+    gen_str(gen, 330, buf);
+}
+
+/* Writes the common entity groups: type, handle, owner, layer, color */
+static void gen_entity_start(gen_t *gen, const char *type,
+    unsigned long long owner) {
+    char layer[32];
+
+    gen_str(gen, 0, type);
+    gen_handle(gen, owner);
+    gen_str(gen, 100, "AcDbEntity");
+    (void)snprintf(layer, sizeof(layer), "LAYER%02d",
+        gen_int(gen, GEN_LAYER_CNT));
+    gen_str(gen, 8, layer);
+    gen_int_rec(gen, 62, 1 + gen_int(gen, 255));
+}
+
+static void gen_xdata(gen_t *gen) {
+    int i, cnt = 4 + gen_int(gen, 12);
+
+    gen_str(gen, 1001, "PLANT3D");
+    gen_str(gen, 1000, "PIPE-SPEC-A1");
+    for(i = 0; i < cnt; i++) {
+        gen_pt(gen, 1010, gen_double(gen, 0, 1e4), gen_double(gen, 0, 1e4),
+            0.0);
+        gen_dbl(gen, 1040, gen_double(gen, 0, 100));
+        gen_int_rec(gen, 1070, gen_int(gen, 32767));
+    }
+    gen_int_rec(gen, 1071, gen_int(gen, 1 << 30));
+}
+
+static void gen_lwpolyline(gen_t *gen, unsigned long long owner) {
+    int i, cnt = 8 + gen_int(gen, 120);
+    double x = gen_double(gen, 0, 1e4), y = gen_double(gen, 0, 1e4);
+
+    gen_entity_start(gen, "LWPOLYLINE", owner);
+    gen_str(gen, 100, "AcDbPolyline");
+    gen_int_rec(gen, 90, cnt);
+    gen_int_rec(gen, 70, gen_int(gen, 2));
+    for(i = 0; i < cnt; i++) {
+        x += gen_double(gen, -5, 5);
+        y += gen_double(gen, -5, 5);
+        gen_dbl(gen, 10, x);
+        gen_dbl(gen, 20, y);
+        if(gen_int(gen, 8) == 0) {
+            gen_dbl(gen, 42, gen_double(gen, -1, 1));
+        }
+    }
+}
+
+static void gen_entity(gen_t *gen, unsigned long long owner) {
+    char buf[64];
+    int kind;
+
+    if(gen->mix == mixPolyline) {
+        kind = (gen_int(gen, 10) < 8) ? 4 : gen_int(gen, 4);
+    } else {
+        kind = gen_int(gen, 6);
+    }
+    switch(kind) {
+        case 0:
+            gen_entity_start(gen, "LINE", owner);
+            gen_str(gen, 100, "AcDbLine");
+            gen_pt(gen, 10, gen_double(gen, 0, 1e4), gen_double(gen, 0, 1e4),
+                0.0);
+            gen_pt(gen, 11, gen_double(gen, 0, 1e4), gen_double(gen, 0, 1e4),
+                0.0);
+            break;
+        case 1:
+            gen_entity_start(gen, "CIRCLE", owner);
+            gen_str(gen, 100, "AcDbCircle");
+            gen_pt(gen, 10, gen_double(gen, 0, 1e4), gen_double(gen, 0, 1e4),
+                0.0);
+            gen_dbl(gen, 40, gen_double(gen, 0.1, 100));
+            break;
+        case 2:
+            gen_entity_start(gen, "ARC", owner);
+            gen_str(gen, 100, "AcDbCircle");
+            gen_pt(gen, 10, gen_double(gen, 0, 1e4), gen_double(gen, 0, 1e4),
+                0.0);
+            gen_dbl(gen, 40, gen_double(gen, 0.1, 100));
+            gen_str(gen, 100, "AcDbArc");
+            gen_dbl(gen, 50, gen_double(gen, 0, 180));
+            gen_dbl(gen, 51, gen_double(gen, 180, 360));
+            break;
+        case 3:
+            gen_entity_start(gen, "TEXT", owner);
+            gen_str(gen, 100, "AcDbText");
+            gen_pt(gen, 10, gen_double(gen, 0, 1e4), gen_double(gen, 0, 1e4),
+                0.0);
+            gen_dbl(gen, 40, 2.5);
+            (void)snprintf(buf, sizeof(buf), "TAG-%05d", gen_int(gen, 100000));
+            gen_str(gen, 1, buf);
+            break;
+        case 4:
+            gen_lwpolyline(gen, owner);
+            break;
+        default:
+            gen_entity_start(gen, "INSERT", owner);
+            gen_str(gen, 100, "AcDbBlockReference");
+            (void)snprintf(buf, sizeof(buf), "BLOCK%02d",
+                gen_int(gen, GEN_BLOCK_CNT));
+            gen_str(gen, 2, buf);
+            gen_pt(gen, 10, gen_double(gen, 0, 1e4), gen_double(gen, 0, 1e4),
+                0.0);
+            gen_dbl(gen, 50, gen_double(gen, 0, 360));
+            break;
+    }
+    if((gen->mix == mixXdata) || ((gen->mix == mixMixed) &&
+        (gen_int(gen, 4) == 0))) {
+        gen_xdata(gen);
+    }
+}
+
+static void gen_header(gen_t *gen, unsigned long long target) {
+    char name[32];
+    int i;
+
+    gen_str(gen, 0, "SECTION");
+    gen_str(gen, 2, "HEADER");
+    gen_str(gen, 9, "$ACADVER");
+    gen_str(gen, 1, "AC1024");
+    gen_str(gen, 9, "$DWGCODEPAGE");
+    gen_str(gen, 3, "ANSI_1252");
+    gen_str(gen, 9, "$INSUNITS");
+    gen_int_rec(gen, 70, 4);
+    gen_str(gen, 9, "$EXTMIN");
+    gen_pt(gen, 10, 0.0, 0.0, 0.0);
+    gen_str(gen, 9, "$EXTMAX");
+    gen_pt(gen, 10, 10000.0, 10000.0, 0.0);
+    gen_str(gen, 9, "$HANDSEED");
+    gen_str(gen, 5, "FFFFFFF");
+    /* Header-heavy files fill most of the target with variables */
+    for(i = 0; (gen->mix == mixHeader) && (gen->bytes < target); i++) {
+        (void)snprintf(name, sizeof(name), "$USERVAR%06d", i);
+        gen_str(gen, 9, name);
+        switch(i % 3) {
+            case 0:
+                gen_int_rec(gen, 70, gen_int(gen, 32767));
+                break;
+            case 1:
+                gen_dbl(gen, 40, gen_double(gen, -1e6, 1e6));
+                break;
+            default:
+                gen_str(gen, 1, name + 1);
+                break;
+        }
+    }
+    gen_str(gen, 0, "ENDSEC");
+}
+
+static void gen_tables(gen_t *gen) {
+    char name[32];
+    unsigned long long table; /* Handle of the current table */
+    int i;
+
+    gen_str(gen, 0, "SECTION");
+    gen_str(gen, 2, "TABLES");
+    table = gen->handle;
+    gen_str(gen, 0, "TABLE");
+    gen_str(gen, 2, "LAYER");
+    gen_handle(gen, 0);
+    gen_int_rec(gen, 70, GEN_LAYER_CNT);
+    for(i = 0; i < GEN_LAYER_CNT; i++) {
+        gen_str(gen, 0, "LAYER");
+        gen_handle(gen, table);
+        gen_str(gen, 100, "AcDbLayerTableRecord");
+        (void)snprintf(name, sizeof(name), "LAYER%02d", i);
+        gen_str(gen, 2, name);
+        gen_int_rec(gen, 70, 0);
+        gen_int_rec(gen, 62, 1 + (i % 255));
+        gen_str(gen, 6, "CONTINUOUS");
+    }
+    gen_str(gen, 0, "ENDTAB");
+
+    /* Model space, the owner of every entity in ENTITIES */
+    table = gen->handle;
+    gen_str(gen, 0, "TABLE");
+    gen_str(gen, 2, "BLOCK_RECORD");
+    gen_handle(gen, 0);
+    gen_int_rec(gen, 70, 1);
+    gen_str(gen, 0, "BLOCK_RECORD");
+    (void)snprintf(name, sizeof(name), "%X", GEN_MODEL_SPACE);
+    gen_str(gen, 5, name);
+    (void)snprintf(name, sizeof(name), "%llX", table);
+    gen_str(gen, 330, name);
+    gen_str(gen, 100, "AcDbBlockTableRecord");
+    gen_str(gen, 2, "*Model_Space");
+    gen_str(gen, 0, "ENDTAB");
+    gen_str(gen, 0, "ENDSEC");
+}
+
+static void gen_blocks(gen_t *gen) {
+    char name[32];
+    unsigned long long owner;
+    int i, j;
+
+    gen_str(gen, 0, "SECTION");
+    gen_str(gen, 2, "BLOCKS");
+    for(i = 0; i < GEN_BLOCK_CNT; i++) {
+        owner = gen->handle;
+        gen_str(gen, 0, "BLOCK");
+        gen_handle(gen, GEN_MODEL_SPACE);
+        (void)snprintf(name, sizeof(name), "BLOCK%02d", i);
+        gen_str(gen, 8, "0");
+        gen_str(gen, 2, name);
+        gen_int_rec(gen, 70, 0);
+        gen_pt(gen, 10, 0.0, 0.0, 0.0);
+        gen_str(gen, 3, name);
+        for(j = 0; j < 4; j++) {
+            gen_entity_start(gen, "LINE", owner);
+            gen_pt(gen, 10, 0.0, 0.0, 0.0);
+            gen_pt(gen, 11, gen_double(gen, 1, 10), gen_double(gen, 1, 10),
+                0.0);
+        }
+        gen_str(gen, 0, "ENDBLK");
+        gen_handle(gen, owner);
+    }
+    gen_str(gen, 0, "ENDSEC");
+}
+
+static void gen_objects(gen_t *gen) {
+    gen_str(gen, 0, "SECTION");
+    gen_str(gen, 2, "OBJECTS");
+    gen_str(gen, 0, "DICTIONARY");
+    gen_handle(gen, 0);
+    gen_str(gen, 100, "AcDbDictionary");
+    gen_str(gen, 3, "ACAD_GROUP");
+    gen_str(gen, 350, "D");
+    gen_str(gen, 0, "ENDSEC");
+}
+
+static void gen_file(gen_t *gen, unsigned long long target) {
+    gen_header(gen, target);
+    gen_tables(gen);
+    gen_blocks(gen);
+    gen_str(gen, 0, "SECTION");
+    gen_str(gen, 2, "ENTITIES");
+    while(gen->bytes < target) {
+        gen_entity(gen, GEN_MODEL_SPACE);
+    }
+    gen_str(gen, 0, "ENDSEC");
+    gen_objects(gen);
+    gen_str(gen, 0, "EOF");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-m header|entity|polyline|xdata|mixed] "
+        "[-s bytes] [-r seed] [-o output.dxf]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    gen_t gen; /* Generator state */
+    unsigned long long target = 1024 * 1024; /* Target size in bytes */
+    const char *output = NULL; /* Output filename, stdout if NULL */
+    int opt;
+    size_t i;
+
+    memset(&gen, 0, sizeof(gen));
+    gen.seed = 0x9E3779B97F4A7C15ULL;
+    gen.handle = 0x100;
+    gen.mix = mixMixed;
+
+    while((opt = getopt(argc, argv, "m:s:r:o:")) != -1) {
+        switch(opt) {
+            case 'm':
+                for(i = 0; i < sizeof(MIX_S) / sizeof(MIX_S[0]); i++) {
+                    if(strcmp(optarg, MIX_S[i]) == 0) {
+                        break;
+                    }
+                }
+                if(i == sizeof(MIX_S) / sizeof(MIX_S[0])) {
+                    usage(argv[0]);
+                }
+                gen.mix = (mix_t)i;
+                break;
+            case 's':
+                target = strtoull(optarg, NULL, 0);
+                break;
+            case 'r':
+                gen.seed = strtoull(optarg, NULL, 0);
+                if(gen.seed == 0) {
+                    gen.seed = 1;
+                }
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if(output == NULL) {
+        gen.fp = stdout;
+    } else if((gen.fp = fopen(output, "w")) == NULL) {
+        perror(output);
+        exit(EXIT_FAILURE);
+    }
+
+    gen_file(&gen, target);
+
+    if((gen.fp != stdout) && (fclose(gen.fp) != 0)) {
+        perror(output);
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
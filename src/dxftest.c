@@ -0,0 +1,636 @@
+/** @file dxftest.c
+ *  @brief Behavioural tests of the DXF API.
+ *
+ * Drives the public API over the small drawings dxfgen writes for each
+ * record mix (see the check target of the Makefile) and compares what it
+ * returns with what a plain reading of the same files finds: entity counts
+ * by type, layer and color, text, extended data, dictionary entries and
+ * points.  Stores loaded compact, spilled or attached must give back the
+ * vertices of a plain load.  Exits non-zero if any check fails.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+#include "dxf.h"
+
+/* Longest line of a fixture, including the newline */
+#define TEST_LINE_MAX 256
+
+/* Quantization step of compact loads */
+#define TEST_STEP (1.0 / 1024.0)
+
+/* Snap distance of topology */
+#define TEST_SNAP (1.0 / 1024.0)
+
+/* Chordal tolerance of flattening */
+#define TEST_TOLERANCE (1.0 / 128.0)
+
+/* Text searched for, and the layer and color queried */
+#define TEST_TEXT "tag-0"
+#define TEST_LAYER "LAYER01"
+#define TEST_COLOR 7
+
+/* Record mixes dxfgen writes, one fixture each */
+static const char *MIX_S[] = {
+    "header", "entity", "polyline", "xdata", "mixed"
+};
+#define TEST_MIX_CNT (sizeof(MIX_S) / sizeof(MIX_S[0]))
+
+/* What a plain reading of a fixture finds */
+typedef struct _test_scan_t {
+    size_t entity_cnt; /* Entities of ENTITIES */
+    size_t block_entity_cnt; /* Entities of block definitions */
+    size_t line_cnt; /* LINE, in both */
+    size_t layer_line_cnt; /* LINE on TEST_LAYER, in both */
+    size_t color_cnt; /* Entities of color TEST_COLOR, in both */
+    size_t edge_cnt; /* LINE, ARC, LWPOLYLINE and POLYLINE of ENTITIES */
+    size_t text_cnt; /* TEXT */
+    size_t text_match_cnt; /* TEXT containing TEST_TEXT, ignoring case */
+    uint64_t text_handle; /* First TEXT, 0 if none */
+    char text[TEST_LINE_MAX]; /* Its group 1 */
+    uint64_t line_handle; /* First LINE of ENTITIES, 0 if none */
+    double line_p[3]; /* Its group 10 */
+    double line_q[3]; /* Its group 11 */
+    uint64_t xdata_handle; /* First entity with extended data, 0 if none */
+    size_t xdata_cnt; /* Its extended data groups */
+} test_scan_t;
+
+/* Checks run and failed */
+static unsigned long g_check_cnt = 0;
+static unsigned long g_fail_cnt = 0;
+
+/* Records a check, reporting it if it failed */
+#define TEST_CHECK(cond) test_check((cond) != 0, #cond, __LINE__)
+
+static int test_check(int ok, const char *what, int line) {
+    g_check_cnt++;
+    if(ok == 0) {
+        g_fail_cnt++;
+        fprintf(stderr, "dxftest.c:%d: check failed: %s\n", line, what);
+    }
+    return ok;
+}
+
+/* Path of the fixture of a mix */
+static void test_path(char *path, size_t size, const char *dir,
+    const char *name) {
+    (void)snprintf(path, size, "%s/%s.dxf", dir, name);
+}
+
+/* Reads the next group of a fixture; 0 at end of file */
+static int test_group(FILE *fp, int *code, char *value) {
+    char line[TEST_LINE_MAX];
+    size_t len;
+
+    if((fgets(line, sizeof(line), fp) == NULL) ||
+        (fgets(value, TEST_LINE_MAX, fp) == NULL)) {
+        return 0;
+    }
+    *code = atoi(line);
+    len = strcspn(value, "\r\n");
+    value[len] = '\0';
+    return 1;
+}
+
+/* Non-zero if s contains pattern, ignoring ASCII case */
+static int test_contains(const char *s, const char *pattern) {
+    size_t n = strlen(pattern), i, j;
+
+    for(i = 0; s[i] != '\0'; i++) {
+        for(j = 0; (j < n) && (s[i + j] != '\0') &&
+            (tolower((unsigned char)s[i + j]) ==
+            tolower((unsigned char)pattern[j])); j++) {
+        }
+        if(j == n) {
+            return 1;
+        }
+    }
+    return (n == 0);
+}
+
+/* Counts a finished entity */
+static void test_scan_entity(test_scan_t *scan, int in_block,
+    const char *type, const char *layer, int color) {
+    int is_line = (strcmp(type, "LINE") == 0);
+
+    if(in_block != 0) {
+        scan->block_entity_cnt++;
+    } else {
+        scan->entity_cnt++;
+        if(is_line || (strcmp(type, "ARC") == 0) ||
+            (strcmp(type, "LWPOLYLINE") == 0) ||
+            (strcmp(type, "POLYLINE") == 0)) {
+            scan->edge_cnt++;
+        }
+    }
+    if(is_line) {
+        scan->line_cnt++;
+        if(strcmp(layer, TEST_LAYER) == 0) {
+            scan->layer_line_cnt++;
+        }
+    }
+    if(color == TEST_COLOR) {
+        scan->color_cnt++;
+    }
+}
+
+/* Reads a fixture the simple way */
+static int test_scan(const char *path, test_scan_t *scan) {
+    char value[TEST_LINE_MAX], section[TEST_LINE_MAX];
+    char type[TEST_LINE_MAX], layer[TEST_LINE_MAX];
+    int code, prev_code = -1, color = 256, in_block = 0, in_entity = 0;
+    uint64_t handle = 0;
+    size_t xdata = 0;
+    FILE *fp;
+
+    memset(scan, 0, sizeof(*scan));
+    section[0] = type[0] = layer[0] = '\0';
+    if((fp = fopen(path, "r")) == NULL) {
+        perror(path);
+        return 0;
+    }
+    while(test_group(fp, &code, value) != 0) {
+        if(code == 0) {
+            if(in_entity != 0) {
+                test_scan_entity(scan, in_block, type, layer, color);
+                if((xdata > 0) && (scan->xdata_handle == 0)) {
+                    scan->xdata_handle = handle;
+                    scan->xdata_cnt = xdata;
+                }
+            }
+            snprintf(type, sizeof(type), "%s", value);
+            layer[0] = '\0';
+            color = 256;
+            handle = 0;
+            xdata = 0;
+            if(strcmp(value, "BLOCK") == 0) {
+                in_block = 1;
+            } else if(strcmp(value, "ENDBLK") == 0) {
+                in_block = 0;
+            } else if(strcmp(value, "ENDSEC") == 0) {
+                section[0] = '\0';
+            }
+            in_entity = (((strcmp(section, "ENTITIES") == 0) ||
+                ((strcmp(section, "BLOCKS") == 0) && (in_block != 0) &&
+                (strcmp(value, "BLOCK") != 0))));
+        } else if((code == 2) && (prev_code == 0) &&
+            (strcmp(type, "SECTION") == 0)) {
+            snprintf(section, sizeof(section), "%s", value);
+        } else if(in_entity != 0) {
+            if(code == 5) {
+                handle = strtoull(value, NULL, 16);
+            } else if(code == 8) {
+                snprintf(layer, sizeof(layer), "%s", value);
+            } else if(code == 62) {
+                color = atoi(value);
+            } else if((code >= 1000) && (code <= 1071)) {
+                xdata++;
+            }
+            if((code == 1) && (strcmp(type, "TEXT") == 0)) {
+                scan->text_cnt++;
+                scan->text_match_cnt += test_contains(value, TEST_TEXT);
+                if(scan->text_handle == 0) {
+                    scan->text_handle = handle;
+                    snprintf(scan->text, sizeof(scan->text), "%s", value);
+                }
+            }
+            if((strcmp(type, "LINE") == 0) && (in_block == 0) &&
+                ((scan->line_handle == 0) || (scan->line_handle == handle))) {
+                scan->line_handle = handle;
+                if((code >= 10) && (code <= 31) && (code % 10 <= 1)) {
+                    ((code % 10 == 0) ? scan->line_p : scan->line_q)[
+                        code / 10 - 1] = strtod(value, NULL);
+                }
+            }
+        }
+        prev_code = code;
+    }
+    (void)fclose(fp);
+    return 1;
+}
+
+/* Loads a fixture with options, reporting failures */
+static int test_load(const char *path, const dxf_load_options_t *options,
+    dxf_handle_t *dxf) {
+    dxf_load_options_t defaults;
+
+    if(options == NULL) {
+        dxf_load_options_init(&defaults);
+        options = &defaults;
+    }
+    return TEST_CHECK(dxf_load_ex(dxf, path, options) == dxfErrorOk);
+}
+
+/* Record id of a handle */
+static dxf_record_id_t test_record(dxf_handle_t dxf, uint64_t handle) {
+    dxf_record_id_t id = DXF_RECORD_NONE;
+
+    (void)TEST_CHECK(dxf_lookup_handle(dxf, handle, &id) == dxfErrorOk);
+    return id;
+}
+
+/* Runs a query with one operand pushed by push, then optional combines */
+static size_t test_query_cnt(dxf_query_t *q) {
+    size_t cnt = 0;
+
+    (void)TEST_CHECK(dxf_query_run(q, (dxf_record_id_t*)NULL, 0, &cnt) ==
+        dxfErrorOk);
+    return cnt;
+}
+
+static void test_query(dxf_handle_t dxf, const test_scan_t *scan) {
+    dxf_query_t *q;
+    size_t all;
+
+    if(!TEST_CHECK(dxf_query_begin(dxf, &q) == dxfErrorOk)) {
+        return;
+    }
+    (void)dxf_query_type(q, "*");
+    all = test_query_cnt(q);
+    (void)TEST_CHECK(all == scan->entity_cnt + scan->block_entity_cnt);
+    dxf_query_end(q);
+
+    (void)dxf_query_begin(dxf, &q);
+    (void)dxf_query_type(q, "line");
+    (void)TEST_CHECK(test_query_cnt(q) == scan->line_cnt);
+    (void)dxf_query_not(q);
+    (void)TEST_CHECK(test_query_cnt(q) == all - scan->line_cnt);
+    dxf_query_end(q);
+
+    (void)dxf_query_begin(dxf, &q);
+    (void)dxf_query_type(q, "LINE");
+    (void)dxf_query_layer(q, TEST_LAYER);
+    (void)dxf_query_and(q);
+    (void)TEST_CHECK(test_query_cnt(q) == scan->layer_line_cnt);
+    dxf_query_end(q);
+
+    (void)dxf_query_begin(dxf, &q);
+    (void)dxf_query_color(q, TEST_COLOR);
+    (void)TEST_CHECK(test_query_cnt(q) == scan->color_cnt);
+    (void)dxf_query_type(q, "TEXT,ARC");
+    (void)dxf_query_or(q);
+    (void)dxf_query_type(q, "CIRCLE");
+    (void)dxf_query_or(q);
+    (void)TEST_CHECK(test_query_cnt(q) <= all);
+    dxf_query_end(q);
+
+    /* Block definitions, and everything outside them */
+    (void)dxf_query_begin(dxf, &q);
+    (void)dxf_query_block(q, "block0?");
+    (void)TEST_CHECK(test_query_cnt(q) == scan->block_entity_cnt);
+    dxf_query_end(q);
+    (void)dxf_query_begin(dxf, &q);
+    (void)dxf_query_block(q, "*");
+    (void)dxf_query_not(q);
+    (void)TEST_CHECK(test_query_cnt(q) == scan->entity_cnt);
+    dxf_query_end(q);
+
+    /* Errors stick */
+    (void)dxf_query_begin(dxf, &q);
+    (void)TEST_CHECK(dxf_query_and(q) == dxfErrorInvalidQuery);
+    (void)TEST_CHECK(dxf_query_type(q, "LINE") == dxfErrorInvalidQuery);
+    dxf_query_end(q);
+}
+
+static void test_text(dxf_handle_t dxf, const test_scan_t *scan) {
+    dxf_record_id_t *ids;
+    char text[TEST_LINE_MAX];
+    size_t cnt = 0, len = 0;
+
+    (void)TEST_CHECK(dxf_text_search(dxf, "", (dxf_record_id_t*)NULL, 0,
+        &cnt) == dxfErrorOk);
+    (void)TEST_CHECK(cnt == scan->text_cnt);
+    (void)TEST_CHECK(dxf_text_search(dxf, TEST_TEXT, (dxf_record_id_t*)NULL,
+        0, &cnt) == dxfErrorOk);
+    (void)TEST_CHECK(cnt == scan->text_match_cnt);
+    if(scan->text_handle == 0) {
+        return;
+    }
+    if((ids = (dxf_record_id_t*)malloc(scan->text_cnt *
+        sizeof(dxf_record_id_t))) == NULL) {
+        (void)TEST_CHECK(ids != NULL);
+        return;
+    }
+    (void)TEST_CHECK(dxf_text_search(dxf, "", ids, scan->text_cnt, &cnt) ==
+        dxfErrorOk);
+    (void)TEST_CHECK(ids[0] == test_record(dxf, scan->text_handle));
+    (void)TEST_CHECK(dxf_get_text(dxf, ids[0], text, sizeof(text), &len) ==
+        dxfErrorOk);
+    (void)TEST_CHECK((strcmp(text, scan->text) == 0) &&
+        (len == strlen(scan->text)));
+    free(ids);
+}
+
+static void test_xdata(dxf_handle_t dxf, const test_scan_t *scan) {
+    dxf_xdata_t *x;
+    const char *value;
+    size_t cnt = 0;
+    int code, first = -1;
+
+    if(!TEST_CHECK(scan->xdata_handle != 0) ||
+        !TEST_CHECK(dxf_xdata_begin(dxf, test_record(dxf,
+        scan->xdata_handle), &x) == dxfErrorOk)) {
+        return;
+    }
+    while(dxf_xdata_next(x, &code, &value) == dxfErrorOk) {
+        if(cnt++ == 0) {
+            first = code;
+            (void)TEST_CHECK(strcmp(value, "PLANT3D") == 0);
+        }
+    }
+    dxf_xdata_end(x);
+    (void)TEST_CHECK(first == 1001);
+    (void)TEST_CHECK(cnt == scan->xdata_cnt);
+}
+
+static void test_dict(dxf_handle_t dxf) {
+    const dxf_dict_entry_t *entries;
+    dxf_record_id_t id;
+    size_t cnt = 0;
+
+    if(!TEST_CHECK(dxf_get_named_object_dict(dxf, &id) == dxfErrorOk) ||
+        !TEST_CHECK(dxf_get_dict_entries(dxf, id, &entries, &cnt) ==
+        dxfErrorOk) || !TEST_CHECK(cnt == 1)) {
+        return;
+    }
+    (void)TEST_CHECK(strcmp(entries[0].name, "ACAD_GROUP") == 0);
+    (void)TEST_CHECK(entries[0].handle == 0xD);
+    (void)TEST_CHECK(entries[0].record == DXF_RECORD_NONE);
+    (void)TEST_CHECK(entries[0].hard == 0);
+}
+
+static void test_geometry(dxf_handle_t dxf, const test_scan_t *scan) {
+    dxf_topology_t t;
+    dxf_geometry_t g;
+    const dxf_geometry_t *all;
+    double p[3], q[3];
+    dxf_record_id_t id;
+    int i;
+
+    /* Points, parsed back from the file on first use */
+    if(scan->line_handle != 0) {
+        id = test_record(dxf, scan->line_handle);
+        (void)TEST_CHECK(dxf_get_entity_points(dxf, id, 0, p, q) ==
+            dxfErrorOk);
+        for(i = 0; i < 3; i++) {
+            (void)TEST_CHECK(fabs(p[i] - scan->line_p[i]) < 1e-9);
+            (void)TEST_CHECK(fabs(q[i] - scan->line_q[i]) < 1e-9);
+        }
+        dxf_geometry_init(&g);
+        (void)TEST_CHECK(dxf_flatten(dxf, id, TEST_TOLERANCE, &g) ==
+            dxfErrorOk);
+        (void)TEST_CHECK((g.path_cnt == 1) && (g.vertex_cnt == 2));
+        dxf_geometry_free(&g);
+    }
+
+    /* Every edge entity of ENTITIES is one edge */
+    dxf_topology_init(&t);
+    if(TEST_CHECK(dxf_build_topology(dxf, TEST_SNAP, &t) == dxfErrorOk)) {
+        (void)TEST_CHECK(t.edge_cnt == scan->edge_cnt);
+        (void)TEST_CHECK((t.node_cnt == 0) ||
+            (t.adjacency_offset[t.node_cnt] == 2 * t.edge_cnt));
+        (void)TEST_CHECK(t.component_cnt <= t.node_cnt);
+        (void)TEST_CHECK((t.chain_cnt == 0) ||
+            (t.chain_offset[t.chain_cnt] == t.edge_cnt));
+    }
+    dxf_topology_free(&t);
+    (void)TEST_CHECK(dxf_tessellate(dxf, TEST_TOLERANCE, &all) ==
+        dxfErrorOk);
+}
+
+/* Compares the vertices of a store with those of a plain load */
+static void test_vertices(dxf_handle_t plain, dxf_handle_t other,
+    double tolerance) {
+    const double *v;
+    double *w;
+    size_t cnt = 0, other_cnt = 0, i;
+    int world;
+
+    if(!TEST_CHECK(dxf_get_vertices(plain, &v, &cnt) == dxfErrorOk) ||
+        !TEST_CHECK(cnt > 0)) {
+        return;
+    }
+    (void)dxf_get_record_cnt(plain, &other_cnt);
+    (void)dxf_get_record_cnt(other, &i);
+    (void)TEST_CHECK(i == other_cnt);
+    if((w = (double*)malloc(cnt * 4 * sizeof(double))) == NULL) {
+        (void)TEST_CHECK(w != NULL);
+        return;
+    }
+    for(world = 0; world < 2; world++) {
+        double err = 0.0;
+        if(world != 0) {
+            (void)TEST_CHECK(dxf_get_world_vertices(plain, &v, &cnt) ==
+                dxfErrorOk);
+        }
+        /* In two ranges, the second starting mid-store */
+        (void)TEST_CHECK(dxf_copy_vertices(other, world, 0, cnt / 3, w) ==
+            dxfErrorOk);
+        (void)TEST_CHECK(dxf_copy_vertices(other, world, cnt / 3,
+            cnt - cnt / 3, &w[4 * (cnt / 3)]) == dxfErrorOk);
+        for(i = 0; i < 4 * cnt; i++) {
+            double d = fabs(w[i] - v[i]);
+            if((i % 4 == 3) && (d != 0.0)) {
+                err = HUGE_VAL;
+            } else if(d > err) {
+                err = d;
+            }
+        }
+        (void)TEST_CHECK(err <= tolerance);
+    }
+    (void)TEST_CHECK(dxf_copy_vertices(other, 0, cnt, 1, w) ==
+        dxfErrorInvalidRecord);
+    free(w);
+}
+
+static void test_stores(const char *path) {
+    dxf_load_options_t options;
+    dxf_handle_t plain, other;
+    int fd;
+
+    if(!test_load(path, (const dxf_load_options_t*)NULL, &plain)) {
+        return;
+    }
+
+    dxf_load_options_init(&options);
+    options.compact_step = TEST_STEP;
+    if(test_load(path, &options, &other)) {
+        test_vertices(plain, other, TEST_STEP / 2.0 + 1e-9);
+        (void)dxf_unload(other);
+    }
+
+    /* One byte: every block is read back, and dropped by the next */
+    dxf_load_options_init(&options);
+    options.max_resident_bytes = 1;
+    if(test_load(path, &options, &other)) {
+        test_vertices(plain, other, 0.0);
+        (void)dxf_unload(other);
+    }
+
+    if(TEST_CHECK(dxf_share(plain, &fd) == dxfErrorOk)) {
+        if(TEST_CHECK(dxf_attach(&other, fd) == dxfErrorOk)) {
+            test_vertices(plain, other, 0.0);
+            (void)dxf_unload(other);
+        }
+        (void)close(fd);
+    }
+    (void)TEST_CHECK(dxf_attach(&other, -1) != dxfErrorOk);
+    (void)dxf_unload(plain);
+}
+
+static void test_probe(const char *path) {
+    dxf_info_t info;
+
+    if(!TEST_CHECK(dxf_probe(path, &info) == dxfErrorOk)) {
+        return;
+    }
+    (void)TEST_CHECK(strcmp(info.version, "AC1024") == 0);
+    (void)TEST_CHECK(strcmp(info.codepage, "ANSI_1252") == 0);
+    (void)TEST_CHECK(info.units == 4);
+    (void)TEST_CHECK(info.has_extents != 0);
+    (void)TEST_CHECK((info.extmin[0] == 0.0) && (info.extmax[0] == 1e4) &&
+        (info.extmax[1] == 1e4));
+}
+
+/* Writes a copy of a fixture with one group code of ENTITIES spoiled */
+static int test_spoil(const char *path, const char *bad) {
+    char line[TEST_LINE_MAX];
+    FILE *in, *out;
+    int n = 0, entities = 0, done = 0;
+
+    if((in = fopen(path, "r")) == NULL) {
+        return 0;
+    }
+    if((out = fopen(bad, "w")) == NULL) {
+        (void)fclose(in);
+        return 0;
+    }
+    while(fgets(line, sizeof(line), in) != NULL) {
+        if(strcmp(line, "ENTITIES\n") == 0) {
+            entities = 1;
+        }
+        /* Group code lines are the even ones */
+        if((entities != 0) && (done == 0) && (n % 2 == 0) &&
+            (atoi(line) == 8)) {
+            fputs("  8x\n", out);
+            done = 1;
+        } else {
+            fputs(line, out);
+        }
+        n++;
+    }
+    (void)fclose(in);
+    return (fclose(out) == 0) && (done != 0);
+}
+
+static void test_validate(const char *dir, const char *path) {
+    dxf_load_options_t options;
+    dxf_handle_t dxf, strict;
+    char bad[FILENAME_MAX];
+    dxf_error_t err;
+    size_t cnt = 0, strict_cnt = 0;
+
+    dxf_load_options_init(&options);
+    options.validate = dxfValidateAfter;
+    if(test_load(path, (const dxf_load_options_t*)NULL, &strict)) {
+        if(test_load(path, &options, &dxf)) {
+            (void)dxf_get_record_cnt(strict, &strict_cnt);
+            (void)dxf_get_record_cnt(dxf, &cnt);
+            (void)TEST_CHECK(cnt == strict_cnt);
+            (void)dxf_unload(dxf);
+        }
+        (void)dxf_unload(strict);
+    }
+
+    /* A spoiled file fails the same way either way */
+    test_path(bad, sizeof(bad), dir, "spoiled");
+    if(!TEST_CHECK(test_spoil(path, bad) != 0)) {
+        return;
+    }
+    err = dxf_load(&strict, bad);
+    (void)TEST_CHECK(err != dxfErrorOk);
+    (void)TEST_CHECK(dxf_load_ex(&dxf, bad, &options) == err);
+    (void)unlink(bad);
+}
+
+static void test_catalog(const char *dir) {
+    char path[TEST_MIX_CNT][FILENAME_MAX], cat[FILENAME_MAX];
+    const char *files[TEST_MIX_CNT];
+    dxf_catalog_t *c;
+    uint32_t found[TEST_MIX_CNT];
+    size_t i, cnt = 0;
+
+    for(i = 0; i < TEST_MIX_CNT; i++) {
+        test_path(path[i], sizeof(path[i]), dir, MIX_S[i]);
+        files[i] = path[i];
+    }
+    (void)snprintf(cat, sizeof(cat), "%s/fixtures.cat", dir);
+    if(!TEST_CHECK(dxf_catalog_build(cat, files, TEST_MIX_CNT, 2) ==
+        dxfErrorOk) || !TEST_CHECK(dxf_catalog_open(cat, &c) ==
+        dxfErrorOk)) {
+        return;
+    }
+    (void)TEST_CHECK(dxf_catalog_file_cnt(c) == TEST_MIX_CNT);
+    for(i = 0; i < TEST_MIX_CNT; i++) {
+        const char *value = dxf_catalog_value(c, i, "$INSUNITS");
+        (void)TEST_CHECK(strcmp(dxf_catalog_file(c, i), path[i]) == 0);
+        (void)TEST_CHECK((value != NULL) && (strcmp(value, "4") == 0));
+    }
+    (void)TEST_CHECK(dxf_catalog_select(c, "$INSUNITS", "4", "layer05",
+        found, TEST_MIX_CNT, &cnt) == dxfErrorOk);
+    (void)TEST_CHECK((cnt == TEST_MIX_CNT) && (found[0] == 0));
+    (void)TEST_CHECK(dxf_catalog_select(c, "$ACADVER", "AC1015",
+        (const char*)NULL, found, TEST_MIX_CNT, &cnt) == dxfErrorOk);
+    (void)TEST_CHECK(cnt == 0);
+    (void)TEST_CHECK(dxf_catalog_select(c, (const char*)NULL,
+        (const char*)NULL, "NO SUCH LAYER", found, TEST_MIX_CNT, &cnt) ==
+        dxfErrorOk);
+    (void)TEST_CHECK(cnt == 0);
+    dxf_catalog_close(c);
+    (void)unlink(cat);
+}
+
+/* Checks everything that reads one fixture */
+static void test_fixture(const char *dir, const char *name) {
+    char path[FILENAME_MAX];
+    test_scan_t scan;
+    dxf_handle_t dxf;
+
+    test_path(path, sizeof(path), dir, name);
+    if(!TEST_CHECK(test_scan(path, &scan) != 0) ||
+        !test_load(path, (const dxf_load_options_t*)NULL, &dxf)) {
+        return;
+    }
+    test_query(dxf, &scan);
+    test_text(dxf, &scan);
+    if(strcmp(name, "xdata") == 0) {
+        test_xdata(dxf, &scan);
+    }
+    test_dict(dxf);
+    test_geometry(dxf, &scan);
+    (void)dxf_unload(dxf);
+    test_probe(path);
+}
+
+int main(int argc, char **argv) {
+    char path[FILENAME_MAX];
+    size_t i;
+
+    if(argc != 2) {
+        fprintf(stderr, "Usage: %s <fixture directory>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < TEST_MIX_CNT; i++) {
+        test_fixture(argv[1], MIX_S[i]);
+    }
+    test_path(path, sizeof(path), argv[1], "mixed");
+    test_stores(path);
+    test_validate(argv[1], path);
+    test_catalog(argv[1]);
+    printf("%lu checks, %lu failed\n", g_check_cnt, g_fail_cnt);
+    return (g_fail_cnt == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
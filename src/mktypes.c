@@ -0,0 +1,118 @@
+/** @file mktypes.c
+ *  @brief Group code type table generator.
+ *
+ * Build-time utility that writes dxf_types.c: a uint8_t table mapping every
+ * valid group code (DXF_GROUP_CODE_MIN..DXF_GROUP_CODE_MAX) to its
+ * dxf_type_t, with DXF_TYPE_NONE for unassigned codes, plus the type names.
+ * Edit g_range_to_types below, never the generated file.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "dxf_types.h"
+
+typedef struct _range_to_type_t {
+    int start;
+    int end;
+    dxf_type_t type;
+} range_to_type_t;
+
+/* Group code value types, from the DXF reference "Group Code Value Types" */
+static const range_to_type_t g_range_to_types [] = {
+    { -5, -1, dxfString2049 },
+    { 0, 9, dxfString2049 },
+    { 10, 39, dxfDouble3d },
+    { 40, 59, dxfDouble },
+    { 60, 79, dxfInt16 },
+    { 90, 99, dxfInt32 },
+    { 100, 100, dxfString255 },
+    { 102, 102, dxfString255 },
+    { 105, 105, dxfString255 },
+    { 110, 119, dxfDouble },
+    { 120, 129, dxfDouble },
+    { 130, 139, dxfDouble },
+    { 140, 149, dxfDouble },
+    { 160, 169, dxfInt64 },
+    { 170, 179, dxfInt16 },
+    { 210, 239, dxfDouble },
+    { 270, 279, dxfInt16 },
+    { 280, 289, dxfInt16 },
+    { 290, 299, dxfBoolean },
+    { 300, 309, dxfString2049 },
+    { 310, 319, dxfString2049 },
+    { 320, 329, dxfString255 },
+    { 330, 369, dxfString255 },
+    { 370, 379, dxfInt16 },
+    { 380, 389, dxfInt16 },
+    { 390, 399, dxfString255 },
+    { 400, 409, dxfInt16 },
+    { 410, 419, dxfString2049 },
+    { 420, 429, dxfInt32 },
+    { 430, 439, dxfString2049 },
+    { 440, 449, dxfInt32 },
+    { 450, 459, dxfLong },
+    { 460, 469, dxfDouble },
+    { 470, 479, dxfString2049 },
+    { 480, 481, dxfString255 },
+    { 999, 999, dxfString2049 },
+    { 1000, 1009, dxfString2049 },
+    { 1010, 1059, dxfDouble },
+    { 1060, 1070, dxfInt16 },
+    { 1071, 1071, dxfInt32 }
+};
+
+/* Names of dxf_type_t values, in enum order */
+static const char *TYPE_S[] = {
+    "dxfString2049", "dxfDouble3d", "dxfDouble", "dxfInt16", "dxfInt32",
+    "dxfString255", "dxfInt64", "dxfBoolean", "dxfLong"
+};
+
+int main(void) {
+    unsigned char table[DXF_GROUP_CODE_MAX - DXF_GROUP_CODE_MIN + 1];
+    int cnt = (int)(sizeof(g_range_to_types)/sizeof(range_to_type_t));
+    int i, j;
+
+    if((int)(sizeof(TYPE_S) / sizeof(TYPE_S[0])) != DXF_TYPE_CNT) {
+        fprintf(stderr, "mktypes: TYPE_S does not match dxf_type_t\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Populate the (sparse) table, rejecting overlapping ranges */
+    for(i = 0; i < (int)sizeof(table); i++) {
+        table[i] = DXF_TYPE_NONE;
+    }
+    for(i = 0; i < cnt; i++) {
+        range_to_type_t t = g_range_to_types[i];
+        if((t.start < DXF_GROUP_CODE_MIN) || (t.end > DXF_GROUP_CODE_MAX) ||
+            (t.start > t.end)) {
+            fprintf(stderr, "mktypes: invalid range %i-%i\n", t.start, t.end);
+            return EXIT_FAILURE;
+        }
+        for(j = t.start; j <= t.end; j++) {
+            if(table[j - DXF_GROUP_CODE_MIN] != DXF_TYPE_NONE) {
+                fprintf(stderr, "mktypes: group code %i assigned twice\n", j);
+                return EXIT_FAILURE;
+            }
+            table[j - DXF_GROUP_CODE_MIN] = (unsigned char)t.type;
+        }
+    }
+
+    /* Print the table initialization */
+    printf("/* Generated by mktypes, do not edit. */\n");
+    printf("#include \"dxf_types.h\"\n\n");
+    printf("/* Index is group code - DXF_GROUP_CODE_MIN, value is the "
+        "dxf_type_t\n");
+    printf("of that group code or DXF_TYPE_NONE. */\n");
+    printf("const uint8_t dxf_group_type_table[%i] = {\n", (int)sizeof(table));
+    for(i = 0; i < (int)sizeof(table); i++) {
+        printf("%s%3u%s", ((i % 16) == 0) ? "    " : "", table[i],
+            (i + 1 == (int)sizeof(table)) ? "\n" :
+            ((i % 16) == 15) ? ",\n" : ",");
+    }
+    printf("};\n\n");
+    printf("const char *dxf_type_names[%i] = {\n", DXF_TYPE_CNT);
+    for(i = 0; i < DXF_TYPE_CNT; i++) {
+        printf("    \"%s\"%s\n", TYPE_S[i], (i + 1 < DXF_TYPE_CNT) ? "," : "");
+    }
+    printf("};\n");
+    return 0;
+}
@@ -1,6 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <time.h>
+#include "util.h"
 
 void util_trim(char *s) {
     int i; /* Iterator */
@@ -35,3 +39,99 @@ void util_trim(char *s) {
     /* Terminate the string */
     s[idx] = '\0';
 }
+
+char *util_strdup(const char *s) {
+    size_t len; /* Length including terminator */
+    char *d; /* Duplicate */
+
+    assert(s != NULL);
+    len = strlen(s) + 1;
+    if((d = (char*)malloc(len)) != NULL) {
+        memcpy(d, s, len);
+    }
+    return d;
+}
+
+/* Powers of ten exactly representable as doubles */
+static const double UTIL_POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+double util_atof(const char *s) {
+    const char *p = s; /* Current character */
+    unsigned long long m = 0; /* Mantissa digits */
+    int digits = 0; /* Significant digits in m */
+    int scale = 0; /* Power of ten applied to m */
+    int neg = 0;
+    int e;
+
+    assert(s != NULL);
+    if((*p == '-') || (*p == '+')) {
+        neg = (*p == '-');
+        p++;
+    }
+    for(; (unsigned int)(*p - '0') <= 9; p++) {
+        if((m != 0) || (*p != '0')) {
+            if(++digits > 19) {
+                return strtod(s, (char**)NULL);
+            }
+        }
+        m = m * 10 + (unsigned int)(*p - '0');
+    }
+    if(*p == '.') {
+        for(p++; (unsigned int)(*p - '0') <= 9; p++) {
+            if((m != 0) || (*p != '0')) {
+                if(++digits > 19) {
+                    return strtod(s, (char**)NULL);
+                }
+            }
+            m = m * 10 + (unsigned int)(*p - '0');
+            scale--;
+        }
+    }
+    if((*p == 'e') || (*p == 'E')) {
+        int exp_neg = 0; /* Exponent sign */
+        int x = 0; /* Exponent */
+
+        p++;
+        if((*p == '-') || (*p == '+')) {
+            exp_neg = (*p == '-');
+            p++;
+        }
+        if((unsigned int)(*p - '0') > 9) {
+            /* No exponent digits */
+            return strtod(s, (char**)NULL);
+        }
+        for(; (unsigned int)(*p - '0') <= 9; p++) {
+            if((x = x * 10 + (*p - '0')) > 22 + 19) {
+                return strtod(s, (char**)NULL);
+            }
+        }
+        scale += (exp_neg != 0) ? -x : x;
+    }
+    if((*p == 'n') || (*p == 'N') || (*p == 'i') || (*p == 'I') ||
+        (*p == 'x') || (*p == 'X')) {
+        /* Hex, infinities and NaNs */
+        return strtod(s, (char**)NULL);
+    }
+
+    /* Exact when both the mantissa and the power of ten are exact */
+    if((m >= (1ULL << 53)) || (scale < -22) || (scale > 22)) {
+        return strtod(s, (char**)NULL);
+    }
+    if(scale >= 0) {
+        return (neg != 0) ? -((double)m * UTIL_POW10[scale]) :
+            (double)m * UTIL_POW10[scale];
+    }
+    e = -scale;
+    return (neg != 0) ? -((double)m / UTIL_POW10[e]) :
+        (double)m / UTIL_POW10[e];
+}
+
+double util_now(void) {
+    struct timespec ts; /* Current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
@@ -23,5 +23,30 @@ a NULL-terminated string with no leading or trailing whitespace.
 */
 void util_trim(char *s);
 
+/**
+Duplicates a string.
+Equivalent to POSIX strdup(), but allocates through malloc() so that every
+library allocation is visible to allocation counters.
+@param  s   NULL-terminated string.
+@returns Newly allocated copy of s, or NULL if allocation failed.
+*/
+char *util_strdup(const char *s);
+
+/**
+Converts a decimal string to a double.
+Equivalent to strtod(s, NULL), correctly rounded, but decimals whose digits
+read as an integer are below 2^53, scaled by the point and any exponent to
+within 10^+/-22, take a fast path that avoids strtod() altogether.
+@param  s   NULL-terminated string.
+@returns Converted value, 0.0 if s does not start with a number.
+*/
+double util_atof(const char *s);
+
+/**
+Reads a monotonic clock.
+@returns Seconds since an arbitrary fixed point, suitable for intervals.
+*/
+double util_now(void);
+
 #endif
 